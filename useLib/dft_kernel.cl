@@ -57,4 +57,425 @@ __kernel void dft_R1SP(__global const float* inputReal, __global float* outputRe
 
     outputReal[gid] = outputReal[gid]*outputReal[gid] + outputImag*outputImag;
 
-}
\ No newline at end of file
+}
+
+// Batched variants: one launch transforms frameCount frames that lie one after another
+// in the input buffer; the second dimension of the range is the frame.
+__kernel void dft_R1SPN_B(__global const float* inputReal, __global float* outputReal) {
+    int gid = get_global_id(0);
+    int frame = get_global_id(1);
+    int onesideSize = get_global_size(0);
+    int sampleSize = 2 * onesideSize - 2;
+    float angle;
+    const float PI2 = 6.28319f;
+
+    __global const float* input = inputReal + frame * sampleSize;
+    float angleK = PI2 * gid / sampleSize;
+
+    float sumReal = 0.0f;
+    float sumImag = 0.0f;
+
+    for (int n = 0; n < sampleSize; n++) {
+        angle = angleK * n;
+        sumReal += input[n] * cos(angle);
+        sumImag -= input[n] * sin(angle);
+    }
+
+    float scale = (gid == 0) ? (1.0f / sampleSize) : (2.0f / sampleSize);
+    sumReal *= scale;
+    sumImag *= scale;
+
+    outputReal[frame * onesideSize + gid] = sumReal*sumReal + sumImag*sumImag;
+
+}
+
+__kernel void dft_R1SP_B(__global const float* inputReal, __global float* outputReal) {
+    int gid = get_global_id(0);
+    int frame = get_global_id(1);
+    int onesideSize = get_global_size(0);
+    int sampleSize = 2 * onesideSize - 2;
+    float angle;
+    const float PI2 = 6.28319f;
+
+    __global const float* input = inputReal + frame * sampleSize;
+    float angleK = PI2 * gid / sampleSize;
+
+    float sumReal = 0.0f;
+    float sumImag = 0.0f;
+
+    for (int n = 0; n < sampleSize; n++) {
+        angle = angleK * n;
+        sumReal += input[n] * cos(angle);
+        sumImag -= input[n] * sin(angle);
+    }
+
+    outputReal[frame * onesideSize + gid] = sumReal*sumReal + sumImag*sumImag;
+
+}
+
+// FP16 transfer variants: samples and power values cross the bus as IEEE half precision,
+// all arithmetic is done in FP32. The power is multiplied by outputScale before packing
+// to keep it inside the FP16 range.
+__kernel void dft_R1SPN_H(__global const half* inputReal, __global half* outputReal, const float outputScale) {
+    int gid = get_global_id(0);
+    int sampleSize = 2* get_global_size(0) - 2;
+    float angle, cosVal, sinVal, sample;
+    const float PI2 = 6.28319f;
+
+    float angleK = PI2 * gid / sampleSize;
+
+    float sumReal = 0.0f;
+    float sumImag = 0.0f;
+
+    for (int n = 0; n < sampleSize; n++) {
+        angle = angleK * n;
+        cosVal = cos(angle);
+        sinVal = sin(angle);
+        sample = vload_half(n, inputReal);
+
+        sumReal += sample * cosVal;
+        sumImag -= sample * sinVal;
+    }
+
+    if(gid == 0){
+        sumReal *= (1.0f / sampleSize);
+        sumImag *= (1.0f / sampleSize);
+    }
+    else{
+        sumReal *= (2.0f / sampleSize);
+        sumImag *= (2.0f / sampleSize);
+    }
+
+    vstore_half((sumReal*sumReal + sumImag*sumImag) * outputScale, gid, outputReal);
+
+}
+
+__kernel void dft_R1SP_H(__global const half* inputReal, __global half* outputReal, const float outputScale) {
+    int gid = get_global_id(0);
+    int sampleSize = 2* get_global_size(0) - 2;
+    float angle, cosVal, sinVal, sample;
+    const float PI2 = 6.28319f;
+
+    float angleK = PI2 * gid / sampleSize;
+
+    float sumReal = 0.0f;
+    float sumImag = 0.0f;
+
+    for (int n = 0; n < sampleSize; n++) {
+        angle = angleK * n;
+        cosVal = cos(angle);
+        sinVal = sin(angle);
+        sample = vload_half(n, inputReal);
+
+        sumReal += sample * cosVal;
+        sumImag -= sample * sinVal;
+    }
+
+    vstore_half((sumReal*sumReal + sumImag*sumImag) * outputScale, gid, outputReal);
+
+}
+
+// Band energies from the one-sided power spectrum. The band matrix is sparse
+// and stored in the compressed sparse row format, one work-item per band.
+__kernel void filterbank_CSR(__global const float* onesidePower, __global const int* rowOffsets,
+    __global const int* columns, __global const float* weights, __global float* bands) {
+    int band = get_global_id(0);
+    float sum = 0.0f;
+
+    for (int k = rowOffsets[band]; k < rowOffsets[band + 1]; k++) {
+        sum += weights[k] * onesidePower[columns[k]];
+    }
+
+    bands[band] = sum;
+}
+
+// The same for the FP16 transfer mode, where the power spectrum is kept packed and scaled.
+__kernel void filterbank_CSR_H(__global const half* onesidePower, __global const int* rowOffsets,
+    __global const int* columns, __global const float* weights, __global float* bands, const float inverseScale) {
+    int band = get_global_id(0);
+    float sum = 0.0f;
+
+    for (int k = rowOffsets[band]; k < rowOffsets[band + 1]; k++) {
+        sum += weights[k] * vload_half(columns[k], onesidePower);
+    }
+
+    bands[band] = sum * inverseScale;
+}
+
+// Work-group size of the kernels that reduce a whole spectrum in a single work-group.
+#define REDUCE_GROUP_SIZE 64
+
+// Top-K spectral peaks of the one-sided power spectrum, found by a single work-group.
+// A peak is a local maximum whose prominence reaches minProminence: its height in dB above
+// the higher of its two bases, where a base is the lowest power between the peak and the
+// nearest higher bin on that side, or the edge of the spectrum. Position and level are refined with a
+// parabola through the dB levels of the peak bin and its two neighbours.
+#define PEAK_MAX_COUNT 32
+
+typedef struct {
+    float bin;          // Interpolated bin position
+    float power;        // Interpolated power
+    float prominence;   // Prominence in dB
+    int index;          // Bin of the local maximum, -1 for an unused record
+} Peak;
+
+inline float loadPower(__global const float* power, __global const half* powerHalf, const float inverseScale, int k) {
+    return powerHalf ? vload_half(k, powerHalf) * inverseScale : power[k];
+}
+
+inline float peakLevel(float power) {
+    return 10.0f * log10(fmax(power, 1e-30f));
+}
+
+// Every work-item keeps the highest peaks of its part of the bin range in a sorted private list.
+// The group then picks the K highest heads of all lists, one argmax reduction per record.
+void findPeaks(__global const float* power, __global const half* powerHalf, const float inverseScale,
+    __global Peak* peaks, const int size, const int peakCount, const float minProminence, const int firstBin, const int lastBin,
+    __local float* bestLevel, __local int* bestOwner) {
+    int lid = get_local_id(0);
+
+    float candidateLevel[PEAK_MAX_COUNT];
+    float candidateProminence[PEAK_MAX_COUNT];
+    int candidateBin[PEAK_MAX_COUNT];
+    int count = 0;
+
+    int chunk = (lastBin - firstBin + REDUCE_GROUP_SIZE) / REDUCE_GROUP_SIZE;
+    int begin = firstBin + lid * chunk;
+    int end = min(begin + chunk, lastBin + 1);
+
+    for (int k = begin; k < end; k++) {
+        float p = loadPower(power, powerHalf, inverseScale, k);
+        if (!(p > loadPower(power, powerHalf, inverseScale, k - 1) && p >= loadPower(power, powerHalf, inverseScale, k + 1))) continue;
+
+        float level = peakLevel(p);
+        if (count == peakCount && level <= candidateLevel[count - 1]) continue;
+
+        // Prominence: on each side, the lowest power between the peak and the nearest higher bin,
+        // or the edge of the spectrum; the higher of the two minima is the base of the peak
+        float left = p;
+        for (int j = k - 1; j >= 0; j--) {
+            float q = loadPower(power, powerHalf, inverseScale, j);
+            if (q > p) break;
+            left = fmin(left, q);
+        }
+        float right = p;
+        for (int j = k + 1; j < size; j++) {
+            float q = loadPower(power, powerHalf, inverseScale, j);
+            if (q > p) break;
+            right = fmin(right, q);
+        }
+
+        float prominence = level - peakLevel(fmax(left, right));
+        if (prominence < minProminence) continue;
+
+        int i = (count < peakCount) ? count++ : count - 1;
+        while (i > 0 && candidateLevel[i - 1] < level) {
+            candidateLevel[i] = candidateLevel[i - 1];
+            candidateProminence[i] = candidateProminence[i - 1];
+            candidateBin[i] = candidateBin[i - 1];
+            i--;
+        }
+        candidateLevel[i] = level;
+        candidateProminence[i] = prominence;
+        candidateBin[i] = k;
+    }
+
+    int head = 0;
+    for (int r = 0; r < peakCount; r++) {
+        bestLevel[lid] = (head < count) ? candidateLevel[head] : -MAXFLOAT;
+        bestOwner[lid] = lid;
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Ties go to the lower work-item, that is to the lower bin
+        for (int s = REDUCE_GROUP_SIZE / 2; s > 0; s >>= 1) {
+            if (lid < s && bestLevel[lid + s] > bestLevel[lid]) {
+                bestLevel[lid] = bestLevel[lid + s];
+                bestOwner[lid] = bestOwner[lid + s];
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+
+        if (bestLevel[0] == -MAXFLOAT) {
+            if (lid == 0) {
+                peaks[r].bin = 0.0f;
+                peaks[r].power = 0.0f;
+                peaks[r].prominence = 0.0f;
+                peaks[r].index = -1;
+            }
+        }
+        else if (bestOwner[0] == lid) {
+            int k = candidateBin[head];
+            float a = peakLevel(loadPower(power, powerHalf, inverseScale, k - 1));
+            float b = candidateLevel[head];
+            float c = peakLevel(loadPower(power, powerHalf, inverseScale, k + 1));
+            float denominator = a - 2.0f * b + c;
+            float offset = (denominator < 0.0f) ? 0.5f * (a - c) / denominator : 0.0f;
+
+            peaks[r].bin = k + offset;
+            peaks[r].power = exp10(0.1f * (b - 0.25f * (a - c) * offset));
+            peaks[r].prominence = candidateProminence[head];
+            peaks[r].index = k;
+            head++;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+__kernel void peaks_topK(__global const float* onesidePower, __global Peak* peaks, const int size,
+    const int peakCount, const float minProminence, const int firstBin, const int lastBin) {
+    __local float bestLevel[REDUCE_GROUP_SIZE];
+    __local int bestOwner[REDUCE_GROUP_SIZE];
+
+    findPeaks(onesidePower, 0, 1.0f, peaks, size, peakCount, minProminence, firstBin, lastBin, bestLevel, bestOwner);
+}
+
+// The same for the FP16 transfer mode, where the power spectrum is kept packed and scaled.
+__kernel void peaks_topK_H(__global const half* onesidePower, __global Peak* peaks, const int size,
+    const int peakCount, const float minProminence, const int firstBin, const int lastBin, const float inverseScale) {
+    __local float bestLevel[REDUCE_GROUP_SIZE];
+    __local int bestOwner[REDUCE_GROUP_SIZE];
+
+    findPeaks(0, onesidePower, inverseScale, peaks, size, peakCount, minProminence, firstBin, lastBin, bestLevel, bestOwner);
+}
+
+// Sum of one value per work-item over the work-group.
+float groupSum(float value, __local float* scratch) {
+    int lid = get_local_id(0);
+    scratch[lid] = value;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int s = REDUCE_GROUP_SIZE / 2; s > 0; s >>= 1) {
+        if (lid < s) scratch[lid] += scratch[lid + s];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    float sum = scratch[0];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    return sum;
+}
+
+// Minimum of one value per work-item over the work-group.
+float groupMin(float value, __local float* scratch) {
+    int lid = get_local_id(0);
+    scratch[lid] = value;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int s = REDUCE_GROUP_SIZE / 2; s > 0; s >>= 1) {
+        if (lid < s) scratch[lid] = fmin(scratch[lid], scratch[lid + s]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    float minimum = scratch[0];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    return minimum;
+}
+
+// Spectral features of a frame, computed by a single work-group from the power spectrum and the samples
+// while they are still on the device. The flux compares the power with the frame stored at previousOffset,
+// which then receives the power of this frame.
+typedef struct {
+    float centroid;     // Power-weighted mean frequency
+    float bandwidth;    // Power-weighted standard deviation around the centroid
+    float rolloff;      // Frequency below which rolloffFraction of the power lies
+    float flatness;     // Geometric mean of the power divided by its arithmetic mean
+    float flux;         // Sum of the increases of the power against the previous frame
+    float rms;          // Root mean square of the samples
+    float energy;       // Sum of the power
+} Features;
+
+void computeFeatures(__global const float* power, __global const half* powerHalf, const float inverseScale,
+    __global const float* input, __global const half* inputHalf, __global float* previous, __global Features* features,
+    const int sampleSize, const int firstBin, const int lastBin, const float frequencyStep, const float rolloffFraction,
+    const int previousOffset, const int hasPrevious, __local float* scratch) {
+    int lid = get_local_id(0);
+
+    int chunk = (lastBin - firstBin + REDUCE_GROUP_SIZE) / REDUCE_GROUP_SIZE;
+    int begin = firstBin + lid * chunk;
+    int end = min(begin + chunk, lastBin + 1);
+
+    float chunkEnergy = 0.0f;
+    float weighted = 0.0f;
+    float logSum = 0.0f;
+    float flux = 0.0f;
+    for (int k = begin; k < end; k++) {
+        float p = loadPower(power, powerHalf, inverseScale, k);
+        chunkEnergy += p;
+        weighted += k * p;
+        logSum += log(fmax(p, 1e-30f));
+        if (hasPrevious && p > previous[previousOffset + k]) flux += p - previous[previousOffset + k];
+    }
+
+    float squares = 0.0f;
+    for (int n = lid; n < sampleSize; n += REDUCE_GROUP_SIZE) {
+        float sample = inputHalf ? vload_half(n, inputHalf) : input[n];
+        squares += sample * sample;
+    }
+
+    float energy = groupSum(chunkEnergy, scratch);
+    weighted = groupSum(weighted, scratch);
+    logSum = groupSum(logSum, scratch);
+    flux = groupSum(flux, scratch);
+    squares = groupSum(squares, scratch);
+
+    float centroid = (energy > 0.0f) ? weighted / energy : 0.0f;
+
+    // The spread is a second pass over the bins of the work-item, so it does not lose precision
+    // to the difference of two large sums.
+    float spread = 0.0f;
+    for (int k = begin; k < end; k++) {
+        float p = loadPower(power, powerHalf, inverseScale, k);
+        spread += (k - centroid) * (k - centroid) * p;
+        previous[previousOffset + k] = p;
+    }
+    spread = groupSum(spread, scratch);
+
+    // The energy of the bins before the part of this work-item
+    scratch[lid] = chunkEnergy;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    float cumulative = 0.0f;
+    for (int i = 0; i < lid; i++) cumulative += scratch[i];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    float target = rolloffFraction * energy;
+    float rolloff = (float)lastBin;
+    for (int k = begin; k < end; k++) {
+        cumulative += loadPower(power, powerHalf, inverseScale, k);
+        if (cumulative >= target) {
+            rolloff = (float)k;
+            break;
+        }
+    }
+    rolloff = groupMin(rolloff, scratch);
+
+    if (lid == 0) {
+        float bins = (float)(lastBin - firstBin + 1);
+        float mean = energy / bins;
+
+        features->centroid = centroid * frequencyStep;
+        features->bandwidth = (energy > 0.0f) ? sqrt(spread / energy) * frequencyStep : 0.0f;
+        features->rolloff = rolloff * frequencyStep;
+        features->flatness = (mean > 0.0f) ? exp(logSum / bins) / mean : 0.0f;
+        features->flux = flux;
+        features->rms = sqrt(squares / sampleSize);
+        features->energy = energy;
+    }
+}
+
+__kernel void features_R(__global const float* onesidePower, __global const float* inputReal, __global float* previous,
+    __global Features* features, const int sampleSize, const int firstBin, const int lastBin, const float frequencyStep,
+    const float rolloffFraction, const int previousOffset, const int hasPrevious) {
+    __local float scratch[REDUCE_GROUP_SIZE];
+
+    computeFeatures(onesidePower, 0, 1.0f, inputReal, 0, previous, features, sampleSize, firstBin, lastBin, frequencyStep,
+        rolloffFraction, previousOffset, hasPrevious, scratch);
+}
+
+// The same for the FP16 transfer mode, where the samples and the power spectrum are kept packed.
+__kernel void features_R_H(__global const half* onesidePower, __global const half* inputReal, __global float* previous,
+    __global Features* features, const int sampleSize, const int firstBin, const int lastBin, const float frequencyStep,
+    const float rolloffFraction, const int previousOffset, const int hasPrevious, const float inverseScale) {
+    __local float scratch[REDUCE_GROUP_SIZE];
+
+    computeFeatures(0, onesidePower, inverseScale, 0, inputReal, previous, features, sampleSize, firstBin, lastBin, frequencyStep,
+        rolloffFraction, previousOffset, hasPrevious, scratch);
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "CiAccuracy.hpp"
+#include "goBenchmark.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Print the command line options of the accuracy mode.
+/// </summary>
+void printAccuracyUsage() {
+    std::cout <<
+        "Usage: useLib --accuracy [options]\n"
+        "  --sizes LIST      Sample sizes, e.g. 64,1024 or a power-of-2 range 64:65536, default 64,256,...,65536\n"
+        "  --backends LIST   kernel, kernel_p1s, kernel_f16, batch, default all\n"
+        "  --signals LIST    tones, chirp, noise, impulse, default all\n"
+        "  --bound X         Largest error relative to the peak power for FP32 transfers, plus the size term, default 1e-3\n"
+        "  --bound-f16 X     Largest error relative to the peak power for FP16 transfers, plus the size term, default 5e-3\n"
+        "  --bound-slope X   Bound added per sample of the frame (the size term), default 1e-6\n"
+        "  --device N        Index of the GPU device, default 0\n"
+        "  --kernel FILE     OpenCL kernel file, default dft_kernel.cl\n";
+}
+
+/// <summary>
+/// Parse a comma separated list of names into their indices.
+/// </summary>
+/// <param name="sValue">Text of the list.</param>
+/// <param name="nCount">Number of known names.</param>
+/// <param name="getName">Function that gives the name of an index.</param>
+std::vector<int> parseAccuracyNames(const std::string& sValue, const int nCount, const char* (*getName)(int)) {
+    std::vector<int> values;
+    std::stringstream ss(sValue);
+    std::string sName;
+    while (std::getline(ss, sName, ',')) {
+        int n = 0;
+        while (n < nCount && sName != getName(n)) n++;
+        if (n == nCount) throw std::invalid_argument("Unknown name " + sName + ".");
+        values.push_back(n);
+    }
+    return values;
+}
+
+/// <summary>
+/// Compare every backend and sample size with the double-precision reference DFT.
+/// </summary>
+/// <returns>0 if all cases are within their bounds, 1 if a case fails, 2 for wrong options.</returns>
+int goAccuracy(int argc, char* argv[])
+{
+    vi::CiAccuracyConfig config;
+
+    try {
+        for (int i = 2; i < argc; i++) {
+            std::string sArg = argv[i];
+            if (sArg == "--help" || sArg == "-h") {
+                printAccuracyUsage();
+                return 0;
+            }
+            if (i + 1 >= argc) throw std::invalid_argument("The option " + sArg + " has no value.");
+            std::string sValue = argv[++i];
+
+            if (sArg == "--sizes") config.sampleSizes = parseBenchmarkList(sValue);
+            else if (sArg == "--backends") config.backends = parseAccuracyNames(sValue, vi::CiAccuracyConfig::BACKEND_COUNT, vi::CiAccuracyConfig::getBackendName);
+            else if (sArg == "--signals") config.signals = parseAccuracyNames(sValue, vi::CiAccuracyConfig::SIGNAL_COUNT, vi::CiAccuracyConfig::getSignalName);
+            else if (sArg == "--bound") config.dbBoundF32 = std::stod(sValue);
+            else if (sArg == "--bound-f16") config.dbBoundF16 = std::stod(sValue);
+            else if (sArg == "--bound-slope") config.dbBoundPerSample = std::stod(sValue);
+            else if (sArg == "--device") config.nDeviceIndex = std::stoi(sValue);
+            else if (sArg == "--kernel") vi::CiCLRuntime::getInstance().setKernelFileName(sValue);
+            else throw std::invalid_argument("Unknown option " + sArg + ".");
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n\n";
+        printAccuracyUsage();
+        return 2;
+    }
+
+    try {
+        vi::CiAccuracy accuracy(config);
+        std::cout << "Device: " << vi::CiCLRuntime::getInstance().getDeviceName(config.nDeviceIndex) << "\n";
+        std::printf("%-11s %-8s %6s %12s %12s %12s %12s %6s %10s\n", "backend", "signal", "size", "peak power", "max error", "bound", "rms error", "bin", "result");
+
+        size_t sizeFailed = 0;
+        accuracy.run([&sizeFailed](const vi::CiAccuracyResult& r) {
+            if (!r.bPassed) sizeFailed++;
+            std::printf("%-11s %-8s %6d %12.4e %12.4e %12.4e %12.4e %6d %10s\n", vi::CiAccuracyConfig::getBackendName(r.nBackend),
+                vi::CiAccuracyConfig::getSignalName(r.nSignal), r.nSampleSize, r.dbPeakPower, r.dbMaxError, r.dbBound, r.dbRmsError, r.nWorstBin,
+                r.bPassed ? "ok" : "FAILED");
+            std::fflush(stdout);
+        });
+
+        std::cout << (sizeFailed ? std::to_string(sizeFailed) + " cases exceed their bound\n" : "All cases are within their bounds\n");
+        return sizeFailed ? 1 : 0;
+    }
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        return 1;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+}
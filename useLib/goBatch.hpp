@@ -0,0 +1,158 @@
+#pragma once
+#include "CiBatchProcessor.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Print the command line options of the batch mode.
+/// </summary>
+void printBatchUsage() {
+    std::cout <<
+        "Usage: useLib [options] <file.wav | folder> ...\n"
+        "       useLib --bench [options], see useLib --bench --help\n"
+        "       useLib --accuracy [options], see useLib --accuracy --help\n"
+        "  --size N          Sample (FFT) size, default 1024\n"
+        "  --hop N           Samples between two frames, default the sample size\n"
+        "  --window NAME     rectangular, hann, hamming or blackman, default hann\n"
+        "  --bins MIN:MAX    Bin range to write, default all bins\n"
+        "  --format NAME     vspec, vspz or csv, default vspec\n"
+        "  --out FOLDER      Output folder, default batch\n"
+        "  --workers N       Worker threads, default one per hardware thread\n"
+        "  --batch N         Hops transformed with one kernel launch, default 32\n"
+        "  --device N        Index of the GPU device, default 0\n"
+        "  --threshold X     CSV rows with all values below X are skipped, default 0\n"
+        "  --kernel FILE     OpenCL kernel file, default dft_kernel.cl\n"
+        "  --config FILE     File of key=value lines with the option names above\n";
+}
+
+/// <summary>
+/// Apply one option of the batch mode to the settings.
+/// </summary>
+/// <param name="sKey">Option name without the leading dashes.</param>
+/// <param name="sValue">Option value.</param>
+/// <param name="config">Settings to change.</param>
+void setBatchOption(const std::string& sKey, const std::string& sValue, vi::CiBatchConfig& config) {
+    if (sKey == "size") config.nSampleSize = std::stoi(sValue);
+    else if (sKey == "hop") config.nHop = std::stoi(sValue);
+    else if (sKey == "workers") config.nWorkers = std::stoi(sValue);
+    else if (sKey == "batch") config.nBatchHops = std::stoi(sValue);
+    else if (sKey == "device") config.nDeviceIndex = std::stoi(sValue);
+    else if (sKey == "threshold") config.fpRecordThreshold = std::stof(sValue);
+    else if (sKey == "out") config.sOutputFolder = sValue;
+    else if (sKey == "kernel") vi::CiCLRuntime::getInstance().setKernelFileName(sValue);
+    else if (sKey == "bins") {
+        size_t sizeColon = sValue.find(':');
+        if (sizeColon == std::string::npos) throw std::invalid_argument("The bin range must be given as MIN:MAX.");
+        config.nIndexMin = std::stoi(sValue.substr(0, sizeColon));
+        config.nIndexMax = (sizeColon + 1 < sValue.size()) ? std::stoi(sValue.substr(sizeColon + 1)) : -1;
+    }
+    else if (sKey == "window") {
+        if (sValue == "rectangular") config.nWindow = vi::CiBatchConfig::WINDOW_RECTANGULAR;
+        else if (sValue == "hann") config.nWindow = vi::CiBatchConfig::WINDOW_HANN;
+        else if (sValue == "hamming") config.nWindow = vi::CiBatchConfig::WINDOW_HAMMING;
+        else if (sValue == "blackman") config.nWindow = vi::CiBatchConfig::WINDOW_BLACKMAN;
+        else throw std::invalid_argument("Unknown window " + sValue + ".");
+    }
+    else if (sKey == "format") {
+        if (sValue == "vspec") config.nFormat = vi::CiBatchConfig::FORMAT_VSPEC;
+        else if (sValue == "vspz") config.nFormat = vi::CiBatchConfig::FORMAT_VSPZ;
+        else if (sValue == "csv") config.nFormat = vi::CiBatchConfig::FORMAT_CSV;
+        else throw std::invalid_argument("Unknown format " + sValue + ".");
+    }
+    else throw std::invalid_argument("Unknown option " + sKey + ".");
+}
+
+/// <summary>
+/// Read the settings of the batch mode from a file of key=value lines; empty lines and lines starting with # are skipped.
+/// </summary>
+/// <param name="sFileName">Name of the file.</param>
+/// <param name="config">Settings to change.</param>
+void readBatchConfig(const std::string& sFileName, vi::CiBatchConfig& config) {
+    std::ifstream file(sFileName);
+    if (!file.is_open()) throw std::runtime_error("Can't open a file " + sFileName + ".");
+
+    std::string sLine;
+    while (std::getline(file, sLine)) {
+        size_t sizeFirst = sLine.find_first_not_of(" \t\r");
+        if (sizeFirst == std::string::npos || sLine[sizeFirst] == '#') continue;
+        size_t sizeEqual = sLine.find('=');
+        if (sizeEqual == std::string::npos) throw std::invalid_argument("The line \"" + sLine + "\" of " + sFileName + " is not key=value.");
+
+        std::string sKey = sLine.substr(sizeFirst, sizeEqual - sizeFirst);
+        std::string sValue = sLine.substr(sizeEqual + 1);
+        sKey.erase(sKey.find_last_not_of(" \t") + 1);
+        sValue.erase(0, sValue.find_first_not_of(" \t"));
+        sValue.erase(sValue.find_last_not_of(" \t\r") + 1);
+        setBatchOption(sKey, sValue, config);
+    }
+}
+
+/// <summary>
+/// Transform the WAV files given on the command line to spectrograms without user interaction.
+/// </summary>
+/// <returns>0 if all files are done, 1 if a file failed, 2 for wrong options.</returns>
+int goBatch(int argc, char* argv[])
+{
+    vi::CiBatchConfig config;
+    std::vector<std::string> inputs;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string sArg = argv[i];
+            if (sArg == "--help" || sArg == "-h") {
+                printBatchUsage();
+                return 0;
+            }
+            if (sArg.rfind("--", 0) != 0) {
+                inputs.push_back(sArg);
+                continue;
+            }
+            if (i + 1 >= argc) throw std::invalid_argument("The option " + sArg + " has no value.");
+            if (sArg == "--config") readBatchConfig(argv[++i], config);
+            else setBatchOption(sArg.substr(2), argv[++i], config);
+        }
+        if (inputs.empty()) throw std::invalid_argument("No input files or folders.");
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n\n";
+        printBatchUsage();
+        return 2;
+    }
+
+    try {
+        vi::CiBatchProcessor processor(config);
+        for (const std::string& sInput : inputs) processor.addInput(sInput);
+
+        const vi::CiBatchConfig& used = processor.getConfig();
+        std::cout << processor.getFileCount() << " files, sample size " << used.nSampleSize << ", hop " << used.nHop
+            << ", window " << vi::CiBatchConfig::getWindowName(used.nWindow) << ", " << used.nWorkers << " workers -> " << used.sOutputFolder << "\n";
+
+        processor.setProgressCallback([](const vi::CiBatchProcessor::Progress& progress) {
+            double dbElapsed = (progress.dbElapsed > 0.0) ? progress.dbElapsed : 1e-9;
+            std::printf("%zu/%zu files, %zu failed, %.0f frames/s, %.1fx realtime\n", progress.sizeFilesDone, progress.sizeFilesTotal,
+                progress.sizeFilesFailed, progress.sizeFrames / dbElapsed, progress.dbAudioSeconds / dbElapsed);
+            std::fflush(stdout);
+        });
+
+        size_t sizeFailed = processor.run();
+
+        vi::CiBatchProcessor::Progress progress = processor.getProgress();
+        std::printf("Done: %zu frames of %.1f s of audio in %.2f s\n", progress.sizeFrames, progress.dbAudioSeconds, progress.dbElapsed);
+        for (const auto& failure : processor.getFailures()) {
+            std::cerr << "Failed: " << failure.sFileName << ": " << failure.sError << "\n";
+        }
+        return sizeFailed ? 1 : 0;
+    }
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        return 1;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+}
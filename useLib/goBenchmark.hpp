@@ -0,0 +1,125 @@
+#pragma once
+#include "CiBenchmark.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Print the command line options of the benchmark mode.
+/// </summary>
+void printBenchmarkUsage() {
+    std::cout <<
+        "Usage: useLib --bench [options]\n"
+        "  --sizes LIST      Sample sizes, e.g. 64,1024 or a power-of-2 range 64:65536, default 64,256,1024,4096\n"
+        "  --channels LIST   Channel counts, default 1,2\n"
+        "  --depths LIST     Hops per iteration, default 1,8,32\n"
+        "  --backends LIST   kernel, kernel_f16, batch, pipeline (Windows), default all\n"
+        "  --warmup N        Untimed iterations per case, default 3\n"
+        "  --reps N          Timed iterations per case, default 20\n"
+        "  --device N        Index of the GPU device, default 0\n"
+        "  --kernel FILE     OpenCL kernel file, default dft_kernel.cl\n"
+        "  --json FILE       Write the results as JSON\n";
+}
+
+/// <summary>
+/// Parse a comma separated list of numbers; MIN:MAX gives the powers of 2 from MIN to MAX.
+/// </summary>
+/// <param name="sValue">Text of the list.</param>
+std::vector<int> parseBenchmarkList(const std::string& sValue) {
+    std::vector<int> values;
+    size_t sizeColon = sValue.find(':');
+    if (sizeColon != std::string::npos) {
+        int nMax = std::stoi(sValue.substr(sizeColon + 1));
+        for (int n = std::stoi(sValue.substr(0, sizeColon)); n > 0 && n <= nMax; n *= 2) values.push_back(n);
+        return values;
+    }
+
+    std::stringstream ss(sValue);
+    std::string sItem;
+    while (std::getline(ss, sItem, ',')) values.push_back(std::stoi(sItem));
+    return values;
+}
+
+/// <summary>
+/// Benchmark the transform backends and the pipeline, print a table and optionally write JSON.
+/// </summary>
+/// <returns>0 on success, 1 on failure, 2 for wrong options.</returns>
+int goBenchmark(int argc, char* argv[])
+{
+    vi::CiBenchConfig config;
+    std::string sJsonFile;
+
+    try {
+        for (int i = 2; i < argc; i++) {
+            std::string sArg = argv[i];
+            if (sArg == "--help" || sArg == "-h") {
+                printBenchmarkUsage();
+                return 0;
+            }
+            if (i + 1 >= argc) throw std::invalid_argument("The option " + sArg + " has no value.");
+            std::string sValue = argv[++i];
+
+            if (sArg == "--sizes") config.sampleSizes = parseBenchmarkList(sValue);
+            else if (sArg == "--channels") config.channelCounts = parseBenchmarkList(sValue);
+            else if (sArg == "--depths") config.batchDepths = parseBenchmarkList(sValue);
+            else if (sArg == "--warmup") config.nWarmup = std::stoi(sValue);
+            else if (sArg == "--reps") config.nRepetitions = std::stoi(sValue);
+            else if (sArg == "--device") config.nDeviceIndex = std::stoi(sValue);
+            else if (sArg == "--kernel") vi::CiCLRuntime::getInstance().setKernelFileName(sValue);
+            else if (sArg == "--json") sJsonFile = sValue;
+            else if (sArg == "--backends") {
+                config.backends.clear();
+                std::stringstream ss(sValue);
+                std::string sName;
+                while (std::getline(ss, sName, ',')) {
+                    int nBackend = 0;
+                    while (nBackend < vi::CiBenchConfig::BACKEND_COUNT && sName != vi::CiBenchConfig::getBackendName(nBackend)) nBackend++;
+                    if (nBackend == vi::CiBenchConfig::BACKEND_COUNT) throw std::invalid_argument("Unknown backend " + sName + ".");
+                    config.backends.push_back(nBackend);
+                }
+            }
+            else throw std::invalid_argument("Unknown option " + sArg + ".");
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n\n";
+        printBenchmarkUsage();
+        return 2;
+    }
+
+    try {
+        vi::CiBenchmark benchmark(config);
+        std::string sDevice = vi::CiCLRuntime::getInstance().getDeviceName(config.nDeviceIndex);
+        std::cout << "Device: " << sDevice << ", warmup " << config.nWarmup << ", repetitions " << config.nRepetitions << "\n";
+        std::printf("%-11s %6s %3s %5s %11s %11s %11s %12s %9s %10s\n", "backend", "size", "ch", "depth",
+            "p50 (us)", "p90 (us)", "p99 (us)", "frames/s", "GFLOP/s", "MB/s");
+
+        std::vector<vi::CiBenchResult> results = benchmark.run([](const vi::CiBenchResult& r) {
+            std::printf("%-11s %6d %3d %5d %11.1f %11.1f %11.1f %12.0f %9.3f %10.1f\n", vi::CiBenchConfig::getBackendName(r.nBackend),
+                r.nSampleSize, r.nChannels, r.nBatchDepth, r.dbLatencyP50 * 1e6, r.dbLatencyP90 * 1e6, r.dbLatencyP99 * 1e6,
+                r.dbFramesPerSec, r.dbGflops, r.dbBytesPerSec * 1e-6);
+            std::fflush(stdout);
+        });
+
+        if (!sJsonFile.empty()) {
+            std::ofstream file(sJsonFile);
+            if (!file.is_open()) throw std::runtime_error("Can't open a file " + sJsonFile + ".");
+            benchmark.writeJson(file, results, sDevice);
+            std::cout << "Results written to " << sJsonFile << "\n";
+        }
+    }
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        return 1;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
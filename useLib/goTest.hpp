@@ -2,6 +2,9 @@
 #include "CiUser.hpp"
 #include "CiCLaDft.hpp"
 #include "CiAudio.hpp"
+#include "CiSpectrogramReader.hpp"
+#include "CiBatchScheduler.hpp"
+#include "CiSignal.hpp"
 
 #include <conio.h>
 #include <iomanip>
@@ -552,16 +555,18 @@ int goCiCLaDft()
         std::vector<float> inputReal(sampleSize);
         std::vector<float> onesidePower(oDft.getOnesideSize());
 
+        vi::CiSignal signal(sampleSize, samplingFrequency);
+
         for (int seconds = 1; seconds <= 5; seconds++) {
             float freq1 = 10.0f * seconds;
             float freq2 = 90.0f - 10.0f * seconds;
             float ampl1 = 1.0f;
             float ampl2 = 5.0f;
 
-            for (int i = 0; i < sampleSize; i++) {
-                float time = (float)i / samplingFrequency;
-                inputReal[i] = (float)(ampl1 * sinf(vi::PI2 * freq1 * time) + ampl2 * sinf(vi::PI2 * freq2 * time));
-            }
+            signal.clear();
+            signal.addTone(freq1, ampl1);
+            signal.addTone(freq2, ampl2);
+            inputReal = signal.getSamples();
 
             err = oDft.executeOpenCLKernel(inputReal.data(), onesidePower.data());
             if (err != CL_SUCCESS) {
@@ -587,6 +592,611 @@ int goCiCLaDft()
     return 0;
 }
 
+int goCiCLaDftHalf()
+{
+    const int sampleSize = 2048;
+    const float samplingFrequency = 48000.0;
+
+    vi::CiCLaDft oDft;
+
+    try
+    {
+        oDft.setTransferMode(oDft.TRANSFER_F16);
+        oDft.setOpenCL();
+        oDft.createOpenCLKernel(sampleSize, oDft.P1SN);
+
+        std::vector<float> inputReal(sampleSize);
+        for (int i = 0; i < sampleSize; i++) {
+            float time = (float)i / samplingFrequency;
+            inputReal[i] = (float)(0.5f * sinf(vi::PI2 * 1000.0f * time) + 0.01f * sinf(vi::PI2 * 7000.0f * time));
+        }
+
+        vi::CiCLaDft::TransferErrorReport report = oDft.measureTransferError(inputReal.data());
+
+        std::cout << "\nFP16 transfer accuracy against FP32 (sample size " << sampleSize << "):\n";
+        std::cout << "Peak power:             " << report.peakPower << "\n";
+        std::cout << "Max absolute error:     " << report.maxAbsError << "\n";
+        std::cout << "RMS error:              " << report.rmsError << "\n";
+        std::cout << "Max error to peak:      " << report.maxErrorToPeak << "\n";
+
+        oDft.releaseOpenCLResources();
+    }
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        oDft.releaseOpenCLResources();
+        return 1;
+    }
+
+    return 0;
+}
+
+int goCiCLaDftProfile()
+{
+    const int sampleSize = 2048;
+    const float samplingFrequency = 48000.0;
+    const int nFrames = 1000;
+
+    vi::CiCLaDft oDft;
+
+    try
+    {
+        oDft.setProfiling(true);
+        oDft.setOpenCL();
+        oDft.createOpenCLKernel(sampleSize, oDft.P1SN);
+
+        std::vector<float> inputReal(sampleSize);
+        for (int i = 0; i < sampleSize; i++) {
+            float time = (float)i / samplingFrequency;
+            inputReal[i] = (float)(0.5f * sinf(vi::PI2 * 1000.0f * time));
+        }
+
+        std::vector<float> onesidePower(oDft.getOnesideSize());
+        for (int n = 0; n < nFrames; n++) oDft.executeOpenCLKernel(inputReal.data(), onesidePower.data());
+
+        const char* stageNames[] = { "Write", "Kernel", "Read" };
+        std::cout << "\nStage timing over " << nFrames << " frames (sample size " << sampleSize << "), microseconds:\n";
+        std::cout << "Stage     queue  submit    mean     p50     p99     max\n";
+        for (int stage = oDft.PROFILE_WRITE; stage <= oDft.PROFILE_READ; stage++) {
+            vi::CiCLaDft::StageProfile profile = oDft.getProfile(stage);
+            std::cout << std::left << std::setw(8) << stageNames[stage] << std::right << std::fixed << std::setprecision(1)
+                << std::setw(7) << profile.queueTime.mean << std::setw(8) << profile.submitTime.mean
+                << std::setw(8) << profile.executionTime.mean << std::setw(8) << profile.executionTime.p50
+                << std::setw(8) << profile.executionTime.p99 << std::setw(8) << profile.executionTime.max << "\n";
+        }
+
+        oDft.releaseOpenCLResources();
+    }
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        oDft.releaseOpenCLResources();
+        return 1;
+    }
+
+    return 0;
+}
+
+int goCiCLaDftPeaks()
+{
+    const int sampleSize = 2048;
+    const float samplingFrequency = 48000.0;
+    const int peakCount = 8;
+
+    vi::CiCLaDft oDft;
+
+    try
+    {
+        oDft.setOpenCL();
+        oDft.createOpenCLKernel(sampleSize, oDft.P1SN);
+
+        // Only the peak records cross the bus, not the whole spectrum
+        oDft.setPeakPicking(peakCount, 10.0f);
+
+        std::vector<float> inputReal(sampleSize);
+        for (int i = 0; i < sampleSize; i++) {
+            float time = (float)i / samplingFrequency;
+            float window = 0.5f - 0.5f * cosf(vi::PI2 * i / sampleSize);
+            inputReal[i] = window * (0.5f * sinf(vi::PI2 * 1000.0f * time) + 0.1f * sinf(vi::PI2 * 3333.3f * time)
+                + 0.02f * sinf(vi::PI2 * 12345.6f * time));
+        }
+
+        std::vector<vi::CiCLaDft::Peak> peaks(oDft.getPeakCount());
+        oDft.executeOpenCLPeaks(inputReal.data(), peaks.data());
+
+        std::cout << "\nSpectral peaks (sample size " << sampleSize << "):\n";
+        std::cout << "Frequency (Hz)       Power  Prominence (dB)\n";
+        for (const vi::CiCLaDft::Peak& peak : peaks) {
+            if (peak.index < 0) break;
+            std::cout << std::fixed << std::setprecision(1) << std::setw(14) << peak.bin * samplingFrequency / sampleSize
+                << std::scientific << std::setprecision(3) << std::setw(12) << peak.power
+                << std::fixed << std::setprecision(1) << std::setw(17) << peak.prominence << "\n";
+        }
+
+        oDft.releaseOpenCLResources();
+    }
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        oDft.releaseOpenCLResources();
+        return 1;
+    }
+
+    return 0;
+}
+
+int goCiCLaDftFeatures()
+{
+    const int sampleSize = 2048;
+    const float samplingFrequency = 48000.0;
+
+    vi::CiCLaDft oDft;
+
+    try
+    {
+        oDft.setOpenCL();
+        oDft.createOpenCLKernel(sampleSize, oDft.P1SN);
+
+        // Frequencies in Hz, 85 % roll-off
+        oDft.setFeatures(samplingFrequency / sampleSize);
+
+        std::vector<float> inputReal(sampleSize);
+        std::cout << "\nSpectral features of a rising tone (sample size " << sampleSize << "):\n";
+        std::cout << "Frame  Centroid  Bandwidth  Roll-off  Flatness      Flux       RMS\n";
+        for (int frame = 0; frame < 5; frame++) {
+            float freq = 1000.0f * (frame + 1);
+            for (int i = 0; i < sampleSize; i++) {
+                float time = (float)i / samplingFrequency;
+                inputReal[i] = (float)(0.5f * sinf(vi::PI2 * freq * time) + 0.05f * sinf(vi::PI2 * 9000.0f * time));
+            }
+
+            vi::CiCLaDft::Features features;
+            oDft.executeOpenCLFeatures(inputReal.data(), &features);
+
+            std::cout << std::setw(5) << frame << std::fixed << std::setprecision(1) << std::setw(10) << features.centroid
+                << std::setw(11) << features.bandwidth << std::setw(10) << features.rolloff
+                << std::scientific << std::setprecision(2) << std::setw(10) << features.flatness << std::setw(10) << features.flux
+                << std::fixed << std::setprecision(4) << std::setw(10) << features.rms << "\n";
+        }
+
+        oDft.releaseOpenCLResources();
+    }
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        oDft.releaseOpenCLResources();
+        return 1;
+    }
+
+    return 0;
+}
+
+int goCiBatchScheduler()
+{
+    const int sampleSize = 1024;
+    const int nStreams = 32;
+    const int nFrames = 200;
+
+    try
+    {
+        // Every stream transforms stereo blocks on its own thread, the scheduler launches them in batches
+        vi::CiBatchScheduler scheduler(sampleSize, 64);
+
+        auto tpStart = std::chrono::steady_clock::now();
+        std::vector<std::thread> streams;
+        for (int s = 0; s < nStreams; s++) {
+            streams.emplace_back([&scheduler, s] {
+                std::vector<float> inputReal(2 * sampleSize);
+                std::vector<float> onesidePower(2 * scheduler.getOnesideSize());
+                for (int i = 0; i < 2 * sampleSize; i++) inputReal[i] = sinf(vi::PI2 * (s + 1) * i / sampleSize);
+                int nPriority = (s == 0) ? vi::CiBatchScheduler::PRIORITY_LIVE : vi::CiBatchScheduler::PRIORITY_BULK;
+                for (int n = 0; n < nFrames; n++) scheduler.transform(inputReal.data(), onesidePower.data(), 2, nPriority);
+            });
+        }
+        for (std::thread& stream : streams) stream.join();
+        double dbSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tpStart).count();
+
+        std::cout << "\n" << nStreams << " stereo streams, " << nFrames << " blocks each (sample size " << sampleSize << "):\n";
+        std::cout << "Batches:              " << scheduler.getBatchCount() << "\n";
+        std::cout << "Mean frames/batch:    " << std::fixed << std::setprecision(1) << scheduler.getMeanBatchFrames() << "\n";
+        std::cout << "Frames per second:    " << std::setprecision(0) << scheduler.getFrameCount() / dbSeconds << "\n";
+    }
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+int goCiSpectrogramFile()
+{
+    try {
+
+        // Record a mono session into one spectrogram file
+        vi::CiAudioDft<vi::AudioCH1F> audio;
+
+        audio.activateEndpointByIndex(1);
+        audio.getStreamFormatInfo();
+        audio.setNumberOfChannels(1);
+
+        int nSampleSize = 2048;
+        audio.setBatchSize(nSampleSize);
+        audio.setIndexRangeF(0, nSampleSize / 2);
+
+        float fpTime = 30.f;
+        audio.setFolderPath("E:/Test_Data");
+        audio.getReady(audio.TO_BIN_A);
+
+        std::cout << "Recording " << fpTime << " s into " << audio.getFolderPath() << " ...\n";
+
+        std::thread t1(&vi::CiAudioDft<vi::AudioCH1F>::readAudioData, &audio, fpTime);
+        std::thread t2(&vi::CiAudioDft<vi::AudioCH1F>::processAudioData, &audio);
+        t2.join();
+        t1.join();
+
+        // Map the file and read 1 - 2 kHz of the whole recording as an overview of at most 40 rows
+        vi::CiSpectrogramReader reader;
+        reader.open(audio.getFolderPath() + "/" + audio.getFolderName() + ".vspec");
+
+        std::cout << "Records: " << reader.getRecordCount() << ", pyramid levels:";
+        for (uint32_t nDecimation : reader.getPyramidLevels()) std::cout << " " << nDecimation;
+        std::cout << "\n";
+
+        vi::CiSpectrogramView view = reader.queryOverview(0.0, fpTime, 1000.f, 2000.f, 40);
+        std::cout << "Overview rows: " << view.getRows() << ", records per row: " << view.getDecimation() << "\n";
+        std::cout << "    time    peak frequency      max power     mean power\n";
+        for (size_t row = 0; row < view.getRows(); ++row) {
+            const float* pMax = view.getMax(row, 0);
+            const float* pMean = view.getMean(row, 0);
+            int nPeak = static_cast<int>(std::max_element(pMax, pMax + view.getSize()) - pMax);
+            std::cout << std::fixed << std::setprecision(2) << std::setw(8) << view.getTimeEnd(row)
+                << std::setw(18) << view.getFrequency(nPeak)
+                << std::scientific << std::setprecision(3) << std::setw(15) << pMax[nPeak] << std::setw(15) << pMean[nPeak] << "\n";
+        }
+    }
+
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        return 1;
+    }
+
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+int goCiAudioTrigger()
+{
+    try {
+
+        // Record only the frames around loud 1 kHz tones and sudden broadband onsets
+        vi::CiAudioDft<vi::AudioCH1F> audio;
+
+        audio.activateEndpointByIndex(1);
+        audio.getStreamFormatInfo();
+        audio.setNumberOfChannels(1);
+
+        int nSampleSize = 1024;
+        audio.setBatchSize(nSampleSize);
+        audio.setIndexRangeF(0, nSampleSize / 2);
+
+        float fpTime = 60.f;
+        audio.setFolderPath("E:/Test_Data");
+        audio.createDataFolder();
+
+        // 20 frames before and 40 frames after every trigger, with the audio of the events as WAV files
+        auto pEvents = std::make_shared<vi::CiSpectrogramSink>(audio.getFolderPath() + "/events.vspec");
+        auto pTrigger = std::make_shared<vi::CiTriggerSink>(pEvents, 20, 40, audio.getFolderPath());
+        pTrigger->getTrigger().addCondition(vi::CiTrigger::PEAK, 950.f, 1050.f, 0.01f);
+        pTrigger->getTrigger().addCondition(vi::CiTrigger::SPECTRAL_FLUX, 0.f, 24000.f, 0.05f);
+        audio.addSink(pTrigger, 64, vi::CiAsyncSink::BLOCK);
+
+        audio.getReady(audio.TO_SINKS);
+
+        std::cout << "Monitoring for " << fpTime << " s, events are saved in " << audio.getFolderPath() << " ...\n";
+
+        std::thread t1(&vi::CiAudioDft<vi::AudioCH1F>::readAudioData, &audio, fpTime);
+        std::thread t2(&vi::CiAudioDft<vi::AudioCH1F>::processAudioData, &audio);
+        t2.join();
+        t1.join();
+
+        std::cout << "Frames: " << pTrigger->getFrameCount() << ", recorded: " << pTrigger->getRecordedFrameCount() << "\n";
+        for (const vi::CiTriggerSink::Event& event : pTrigger->getEvents()) {
+            std::cout << std::fixed << std::setprecision(3) << "Event at " << std::setw(8) << event.dbTimeBegin << " - " << std::setw(8) << event.dbTimeEnd
+                << " s, trigger frame " << event.sizeTriggerFrame << ", " << event.sAudioFile << "\n";
+        }
+    }
+
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        return 1;
+    }
+
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+int goCiAudioNoiseStatistics()
+{
+    try {
+
+        // Per-bin Leq, Lmin, Lmax, L10, L50 and L90 of every minute, without storing the spectra
+        vi::CiAudioDft<vi::AudioCH1F> audio;
+
+        audio.activateEndpointByIndex(1);
+        audio.getStreamFormatInfo();
+        audio.setNumberOfChannels(1);
+
+        int nSampleSize = 2048;
+        audio.setBatchSize(nSampleSize);
+        audio.setIndexRangeF(1, nSampleSize / 2);
+
+        float fpTime = 600.f;
+        audio.setFolderPath("E:/Test_Data");
+        audio.createDataFolder();
+
+        auto pStatistics = std::make_shared<vi::CiStatisticsSink>(audio.getFolderPath(), 60.0);
+        audio.addSink(pStatistics, 64, vi::CiAsyncSink::BLOCK);
+
+        audio.getReady(audio.TO_SINKS);
+
+        std::cout << "Monitoring for " << fpTime << " s, reports are saved in " << audio.getFolderPath() << " ...\n";
+
+        std::thread t1(&vi::CiAudioDft<vi::AudioCH1F>::readAudioData, &audio, fpTime);
+        std::thread t2(&vi::CiAudioDft<vi::AudioCH1F>::processAudioData, &audio);
+        t2.join();
+        t1.join();
+
+        std::cout << "Reports: " << pStatistics->getReportCount() << ", last: " << pStatistics->getLastReport().sFileName << "\n";
+    }
+
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        return 1;
+    }
+
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+int goCiAudioTelemetry()
+{
+    try {
+
+        // Record stereo spectra to CSV while a Prometheus snapshot of the pipeline metrics is refreshed every second
+        vi::CiAudioDft<vi::AudioCH2F> audio;
+
+        audio.activateEndpointByIndex(1);
+        audio.getStreamFormatInfo();
+        audio.setNumberOfChannels(2);
+
+        int nSampleSize = 1024;
+        audio.setBatchSize(nSampleSize);
+        audio.setIndexRangeF(0, nSampleSize / 2);
+
+        float fpTime = 60.f;
+        audio.setFolderPath("E:/Test_Data");
+        audio.getReady(audio.TO_CSV_A);
+
+        vi::CiTelemetryExporter exporter("E:/Test_Data/vslib.prom", vi::CiTelemetry::FORMAT_PROMETHEUS, 1.0);
+        exporter.start();
+
+        std::cout << "Recording " << fpTime << " s, metrics are saved in E:/Test_Data/vslib.prom ...\n";
+
+        std::thread t1(&vi::CiAudioDft<vi::AudioCH2F>::readAudioData, &audio, fpTime);
+        std::thread t2(&vi::CiAudioDft<vi::AudioCH2F>::processAudioData, &audio);
+        t2.join();
+        t1.join();
+
+        exporter.stop();
+        vi::CiTelemetry::getInstance().writeSnapshot(std::cout, vi::CiTelemetry::FORMAT_JSON);
+    }
+
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        return 1;
+    }
+
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+int goCiAudioTrace()
+{
+    try {
+
+        // Record a few seconds of stereo spectra and save the timeline of every stage.
+        // The trace points are compiled only when VSLIB_TRACE is defined for the project.
+#ifndef VSLIB_TRACE
+        std::cout << "The trace points are not compiled, define VSLIB_TRACE to record a timeline.\n";
+#endif
+        vi::CiAudioDft<vi::AudioCH2F> audio;
+
+        audio.activateEndpointByIndex(1);
+        audio.getStreamFormatInfo();
+        audio.setNumberOfChannels(2);
+
+        int nSampleSize = 1024;
+        audio.setBatchSize(nSampleSize);
+        audio.setIndexRangeF(0, nSampleSize / 2);
+
+        float fpTime = 5.f;
+        audio.setFolderPath("E:/Test_Data");
+        audio.getReady(audio.TO_CSV_A);
+
+        std::cout << "Recording " << fpTime << " s ...\n";
+
+        std::thread t1(&vi::CiAudioDft<vi::AudioCH2F>::readAudioData, &audio, fpTime);
+        std::thread t2(&vi::CiAudioDft<vi::AudioCH2F>::processAudioData, &audio);
+        t2.join();
+        t1.join();
+
+        vi::CiTrace& trace = vi::CiTrace::getInstance();
+        trace.writeChromeJson(std::string("E:/Test_Data/trace.json"));
+        std::cout << trace.getEventCount() << " events (" << trace.getDroppedCount() << " dropped) are saved in E:/Test_Data/trace.json,"
+            << " open it in chrome://tracing or ui.perfetto.dev\n";
+    }
+
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        return 1;
+    }
+
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+int goCiAudioRealtime()
+{
+    try {
+
+        // Record stereo spectra with the capture and transform threads at MMCSS priority on cores of their own,
+        // then show what each thread got and how much the packet interval varied
+        vi::CiAudioDft<vi::AudioCH2F> audio;
+
+        audio.activateEndpointByIndex(1);
+        audio.getStreamFormatInfo();
+        audio.setNumberOfChannels(2);
+
+        int nSampleSize = 1024;
+        audio.setBatchSize(nSampleSize);
+        audio.setIndexRangeF(0, nSampleSize / 2);
+
+        vi::CiThreadConfig capture;
+        capture.nPriority = vi::CiThreadConfig::PRIORITY_REALTIME;
+        capture.sMmcssTask = "Pro Audio";
+        capture.cores = { 2 };
+        capture.bLockMemory = true;
+        audio.setThreadConfig(audio.THREAD_CAPTURE, capture);
+
+        vi::CiThreadConfig transform = capture;
+        transform.sMmcssTask = "Audio";
+        transform.cores = { 3 };
+        audio.setThreadConfig(audio.THREAD_TRANSFORM, transform);
+
+        vi::CiThreadConfig sink;
+        sink.cores = { 0, 1 };
+        audio.setThreadConfig(audio.THREAD_SINK, sink);
+
+        float fpTime = 30.f;
+        audio.setFolderPath("E:/Test_Data");
+        audio.getReady(audio.TO_CSV_A);
+
+        std::cout << "Recording " << fpTime << " s ...\n";
+
+        std::thread t1(&vi::CiAudioDft<vi::AudioCH2F>::readAudioData, &audio, fpTime);
+        std::thread t2(&vi::CiAudioDft<vi::AudioCH2F>::processAudioData, &audio);
+        t2.join();
+        t1.join();
+
+        for (const vi::CiThreadReport& report : audio.getThreadReports()) std::cout << report.toString() << "\n";
+        vi::CiTelemetry::getInstance().writeSnapshot(std::cout, vi::CiTelemetry::FORMAT_PROMETHEUS);
+    }
+
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        return 1;
+    }
+
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+int goCiAudioLanes()
+{
+    try {
+
+        // Run two sessions on the same cached plan; the stage threads of the second session
+        // take the lanes the first one gave back, so the plan has no more lanes than before
+        vi::CiAudioDft<vi::AudioCH2F> audio;
+
+        audio.activateEndpointByIndex(1);
+        audio.getStreamFormatInfo();
+        audio.setNumberOfChannels(2);
+
+        int nSampleSize = 1024;
+        audio.setBatchSize(nSampleSize);
+        audio.setIndexRangeF(0, nSampleSize / 2);
+
+        float fpTime = 2.f;
+        size_t sizeLanes[2] = { 0, 0 };
+        for (int nSession = 0; nSession < 2; nSession++) {
+            audio.getReady(audio.TO_SINKS);
+
+            std::thread t1(&vi::CiAudioDft<vi::AudioCH2F>::readAudioData, &audio, fpTime);
+            std::thread t2(&vi::CiAudioDft<vi::AudioCH2F>::processAudioData, &audio);
+            t2.join();
+            t1.join();
+
+            sizeLanes[nSession] = audio.getDftPlan()->getLaneCount();
+            std::cout << "Session " << nSession + 1 << ": " << sizeLanes[nSession] << " lanes\n";
+        }
+
+        bool bPassed = sizeLanes[0] > 0 && sizeLanes[1] == sizeLanes[0];
+        std::cout << (bPassed ? "The lanes were reused\n" : "FAILED: the second session added lanes\n");
+        return bPassed ? 0 : 1;
+    }
+
+    catch (const vi::OpenCLException& e) {
+        std::cerr << "OpenCL Error: " << e.what() << " (Error Code: " << e.getErrorCode() << ")" << std::endl;
+        return 1;
+    }
+
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+}
+
+int goCiFilterbankOctave()
+{
+    // Compare the centre frequencies of 1/3- and 1/6-octave banks with the exact base-10 centres of
+    // IEC 61260: G^(x/3) kHz for the odd 1/3 octave, G^((2x+1)/12) kHz for the even 1/6 octave
+    struct Expected { int nBandParameter; float fpCentreF; };
+    const Expected expected[] = {
+        { 3, 1000.000f }, { 3, 501.187f }, { 3, 1995.262f },
+        { 6, 530.884f }, { 6, 944.061f }, { 6, 1059.254f }, { 6, 1883.649f }, { 6, 3758.374f }
+    };
+
+    int nFailed = 0;
+    for (const Expected& e : expected) {
+        vi::CiFilterbank oFilterbank(vi::CiFilterbank::FRACTIONAL_OCTAVE, 400.0f, 5000.0f, e.nBandParameter);
+        oFilterbank.design(48000, 8192);
+
+        float fpClosest = 0.0f;
+        for (float fpCentreF : oFilterbank.getCentreFrequencies()) {
+            if (std::fabs(fpCentreF - e.fpCentreF) < std::fabs(fpClosest - e.fpCentreF)) fpClosest = fpCentreF;
+        }
+
+        bool bPassed = std::fabs(fpClosest - e.fpCentreF) < 0.01f;
+        if (!bPassed) nFailed++;
+        std::cout << "1/" << e.nBandParameter << " octave " << std::fixed << std::setprecision(3) << std::setw(9) << e.fpCentreF
+            << " Hz: closest centre " << std::setw(9) << fpClosest << " Hz " << (bPassed ? "ok" : "FAILED") << "\n";
+    }
+
+    return nFailed ? 1 : 0;
+}
+
 int goCiUser()
 {
     // Create an instance of the CiUser class
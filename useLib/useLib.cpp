@@ -1,9 +1,20 @@
+#include "goBatch.hpp"
+#include "goBenchmark.hpp"
+#include "goAccuracy.hpp"
+#ifdef _WIN32
 #include "CiAudioDft.hpp"
 #include "goTest.hpp"
+#endif
 
 
-int main() {
+int main(int argc, char* argv[]) {
 
+    // With arguments the program benchmarks, checks the accuracy or transforms recordings without user interaction
+    if (argc > 1 && std::string(argv[1]) == "--bench") return goBenchmark(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "--accuracy") return goAccuracy(argc, argv);
+    if (argc > 1) return goBatch(argc, argv);
+
+#ifdef _WIN32
     int k = 5;
 
     if (k == 5) return goCiAudioCSVMono();
@@ -11,7 +22,9 @@ int main() {
     if (k == 1) return goCiAudioConsole();
     if (k == 2) return goCiAudioCSV();
     if (k == 3) return goCiAudioV01();
+#else
+    printBatchUsage();
+#endif
 
     return 0;
 }
-
@@ -0,0 +1,283 @@
+// This C++ code defines the accuracy check of the transform paths. A
+// reference one-sided power spectrum is computed on the CPU in double
+// precision with the exact value of 2 pi and the same scaling as the
+// kernels: none for P1S, 1/N for the DC bin and 2/N for the other bins of
+// P1SN. The check transforms synthetic test signals of every sample size
+// with every backend and compares the result bin by bin with the
+// reference. The errors are reported relative to the largest power of the
+// reference spectrum, so one bound holds for quiet and loud signals, and a
+// case passes when its largest error stays within the bound of its
+// backend. The bound grows with the sample size: the kernels compute the
+// phase as a float product of 2 pi (6.28319f) and the sample index, whose
+// drift grows with N and is largest near N/2. The unchanged kernel reaches
+// about 3e-3 at N=4096, 7e-3 at 16384 and 3.6e-2 at 65536 with noise (below
+// 7.1e-7 N at every size), so the default adds 1e-6 per sample to the fixed
+// bound of the transfer mode. A new fast path is added as a backend here
+// and has to pass before it is used in production.
+
+#pragma once
+#include "CiDftPlanCache.hpp"
+#include "CiSignal.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Double-precision DFT used as the reference of the kernels.
+    /// </summary>
+    class CiReferenceDft {
+    public:
+
+        /// <summary>
+        /// Compute the one-sided power spectrum of a frame.
+        /// </summary>
+        /// <param name="pSamples">Samples of the frame.</param>
+        /// <param name="nSize">Number of samples, even.</param>
+        /// <param name="bNormalized">True for the scaling of P1SN, false for the unscaled P1S.</param>
+        /// <param name="power">Receives nSize / 2 + 1 power values.</param>
+        static void computePower(const float* pSamples, const int nSize, const bool bNormalized, std::vector<double>& power) {
+            if (nSize < 2 || nSize % 2 != 0) {
+                throw std::invalid_argument("The sample size must be an even number.");
+            }
+
+            // The phase of bin k at sample n is 2 pi (k n mod N) / N, so one table of N angles serves all bins exactly
+            std::vector<double> cosTable(nSize), sinTable(nSize);
+            for (int n = 0; n < nSize; ++n) {
+                double dbAngle = TWO_PI * n / nSize;
+                cosTable[n] = std::cos(dbAngle);
+                sinTable[n] = std::sin(dbAngle);
+            }
+
+            int nOneside = nSize / 2 + 1;
+            power.assign(nOneside, 0.0);
+            for (int k = 0; k < nOneside; ++k) {
+                double dbReal = 0.0, dbImag = 0.0;
+                int nIndex = 0;
+                for (int n = 0; n < nSize; ++n) {
+                    dbReal += pSamples[n] * cosTable[nIndex];
+                    dbImag -= pSamples[n] * sinTable[nIndex];
+                    nIndex += k;
+                    if (nIndex >= nSize) nIndex -= nSize;
+                }
+                if (bNormalized) {
+                    double dbScale = (k == 0) ? 1.0 / nSize : 2.0 / nSize;
+                    dbReal *= dbScale;
+                    dbImag *= dbScale;
+                }
+                power[k] = dbReal * dbReal + dbImag * dbImag;
+            }
+        }
+
+    private:
+        static constexpr double TWO_PI = 6.283185307179586476925;
+    };
+
+    /// <summary>
+    /// Cases and error bounds of an accuracy check.
+    /// </summary>
+    struct CiAccuracyConfig {
+
+        static constexpr int BACKEND_KERNEL = 0;        // P1SN, FP32 transfers
+        static constexpr int BACKEND_KERNEL_P1S = 1;    // P1S, FP32 transfers
+        static constexpr int BACKEND_KERNEL_F16 = 2;    // P1SN, FP16 transfers
+        static constexpr int BACKEND_BATCH = 3;         // P1SN, batched kernel
+        static constexpr int BACKEND_COUNT = 4;
+
+        static constexpr int SIGNAL_TONES = 0;          // Three tones between bins, 0 dB, -20 dB and -40 dB
+        static constexpr int SIGNAL_CHIRP = 1;          // Linear chirp over most of the band
+        static constexpr int SIGNAL_NOISE = 2;          // Gaussian white noise
+        static constexpr int SIGNAL_IMPULSE = 3;        // One impulse, a flat spectrum
+        static constexpr int SIGNAL_COUNT = 4;
+
+        std::vector<int> sampleSizes;       // Sample (FFT) sizes
+        std::vector<int> backends;          // BACKEND_*
+        std::vector<int> signals;           // SIGNAL_*
+        double dbSamplesPerSec;             // Sample rate of the test signals (Hz)
+        double dbBoundF32;                  // Largest error relative to the peak power for FP32 transfers, before the size term
+        double dbBoundF16;                  // Largest error relative to the peak power for FP16 transfers, before the size term
+        double dbBoundPerSample;            // Bound added per sample of the frame for the phase drift of the kernels
+        int nDeviceIndex;                   // Index of the GPU device
+
+        CiAccuracyConfig() : sampleSizes{ 64, 256, 1024, 4096, 16384, 65536 },
+            backends{ BACKEND_KERNEL, BACKEND_KERNEL_P1S, BACKEND_KERNEL_F16, BACKEND_BATCH },
+            signals{ SIGNAL_TONES, SIGNAL_CHIRP, SIGNAL_NOISE, SIGNAL_IMPULSE },
+            dbSamplesPerSec(48000.0), dbBoundF32(1e-3), dbBoundF16(5e-3), dbBoundPerSample(1e-6), nDeviceIndex(0) {}
+
+        /// <summary>
+        /// Get the bound of the largest error of a backend at a sample size.
+        /// </summary>
+        double getBound(const int nBackend, const int nSampleSize) const {
+            double dbBound = (nBackend == BACKEND_KERNEL_F16) ? dbBoundF16 : dbBoundF32;
+            return dbBound + dbBoundPerSample * nSampleSize;
+        }
+
+        /// <summary>
+        /// Get the name of a backend as it is written to the results.
+        /// </summary>
+        static const char* getBackendName(const int nBackend) {
+            switch (nBackend) {
+            case BACKEND_KERNEL: return "kernel";
+            case BACKEND_KERNEL_P1S: return "kernel_p1s";
+            case BACKEND_KERNEL_F16: return "kernel_f16";
+            case BACKEND_BATCH: return "batch";
+            default: return "unknown";
+            }
+        }
+
+        /// <summary>
+        /// Get the name of a test signal as it is written to the results.
+        /// </summary>
+        static const char* getSignalName(const int nSignal) {
+            switch (nSignal) {
+            case SIGNAL_TONES: return "tones";
+            case SIGNAL_CHIRP: return "chirp";
+            case SIGNAL_NOISE: return "noise";
+            case SIGNAL_IMPULSE: return "impulse";
+            default: return "unknown";
+            }
+        }
+    };
+
+    /// <summary>
+    /// Result of one accuracy case.
+    /// </summary>
+    struct CiAccuracyResult {
+        int nBackend;
+        int nSignal;
+        int nSampleSize;
+        double dbPeakPower;         // Largest power of the reference spectrum
+        double dbMaxError;          // Largest absolute error of a bin, relative to the peak power
+        double dbRmsError;          // RMS error over all bins, relative to the peak power
+        int nWorstBin;              // Bin of the largest error
+        double dbBound;             // Bound of the largest error
+        bool bPassed;
+    };
+
+    /// <summary>
+    /// Class for checking the transform backends against the reference DFT.
+    /// </summary>
+    class CiAccuracy {
+    public:
+
+        /// <summary>
+        /// Constructor for CiAccuracy.
+        /// </summary>
+        /// <param name="config">Cases and error bounds.</param>
+        explicit CiAccuracy(const CiAccuracyConfig& config) : m_config(config) {
+            for (int nBackend : m_config.backends) {
+                if (nBackend < 0 || nBackend >= CiAccuracyConfig::BACKEND_COUNT) {
+                    throw std::invalid_argument("Unknown accuracy backend.");
+                }
+            }
+            for (int nSignal : m_config.signals) {
+                if (nSignal < 0 || nSignal >= CiAccuracyConfig::SIGNAL_COUNT) {
+                    throw std::invalid_argument("Unknown test signal.");
+                }
+            }
+        }
+
+        /// <summary>
+        /// Run all cases; the reference of a signal and size is computed once for all backends.
+        /// </summary>
+        /// <param name="onResult">Function called with the result of every case as soon as it is done, or nullptr.</param>
+        /// <returns>Results of all cases.</returns>
+        std::vector<CiAccuracyResult> run(const std::function<void(const CiAccuracyResult&)>& onResult = nullptr) {
+            std::vector<CiAccuracyResult> results;
+            std::vector<double> referenceN, referenceU;
+            std::vector<float> output;
+
+            for (int nSampleSize : m_config.sampleSizes) {
+                for (int nSignal : m_config.signals) {
+                    std::vector<float> samples = makeSignal(nSignal, nSampleSize);
+                    CiReferenceDft::computePower(samples.data(), nSampleSize, true, referenceN);
+                    bool bUnscaled = std::find(m_config.backends.begin(), m_config.backends.end(), CiAccuracyConfig::BACKEND_KERNEL_P1S) != m_config.backends.end();
+                    if (bUnscaled) CiReferenceDft::computePower(samples.data(), nSampleSize, false, referenceU);
+
+                    for (int nBackend : m_config.backends) {
+                        transform(nBackend, samples, output);
+                        const std::vector<double>& reference = (nBackend == CiAccuracyConfig::BACKEND_KERNEL_P1S) ? referenceU : referenceN;
+                        results.push_back(compare(reference, output));
+                        CiAccuracyResult& result = results.back();
+                        result.nBackend = nBackend;
+                        result.nSignal = nSignal;
+                        result.nSampleSize = nSampleSize;
+                        result.dbBound = m_config.getBound(nBackend, nSampleSize);
+                        result.bPassed = result.dbMaxError <= result.dbBound;
+                        if (onResult) onResult(result);
+                    }
+                }
+            }
+            return results;
+        }
+
+        /// <summary>
+        /// Create the samples of a test signal.
+        /// </summary>
+        /// <param name="nSignal">SIGNAL_*.</param>
+        /// <param name="nSampleSize">Number of samples.</param>
+        std::vector<float> makeSignal(const int nSignal, const int nSampleSize) const {
+            CiSignal signal(nSampleSize, m_config.dbSamplesPerSec);
+            double dbNyquist = m_config.dbSamplesPerSec / 2.0;
+            switch (nSignal) {
+            case CiAccuracyConfig::SIGNAL_TONES:
+                // Frequencies between bins, so the leakage reaches every bin
+                signal.addTone(0.0213 * m_config.dbSamplesPerSec, 1.0);
+                signal.addTone(0.1067 * m_config.dbSamplesPerSec, 0.1, 0.3);
+                signal.addTone(0.3125 * m_config.dbSamplesPerSec + 0.37 * m_config.dbSamplesPerSec / nSampleSize, 0.01, 1.1);
+                break;
+            case CiAccuracyConfig::SIGNAL_CHIRP:
+                signal.addChirp(0.01 * dbNyquist, 0.9 * dbNyquist, 0.5);
+                break;
+            case CiAccuracyConfig::SIGNAL_NOISE:
+                signal.addNoise(0.1, 12345u + static_cast<unsigned int>(nSampleSize));
+                break;
+            default:
+                signal.addImpulse(nSampleSize / 4, 1.0);
+                break;
+            }
+            return signal.getSamples();
+        }
+
+        // Getter for the cases and error bounds
+        const CiAccuracyConfig& getConfig() const { return m_config; }
+
+    private:
+        CiAccuracyConfig m_config;
+
+        // Method to transform the samples with a backend
+        void transform(const int nBackend, const std::vector<float>& samples, std::vector<float>& output) const {
+            int nSampleSize = static_cast<int>(samples.size());
+            int nKernel = (nBackend == CiAccuracyConfig::BACKEND_KERNEL_P1S) ? CiCLaDft::P1S : CiCLaDft::P1SN;
+            int nTransfer = (nBackend == CiAccuracyConfig::BACKEND_KERNEL_F16) ? CiCLaDft::TRANSFER_F16 : CiCLaDft::TRANSFER_F32;
+            CiDftPlan pDft = CiDftPlanCache::getInstance().acquirePlan(nSampleSize, nKernel, nTransfer, 0, m_config.nDeviceIndex);
+
+            output.assign(pDft->getOnesideSize(), 0.0f);
+            if (nBackend == CiAccuracyConfig::BACKEND_BATCH) pDft->executeOpenCLBatch(samples.data(), output.data(), 1);
+            else pDft->executeOpenCLKernel(samples.data(), output.data());
+        }
+
+        // Method to compare a spectrum with the reference
+        static CiAccuracyResult compare(const std::vector<double>& reference, const std::vector<float>& output) {
+            CiAccuracyResult result{};
+            result.dbPeakPower = *std::max_element(reference.begin(), reference.end());
+            double dbScale = (result.dbPeakPower > 0.0) ? 1.0 / result.dbPeakPower : 1.0;
+
+            double dbSumSquares = 0.0;
+            for (size_t k = 0; k < reference.size(); ++k) {
+                double dbError = std::fabs(output[k] - reference[k]) * dbScale;
+                dbSumSquares += dbError * dbError;
+                if (dbError > result.dbMaxError) {
+                    result.dbMaxError = dbError;
+                    result.nWorstBin = static_cast<int>(k);
+                }
+            }
+            result.dbRmsError = std::sqrt(dbSumSquares / reference.size());
+            return result;
+        }
+    };
+
+}
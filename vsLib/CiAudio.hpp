@@ -18,6 +18,12 @@
 #include <thread>
 #include <queue>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "CiFrame.hpp"
+#include "CiRealtime.hpp"
+#include "CiTelemetry.hpp"
+#include "CiTrace.hpp"
 
 namespace vi {
 
@@ -65,6 +71,40 @@ namespace vi {
         // Queue to accumulate the read audio data
         std::vector<T> m_audioData;
 
+        // Telemetry of the capture, shared by all instances of the process
+        struct CaptureMetrics {
+            CiCounter& packets;
+            CiCounter& frames;
+            CiCounter& discontinuities;
+            CiCounter& silentPackets;
+            CiCounter& timestampErrors;
+            CiHistogram& packetFrames;
+            CiGauge& bufferFrames;
+            CiHistogram& deinterleaveSeconds;
+            CiHistogram& packetIntervalSeconds;
+        } m_metrics;
+
+        // Real-time settings of the thread that runs readAudioData, and what it got of them
+        CiThreadConfig m_captureThreadConfig;
+        CiThreadReport m_captureThreadReport;
+
+        // Method to register the metrics of the capture
+        static CaptureMetrics getCaptureMetrics() {
+            CiTelemetry& telemetry = CiTelemetry::getInstance();
+            return {
+                telemetry.getCounter("vslib_capture_packets_total", "Packets read from the capture client."),
+                telemetry.getCounter("vslib_capture_frames_total", "Audio frames read from the capture client."),
+                telemetry.getCounter("vslib_capture_discontinuities_total", "Packets flagged as a data discontinuity (glitch)."),
+                telemetry.getCounter("vslib_capture_silent_packets_total", "Packets flagged as silent."),
+                telemetry.getCounter("vslib_capture_timestamp_errors_total", "Packets flagged with a timestamp error."),
+                telemetry.getHistogram("vslib_capture_packet_frames", "Audio frames per capture packet.", CiHistogram::makeExponentialBounds(16.0, 2.0, 10)),
+                telemetry.getGauge("vslib_capture_buffer_frames", "Audio frames captured but not yet deinterleaved."),
+                telemetry.getHistogram("vslib_deinterleave_seconds", "Time to move one batch out of the capture buffer.", CiHistogram::makeExponentialBounds(1e-6, 4.0, 10)),
+                telemetry.getHistogram("vslib_capture_packet_interval_seconds", "Time between two capture packets; its spread is the capture jitter.",
+                    CiHistogram::makeExponentialBounds(1e-4, 2.0, 14))
+            };
+        }
+
     protected:
         // Sample rate (Hz)
         DWORD m_dwSamplesPerSec;
@@ -107,7 +147,7 @@ namespace vi {
         /// Initializes COM library and creates a multimedia device enumerator.
         /// </summary>
         CiAudio() : m_pAudioClient(nullptr), m_pFormat(nullptr), m_pCaptureClient(nullptr), m_pCollection(nullptr), m_pDevice(nullptr),
-            m_sizeAudioClientNo(-1), m_dwSamplesPerSec(0), m_nMessageID(1), m_sizeBatch(0), m_nNumberOfChannels(2) {
+            m_sizeAudioClientNo(-1), m_metrics(getCaptureMetrics()), m_dwSamplesPerSec(0), m_nMessageID(1), m_sizeBatch(0), m_nNumberOfChannels(2) {
             // Initialize COM library using RAII.
             HRESULT hr = CoInitialize(nullptr);
             if (FAILED(hr)) {
@@ -154,6 +194,24 @@ namespace vi {
             return m_audioData.size();
         }
 
+        /// <summary>
+        /// Sets the real-time settings of the thread that runs readAudioData. They are applied when the capture starts
+        /// and reverted when it ends.
+        /// </summary>
+        /// <param name="config">Priority, cores and memory locking of the capture thread.</param>
+        void setCaptureThreadConfig(const CiThreadConfig& config) {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_captureThreadConfig = config;
+        }
+
+        /// <summary>
+        /// Gets what the capture thread got of its real-time settings at the last start of readAudioData.
+        /// </summary>
+        CiThreadReport getCaptureThreadReport() {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            return m_captureThreadReport;
+        }
+
         /// <summary>
         /// Gets the sample rate of the audio endpoint.
         /// </summary>
@@ -162,6 +220,14 @@ namespace vi {
             return m_dwSamplesPerSec;
         }
 
+        /// <summary>
+        /// Sets the sample rate for frames that come from appendFrames instead of an endpoint.
+        /// </summary>
+        /// <param name="dwSamplesPerSec">The sample rate in Hertz (Hz).</param>
+        void setSamplesPerSec(const DWORD dwSamplesPerSec) {
+            m_dwSamplesPerSec = dwSamplesPerSec;
+        }
+
         /// <summary>
         /// Gets the current message ID.
         /// </summary>
@@ -279,6 +345,39 @@ namespace vi {
             return { chAData };
         }
 
+        /// <summary>
+        /// Waits until a whole batch of frames is captured or the capture has ended, then moves
+        /// the first batch into a frame with one block of samples per channel.
+        /// </summary>
+        /// <param name="block">Frame that receives the deinterleaved samples.</param>
+        /// <returns>False if the capture has ended and less than a batch of frames is left.</returns>
+        bool waitMoveFirstSample(CiFrame& block) {
+
+            const int nFrameChannels = static_cast<int>(sizeof(T) / sizeof(float));
+            const int nChannels = (m_nNumberOfChannels < nFrameChannels) ? m_nNumberOfChannels : nFrameChannels;
+
+            // Wait for the signal of readAudioData instead of polling the queue
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_cv.wait(lock, [this] { return m_audioData.size() >= m_sizeBatch || m_nMessageID == AM_DATAEND; });
+
+            if (m_sizeBatch == 0 || m_audioData.size() < m_sizeBatch) return false;
+
+            CI_TRACE_SCOPE("extract");
+            auto tpBegin = std::chrono::steady_clock::now();
+            block.resize(nChannels, static_cast<int>(m_sizeBatch));
+            for (int c = 0; c < nChannels; ++c) {
+                float* pChannel = block.getChannel(c);
+                for (std::size_t i = 0; i < m_sizeBatch; ++i) pChannel[i] = m_audioData[i].ch[c];
+            }
+
+            m_audioData.erase(m_audioData.begin(), m_audioData.begin() + m_sizeBatch);  // Remove the N first frames
+
+            m_metrics.bufferFrames.set(static_cast<int64_t>(m_audioData.size()));
+            m_metrics.deinterleaveSeconds.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - tpBegin).count());
+
+            return true;
+        }
+
         /// <summary>
         /// Activates an audio endpoint by its index.
         /// </summary>
@@ -448,7 +547,29 @@ namespace vi {
             const int targetFrames = static_cast<int> (fpTime * m_dwSamplesPerSec); // Target frames for 0.1 second
             int totalFramesRead = 0;
 
-            m_nMessageID = AM_DATASTART;
+            CiThreadConfig threadConfig;
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_nMessageID = AM_DATASTART;
+                threadConfig = m_captureThreadConfig;
+            }
+
+            // Signal the end of the capture also when reading fails, so the waiting stages finish
+            struct CaptureEnd {
+                CiAudio* pAudio;
+                ~CaptureEnd() { pAudio->endCapture(); }
+            } captureEnd{ this };
+
+            CI_TRACE_THREAD_NAME("capture");
+
+            // Real-time priority and cores of the capture thread until the capture ends
+            CiRealtimeThread realtime("capture", threadConfig);
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_captureThreadReport = realtime.getReport();
+            }
+            std::chrono::steady_clock::time_point tpLastPacket;
+            bool bFirstPacket = true;
 
             while (totalFramesRead <= targetFrames) {
                 UINT32 packetLength = 0;
@@ -462,23 +583,24 @@ namespace vi {
                 }
 
                 if (packetLength != 0) {
+                    CI_TRACE_SCOPE("capture_packet");
                     hr = m_pCaptureClient->GetBuffer(&pData, &numFramesAvailable, &flags, NULL, NULL);
                     if (FAILED(hr)) {
                         throw std::runtime_error("Failed to get buffer.");
                     }
 
-                    {
-                        // Lock the mutex while modifying the queue
-                        std::lock_guard<std::mutex> lock(m_mtx);
-
-                        // Process audio data here...
-                        T* pAudioData = reinterpret_cast<T*>(pData);
-                        for (UINT32 i = 0; i < numFramesAvailable; ++i) {
-                            m_audioData.push_back(pAudioData[i]);
-                        }
+                    auto tpPacket = std::chrono::steady_clock::now();
+                    if (!bFirstPacket) m_metrics.packetIntervalSeconds.observe(std::chrono::duration<double>(tpPacket - tpLastPacket).count());
+                    bFirstPacket = false;
+                    tpLastPacket = tpPacket;
+                    m_metrics.packets.add();
+                    m_metrics.frames.add(numFramesAvailable);
+                    m_metrics.packetFrames.observe(numFramesAvailable);
+                    if (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) m_metrics.discontinuities.add();
+                    if (flags & AUDCLNT_BUFFERFLAGS_SILENT) m_metrics.silentPackets.add();
+                    if (flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR) m_metrics.timestampErrors.add();
 
-                        if (m_audioData.size() >= m_sizeBatch) m_cv.notify_one();
-                    }
+                    appendFrames(reinterpret_cast<const T*>(pData), numFramesAvailable);
 
                     hr = m_pCaptureClient->ReleaseBuffer(numFramesAvailable);
                     if (FAILED(hr)) {
@@ -489,9 +611,33 @@ namespace vi {
                 }
             }
 
-            m_nMessageID = AM_DATAEND;
-            m_cv.notify_one();
+        }
+
+        /// <summary>
+        /// Appends captured frames to the audio data and wakes up the threads waiting for a batch. readAudioData
+        /// calls it for every packet of the endpoint; another source, e.g. a file or a benchmark, can call it instead.
+        /// </summary>
+        /// <param name="pFrames">Interleaved frames to append.</param>
+        /// <param name="sizeFrames">The number of frames.</param>
+        void appendFrames(const T* pFrames, const size_t sizeFrames) {
+            // Lock the mutex while modifying the queue
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_audioData.insert(m_audioData.end(), pFrames, pFrames + sizeFrames);
+
+            m_metrics.bufferFrames.set(static_cast<int64_t>(m_audioData.size()));
+            if (m_audioData.size() >= m_sizeBatch) m_cv.notify_all();
+        }
 
+        /// <summary>
+        /// Sets the end of capture message and wakes up the threads waiting for audio data. readAudioData calls it
+        /// when it returns; a source that calls appendFrames calls it after its last frames.
+        /// </summary>
+        void endCapture() {
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_nMessageID = AM_DATAEND;
+            }
+            m_cv.notify_all();
         }
 
     };
@@ -1,7 +1,24 @@
 #pragma once
 #include "CiAudio.hpp"
 #include "CiCLaDft.hpp"
+#include "CiDftPlanCache.hpp"
+#include "CiFilterbank.hpp"
+#include "CiBoundedQueue.hpp"
+#include "CiFrame.hpp"
+#include "CiFramePool.hpp"
+#include "CiSink.hpp"
+#include "CiConsoleSink.hpp"
+#include "CiCsvSink.hpp"
+#include "CiSpectrogramFile.hpp"
+#include "CiCompressedSpectrogram.hpp"
+#include "CiTrigger.hpp"
+#include "CiLevelStatistics.hpp"
+#include "CiBatchScheduler.hpp"
 #include <string>
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <memory>
 #include <Windows.h>
 #include <iomanip>
 #include <direct.h>
@@ -45,58 +62,6 @@ namespace vi {
         return number;
     }
 
-    void clearConsole() {
-        // Get the console handle
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        if (hConsole == INVALID_HANDLE_VALUE) {
-            throw std::runtime_error("Failed to get console handle");
-        }
-
-        // Get the size of the console window
-        CONSOLE_SCREEN_BUFFER_INFO csbi;
-        if (!GetConsoleScreenBufferInfo(hConsole, &csbi)) {
-            throw std::runtime_error("Failed to get console buffer info");
-        }
-        DWORD consoleSize = csbi.dwSize.X * csbi.dwSize.Y;
-
-        // Fill the entire screen with blanks
-        DWORD charsWritten;
-        if (!FillConsoleOutputCharacter(hConsole, (TCHAR)' ', consoleSize, { 0, 0 }, &charsWritten)) {
-            throw std::runtime_error("Failed to fill console output character");
-        }
-
-        // Get the current text attribute
-        if (!GetConsoleScreenBufferInfo(hConsole, &csbi)) {
-            throw std::runtime_error("Failed to get console buffer info");
-        }
-
-        // Set the buffer's attributes accordingly
-        if (!FillConsoleOutputAttribute(hConsole, csbi.wAttributes, consoleSize, { 0, 0 }, &charsWritten)) {
-            throw std::runtime_error("Failed to fill console output attribute");
-        }
-
-        // Put the cursor at (0, 0)
-        if (!SetConsoleCursorPosition(hConsole, { 0, 0 })) {
-            throw std::runtime_error("Failed to set console cursor position");
-        }
-    }
-
-    void setCursorPosition(int x, int y) {
-        // Get the console handle
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        if (hConsole == INVALID_HANDLE_VALUE) {
-            throw std::runtime_error("Failed to get console handle");
-        }
-
-        // Set the cursor position
-        COORD coord;
-        coord.X = x;
-        coord.Y = y;
-        if (!SetConsoleCursorPosition(hConsole, coord)) {
-            throw std::runtime_error("Failed to set console cursor position");
-        }
-    }
-
     template <typename T>
     class CiAudioDft : public CiAudio<T> {
 
@@ -104,22 +69,61 @@ namespace vi {
 
         int m_nIndexMinF;
         int m_nIndexMaxF;
-        CiCLaDft m_oDft;
+        CiDftPlan m_pDft;
+        int m_nTransferMode;
         double m_dbTimeStep;
         float m_fpFrequencyStep;
         std::string m_sFolderPath;
         std::string m_sFolderName;
         float m_fpRecordThreshold;
         int m_nDoFor;
+        int m_nHistoryFrames;
+        CiFilterbank m_oFilterbank;
+        bool m_bUseFilterbank;
+
+        // Queue between the deinterleave and transform stages
+        size_t m_sizeQueueCapacity;
+        CiBoundedQueue<CiFrameHandle> m_blockQueue;
+
+        // Recycled frames of the samples and of the outputs, created by processAudioData
+        std::unique_ptr<CiFramePool> m_pBlockPool;
+        std::unique_ptr<CiFramePool> m_pOutputPool;
+        std::exception_ptr m_pStageError;
+
+        // Output sinks, each running on its own I/O thread; the sinks added by getReady for the TO_... output modes are marked as fixed
+        std::vector<std::unique_ptr<CiAsyncSink>> m_sinks;
+        std::vector<bool> m_sinkFixed;
+
+        // True while a sink needs the audio samples of the frames
+        bool m_bAttachSource;
+        std::mutex m_errorMutex;
+
+        // Shared scheduler that batches the frames of many streams on one device, or nullptr
+        std::shared_ptr<CiBatchScheduler> m_pScheduler;
+        int m_nSchedulerPriority;
+
+        // Real-time settings of the deinterleave, transform and sink threads, and what the stage threads got of them
+        CiThreadConfig m_threadConfigs[4];
+        CiThreadReport m_threadReports[4];
 
     public:
 
+        static constexpr int THREAD_CAPTURE = 0;        // The thread that runs readAudioData
+        static constexpr int THREAD_DEINTERLEAVE = 1;
+        static constexpr int THREAD_TRANSFORM = 2;
+        static constexpr int THREAD_SINK = 3;           // The I/O threads of all sinks
+
         const int TO_CONSOLE_A = 0;
         const int TO_CSV_A = 10;
+        const int TO_SINKS = 20;
+        const int TO_BIN_A = 30;
+        const int TO_CSV_LONG_A = 40;
+        const int TO_BINZ_A = 50;
 
         // Constructor to initialize class variables
-        CiAudioDft() : m_nIndexMinF(0), m_nIndexMaxF(0), m_dbTimeStep(0.0), m_fpFrequencyStep(0.0f), m_nDoFor(0),
-            m_sFolderPath(""), m_sFolderName(""), m_fpRecordThreshold(0.0000005f) {}
+        CiAudioDft() : m_nIndexMinF(0), m_nIndexMaxF(0), m_nTransferMode(CiCLaDft::TRANSFER_F32), m_dbTimeStep(0.0), m_fpFrequencyStep(0.0f),
+            m_sFolderPath(""), m_sFolderName(""), m_fpRecordThreshold(0.0000005f), m_nDoFor(0), m_nHistoryFrames(0), m_bUseFilterbank(false),
+            m_sizeQueueCapacity(8), m_bAttachSource(false), m_nSchedulerPriority(CiBatchScheduler::PRIORITY_LIVE) {}
 
         // Setter for m_nIndexMinF and m_nIndexMaxF
         void setIndexRangeF(const int nIndexMinF, const int nIndexMaxF) {
@@ -148,241 +152,285 @@ namespace vi {
         // Getter for m_sFolderName
         std::string getFolderName() const { return m_sFolderName; }
 
-        void getReady(const int nDoFor) {
+        // Setter for the host-device transfer mode (CiCLaDft::TRANSFER_F32 or TRANSFER_F16), call before getReady
+        void setTransferMode(const int nTransferMode) { m_nTransferMode = nTransferMode; }
 
-            m_nDoFor = nDoFor;
+        // Getter for the host-device transfer mode
+        int getTransferMode() const { return m_nTransferMode; }
 
-            if (this->m_dwSamplesPerSec < 1) {
-                throw std::runtime_error("Sample rate of the audio endpoint < 1.");
-            }
-
-            cl_int err{ 0 };
+        // Setter for the number of frames per channel kept in the device-side spectrogram history, call before getReady
+        void setHistoryFrames(const int nHistoryFrames) { m_nHistoryFrames = nHistoryFrames; }
 
-            err = m_oDft.setOpenCL();
-            if (err != CL_SUCCESS) throw OpenCLException(err, "Failed to initialize OpenCL resources.");
+        // Getter for the number of frames per channel kept in the device-side spectrogram history
+        int getHistoryFrames() const { return m_nHistoryFrames; }
 
-            err = m_oDft.createOpenCLKernel(static_cast<int>(this->m_sizeBatch), m_oDft.P1SN);
-            if (err != CL_SUCCESS) throw OpenCLException(err, "Failed to create an OpenCL kernel.");
+        // Setter for the filterbank, the output then holds band energies instead of power spectrum bins; call before getReady
+        void setFilterbank(const CiFilterbank& oFilterbank) {
+            m_oFilterbank = oFilterbank;
+            m_bUseFilterbank = true;
+        }
 
-            m_dbTimeStep = this->m_sizeBatch / static_cast<double>(this->m_dwSamplesPerSec);
-            m_fpFrequencyStep = static_cast<float>(this->m_dwSamplesPerSec) / this->m_sizeBatch;
+        // Method to switch back to power spectrum bins output
+        void clearFilterbank() { m_bUseFilterbank = false; }
 
-            if (m_nDoFor == TO_CSV_A)
-            {
-                createDataFolder();
-            }
+        // Getter for the filterbank
+        const CiFilterbank& getFilterbank() const { return m_oFilterbank; }
 
+        // Setter for a batch scheduler shared with other streams; the power spectra are then computed in its batches
+        // instead of frame by frame. Not used with a filterbank or the spectrogram history; call before getReady.
+        void setScheduler(std::shared_ptr<CiBatchScheduler> pScheduler, const int nPriority = CiBatchScheduler::PRIORITY_LIVE) {
+            m_pScheduler = pScheduler;
+            m_nSchedulerPriority = nPriority;
         }
 
-        void processAudioData() {
+        // Getter for the batch scheduler
+        std::shared_ptr<CiBatchScheduler> getScheduler() const { return m_pScheduler; }
 
-            int nOnesideSize = m_oDft.getOnesideSize();
+        // Method to add an output sink; every frame is handed to all added sinks, each writes on its own I/O thread.
+        // nOverflow (CiAsyncSink::DROP_NEWEST, BLOCK or DROP_OLDEST) decides what a full sink queue does with a new frame.
+        void addSink(std::shared_ptr<CiSink> pSink, const size_t sizeCapacity = 64, const int nOverflow = CiAsyncSink::DROP_NEWEST) {
+            m_sinks.emplace_back(new CiAsyncSink(pSink, sizeCapacity, nOverflow));
+            m_sinkFixed.push_back(false);
+        }
 
-            // Output frequency index check
-            if (m_nIndexMaxF > nOnesideSize) m_nIndexMaxF = nOnesideSize;
-            if (m_nIndexMinF > m_nIndexMaxF) m_nIndexMinF = m_nIndexMaxF;
+        // Method to remove all output sinks
+        void clearSinks() {
+            m_sinks.clear();
+            m_sinkFixed.clear();
+        }
 
-            if (this->m_nNumberOfChannels == 2)
-            {
-                std::vector<float> onesidePowerA(nOnesideSize);
-                std::vector<float> onesidePowerB(nOnesideSize);
+        // Getter for the number of output sinks
+        size_t getSinkCount() const { return m_sinks.size(); }
 
-                if (m_nDoFor == TO_CSV_A) savePowerAsCSV_A(onesidePowerA, onesidePowerB);
-                if (m_nDoFor == TO_CONSOLE_A) showPowerOnConsole_A(onesidePowerA, onesidePowerB);
-            }
+        // Getter for the number of frames written by a sink
+        size_t getSinkWrittenFrames(const size_t sizeSink) const { return m_sinks.at(sizeSink)->getWrittenFrames(); }
 
+        // Getter for the number of frames a sink dropped because its queue was full
+        size_t getSinkDroppedFrames(const size_t sizeSink) const { return m_sinks.at(sizeSink)->getDroppedFrames(); }
 
-            if (this->m_nNumberOfChannels == 1)
-            {
-                std::vector<float> onesidePowerA(nOnesideSize);
+        // Setter for the number of frames the queue between the deinterleave and transform stages holds, call before processAudioData
+        void setQueueCapacity(const size_t sizeQueueCapacity) { m_sizeQueueCapacity = sizeQueueCapacity; }
 
-                if (m_nDoFor == TO_CSV_A) savePowerAsCSV_ACH1(onesidePowerA);
-                if (m_nDoFor == TO_CONSOLE_A) showPowerOnConsole_ACH1(onesidePowerA);
-            }
+        // Getter for the number of frames the queue between the deinterleave and transform stages holds
+        size_t getQueueCapacity() const { return m_sizeQueueCapacity; }
 
-            m_oDft.releaseOpenCLResources();
+        // Setter for the real-time settings (priority, cores, memory locking) of a pipeline thread, THREAD_CAPTURE ... THREAD_SINK.
+        // Call before the capture starts; the settings are applied when a thread starts its stage and reverted when it ends.
+        void setThreadConfig(const int nThread, const CiThreadConfig& config) {
+            if (nThread < THREAD_CAPTURE || nThread > THREAD_SINK) {
+                throw std::invalid_argument("Unknown pipeline thread.");
+            }
+            if (nThread == THREAD_CAPTURE) this->setCaptureThreadConfig(config);
+            else m_threadConfigs[nThread] = config;
         }
 
-        void showPowerOnConsole_A(std::vector<float>& onesidePowerA, std::vector<float>& onesidePowerB) {
-            size_t i = 1;
-            do
+        // Getter for what the pipeline threads got of their real-time settings at the last run:
+        // the capture, deinterleave and transform threads, then the I/O thread of every sink
+        std::vector<CiThreadReport> getThreadReports() {
+            std::vector<CiThreadReport> reports{ this->getCaptureThreadReport() };
             {
-                // Get the read audio data
-                std::tuple<std::vector<float>, std::vector<float>>
-                    audioData = this->moveFirstSample();
-
-                if (this->m_sizeBatch > std::get<0>(audioData).size()) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                    continue;
-                }
-
-                cl_int err = m_oDft.executeOpenCLKernel(std::get<0>(audioData).data(), onesidePowerA.data());
-                if (err != CL_SUCCESS) throw OpenCLException(err, "Failed to execute an OpenCL kernel for A.");
-
-                err = m_oDft.executeOpenCLKernel(std::get<1>(audioData).data(), onesidePowerB.data());
-                if (err != CL_SUCCESS) throw OpenCLException(err, "Failed to execute an OpenCL kernel for B.");
+                std::lock_guard<std::mutex> lock(m_errorMutex);
+                reports.push_back(m_threadReports[THREAD_DEINTERLEAVE]);
+                reports.push_back(m_threadReports[THREAD_TRANSFORM]);
+            }
+            for (auto& pSink : m_sinks) reports.push_back(pSink->getThreadReport());
+            return reports;
+        }
 
-                // Move the cursor to the beginning of the console
-                setCursorPosition(0, 0);
-                printf("\n  Normalized One-Sided Power Spectrum after ");
-                printf(" %10.6f seconds (frames left: %6d)\n", i * m_dbTimeStep, static_cast<int>(this->getAudioDataSize()));
-                printf("----------------------------------------------\n");
-                printf(" Frequency | Index  |   Power A  |   Power B\n");
-                printf("----------------------------------------------\n");
+        // Getter for the DFT plan of the session, empty before getReady
+        const CiDftPlan& getDftPlan() const { return m_pDft; }
 
-                for (int j = m_nIndexMinF; j <= m_nIndexMaxF; ++j) {
-                    float freq = j * m_fpFrequencyStep;
-                    printf("%10.2f | %6d | %10.6f | %10.6f\n", freq, j, onesidePowerA.data()[j], onesidePowerB.data()[j]);
-                }
+        // Getter for the number of values of one output frame (bands or bins)
+        int getOutputSize() const {
+            if (!m_pDft) return 0;
+            return m_bUseFilterbank ? m_pDft->getBandCount() : m_pDft->getOnesideSize();
+        }
 
-                ++i;
+        // Getter for the first output index written to the sinks
+        int getOutputIndexMin() const { return m_bUseFilterbank ? 0 : m_nIndexMinF; }
 
-            } while (this->m_nMessageID == this->AM_DATASTART || this->getAudioDataSize() >= this->m_sizeBatch);
+        // Getter for the last output index written to the sinks
+        int getOutputIndexMax() const {
+            int nLast = getOutputSize() - 1;
+            if (m_bUseFilterbank) return nLast;
+            return (m_nIndexMaxF < nLast) ? m_nIndexMaxF : nLast;
         }
 
+        // Getter for the frequency of an output index: the bin frequency or the band centre frequency
+        float getOutputFrequency(const int j) const {
+            return m_bUseFilterbank ? m_oFilterbank.getCentreFrequencies()[j] : j * m_fpFrequencyStep;
+        }
 
-        void showPowerOnConsole_ACH1(std::vector<float>& onesidePowerA) {
-            size_t i = 1;
-            do
-            {
-                // Get the read audio data
-                std::tuple<std::vector<float>>
-                    audioData = static_cast<std::tuple<std::vector<float>>> (this->moveFirstSampleCH1());
+        // Method to transform one frame of samples into the output values (power spectrum or band energies)
+        void transformFrame(const float* pSamples, float* pOutput) {
+            if (m_bUseFilterbank) m_pDft->executeOpenCLFilterbank(pSamples, pOutput);
+            else m_pDft->executeOpenCLKernel(pSamples, pOutput);
+        }
 
-                if (this->m_sizeBatch > std::get<0>(audioData).size()) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                    continue;
-                }
+        // Method to transform one frame of samples into a vector of getOutputSize() values
+        void transformFrame(const float* pSamples, std::vector<float>& output) { transformFrame(pSamples, output.data()); }
 
-                cl_int err = m_oDft.executeOpenCLKernel(std::get<0>(audioData).data(), onesidePowerA.data());
-                if (err != CL_SUCCESS) throw OpenCLException(err, "Failed to execute an OpenCL kernel for A.");
+        // Method to read the last nFrames spectra of each channel from the device-side history, the oldest frame first.
+        // Every returned vector holds (number of frames read) * (one-sided size) values.
+        std::vector<std::vector<float>> getSpectrogramHistory(const int nFrames) {
+            int nChannels = this->m_nNumberOfChannels;
+            if (!m_pDft) throw std::runtime_error("The transform is not ready.");
 
-                // Move the cursor to the beginning of the console
-                setCursorPosition(0, 0);
-                printf("\n  Normalized One-Sided Power Spectrum after ");
-                printf(" %10.6f seconds (frames left: %6d)\n", i * m_dbTimeStep, static_cast<int>(this->getAudioDataSize()));
-                printf("----------------------------------------------\n");
-                printf(" Frequency | Index  |   Power A  |   Power B\n");
-                printf("----------------------------------------------\n");
+            int nOnesideSize = m_pDft->getOnesideSize();
 
+            // The channels are transformed one after another, so the history interleaves them frame by frame.
+            std::vector<float> interleaved(static_cast<size_t>(nFrames) * nChannels * nOnesideSize);
+            int nRead = m_pDft->readHistory(nFrames * nChannels, interleaved.data(), nChannels) / nChannels;
 
-                //std::vector<float>& data = std::get<0>(audioData);
-                for (int j = m_nIndexMinF; j <= m_nIndexMaxF; ++j) {
-                    float freq = j * m_fpFrequencyStep;
-                    printf("%10.2f | %6d | %10.6f\n", freq, j, onesidePowerA.data()[j]);
-                    //printf("%10.2f | %6d | %10.6f\n", freq, j, data[j]);
+            std::vector<std::vector<float>> history(nChannels, std::vector<float>(static_cast<size_t>(nRead) * nOnesideSize));
+            for (int k = 0; k < nRead; ++k) {
+                for (int c = 0; c < nChannels; ++c) {
+                    std::copy_n(interleaved.begin() + (static_cast<size_t>(k) * nChannels + c) * nOnesideSize, nOnesideSize,
+                        history[c].begin() + static_cast<size_t>(k) * nOnesideSize);
                 }
+            }
 
-                ++i;
-
-            } while (this->m_nMessageID == this->AM_DATASTART || this->getAudioDataSize() >= this->m_sizeBatch);
+            return history;
         }
 
+        void getReady(const int nDoFor) {
 
+            m_nDoFor = nDoFor;
 
-        void savePowerAsCSV_ACH1(std::vector<float>& onesidePowerA) {
-
-            size_t i = 1;
-            double dbFrequencyStep = static_cast<double>(m_fpFrequencyStep);
-
-            do
-            {
-                // Get the read audio data
-                std::tuple<std::vector<float>>
-                    audioData = static_cast<std::tuple<std::vector<float>>> (this->moveFirstSampleCH1());
-
-                if (this->m_sizeBatch > std::get<0>(audioData).size()) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                    continue;
-                }
+            if (this->m_dwSamplesPerSec < 1) {
+                throw std::runtime_error("Sample rate of the audio endpoint < 1.");
+            }
 
-                cl_int err = m_oDft.executeOpenCLKernel(std::get<0>(audioData).data(), onesidePowerA.data());
-                if (err != CL_SUCCESS) throw OpenCLException(err, "Failed to execute an OpenCL kernel for A.");
+            cl_int err{ 0 };
 
+            // Restart the capture messages, a previous session leaves AM_DATAEND behind
+            this->m_nMessageID = this->AM_STARTED;
 
-                // Create a file with a name that always consists of 10 symbols consisting of "dbTime = i * m_dbTimeStep" expressed in whole microseconds
-                double dbTime = i * m_dbTimeStep;
-                std::ostringstream oss;
-                oss << std::setw(10) << std::setfill('0') << static_cast<int>(dbTime * 1e6);
-                std::string fileName = m_sFolderPath + "/" + oss.str() + ".csv";
+            // Return the plan of the previous session to the cache before taking a warm one for this session
+            m_pDft.reset();
+            m_pDft = CiDftPlanCache::getInstance().acquirePlan(static_cast<int>(this->m_sizeBatch), CiCLaDft::P1SN,
+                m_nTransferMode, m_nHistoryFrames * this->m_nNumberOfChannels);
 
+            if (m_pScheduler && m_pScheduler->getSampleSize() != static_cast<int>(this->m_sizeBatch)) {
+                throw std::invalid_argument("The batch scheduler is set up for another sample size.");
+            }
 
-                // Write to the CSV file
-                FILE* file;
-                err = fopen_s(&file, fileName.c_str(), "w");
-                if (err == 0) {
-                    fprintf(file, "Frequency,Power A\n");
-                    for (int j = m_nIndexMinF; j <= m_nIndexMaxF; ++j) {
-                        // Skip the record if the power of both channels is less than the threshold value.
-                        if (onesidePowerA.data()[j] < m_fpRecordThreshold) continue;
-                        fprintf(file, "%.2f,%f\n", j * dbFrequencyStep, onesidePowerA.data()[j]);
-                    }
-                    fclose(file);
-                }
-                else {
-                    throw std::runtime_error("Can't open a file " + fileName + ".");
-                }
+            if (m_bUseFilterbank) {
+                m_oFilterbank.design(this->m_dwSamplesPerSec, static_cast<int>(this->m_sizeBatch));
+                err = m_pDft->setFilterbank(m_oFilterbank);
+                if (err != CL_SUCCESS) throw OpenCLException(err, "Failed to set the filterbank.");
+            }
 
-                ++i;
+            m_dbTimeStep = this->m_sizeBatch / static_cast<double>(this->m_dwSamplesPerSec);
+            m_fpFrequencyStep = static_cast<float>(this->m_dwSamplesPerSec) / this->m_sizeBatch;
 
-            } while (this->m_nMessageID == this->AM_DATASTART || this->getAudioDataSize() >= this->m_sizeBatch);
-        }
+            // The fixed outputs are sinks next to the ones added with addSink; the sink of a previous session is replaced
+            for (size_t k = m_sinks.size(); k-- > 0;) {
+                if (!m_sinkFixed[k]) continue;
+                m_sinks.erase(m_sinks.begin() + k);
+                m_sinkFixed.erase(m_sinkFixed.begin() + k);
+            }
 
+            if (m_nDoFor == TO_CSV_A)
+            {
+                createDataFolder();
+                // Every frame is recorded, so the transform waits if the disk falls behind a full queue
+                addSink(std::make_shared<CiCsvSink>(m_sFolderPath, m_fpRecordThreshold), 64, CiAsyncSink::BLOCK);
+                m_sinkFixed.back() = true;
+            }
 
+            if (m_nDoFor == TO_CSV_LONG_A)
+            {
+                createDataFolder();
+                // All frames in one file, every row tagged with the time and index of its frame
+                addSink(std::make_shared<CiCsvSink>(m_sFolderPath, m_fpRecordThreshold, CiCsvSink::LAYOUT_LONG), 64, CiAsyncSink::BLOCK);
+                m_sinkFixed.back() = true;
+            }
 
+            if (m_nDoFor == TO_BIN_A)
+            {
+                createDataFolder();
+                // One spectrogram file with the frames appended in large sequential writes
+                addSink(std::make_shared<CiSpectrogramSink>(m_sFolderPath + "/" + m_sFolderName + ".vspec"), 64, CiAsyncSink::BLOCK);
+                m_sinkFixed.back() = true;
+            }
 
+            if (m_nDoFor == TO_BINZ_A)
+            {
+                createDataFolder();
+                // The frames are compressed on the I/O thread of the sink
+                addSink(std::make_shared<CiCompressedSpectrogramSink>(m_sFolderPath + "/" + m_sFolderName + ".vspz"), 64, CiAsyncSink::BLOCK);
+                m_sinkFixed.back() = true;
+            }
 
+            if (m_nDoFor == TO_CONSOLE_A)
+            {
+                // The console shows the latest frame at a limited refresh rate; the frames in between are skipped
+                addSink(std::make_shared<CiConsoleSink>([this] { return this->getAudioDataSize(); }), 1, CiAsyncSink::DROP_OLDEST);
+                m_sinkFixed.back() = true;
+            }
 
-        void savePowerAsCSV_A(std::vector<float>& onesidePowerA, std::vector<float>& onesidePowerB) {
+        }
 
-            size_t i = 1;
+        // Method to run the deinterleave and transform stages and the output sinks on their own threads until the capture has ended.
+        // The capture stage is readAudioData, which the caller runs on a thread of its own.
+        void processAudioData() {
 
-            double dbFrequencyStep = static_cast<double>(m_fpFrequencyStep);
+            int nOnesideSize = m_pDft->getOnesideSize();
 
-            do
-            {
-                // Get the read audio data
-                std::tuple<std::vector<float>, std::vector<float>>
-                    audioData = this->moveFirstSample();
-
-                if (this->m_sizeBatch > std::get<0>(audioData).size()) {
-                    //std::cout << "\nWrong Batch at " << i << ": " << std::get<0>(audioData).size() << "\n";
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                    continue;
-                }
+            // Output frequency index check
+            if (m_nIndexMaxF > nOnesideSize) m_nIndexMaxF = nOnesideSize;
+            if (m_nIndexMinF > m_nIndexMaxF) m_nIndexMinF = m_nIndexMaxF;
 
-                cl_int err = m_oDft.executeOpenCLKernel(std::get<0>(audioData).data(), onesidePowerA.data());
-                if (err != CL_SUCCESS) throw OpenCLException(err, "Failed to execute an OpenCL kernel for A.");
+            m_blockQueue.reset();
+            m_blockQueue.setCapacity(m_sizeQueueCapacity);
+            m_pStageError = nullptr;
+
+            CiSinkLayout layout = getSinkLayout();
+            m_bAttachSource = false;
+            size_t sizeSinkFrames = 0;
+            for (auto& pSink : m_sinks) {
+                m_bAttachSource = m_bAttachSource || pSink->getSink()->needsSource();
+                sizeSinkFrames += pSink->getCapacity();
+                pSink->setThreadConfig(m_threadConfigs[THREAD_SINK]);
+                pSink->start(layout);
+            }
 
-                err = m_oDft.executeOpenCLKernel(std::get<1>(audioData).data(), onesidePowerB.data());
-                if (err != CL_SUCCESS) throw OpenCLException(err, "Failed to execute an OpenCL kernel for B.");
+            // Enough frames for every queue to be full while one frame is filled and one is transformed;
+            // the samples stay in use as long as their outputs when the sinks need them
+            m_pOutputPool.reset(new CiFramePool(sizeSinkFrames + 2, this->m_nNumberOfChannels, getOutputSize()));
+            m_pBlockPool.reset(new CiFramePool(m_sizeQueueCapacity + 2 + (m_bAttachSource ? sizeSinkFrames : 0),
+                this->m_nNumberOfChannels, static_cast<int>(this->m_sizeBatch)));
 
-                // Create a file with a name that always consists of 10 symbols consisting of "dbTime = i * m_dbTimeStep" expressed in whole microseconds
-                double dbTime = i * m_dbTimeStep;
-                std::ostringstream oss;
-                oss << std::setw(10) << std::setfill('0') << static_cast<int>(dbTime * 1e6);
-                std::string fileName = m_sFolderPath + "/" + oss.str() + ".csv";
+            // Every stage hands its frames to the next one through a bounded queue and waits
+            // for its input instead of polling, so a frame is processed as soon as it is ready.
+            std::thread tDeinterleave(&CiAudioDft::runDeinterleaveStage, this);
+            std::thread tTransform(&CiAudioDft::runTransformStage, this);
 
+            tDeinterleave.join();
+            tTransform.join();
 
-                // Write to the CSV file
-                FILE* file;
-                err = fopen_s(&file, fileName.c_str(), "w");
-                if (err == 0) {
-                    fprintf(file, "Frequency,Power A,Power B\n");
-                    for (int j = m_nIndexMinF; j <= m_nIndexMaxF; ++j) {
-                        // Skip the record if the power of both channels is less than the threshold value.
-                        if (onesidePowerA.data()[j] < m_fpRecordThreshold && onesidePowerB.data()[j] < m_fpRecordThreshold) continue;
-                        fprintf(file, "%.2f,%f,%f\n", j * dbFrequencyStep, onesidePowerA.data()[j], onesidePowerB.data()[j]);
-                    }
-                    fclose(file);
-                }
-                else {
-                    throw std::runtime_error("Can't open a file " + fileName + ".");
-                }
+            // Let the sinks write their queued frames
+            for (auto& pSink : m_sinks) pSink->stop();
 
-                ++i;
+            if (m_pStageError) std::rethrow_exception(m_pStageError);
+            for (auto& pSink : m_sinks) {
+                if (pSink->getError()) std::rethrow_exception(pSink->getError());
+            }
+        }
 
-            } while (this->m_nMessageID == this->AM_DATASTART || this->getAudioDataSize() >= this->m_sizeBatch);
+        // Method to describe the output frames for the sinks
+        CiSinkLayout getSinkLayout() const {
+            CiSinkLayout layout;
+            layout.nChannels = this->m_nNumberOfChannels;
+            layout.nSampleSize = static_cast<int>(this->m_sizeBatch);
+            layout.dwSamplesPerSec = this->m_dwSamplesPerSec;
+            layout.dbTimeStep = m_dbTimeStep;
+            layout.nIndexMin = getOutputIndexMin();
+            layout.nIndexMax = getOutputIndexMax();
+            layout.bBands = m_bUseFilterbank;
+            for (int j = 0; j < getOutputSize(); ++j) layout.frequencies.push_back(getOutputFrequency(j));
+            return layout;
         }
 
         // Method to create a new data folder
@@ -445,6 +493,115 @@ namespace vi {
             }
         }
 
+    private:
+
+        // Deinterleave stage: waits for each batch of captured frames and splits it into one block per channel
+        void runDeinterleaveStage() {
+            CI_TRACE_THREAD_NAME("deinterleave");
+            try {
+                CiRealtimeThread realtime("deinterleave", m_threadConfigs[THREAD_DEINTERLEAVE]);
+                setThreadReport(THREAD_DEINTERLEAVE, realtime.getReport());
+                size_t i = 1;
+                StageMetrics& metrics = getStageMetrics();
+                while (true) {
+                    CiFrameHandle pBlock = m_pBlockPool->acquire();
+                    if (!this->waitMoveFirstSample(*pBlock)) break;
+                    pBlock->setIndex(i);
+                    pBlock->setTime(i * m_dbTimeStep);
+                    ++i;
+                    // A full queue holds the block back until the transform stage catches up
+                    if (m_blockQueue.size() >= m_blockQueue.getCapacity()) metrics.delayedBlocks.add();
+                    if (!m_blockQueue.push(std::move(pBlock))) break;
+                    metrics.queueBlocks.set(static_cast<int64_t>(m_blockQueue.size()));
+                }
+            }
+            catch (...) {
+                setStageError(std::current_exception());
+            }
+            m_blockQueue.close();
+        }
+
+        // Method to check whether the frames are transformed by the batch scheduler
+        bool isScheduled() const { return m_pScheduler && !m_bUseFilterbank && m_nHistoryFrames == 0; }
+
+        // Transform stage: computes the output of every channel of a block and hands the frame to all sinks
+        void runTransformStage() {
+            CI_TRACE_THREAD_NAME("transform");
+            try {
+                CiRealtimeThread realtime("transform", m_threadConfigs[THREAD_TRANSFORM]);
+                setThreadReport(THREAD_TRANSFORM, realtime.getReport());
+                // All frames of the stage run on one lane of the plan, which goes back to the plan with the end of the stage
+                std::unique_ptr<CiCLaDft::LaneScope> pLane;
+                if (!isScheduled()) pLane.reset(new CiCLaDft::LaneScope(*m_pDft));
+                int nOutputSize = getOutputSize();
+                CiFrameHandle pBlock;
+                StageMetrics& metrics = getStageMetrics();
+                while (m_blockQueue.pop(pBlock)) {
+                    metrics.queueBlocks.set(static_cast<int64_t>(m_blockQueue.size()));
+                    CI_TRACE_SCOPE_INDEX("transform", pBlock->getIndex());
+                    auto tpBegin = std::chrono::steady_clock::now();
+                    CiFrameHandle pSpectrum = m_pOutputPool->acquire();
+                    pSpectrum->resize(pBlock->getChannelCount(), nOutputSize);
+                    pSpectrum->setIndex(pBlock->getIndex());
+                    pSpectrum->setTime(pBlock->getTime());
+                    if (isScheduled()) {
+                        // All channels of the block go into the same batch
+                        m_pScheduler->transform(pBlock->getChannel(0), pSpectrum->getChannel(0), pBlock->getChannelCount(), m_nSchedulerPriority);
+                    }
+                    else {
+                        for (int c = 0; c < pBlock->getChannelCount(); ++c) transformFrame(pBlock->getChannel(c), pSpectrum->getChannel(c));
+                    }
+                    // The sinks get the samples without a copy; otherwise the block returns to its pool
+                    if (m_bAttachSource) pSpectrum->setSource(pBlock);
+                    pBlock.reset();
+
+                    metrics.transformSeconds.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - tpBegin).count());
+                    metrics.frames.add();
+
+                    std::shared_ptr<const CiFrame> pFrame = pSpectrum;
+                    for (auto& pSink : m_sinks) pSink->push(pFrame);
+                }
+            }
+            catch (...) {
+                setStageError(std::current_exception());
+            }
+        }
+
+        // Telemetry of the processing stages, shared by all instances of the process
+        struct StageMetrics {
+            CiGauge& queueBlocks;
+            CiCounter& delayedBlocks;
+            CiHistogram& transformSeconds;
+            CiCounter& frames;
+        };
+
+        // Method to register the metrics of the processing stages
+        static StageMetrics& getStageMetrics() {
+            CiTelemetry& telemetry = CiTelemetry::getInstance();
+            static StageMetrics metrics{
+                telemetry.getGauge("vslib_block_queue_blocks", "Blocks waiting between the deinterleave and transform stages."),
+                telemetry.getCounter("vslib_block_queue_delayed_total", "Blocks that waited for room in a full block queue."),
+                telemetry.getHistogram("vslib_transform_seconds", "Time to transform all channels of one block.", CiHistogram::makeExponentialBounds(1e-5, 2.0, 16)),
+                telemetry.getCounter("vslib_frames_processed_total", "Frames transformed and handed to the sinks.")
+            };
+            return metrics;
+        }
+
+        // Method to keep what a stage thread got of its real-time settings
+        void setThreadReport(const int nThread, const CiThreadReport& report) {
+            std::lock_guard<std::mutex> lock(m_errorMutex);
+            m_threadReports[nThread] = report;
+        }
+
+        // Method to keep the first error of a stage and stop the other stages
+        void setStageError(std::exception_ptr pError) {
+            {
+                std::lock_guard<std::mutex> lock(m_errorMutex);
+                if (!m_pStageError) m_pStageError = pError;
+            }
+            m_blockQueue.close();
+        }
+
     };
 
 }
\ No newline at end of file
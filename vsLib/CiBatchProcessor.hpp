@@ -0,0 +1,399 @@
+// This C++ code defines a processor that turns directories of recorded WAV
+// files into spectrograms without any user interaction. The inputs are
+// scanned for WAV files, and a pool of worker threads takes the files one
+// after another. Each worker reads its file block by block, cuts it into
+// windowed frames that advance by the hop size, transforms the frames of
+// many hops with one batched kernel launch and writes them through the
+// same sinks the live capture uses. The counters of done files, frames and
+// audio seconds are reported at a fixed interval, and a failed file is
+// recorded and skipped so one broken recording does not stop the run.
+// Nothing here depends on the audio capture, so the processor also runs
+// on Linux compute nodes.
+
+#pragma once
+#include "CiDftPlanCache.hpp"
+#include "CiWavReader.hpp"
+#include "CiSink.hpp"
+#include "CiCsvSink.hpp"
+#include "CiSpectrogramFile.hpp"
+#include "CiCompressedSpectrogram.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Settings of a batch run.
+    /// </summary>
+    struct CiBatchConfig {
+
+        static constexpr int WINDOW_RECTANGULAR = 0;
+        static constexpr int WINDOW_HANN = 1;
+        static constexpr int WINDOW_HAMMING = 2;
+        static constexpr int WINDOW_BLACKMAN = 3;
+
+        static constexpr int FORMAT_VSPEC = 0;      // One spectrogram file per input
+        static constexpr int FORMAT_VSPZ = 1;       // One compressed spectrogram file per input
+        static constexpr int FORMAT_CSV = 2;        // One folder of long-layout CSV files per input
+
+        int nSampleSize;            // Sample (FFT) size
+        int nHop;                   // Samples between the starts of two frames, 0 for the sample size
+        int nWindow;                // Window function, WINDOW_*
+        int nIndexMin;              // First bin to write
+        int nIndexMax;              // Last bin to write, -1 for the last bin of the spectrum
+        int nFormat;                // Output format, FORMAT_*
+        std::string sOutputFolder;  // Folder for the outputs, created if it does not exist
+        int nWorkers;               // Number of worker threads, 0 for one per hardware thread
+        int nBatchHops;             // Hops transformed with one kernel launch
+        int nDeviceIndex;           // Index of the GPU device
+        float fpRecordThreshold;    // CSV rows where all values are below this threshold are skipped
+
+        CiBatchConfig() : nSampleSize(1024), nHop(0), nWindow(WINDOW_HANN), nIndexMin(0), nIndexMax(-1), nFormat(FORMAT_VSPEC),
+            sOutputFolder("batch"), nWorkers(0), nBatchHops(32), nDeviceIndex(0), fpRecordThreshold(0.0f) {}
+
+        /// <summary>
+        /// Get the name of a window function as it is stored in the spectrogram header.
+        /// </summary>
+        static const char* getWindowName(const int nWindow) {
+            switch (nWindow) {
+            case WINDOW_HANN: return "hann";
+            case WINDOW_HAMMING: return "hamming";
+            case WINDOW_BLACKMAN: return "blackman";
+            default: return "rectangular";
+            }
+        }
+    };
+
+    /// <summary>
+    /// Class for transforming WAV files to spectrograms on a pool of worker threads.
+    /// </summary>
+    class CiBatchProcessor {
+    public:
+
+        /// <summary>
+        /// Counters of a run.
+        /// </summary>
+        struct Progress {
+            size_t sizeFilesTotal;      // Files of the run
+            size_t sizeFilesDone;       // Files finished, including the failed ones
+            size_t sizeFilesFailed;     // Files that failed
+            size_t sizeFrames;          // Frames transformed, all channels of a hop count as one frame
+            double dbAudioSeconds;      // Duration of the audio transformed (s)
+            double dbElapsed;           // Time since the start of the run (s)
+        };
+
+        /// <summary>
+        /// A file that could not be processed.
+        /// </summary>
+        struct Failure {
+            std::string sFileName;
+            std::string sError;
+        };
+
+        /// <summary>
+        /// Constructor for CiBatchProcessor.
+        /// </summary>
+        /// <param name="config">Settings of the run.</param>
+        explicit CiBatchProcessor(const CiBatchConfig& config)
+            : m_config(config), m_dbProgressInterval(1.0), m_sizeNext(0), m_sizeFilesDone(0), m_sizeFrames(0), m_nAudioMicroseconds(0) {
+            if (m_config.nSampleSize < 2) {
+                throw std::invalid_argument("The sample size must be at least 2.");
+            }
+            if (m_config.nHop == 0) m_config.nHop = m_config.nSampleSize;
+            if (m_config.nHop < 1) {
+                throw std::invalid_argument("The hop must be at least 1 sample.");
+            }
+            if (m_config.nWindow < CiBatchConfig::WINDOW_RECTANGULAR || m_config.nWindow > CiBatchConfig::WINDOW_BLACKMAN) {
+                throw std::invalid_argument("Unknown window function.");
+            }
+            if (m_config.nFormat < CiBatchConfig::FORMAT_VSPEC || m_config.nFormat > CiBatchConfig::FORMAT_CSV) {
+                throw std::invalid_argument("Unknown output format.");
+            }
+            if (m_config.nWorkers < 1) m_config.nWorkers = (std::max)(1, static_cast<int>(std::thread::hardware_concurrency()));
+            if (m_config.nBatchHops < 1) m_config.nBatchHops = 1;
+        }
+
+        /// <summary>
+        /// Add a WAV file, or a folder whose WAV files are all added, including the ones in subfolders.
+        /// The outputs of a folder keep its subfolder structure in the output folder.
+        /// </summary>
+        /// <param name="sPath">Path of the file or folder.</param>
+        void addInput(const std::string& sPath) {
+            namespace fs = std::filesystem;
+            fs::path path(sPath);
+
+            if (fs::is_directory(path)) {
+                std::vector<Input> inputs;
+                for (const auto& entry : fs::recursive_directory_iterator(path)) {
+                    if (entry.is_regular_file() && isWavFile(entry.path())) {
+                        inputs.push_back({ entry.path(), fs::relative(entry.path(), path) });
+                    }
+                }
+                // The directory order is not defined, the files are taken in name order
+                std::sort(inputs.begin(), inputs.end(), [](const Input& a, const Input& b) { return a.path < b.path; });
+                m_inputs.insert(m_inputs.end(), inputs.begin(), inputs.end());
+            }
+            else if (fs::is_regular_file(path)) {
+                m_inputs.push_back({ path, path.filename() });
+            }
+            else {
+                throw std::invalid_argument("The input " + sPath + " does not exist.");
+            }
+        }
+
+        /// <summary>
+        /// Set the function that receives the counters while the files are processed.
+        /// It is called from the thread of run, at the interval and once at the end.
+        /// </summary>
+        /// <param name="onProgress">Function to call.</param>
+        /// <param name="dbInterval">Time between two calls (s).</param>
+        void setProgressCallback(std::function<void(const Progress&)> onProgress, const double dbInterval = 1.0) {
+            m_onProgress = std::move(onProgress);
+            m_dbProgressInterval = dbInterval;
+        }
+
+        /// <summary>
+        /// Process all added files and wait until they are done.
+        /// </summary>
+        /// <returns>Number of files that failed.</returns>
+        size_t run() {
+            m_sizeNext = 0;
+            m_sizeFilesDone = 0;
+            m_sizeFrames = 0;
+            m_nAudioMicroseconds = 0;
+            m_failures.clear();
+
+            std::filesystem::create_directories(m_config.sOutputFolder);
+            makeWindow();
+
+            // One plan serves all workers; every worker thread gets its own lane of it
+            m_pDft = CiDftPlanCache::getInstance().acquirePlan(m_config.nSampleSize, CiCLaDft::P1SN, CiCLaDft::TRANSFER_F32, 0, m_config.nDeviceIndex);
+
+            m_tpStart = std::chrono::steady_clock::now();
+            int nWorkers = static_cast<int>((std::min)(static_cast<size_t>(m_config.nWorkers), m_inputs.size()));
+            std::vector<std::thread> workers;
+            for (int k = 0; k < nWorkers; ++k) workers.emplace_back(&CiBatchProcessor::work, this);
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_dbProgressInterval));
+                while (!m_cvDone.wait_for(lock, interval, [this] { return m_sizeFilesDone == m_inputs.size(); })) {
+                    lock.unlock();
+                    if (m_onProgress) m_onProgress(getProgress());
+                    lock.lock();
+                }
+            }
+
+            for (auto& worker : workers) worker.join();
+            m_pDft.reset();
+
+            if (m_onProgress) m_onProgress(getProgress());
+            return m_failures.size();
+        }
+
+        // Getter for the number of added files
+        size_t getFileCount() const { return m_inputs.size(); }
+
+        // Getter for the files that failed in the last run
+        const std::vector<Failure>& getFailures() const { return m_failures; }
+
+        // Getter for the settings, with the defaults resolved
+        const CiBatchConfig& getConfig() const { return m_config; }
+
+        // Getter for the counters of the current or last run
+        Progress getProgress() const {
+            Progress progress;
+            progress.sizeFilesTotal = m_inputs.size();
+            progress.sizeFilesDone = m_sizeFilesDone;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                progress.sizeFilesFailed = m_failures.size();
+            }
+            progress.sizeFrames = m_sizeFrames;
+            progress.dbAudioSeconds = m_nAudioMicroseconds * 1e-6;
+            progress.dbElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_tpStart).count();
+            return progress;
+        }
+
+    private:
+
+        // A file to process and the path of its output relative to the output folder
+        struct Input {
+            std::filesystem::path path;
+            std::filesystem::path relative;
+        };
+
+        CiBatchConfig m_config;
+        std::vector<Input> m_inputs;
+        std::vector<float> m_window;
+        CiDftPlan m_pDft;
+
+        std::function<void(const Progress&)> m_onProgress;
+        double m_dbProgressInterval;
+        std::chrono::steady_clock::time_point m_tpStart;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cvDone;
+        std::vector<Failure> m_failures;
+        std::atomic<size_t> m_sizeNext;
+        std::atomic<size_t> m_sizeFilesDone;
+        std::atomic<size_t> m_sizeFrames;
+        std::atomic<int64_t> m_nAudioMicroseconds;
+
+        // Method to check the extension of a file name, in any letter case
+        static bool isWavFile(const std::filesystem::path& path) {
+            std::string sExtension = path.extension().string();
+            std::transform(sExtension.begin(), sExtension.end(), sExtension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            return sExtension == ".wav";
+        }
+
+        // Method to compute the coefficients of the window function
+        void makeWindow() {
+            const double PI = 3.14159265358979323846;
+            int n = m_config.nSampleSize;
+            m_window.assign(n, 1.0f);
+            for (int i = 0; i < n; ++i) {
+                double x = 2.0 * PI * i / n;
+                switch (m_config.nWindow) {
+                case CiBatchConfig::WINDOW_HANN: m_window[i] = static_cast<float>(0.5 - 0.5 * std::cos(x)); break;
+                case CiBatchConfig::WINDOW_HAMMING: m_window[i] = static_cast<float>(0.54 - 0.46 * std::cos(x)); break;
+                case CiBatchConfig::WINDOW_BLACKMAN: m_window[i] = static_cast<float>(0.42 - 0.5 * std::cos(x) + 0.08 * std::cos(2.0 * x)); break;
+                default: break;
+                }
+            }
+        }
+
+        // Method of the worker threads: takes the next file until all are taken
+        void work() {
+            CI_TRACE_THREAD_NAME("batch worker");
+            size_t sizeFile;
+            while ((sizeFile = m_sizeNext++) < m_inputs.size()) {
+                const Input& input = m_inputs[sizeFile];
+                try {
+                    processFile(input);
+                }
+                catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_failures.push_back({ input.path.string(), e.what() });
+                }
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_sizeFilesDone;
+                m_cvDone.notify_one();
+            }
+        }
+
+        // Method to create the sink of a file in the configured format
+        std::unique_ptr<CiSink> createSink(const Input& input) const {
+            namespace fs = std::filesystem;
+            fs::path output = fs::path(m_config.sOutputFolder) / input.relative;
+            fs::create_directories(output.parent_path());
+            std::string sWindow = CiBatchConfig::getWindowName(m_config.nWindow);
+
+            if (m_config.nFormat == CiBatchConfig::FORMAT_VSPZ) {
+                return std::make_unique<CiCompressedSpectrogramSink>(output.replace_extension(".vspz").string(), sWindow);
+            }
+            if (m_config.nFormat == CiBatchConfig::FORMAT_CSV) {
+                output.replace_extension();
+                fs::create_directories(output);
+                return std::make_unique<CiCsvSink>(output.string(), m_config.fpRecordThreshold, CiCsvSink::LAYOUT_LONG);
+            }
+            return std::make_unique<CiSpectrogramSink>(output.replace_extension(".vspec").string(), sWindow);
+        }
+
+        // Method to transform one file: read, window, transform many hops at once and write
+        void processFile(const Input& input) {
+            CiWavReader reader;
+            reader.open(input.path.string());
+
+            const int nChannels = reader.getChannelCount();
+            const int nSize = m_config.nSampleSize;
+            const int nOneside = m_pDft->getOnesideSize();
+            const size_t sizeHop = static_cast<size_t>(m_config.nHop);
+            const double dbRate = static_cast<double>(reader.getSamplesPerSec());
+
+            CiSinkLayout layout;
+            layout.nChannels = nChannels;
+            layout.nSampleSize = nSize;
+            layout.dwSamplesPerSec = reader.getSamplesPerSec();
+            layout.dbTimeStep = sizeHop / dbRate;
+            layout.nIndexMin = (std::min)(m_config.nIndexMin, nOneside - 1);
+            layout.nIndexMax = (m_config.nIndexMax < 0) ? nOneside - 1 : (std::min)(m_config.nIndexMax, nOneside - 1);
+            layout.bBands = false;
+            for (int j = 0; j < nOneside; ++j) layout.frequencies.push_back(static_cast<float>(j * dbRate / nSize));
+            if (layout.nIndexMin > layout.nIndexMax) {
+                throw std::invalid_argument("The bin range is empty.");
+            }
+
+            std::unique_ptr<CiSink> pSink = createSink(input);
+            pSink->open(layout);
+
+            // The samples of every channel that are read but not yet used by a frame
+            std::vector<std::vector<float>> pending(nChannels);
+            size_t sizeStart = 0;           // First pending sample of the next frame
+            size_t sizeIndex = 0;           // Frames written
+            CiFrame block;
+            CiFrame spectrum;
+            std::vector<float> frames(static_cast<size_t>(m_config.nBatchHops) * nChannels * nSize);
+            std::vector<float> output(static_cast<size_t>(m_config.nBatchHops) * nChannels * nOneside);
+            const size_t sizeReadFrames = (std::max)(static_cast<size_t>(nSize), sizeHop) * m_config.nBatchHops;
+
+            while (true) {
+                // Drop the samples no frame needs any more; a hop longer than the frame may skip samples not read yet
+                size_t sizeUsed = (std::min)(sizeStart, pending[0].size());
+                size_t sizeRead = reader.read(block, sizeReadFrames);
+                for (int c = 0; c < nChannels; ++c) {
+                    pending[c].erase(pending[c].begin(), pending[c].begin() + sizeUsed);
+                    pending[c].insert(pending[c].end(), block.getChannel(c), block.getChannel(c) + sizeRead);
+                }
+                sizeStart -= sizeUsed;
+
+                // Cut the pending samples into windowed frames, the channels of a hop one after another
+                while (true) {
+                    int nHops = 0;
+                    while (nHops < m_config.nBatchHops && sizeStart + nSize <= pending[0].size()) {
+                        for (int c = 0; c < nChannels; ++c) {
+                            float* pFrame = frames.data() + (static_cast<size_t>(nHops) * nChannels + c) * nSize;
+                            const float* pSamples = pending[c].data() + sizeStart;
+                            for (int i = 0; i < nSize; ++i) pFrame[i] = pSamples[i] * m_window[i];
+                        }
+                        sizeStart += sizeHop;
+                        ++nHops;
+                    }
+                    if (nHops == 0) break;
+
+                    m_pDft->executeOpenCLBatch(frames.data(), output.data(), nHops * nChannels);
+
+                    for (int k = 0; k < nHops; ++k) {
+                        spectrum.resize(nChannels, nOneside);
+                        std::memcpy(spectrum.getChannel(0), output.data() + static_cast<size_t>(k) * nChannels * nOneside, static_cast<size_t>(nChannels) * nOneside * sizeof(float));
+                        spectrum.setIndex(++sizeIndex);
+                        // The time of the end of the frame
+                        spectrum.setTime(((sizeIndex - 1) * sizeHop + nSize) / dbRate);
+                        pSink->write(spectrum);
+                    }
+                    m_sizeFrames += nHops;
+                }
+
+                if (sizeRead == 0) break;
+                m_nAudioMicroseconds += static_cast<int64_t>(std::llround(sizeRead * 1e6 / dbRate));
+            }
+
+            pSink->close();
+        }
+    };
+
+}
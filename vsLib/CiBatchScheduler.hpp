@@ -0,0 +1,230 @@
+// This C++ code defines a scheduler that lets many streams share one
+// OpenCL device. Each stream hands its frames to the scheduler and waits
+// for the spectra. One dispatcher thread collects the frames of all
+// streams for up to one tick, then transforms them with a single batched
+// kernel launch and hands the results back. The per-frame launch and
+// transfer overhead is paid once per batch, so the aggregate throughput
+// grows with the number of streams. Live streams are taken into a batch
+// before bulk (offline) streams, which only get the room of a batch when no
+// live request is left waiting.
+
+#pragma once
+#include "CiDftPlanCache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Coalesces the frames of many streams into batched transforms on one device.
+    /// </summary>
+    class CiBatchScheduler {
+    public:
+
+        static constexpr int PRIORITY_LIVE = 0;     // Low-latency streams, taken into every batch first
+        static constexpr int PRIORITY_BULK = 1;     // Offline streams, fill the rest of a batch once no live request waits
+
+        /// <summary>
+        /// Constructor for CiBatchScheduler. Creates the transform and starts the dispatcher thread.
+        /// </summary>
+        /// <param name="nSampleSize">Sample size of all streams.</param>
+        /// <param name="nMaxBatchFrames">Largest number of frames of a batch.</param>
+        /// <param name="dbTick">Longest time a frame waits for the batch to fill (s).</param>
+        /// <param name="nDeviceIndex">Index of the GPU device.</param>
+        CiBatchScheduler(const int nSampleSize, const int nMaxBatchFrames = 64, const double dbTick = 0.001, const int nDeviceIndex = 0)
+            : m_nMaxBatchFrames(nMaxBatchFrames), m_tick(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(dbTick))),
+            m_nPendingFrames(0), m_bStop(false), m_sizeBatches(0), m_sizeFrames(0) {
+            if (nMaxBatchFrames < 1) {
+                throw std::invalid_argument("The batch must hold at least one frame.");
+            }
+            m_pDft = CiDftPlanCache::getInstance().acquirePlan(nSampleSize, CiCLaDft::P1SN, CiCLaDft::TRANSFER_F32, 0, nDeviceIndex);
+            m_thread = std::thread(&CiBatchScheduler::run, this);
+        }
+
+        CiBatchScheduler(const CiBatchScheduler&) = delete;
+        CiBatchScheduler& operator=(const CiBatchScheduler&) = delete;
+
+        /// <summary>
+        /// Destructor for CiBatchScheduler. Transforms the pending frames and stops the dispatcher thread.
+        /// </summary>
+        ~CiBatchScheduler() {
+            stop();
+        }
+
+        /// <summary>
+        /// Transform frames of a stream; blocks until their spectra are ready. Called by the threads of the streams.
+        /// The frames of one call are kept together in one batch.
+        /// </summary>
+        /// <param name="pSamples">nFrames frames of getSampleSize() samples one after another.</param>
+        /// <param name="pOutput">Receives nFrames spectra of getOnesideSize() values one after another.</param>
+        /// <param name="nFrames">Number of frames, e.g. the channels of a block; nothing is done for 0.</param>
+        /// <param name="nPriority">PRIORITY_LIVE or PRIORITY_BULK.</param>
+        void transform(const float* pSamples, float* pOutput, const int nFrames, const int nPriority = PRIORITY_LIVE) {
+            if (nPriority != PRIORITY_LIVE && nPriority != PRIORITY_BULK) {
+                throw std::invalid_argument("Unknown scheduler priority.");
+            }
+            if (nFrames < 0) {
+                throw std::invalid_argument("The number of frames must not be negative.");
+            }
+            // A request without frames would never be taken by the dispatcher
+            if (nFrames == 0) return;
+
+            Request request{ pSamples, pOutput, nFrames, std::chrono::steady_clock::now(), false, nullptr };
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (m_bStop) {
+                    throw std::runtime_error("The batch scheduler is stopped.");
+                }
+                m_queues[nPriority].push_back(&request);
+                m_nPendingFrames += nFrames;
+                m_cvWork.notify_one();
+                m_cvDone.wait(lock, [&request] { return request.bDone; });
+            }
+
+            if (request.pError) std::rethrow_exception(request.pError);
+        }
+
+        /// <summary>
+        /// Transform the pending frames and stop the dispatcher thread.
+        /// </summary>
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_bStop = true;
+            }
+            m_cvWork.notify_one();
+            if (m_thread.joinable()) m_thread.join();
+        }
+
+        // Getter for the sample size of the streams
+        int getSampleSize() const { return m_pDft->getSampleSize(); }
+
+        // Getter for the size of a spectrum
+        int getOnesideSize() const { return m_pDft->getOnesideSize(); }
+
+        // Getter for the number of launched batches
+        size_t getBatchCount() const { return m_sizeBatches; }
+
+        // Getter for the number of transformed frames
+        size_t getFrameCount() const { return m_sizeFrames; }
+
+        // Getter for the mean number of frames of a batch
+        double getMeanBatchFrames() const {
+            size_t sizeBatches = m_sizeBatches;
+            return sizeBatches ? static_cast<double>(m_sizeFrames) / sizeBatches : 0.0;
+        }
+
+    private:
+
+        // Frames of one transform call, owned by the waiting stream thread
+        struct Request {
+            const float* pSamples;
+            float* pOutput;
+            int nFrames;
+            std::chrono::steady_clock::time_point tpArrival;
+            bool bDone;
+            std::exception_ptr pError;
+        };
+
+        CiDftPlan m_pDft;
+        int m_nMaxBatchFrames;
+        std::chrono::steady_clock::duration m_tick;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cvWork;
+        std::condition_variable m_cvDone;
+        std::deque<Request*> m_queues[2];   // Pending requests by priority
+        int m_nPendingFrames;
+        bool m_bStop;
+        std::thread m_thread;
+
+        std::vector<float> m_input;
+        std::vector<float> m_output;
+        std::atomic<size_t> m_sizeBatches;
+        std::atomic<size_t> m_sizeFrames;
+
+        // Method of the dispatcher thread
+        void run() {
+            CI_TRACE_THREAD_NAME("batch scheduler");
+            std::unique_lock<std::mutex> lock(m_mutex);
+            std::vector<Request*> batch;
+
+            while (true) {
+                m_cvWork.wait(lock, [this] { return m_bStop || m_nPendingFrames > 0; });
+                if (m_nPendingFrames == 0) break;
+
+                // Wait for more frames until the batch is full or the oldest frame has waited one tick
+                std::chrono::steady_clock::time_point tpOldest = std::chrono::steady_clock::time_point::max();
+                for (const auto& queue : m_queues) {
+                    if (!queue.empty()) tpOldest = (std::min)(tpOldest, queue.front()->tpArrival);
+                }
+                m_cvWork.wait_until(lock, tpOldest + m_tick, [this] { return m_bStop || m_nPendingFrames >= m_nMaxBatchFrames; });
+
+                // The live requests go first, and a bulk request only fills a batch once no live request is left
+                // waiting, so bulk frames never take the room of a live one; a request larger than a batch is launched alone
+                batch.clear();
+                int nFrames = 0;
+                for (auto& queue : m_queues) {
+                    while (!queue.empty() && (batch.empty() || nFrames + queue.front()->nFrames <= m_nMaxBatchFrames)) {
+                        batch.push_back(queue.front());
+                        nFrames += queue.front()->nFrames;
+                        queue.pop_front();
+                    }
+                    if (!queue.empty()) break;
+                }
+                m_nPendingFrames -= nFrames;
+
+                lock.unlock();
+                std::exception_ptr pError = execute(batch, nFrames);
+                lock.lock();
+
+                for (Request* pRequest : batch) {
+                    pRequest->pError = pError;
+                    pRequest->bDone = true;
+                }
+                m_cvDone.notify_all();
+            }
+        }
+
+        // Method to transform the frames of a batch with one launch and copy the spectra back to the requests
+        std::exception_ptr execute(const std::vector<Request*>& batch, const int nFrames) {
+            try {
+                size_t sizeSamples = static_cast<size_t>(m_pDft->getSampleSize());
+                size_t sizeOneside = static_cast<size_t>(m_pDft->getOnesideSize());
+                m_input.resize(nFrames * sizeSamples);
+                m_output.resize(nFrames * sizeOneside);
+
+                size_t sizeFrame = 0;
+                for (const Request* pRequest : batch) {
+                    std::memcpy(m_input.data() + sizeFrame * sizeSamples, pRequest->pSamples, pRequest->nFrames * sizeSamples * sizeof(float));
+                    sizeFrame += pRequest->nFrames;
+                }
+
+                m_pDft->executeOpenCLBatch(m_input.data(), m_output.data(), nFrames);
+
+                sizeFrame = 0;
+                for (const Request* pRequest : batch) {
+                    std::memcpy(pRequest->pOutput, m_output.data() + sizeFrame * sizeOneside, pRequest->nFrames * sizeOneside * sizeof(float));
+                    sizeFrame += pRequest->nFrames;
+                }
+
+                ++m_sizeBatches;
+                m_sizeFrames += nFrames;
+                return nullptr;
+            }
+            catch (...) {
+                return std::current_exception();
+            }
+        }
+    };
+
+}
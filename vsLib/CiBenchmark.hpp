@@ -0,0 +1,331 @@
+// This C++ code defines a benchmark of the transform and of the pipeline
+// around it. It sweeps sample sizes, channel counts, batch depths (hops
+// handed over at once) and backends: the single-frame kernel with FP32 or
+// FP16 transfers, the batched kernel, and the pipeline: the stages of
+// CiAudioDft with a synthetic source that appends the samples as captured
+// packets, so the deinterleave, transform and sink threads are the ones of a
+// capture (Windows only). Every case runs a number of warmup iterations,
+// then timed repetitions. The default sweep is short; the sizes the naive
+// transform takes long for are left to explicit configs. The results hold
+// latency percentiles of one iteration, frames/s, the bytes moved between
+// host and device, and GFLOP/s counted as 2.5 N log2(N) per frame, the
+// usual figure for a real transform of size N, so the numbers stay
+// comparable if the kernel algorithm changes. The results can be written
+// as JSON to track them across releases.
+
+#pragma once
+#include "CiDftPlanCache.hpp"
+#include "CiSink.hpp"
+#ifdef _WIN32
+#include "CiAudioDft.hpp"
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Cases and repetitions of a benchmark run.
+    /// </summary>
+    struct CiBenchConfig {
+
+        static constexpr int BACKEND_KERNEL = 0;        // executeOpenCLKernel per frame, FP32 transfers
+        static constexpr int BACKEND_KERNEL_F16 = 1;    // executeOpenCLKernel per frame, FP16 transfers
+        static constexpr int BACKEND_BATCH = 2;         // executeOpenCLBatch, all frames of an iteration with one launch
+        static constexpr int BACKEND_PIPELINE = 3;      // Deinterleave, transform and sink stages of CiAudioDft (Windows)
+        static constexpr int BACKEND_COUNT = 4;
+
+        std::vector<int> sampleSizes;       // Sample (FFT) sizes
+        std::vector<int> channelCounts;     // Channels per hop
+        std::vector<int> batchDepths;       // Hops per iteration
+        std::vector<int> backends;          // BACKEND_*
+        int nWarmup;                        // Untimed iterations per case
+        int nRepetitions;                   // Timed iterations per case
+        int nDeviceIndex;                   // Index of the GPU device; the pipeline uses the device of CiAudioDft
+
+        // The default sweep stays within seconds; larger sizes and more repetitions are set explicitly
+        CiBenchConfig() : sampleSizes{ 64, 256, 1024, 4096 }, channelCounts{ 1, 2 }, batchDepths{ 1, 8, 32 },
+            backends{ BACKEND_KERNEL, BACKEND_KERNEL_F16, BACKEND_BATCH }, nWarmup(3), nRepetitions(20), nDeviceIndex(0) {
+#ifdef _WIN32
+            // The pipeline runs the stages of CiAudioDft, which are built on the Windows capture classes
+            backends.push_back(BACKEND_PIPELINE);
+#endif
+        }
+
+        /// <summary>
+        /// Get the name of a backend as it is written to the results.
+        /// </summary>
+        static const char* getBackendName(const int nBackend) {
+            switch (nBackend) {
+            case BACKEND_KERNEL: return "kernel";
+            case BACKEND_KERNEL_F16: return "kernel_f16";
+            case BACKEND_BATCH: return "batch";
+            case BACKEND_PIPELINE: return "pipeline";
+            default: return "unknown";
+            }
+        }
+    };
+
+    /// <summary>
+    /// Result of one benchmark case.
+    /// </summary>
+    struct CiBenchResult {
+        int nBackend;
+        int nSampleSize;
+        int nChannels;
+        int nBatchDepth;
+        int nRepetitions;
+        double dbLatencyMean;       // Time of one iteration (s)
+        double dbLatencyP50;
+        double dbLatencyP90;
+        double dbLatencyP99;
+        double dbLatencyMax;
+        double dbFramesPerSec;      // Transformed frames (one channel of one hop) per second
+        double dbGflops;            // 2.5 N log2(N) floating point operations per frame
+        double dbBytesPerFrame;     // Bytes written to and read from the device per frame
+        double dbBytesPerSec;
+    };
+
+    /// <summary>
+    /// Class for running the transform benchmark.
+    /// </summary>
+    class CiBenchmark {
+    public:
+
+        /// <summary>
+        /// Constructor for CiBenchmark.
+        /// </summary>
+        /// <param name="config">Cases and repetitions.</param>
+        explicit CiBenchmark(const CiBenchConfig& config) : m_config(config) {
+            if (m_config.nRepetitions < 1) {
+                throw std::invalid_argument("The benchmark needs at least one repetition.");
+            }
+            for (int nBackend : m_config.backends) {
+                if (nBackend < 0 || nBackend >= CiBenchConfig::BACKEND_COUNT) {
+                    throw std::invalid_argument("Unknown benchmark backend.");
+                }
+#ifndef _WIN32
+                if (nBackend == CiBenchConfig::BACKEND_PIPELINE) {
+                    throw std::invalid_argument("The pipeline backend needs the Windows capture classes.");
+                }
+#endif
+            }
+        }
+
+        /// <summary>
+        /// Run all cases, the backends of a sample size one after another.
+        /// </summary>
+        /// <param name="onResult">Function called with the result of every case as soon as it is done, or nullptr.</param>
+        /// <returns>Results of all cases.</returns>
+        std::vector<CiBenchResult> run(const std::function<void(const CiBenchResult&)>& onResult = nullptr) {
+            std::vector<CiBenchResult> results;
+            for (int nSampleSize : m_config.sampleSizes) {
+                for (int nBackend : m_config.backends) {
+                    for (int nChannels : m_config.channelCounts) {
+                        for (int nBatchDepth : m_config.batchDepths) {
+                            results.push_back(runCase(nBackend, nSampleSize, nChannels, nBatchDepth));
+                            if (onResult) onResult(results.back());
+                        }
+                    }
+                }
+            }
+            return results;
+        }
+
+        /// <summary>
+        /// Run one case.
+        /// </summary>
+        /// <param name="nBackend">BACKEND_*.</param>
+        /// <param name="nSampleSize">Sample (FFT) size.</param>
+        /// <param name="nChannels">Channels per hop.</param>
+        /// <param name="nBatchDepth">Hops per iteration.</param>
+        /// <returns>Result of the case.</returns>
+        CiBenchResult runCase(const int nBackend, const int nSampleSize, const int nChannels, const int nBatchDepth) {
+            if (nChannels < 1 || nBatchDepth < 1) {
+                throw std::invalid_argument("A benchmark case needs at least one channel and one hop.");
+            }
+
+            int nTransfer = (nBackend == CiBenchConfig::BACKEND_KERNEL_F16) ? CiCLaDft::TRANSFER_F16 : CiCLaDft::TRANSFER_F32;
+            const size_t sizeFrames = static_cast<size_t>(nChannels) * nBatchDepth;
+            const size_t sizeOneside = static_cast<size_t>(nSampleSize / 2 + 1);
+
+            // Interleaved test samples of a whole iteration, as the capture delivers them
+            std::vector<float> captured(sizeFrames * nSampleSize);
+            for (size_t i = 0; i < captured.size(); ++i) captured[i] = static_cast<float>(std::sin(0.05 * static_cast<double>(i)));
+
+            std::vector<double> latencies;
+            double dbTotal = 0.0;
+
+            if (nBackend == CiBenchConfig::BACKEND_PIPELINE) {
+#ifdef _WIN32
+                if (nChannels == 1) dbTotal = runPipeline<AudioCH1F>(nSampleSize, nChannels, nBatchDepth, captured, latencies);
+                else if (nChannels == 2) dbTotal = runPipeline<AudioCH2F>(nSampleSize, nChannels, nBatchDepth, captured, latencies);
+                else throw std::invalid_argument("The pipeline backend captures 1 or 2 channels.");
+#else
+                throw std::runtime_error("The pipeline backend needs the Windows capture classes.");
+#endif
+            }
+            else {
+                CiDftPlan pDft = CiDftPlanCache::getInstance().acquirePlan(nSampleSize, CiCLaDft::P1SN, nTransfer, 0, m_config.nDeviceIndex);
+                std::vector<float> output(sizeFrames * sizeOneside);
+
+                if (nBackend == CiBenchConfig::BACKEND_BATCH) {
+                    dbTotal = measure([&] { pDft->executeOpenCLBatch(captured.data(), output.data(), static_cast<int>(sizeFrames)); }, latencies);
+                }
+                else {
+                    dbTotal = measure([&] {
+                        for (size_t f = 0; f < sizeFrames; ++f) pDft->executeOpenCLKernel(captured.data() + f * nSampleSize, output.data() + f * sizeOneside);
+                    }, latencies);
+                }
+            }
+
+            CiBenchResult result;
+            result.nBackend = nBackend;
+            result.nSampleSize = nSampleSize;
+            result.nChannels = nChannels;
+            result.nBatchDepth = nBatchDepth;
+            result.nRepetitions = m_config.nRepetitions;
+
+            result.dbLatencyMean = dbTotal / m_config.nRepetitions;
+            std::sort(latencies.begin(), latencies.end());
+            result.dbLatencyP50 = getPercentile(latencies, 0.50);
+            result.dbLatencyP90 = getPercentile(latencies, 0.90);
+            result.dbLatencyP99 = getPercentile(latencies, 0.99);
+            result.dbLatencyMax = latencies.back();
+
+            double dbFrames = static_cast<double>(sizeFrames) * m_config.nRepetitions;
+            size_t sizeValueBytes = (nTransfer == CiCLaDft::TRANSFER_F16) ? 2 : sizeof(float);
+            result.dbFramesPerSec = dbFrames / dbTotal;
+            result.dbGflops = result.dbFramesPerSec * 2.5 * nSampleSize * std::log2(static_cast<double>(nSampleSize)) * 1e-9;
+            result.dbBytesPerFrame = static_cast<double>((nSampleSize + sizeOneside) * sizeValueBytes);
+            result.dbBytesPerSec = result.dbFramesPerSec * result.dbBytesPerFrame;
+            return result;
+        }
+
+        /// <summary>
+        /// Write results as a JSON document.
+        /// </summary>
+        /// <param name="os">Stream to write to.</param>
+        /// <param name="results">Results of the cases.</param>
+        /// <param name="sDevice">Name of the device, written as it is.</param>
+        void writeJson(std::ostream& os, const std::vector<CiBenchResult>& results, const std::string& sDevice = "") const {
+            os << "{\n  \"benchmark\": \"vsLib transform\",\n  \"device\": \"" << escapeJson(sDevice) << "\","
+                << "\n  \"warmup\": " << m_config.nWarmup << ",\n  \"repetitions\": " << m_config.nRepetitions << ",\n  \"results\": [";
+            for (size_t k = 0; k < results.size(); ++k) {
+                const CiBenchResult& r = results[k];
+                os << (k ? ",\n" : "\n") << "    { \"backend\": \"" << CiBenchConfig::getBackendName(r.nBackend) << "\""
+                    << ", \"sample_size\": " << r.nSampleSize << ", \"channels\": " << r.nChannels << ", \"batch_depth\": " << r.nBatchDepth
+                    << ", \"latency_s\": { \"mean\": " << r.dbLatencyMean << ", \"p50\": " << r.dbLatencyP50 << ", \"p90\": " << r.dbLatencyP90
+                    << ", \"p99\": " << r.dbLatencyP99 << ", \"max\": " << r.dbLatencyMax << " }"
+                    << ", \"frames_per_s\": " << r.dbFramesPerSec << ", \"gflops\": " << r.dbGflops
+                    << ", \"bytes_per_frame\": " << r.dbBytesPerFrame << ", \"bytes_per_s\": " << r.dbBytesPerSec << " }";
+            }
+            os << "\n  ]\n}\n";
+        }
+
+        // Getter for the cases and repetitions
+        const CiBenchConfig& getConfig() const { return m_config; }
+
+    private:
+
+        // Sink of the pipeline backend, which only takes the frames
+        class CiNullSink : public CiSink {
+        public:
+            void open(const CiSinkLayout&) override {}
+            void write(const CiFrame&) override {}
+        };
+
+        CiBenchConfig m_config;
+
+        // Method to run the warmup and the timed iterations of a case; returns the total time of the timed ones (s)
+        double measure(const std::function<void()>& iterate, std::vector<double>& latencies) const {
+            for (int n = 0; n < m_config.nWarmup; ++n) iterate();
+
+            latencies.assign(m_config.nRepetitions, 0.0);
+            auto tpStart = std::chrono::steady_clock::now();
+            for (int n = 0; n < m_config.nRepetitions; ++n) {
+                auto tpBegin = std::chrono::steady_clock::now();
+                iterate();
+                latencies[n] = std::chrono::duration<double>(std::chrono::steady_clock::now() - tpBegin).count();
+            }
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - tpStart).count();
+        }
+
+#ifdef _WIN32
+        // Method to time the stages of CiAudioDft with the test samples appended as captured packets instead of
+        // an endpoint; returns the total time of the timed iterations (s)
+        template <typename T>
+        double runPipeline(const int nSampleSize, const int nChannels, const int nBatchDepth, const std::vector<float>& captured,
+            std::vector<double>& latencies) const {
+            CiAudioDft<T> audio;
+            audio.setSamplesPerSec(48000);
+            audio.setNumberOfChannels(nChannels);
+            audio.setBatchSize(static_cast<size_t>(nSampleSize));
+            audio.addSink(std::make_shared<CiNullSink>(), 64, CiAsyncSink::BLOCK);
+            audio.getReady(audio.TO_SINKS);
+
+            // The deinterleave and transform stages and the sink run on their own threads, as during a capture
+            std::atomic<bool> bFinished(false);
+            std::exception_ptr pError;
+            std::thread tProcess([&] {
+                try { audio.processAudioData(); }
+                catch (...) { pError = std::current_exception(); }
+                bFinished = true;
+            });
+
+            const T* pFrames = reinterpret_cast<const T*>(captured.data());
+            const size_t sizePacketFrames = static_cast<size_t>(nBatchDepth) * nSampleSize;
+            size_t sizeExpected = 0;
+            double dbTotal = 0.0;
+            try {
+                dbTotal = measure([&] {
+                    // The source appends the hops as one packet; the iteration ends when the sink has written the last frame
+                    audio.appendFrames(pFrames, sizePacketFrames);
+                    sizeExpected += nBatchDepth;
+                    while (audio.getSinkWrittenFrames(0) < sizeExpected && !bFinished) std::this_thread::yield();
+                }, latencies);
+            }
+            catch (...) {
+                audio.endCapture();
+                tProcess.join();
+                throw;
+            }
+            audio.endCapture();
+            tProcess.join();
+
+            if (pError) std::rethrow_exception(pError);
+            if (audio.getSinkWrittenFrames(0) < sizeExpected) {
+                throw std::runtime_error("The pipeline ended before the sink had written all frames.");
+            }
+            return dbTotal;
+        }
+#endif
+
+        // Method to get a percentile of sorted values, the nearest rank
+        static double getPercentile(const std::vector<double>& sorted, const double dbFraction) {
+            size_t sizeRank = static_cast<size_t>(std::ceil(dbFraction * sorted.size()));
+            return sorted[(std::max)(sizeRank, static_cast<size_t>(1)) - 1];
+        }
+
+        // Method to escape the quotes and backslashes of a JSON string
+        static std::string escapeJson(const std::string& s) {
+            std::string sEscaped;
+            for (char c : s) {
+                if (c == '"' || c == '\\') sEscaped += '\\';
+                sEscaped += c;
+            }
+            return sEscaped;
+        }
+    };
+
+}
@@ -0,0 +1,195 @@
+// This C++ code defines a bounded blocking queue that connects the stages
+// of a processing pipeline. A producer blocks while the queue is full and a
+// consumer blocks while it is empty, so every stage runs as soon as its
+// input is ready and a slow stage slows its producers down instead of
+// letting the backlog grow without limit. The items are kept in a ring
+// that is allocated with the queue, so passing an item along never
+// touches the heap.
+
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Bounded first-in first-out queue with blocking push and pop.
+    /// </summary>
+    template <typename T>
+    class CiBoundedQueue {
+    public:
+
+        /// <summary>
+        /// Constructor for CiBoundedQueue.
+        /// </summary>
+        /// <param name="sizeCapacity">Maximum number of queued items.</param>
+        explicit CiBoundedQueue(const size_t sizeCapacity = 8)
+            : m_ring(sizeCapacity > 0 ? sizeCapacity : 1), m_sizeHead(0), m_sizeCount(0), m_sizeCapacity(sizeCapacity > 0 ? sizeCapacity : 1), m_bClosed(false) {}
+
+        CiBoundedQueue(const CiBoundedQueue&) = delete;
+        CiBoundedQueue& operator=(const CiBoundedQueue&) = delete;
+
+        /// <summary>
+        /// Add an item, waiting while the queue is full.
+        /// </summary>
+        /// <param name="item">Item to add.</param>
+        /// <returns>False if the queue was closed and the item was not added.</returns>
+        bool push(T item) {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_cvNotFull.wait(lock, [this] { return m_bClosed || m_sizeCount < m_sizeCapacity; });
+            if (m_bClosed) return false;
+
+            pushBack(std::move(item));
+            lock.unlock();
+            m_cvNotEmpty.notify_one();
+            return true;
+        }
+
+        /// <summary>
+        /// Add an item if there is room, without waiting.
+        /// </summary>
+        /// <param name="item">Item to add.</param>
+        /// <returns>False if the queue is full or closed.</returns>
+        bool tryPush(T item) {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            if (m_bClosed || m_sizeCount >= m_sizeCapacity) return false;
+
+            pushBack(std::move(item));
+            lock.unlock();
+            m_cvNotEmpty.notify_one();
+            return true;
+        }
+
+        /// <summary>
+        /// Add an item without waiting; if the queue is full, the oldest item is discarded to make room.
+        /// </summary>
+        /// <param name="item">Item to add.</param>
+        /// <param name="bDiscarded">Set to true if an older item was discarded.</param>
+        /// <returns>False if the queue is closed.</returns>
+        bool pushOverwrite(T item, bool& bDiscarded) {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            bDiscarded = false;
+            if (m_bClosed) return false;
+
+            if (m_sizeCount >= m_sizeCapacity) {
+                popFront();
+                bDiscarded = true;
+            }
+            pushBack(std::move(item));
+            lock.unlock();
+            m_cvNotEmpty.notify_one();
+            return true;
+        }
+
+        /// <summary>
+        /// Remove the oldest item, waiting while the queue is empty.
+        /// </summary>
+        /// <param name="item">Receives the removed item.</param>
+        /// <returns>False if the queue is closed and all items have been removed.</returns>
+        bool pop(T& item) {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_cvNotEmpty.wait(lock, [this] { return m_bClosed || m_sizeCount > 0; });
+            if (m_sizeCount == 0) return false;
+
+            item = popFront();
+            lock.unlock();
+            m_cvNotFull.notify_one();
+            return true;
+        }
+
+        /// <summary>
+        /// Close the queue. Waiting producers return at once, consumers still get the remaining items.
+        /// </summary>
+        void close() {
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_bClosed = true;
+            }
+            m_cvNotFull.notify_all();
+            m_cvNotEmpty.notify_all();
+        }
+
+        /// <summary>
+        /// Remove all items and open the queue again.
+        /// </summary>
+        void reset() {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            while (m_sizeCount > 0) popFront();
+            m_sizeHead = 0;
+            m_bClosed = false;
+        }
+
+        /// <summary>
+        /// Set the maximum number of queued items. Waiting producers are woken up when it grows.
+        /// The ring is reallocated when it grows, so set the capacity before the items flow.
+        /// </summary>
+        /// <param name="sizeCapacity">Maximum number of queued items.</param>
+        void setCapacity(const size_t sizeCapacity) {
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_sizeCapacity = sizeCapacity > 0 ? sizeCapacity : 1;
+                if (m_sizeCapacity > m_ring.size()) {
+                    std::vector<T> ring(m_sizeCapacity);
+                    for (size_t k = 0; k < m_sizeCount; ++k) ring[k] = std::move(m_ring[(m_sizeHead + k) % m_ring.size()]);
+                    m_ring.swap(ring);
+                    m_sizeHead = 0;
+                }
+            }
+            m_cvNotFull.notify_all();
+        }
+
+        /// <summary>
+        /// Get the maximum number of queued items.
+        /// </summary>
+        size_t getCapacity() {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            return m_sizeCapacity;
+        }
+
+        /// <summary>
+        /// Get the number of queued items.
+        /// </summary>
+        size_t size() {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            return m_sizeCount;
+        }
+
+        /// <summary>
+        /// Check whether the queue is closed.
+        /// </summary>
+        bool isClosed() {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            return m_bClosed;
+        }
+
+    private:
+        std::mutex m_mtx;
+        std::condition_variable m_cvNotFull;
+        std::condition_variable m_cvNotEmpty;
+        std::vector<T> m_ring;      // At least m_sizeCapacity slots; a smaller capacity keeps the slots
+        size_t m_sizeHead;          // Slot of the oldest item
+        size_t m_sizeCount;         // Number of queued items
+        size_t m_sizeCapacity;
+        bool m_bClosed;
+
+        // Method to add an item behind the newest one, called with the lock held and room in the ring
+        void pushBack(T item) {
+            m_ring[(m_sizeHead + m_sizeCount) % m_ring.size()] = std::move(item);
+            ++m_sizeCount;
+        }
+
+        // Method to remove the oldest item, called with the lock held and an item in the ring.
+        // The slot is emptied, so a shared frame is released as soon as it leaves the queue.
+        T popFront() {
+            T item = std::move(m_ring[m_sizeHead]);
+            m_ring[m_sizeHead] = T();
+            m_sizeHead = (m_sizeHead + 1) % m_ring.size();
+            --m_sizeCount;
+            return item;
+        }
+    };
+
+}
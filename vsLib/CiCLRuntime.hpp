@@ -0,0 +1,238 @@
+// This C++ code defines a process-wide OpenCL runtime. The runtime owns
+// the platform, device, context and compiled DFT program of every used
+// device, so they are created once per process and shared by all transforms
+// instead of being rebuilt for every session. It owns no command queue: the
+// transforms create a queue for every lane of executing threads, so threads
+// never serialize on a shared queue.
+
+#pragma once
+#include <CL/cl.h>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Custom exception class for OpenCL errors.
+    /// </summary>
+    class OpenCLException : public std::exception {
+    private:
+        cl_int errorCode;
+        std::string errorDescription;
+
+    public:
+        /// <summary>
+        /// Constructor for OpenCLException.
+        /// </summary>
+        /// <param name="code">OpenCL error code.</param>
+        /// <param name="description">Error description.</param>
+        OpenCLException(cl_int code, const std::string& description) : errorCode(code), errorDescription(description) {}
+
+        /// <summary>
+        /// Get the error message.
+        /// </summary>
+        const char* what() const noexcept override {
+            return errorDescription.c_str();
+        }
+
+        /// <summary>
+        /// Get the OpenCL error code.
+        /// </summary>
+        cl_int getErrorCode() const {
+            return errorCode;
+        }
+    };
+
+    /// <summary>
+    /// Process-wide owner of the OpenCL contexts and programs.
+    /// </summary>
+    class CiCLRuntime {
+    public:
+
+        /// <summary>
+        /// OpenCL objects of one device.
+        /// </summary>
+        struct Device {
+            cl_platform_id platform;
+            cl_device_id device;
+            cl_context context;
+            cl_program program;
+        };
+
+        /// <summary>
+        /// Get the runtime of the process.
+        /// </summary>
+        static CiCLRuntime& getInstance() {
+            static CiCLRuntime runtime;
+            return runtime;
+        }
+
+        CiCLRuntime(const CiCLRuntime&) = delete;
+        CiCLRuntime& operator=(const CiCLRuntime&) = delete;
+
+        /// <summary>
+        /// Destructor for CiCLRuntime. Releases the objects of all devices.
+        /// </summary>
+        ~CiCLRuntime() {
+            releaseOpenCLResources();
+        }
+
+        /// <summary>
+        /// Get the OpenCL objects of a GPU device, creating them on first use.
+        /// The context and program are retained for the caller,
+        /// who releases them with clReleaseContext and clReleaseProgram.
+        /// </summary>
+        /// <param name="deviceIndex">Index of the GPU device of the first platform.</param>
+        /// <returns>Retained OpenCL objects of the device.</returns>
+        Device retainDevice(const int deviceIndex = 0) {
+            std::lock_guard<std::mutex> lock(m_mtx);
+
+            auto it = m_devices.find(deviceIndex);
+            if (it == m_devices.end()) {
+                it = m_devices.emplace(deviceIndex, createDevice(deviceIndex)).first;
+            }
+
+            const Device& device = it->second;
+            clRetainContext(device.context);
+            clRetainProgram(device.program);
+
+            return device;
+        }
+
+        /// <summary>
+        /// Set the name of the kernel source file used for devices created afterwards.
+        /// </summary>
+        /// <param name="sFileName">Name of the kernel source file.</param>
+        void setKernelFileName(const std::string& sFileName) {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_sKernelFileName = sFileName;
+            m_kernelSource.clear();
+        }
+
+        /// <summary>
+        /// Get the number of devices with created OpenCL objects.
+        /// </summary>
+        size_t getDeviceCount() {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            return m_devices.size();
+        }
+
+        /// <summary>
+        /// Get the name of a device, creating its OpenCL objects on first use.
+        /// </summary>
+        /// <param name="deviceIndex">Index of the GPU device of the first platform.</param>
+        std::string getDeviceName(const int deviceIndex = 0) {
+            std::lock_guard<std::mutex> lock(m_mtx);
+
+            auto it = m_devices.find(deviceIndex);
+            if (it == m_devices.end()) {
+                it = m_devices.emplace(deviceIndex, createDevice(deviceIndex)).first;
+            }
+
+            size_t sizeName = 0;
+            cl_int err = clGetDeviceInfo(it->second.device, CL_DEVICE_NAME, 0, nullptr, &sizeName);
+            std::string sName(sizeName, '\0');
+            if (err == CL_SUCCESS && sizeName > 0) err = clGetDeviceInfo(it->second.device, CL_DEVICE_NAME, sizeName, &sName[0], nullptr);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to get the device name.");
+            }
+            sName.resize(sName.find('\0') == std::string::npos ? sName.size() : sName.find('\0'));
+            return sName;
+        }
+
+        /// <summary>
+        /// Release the runtime references to the objects of all devices.
+        /// Objects still retained by transforms stay valid until those release them.
+        /// </summary>
+        void releaseOpenCLResources() {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            for (auto& entry : m_devices) {
+                if (entry.second.program) clReleaseProgram(entry.second.program);
+                if (entry.second.context) clReleaseContext(entry.second.context);
+            }
+            m_devices.clear();
+        }
+
+    private:
+        std::mutex m_mtx;
+        std::map<int, Device> m_devices;
+        std::string m_sKernelFileName;
+        std::string m_kernelSource;
+
+        CiCLRuntime() : m_sKernelFileName("dft_kernel.cl") {}
+
+        /// <summary>
+        /// Create the context and program of a device.
+        /// </summary>
+        Device createDevice(const int deviceIndex) {
+            cl_int err;
+            Device device{ nullptr, nullptr, nullptr, nullptr };
+
+            if (m_kernelSource.empty()) loadKernelFromFile(m_sKernelFileName);
+
+            err = clGetPlatformIDs(1, &device.platform, nullptr);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to get an OpenCL platform.");
+            }
+
+            cl_uint numDevices = 0;
+            err = clGetDeviceIDs(device.platform, CL_DEVICE_TYPE_GPU, 0, nullptr, &numDevices);
+            if (err != CL_SUCCESS || deviceIndex < 0 || static_cast<cl_uint>(deviceIndex) >= numDevices) {
+                throw OpenCLException(err, "Failed to get GPU device.");
+            }
+            std::vector<cl_device_id> devices(numDevices);
+            err = clGetDeviceIDs(device.platform, CL_DEVICE_TYPE_GPU, numDevices, devices.data(), nullptr);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to get GPU device.");
+            }
+            device.device = devices[deviceIndex];
+
+            device.context = clCreateContext(nullptr, 1, &device.device, nullptr, nullptr, &err);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to create an OpenCL context.");
+            }
+
+            const char* pKernelSource = m_kernelSource.c_str();
+            device.program = clCreateProgramWithSource(device.context, 1, &pKernelSource, NULL, &err);
+            if (err != CL_SUCCESS) {
+                clReleaseContext(device.context);
+                throw OpenCLException(err, "Failed to create an OpenCL program.");
+            }
+
+            err = clBuildProgram(device.program, 1, &device.device, NULL, NULL, NULL);
+            if (err != CL_SUCCESS) {
+                std::string sMessage = "Failed to build the OpenCL program.";
+                size_t logSize = 0;
+                clGetProgramBuildInfo(device.program, device.device, CL_PROGRAM_BUILD_LOG, 0, NULL, &logSize);
+                if (logSize > 0) {
+                    std::vector<char> log(logSize);
+                    clGetProgramBuildInfo(device.program, device.device, CL_PROGRAM_BUILD_LOG, logSize, log.data(), NULL);
+                    sMessage = "Failed to build the OpenCL program. Build log:\n" + std::string(log.data());
+                }
+                clReleaseProgram(device.program);
+                clReleaseContext(device.context);
+                throw OpenCLException(err, sMessage);
+            }
+
+            return device;
+        }
+
+        /// <summary>
+        /// Load OpenCL kernel source code from a file.
+        /// </summary>
+        /// <param name="fileName">Name of the kernel source file.</param>
+        void loadKernelFromFile(const std::string& fileName) {
+            std::ifstream file(fileName);
+            if (!file.is_open()) {
+                throw OpenCLException(1, "Failed to open the kernel file " + fileName + ".");
+            }
+            m_kernelSource.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        }
+
+    };
+
+}
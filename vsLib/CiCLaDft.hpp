@@ -1,4 +1,4 @@
-// This C++ code implements the Discrete Fourier Transform(DFT) using OpenCL 
+// This C++ code implements the Discrete Fourier Transform(DFT) using OpenCL
 // for parallel processing. A class CiCLaDft contains member functions
 // and data members to set up and execute the DFT using OpenCL.
 // Author: Ilmars Viksne
@@ -7,93 +7,268 @@
 #pragma once
 #include <iostream>
 #include <CL/cl.h>
-#include <fstream>
+#include "CiCLRuntime.hpp"
+#include "CiFilterbank.hpp"
+#include "CiTrace.hpp"
 #include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 namespace vi {
 
     const float PI2 = 6.28319f;
 
     /// <summary>
-    /// Custom exception class for OpenCL errors.
+    /// Class for performing Discrete Fourier Transform (DFT) using OpenCL.
+    /// The compiled program is shared, while every executing thread works on a command queue,
+    /// buffers and kernel objects of its own (a lane), so one instance can be used by several
+    /// worker threads at the same time. The lanes are kept in a pool: a thread takes a free lane
+    /// for each frame, or for a whole stage with a LaneScope, and gives it back afterwards, so
+    /// the number of lanes follows the number of concurrent threads, not of threads ever started.
+    /// Configuration (createOpenCLKernel, setFilterbank, setPeakPicking, setFeatures and their clear methods, releaseOpenCLResources)
+    /// must not run concurrently with the execution of frames.
     /// </summary>
-    class OpenCLException : public std::exception {
-    private:
-        cl_int errorCode;
-        std::string errorDescription;
-
+    class CiCLaDft {
     public:
+
+        CiCLaDft() : m_platform(nullptr), m_device(nullptr), m_context(nullptr), m_program(nullptr), m_historyQueue(nullptr), m_historyBuffer(nullptr),
+            m_rowOffsetsBuffer(nullptr), m_columnsBuffer(nullptr), m_weightsBuffer(nullptr),
+            m_sampleSize{ 0 }, m_onesideSize{ 0 }, m_kernelNo{ -1 }, m_transferMode{ 0 }, m_fpHalfOutputScale{ 0.0f },
+            m_historyDepth{ 0 }, m_historyNext{ 0 }, m_historyCount{ 0 }, m_historyTotal{ 0 }, m_bandCount{ 0 },
+            m_filterbankVersion{ 0 }, m_peakCount{ 0 }, m_fpMinProminence{ 0.0f }, m_peakFirstBin{ 0 }, m_peakLastBin{ 0 }, m_peakVersion{ 0 },
+            m_bFeatures{ false }, m_fpFrequencyStep{ 1.0f }, m_fpRolloffFraction{ 0.85f }, m_featureFirstBin{ 0 }, m_featureLastBin{ 0 },
+            m_featureFrameGroup{ 1 }, m_featureVersion{ 0 }, m_deviceIndex{ 0 }, m_bProfiling{ false }, m_profileCapacity{ 4096 } {}
+
         /// <summary>
-        /// Constructor for OpenCLException.
+        /// Destructor for CiCLaDft. Releases the OpenCL resources that are still held.
         /// </summary>
-        /// <param name="code">OpenCL error code.</param>
-        /// <param name="description">Error description.</param>
-        OpenCLException(cl_int code, const std::string& description) : errorCode(code), errorDescription(description) {}
+        ~CiCLaDft() {
+            releaseOpenCLResources();
+        }
+
+        CiCLaDft(const CiCLaDft&) = delete;
+        CiCLaDft& operator=(const CiCLaDft&) = delete;
+
+        static const int P1S = 0;
+        static const int P1SN = 1;
+
+        static const int TRANSFER_F32 = 0;
+        static const int TRANSFER_F16 = 1;
 
         /// <summary>
-        /// Get the error message.
+        /// Accuracy of the FP16 transfer mode measured against the FP32 transfer of the same frame.
         /// </summary>
-        const char* what() const noexcept override {
-            return errorDescription.c_str();
-        }
+        struct TransferErrorReport {
+            float maxAbsError;      // Largest absolute difference of the power values
+            float rmsError;         // Root mean square of the power differences
+            float maxErrorToPeak;   // maxAbsError relative to the largest FP32 power value
+            float peakPower;        // Largest FP32 power value of the frame
+        };
+
+        static const int PROFILE_WRITE = 0;
+        static const int PROFILE_KERNEL = 1;
+        static const int PROFILE_READ = 2;
+        static const int PROFILE_FILTERBANK = 3;
+        static const int PROFILE_PEAKS = 4;
+        static const int PROFILE_FEATURES = 5;
+        static const int PROFILE_STAGES = 6;
+
+        static const int PEAKS_MAX = 32;
 
         /// <summary>
-        /// Get the OpenCL error code.
+        /// Spectral peak found on the device. The records are sorted by power, the highest first.
         /// </summary>
-        cl_int getErrorCode() const {
-            return errorCode;
-        }
-    };
+        struct Peak {
+            float bin;              // Bin position refined by parabolic interpolation
+            float power;            // Power at the interpolated position
+            float prominence;       // Height above the higher of the two bases, the lowest power towards the nearest higher bin on each side (dB)
+            int index;              // Bin of the local maximum, -1 for a record without a peak
+        };
 
-    /// <summary>
-    /// Class for performing Discrete Fourier Transform (DFT) using OpenCL.
-    /// </summary>
-    class CiCLaDft {
-    public:
+        /// <summary>
+        /// Spectral features of a frame computed on the device. The frequencies are in the unit of the frequency step.
+        /// </summary>
+        struct Features {
+            float centroid;         // Power-weighted mean frequency
+            float bandwidth;        // Power-weighted standard deviation around the centroid
+            float rolloff;          // Frequency below which the roll-off fraction of the power lies
+            float flatness;         // Geometric mean of the power divided by its arithmetic mean (0 ... 1)
+            float flux;             // Sum of the increases of the power against the previous frame of the stream
+            float rms;              // Root mean square of the input samples
+            float energy;           // Sum of the power in the bin range
+        };
+
+        /// <summary>
+        /// Device timestamps (ns) of one profiled command.
+        /// </summary>
+        struct ProfileSample {
+            cl_ulong queued;        // The command was enqueued by the host
+            cl_ulong submit;        // The command was submitted to the device
+            cl_ulong start;         // The device started the command
+            cl_ulong end;           // The device finished the command
+        };
+
+        /// <summary>
+        /// Statistics of one interval over the recorded samples, in microseconds.
+        /// </summary>
+        struct ProfileStats {
+            size_t count;
+            double mean;
+            double p50;
+            double p99;
+            double max;
+        };
+
+        /// <summary>
+        /// Statistics of one stage (PROFILE_WRITE, PROFILE_KERNEL, PROFILE_READ, PROFILE_FILTERBANK, PROFILE_PEAKS or PROFILE_FEATURES).
+        /// </summary>
+        struct StageProfile {
+            ProfileStats queueTime;     // From queued to submit
+            ProfileStats submitTime;    // From submit to start
+            ProfileStats executionTime; // From start to end
+            ProfileStats totalTime;     // From queued to end
+        };
+
+        /// <summary>
+        /// Keeps a lane of the pool for the calling thread from its construction to its destruction,
+        /// e.g. for the thread of a stage, so all frames of the stage run on the same lane.
+        /// The lane goes back to the pool afterwards and is reused by the next stage.
+        /// </summary>
+        class LaneScope {
+        public:
+
+            /// <summary>
+            /// Constructor for LaneScope. Takes a free lane, or keeps the lane the calling thread already has.
+            /// </summary>
+            /// <param name="dft">Transform whose lane is kept.</param>
+            explicit LaneScope(CiCLaDft& dft) : LaneScope(dft, true) {}
+
+            /// <summary>
+            /// Destructor for LaneScope. Gives the lane back to the pool.
+            /// </summary>
+            ~LaneScope() {
+                if (m_bOwner) m_dft.returnLane(m_bStage);
+            }
+
+            LaneScope(const LaneScope&) = delete;
+            LaneScope& operator=(const LaneScope&) = delete;
 
-        CiCLaDft() : m_kernelSource(""), m_platform(nullptr), m_device(nullptr), m_context(nullptr), m_commandQueue(nullptr),
-            m_inputRealBuffer(nullptr), m_onesidePowerBuffer(nullptr), m_program(nullptr), m_kernel(nullptr),
-            m_sampleSize{ 0 }, m_onesideSize{ 0 }, m_kernelNo{ -1 } {}
+        private:
+            friend class CiCLaDft;
 
-        const int P1S = 0;
-        const int P1SN = 1;
+            CiCLaDft& m_dft;
+            bool m_bStage;      // The scope of a stage; the streams of the stage end with it
+            bool m_bOwner;      // False when an outer scope of the thread already holds the lane
+
+            LaneScope(CiCLaDft& dft, const bool bStage) : m_dft(dft), m_bStage(bStage), m_bOwner(dft.bindLane()) {}
+        };
 
         /// <summary>
-        /// Initialize OpenCL resources.
+        /// Initialize OpenCL resources. The context and compiled program are shared
+        /// with other transforms through the process-wide CiCLRuntime.
         /// </summary>
         /// <returns>0 on success, 1 on failure.</returns>
         int setOpenCL() {
 
-            cl_int err;
+            // The queues are created with the lanes of the executing threads
+            CiCLRuntime::Device device = CiCLRuntime::getInstance().retainDevice(m_deviceIndex);
 
-            err = loadKernelFromFile("dft_kernel.cl");
-            if (err != CL_SUCCESS) return 1;
+            m_platform = device.platform;
+            m_device = device.device;
+            m_context = device.context;
+            m_program = device.program;
 
-            err = clGetPlatformIDs(1, &m_platform, nullptr);
-            if (err != CL_SUCCESS) {
-                throw OpenCLException(err, "Failed to load OpenCL kernel.");
-            }
+            return 0;
+        }
 
-            err = clGetDeviceIDs(m_platform, CL_DEVICE_TYPE_GPU, 1, &m_device, NULL);
-            if (err != CL_SUCCESS) {
-                throw OpenCLException(err, "Failed to get GPU device.");
-            }
+        /// <summary>
+        /// Set the index of the GPU device. Must be called before setOpenCL.
+        /// </summary>
+        /// <param name="deviceIndex">Index of the GPU device of the first platform.</param>
+        void setDeviceIndex(const int deviceIndex) { m_deviceIndex = deviceIndex; }
 
-            m_context = clCreateContext(nullptr, 1, &m_device, nullptr, nullptr, &err);
-            if (err != CL_SUCCESS) {
-                throw OpenCLException(err, "Failed to create an OpenCL context.");
+        /// <summary>
+        /// Get the index of the GPU device.
+        /// </summary>
+        /// <returns>Device index.</returns>
+        int getDeviceIndex() const { return m_deviceIndex; }
+
+        /// <summary>
+        /// Enable the recording of OpenCL profiling events for every write, kernel launch and read.
+        /// Must be called before createOpenCLKernel, the command queues are then created with CL_QUEUE_PROFILING_ENABLE.
+        /// </summary>
+        /// <param name="bProfiling">True to enable profiling.</param>
+        void setProfiling(const bool bProfiling) { m_bProfiling = bProfiling; }
+
+        /// <summary>
+        /// Check whether profiling is enabled.
+        /// </summary>
+        /// <returns>True if profiling events are recorded.</returns>
+        bool isProfiling() const { return m_bProfiling; }
+
+        /// <summary>
+        /// Set the number of most recent samples per stage the statistics are computed from.
+        /// </summary>
+        /// <param name="capacity">Number of samples kept per stage.</param>
+        void setProfileCapacity(const size_t capacity) {
+            if (capacity < 1) {
+                throw OpenCLException(1, "The profile capacity must be positive.");
             }
+            std::lock_guard<std::mutex> lock(m_profileMutex);
+            m_profileCapacity = capacity;
+            for (ProfileRing& ring : m_profile) ring = ProfileRing();
+        }
 
-            m_commandQueue = clCreateCommandQueue(m_context, m_device, 0, &err);
-            if (err != CL_SUCCESS) {
-                throw OpenCLException(err, "Failed to create a command queue.");
+        /// <summary>
+        /// Forget all recorded profiling samples.
+        /// </summary>
+        void resetProfile() {
+            std::lock_guard<std::mutex> lock(m_profileMutex);
+            for (ProfileRing& ring : m_profile) ring = ProfileRing();
+        }
+
+        /// <summary>
+        /// Get the recorded samples of a stage, the oldest sample first.
+        /// Commands without a readback are recorded once a later command of the same thread has completed.
+        /// </summary>
+        /// <param name="stage">PROFILE_WRITE, PROFILE_KERNEL, PROFILE_READ, PROFILE_FILTERBANK, PROFILE_PEAKS or PROFILE_FEATURES.</param>
+        /// <returns>Device timestamps of the recorded commands.</returns>
+        std::vector<ProfileSample> getProfileSamples(const int stage) {
+            if (stage < 0 || stage >= PROFILE_STAGES) {
+                throw OpenCLException(1, "No profile stage with such number.");
             }
+            std::lock_guard<std::mutex> lock(m_profileMutex);
+            const ProfileRing& ring = m_profile[stage];
+            std::vector<ProfileSample> samples(ring.samples.begin() + ring.next, ring.samples.end());
+            samples.insert(samples.end(), ring.samples.begin(), ring.samples.begin() + ring.next);
+            return samples;
+        }
 
-            return 0;
+        /// <summary>
+        /// Get the statistics of a stage over the recorded samples.
+        /// </summary>
+        /// <param name="stage">PROFILE_WRITE, PROFILE_KERNEL, PROFILE_READ, PROFILE_FILTERBANK, PROFILE_PEAKS or PROFILE_FEATURES.</param>
+        /// <returns>Mean, median, 99th percentile and maximum of the stage intervals.</returns>
+        StageProfile getProfile(const int stage) {
+            std::vector<ProfileSample> samples = getProfileSamples(stage);
+
+            StageProfile profile;
+            profile.queueTime = computeStats(samples, &ProfileSample::queued, &ProfileSample::submit);
+            profile.submitTime = computeStats(samples, &ProfileSample::submit, &ProfileSample::start);
+            profile.executionTime = computeStats(samples, &ProfileSample::start, &ProfileSample::end);
+            profile.totalTime = computeStats(samples, &ProfileSample::queued, &ProfileSample::end);
+            return profile;
         }
 
         /// <summary>
         /// Create an OpenCL kernel for DFT computation.
+        /// The lanes with their buffers and kernel objects are created by the first frames that need them.
         /// </summary>
         /// <param name="sampleSize">Size of the input samples.</param>
         /// <param name="kernelNo">Kernel number (P1S or P1SN).</param>
@@ -112,134 +287,1364 @@ namespace vi {
             }
             m_kernelNo = kernelNo;
 
-            m_inputRealBuffer = clCreateBuffer(m_context, CL_MEM_READ_ONLY, m_sampleSize * sizeof(float), nullptr, &err);
-            m_onesidePowerBuffer = clCreateBuffer(m_context, CL_MEM_WRITE_ONLY, m_onesideSize * sizeof(float), nullptr, &err);
+            if (!m_program) {
+                throw OpenCLException(1, "OpenCL resources are not initialized.");
+            }
 
-            if (err != CL_SUCCESS || !m_inputRealBuffer || !m_onesidePowerBuffer) {
-                throw OpenCLException(err, "Failed to create OpenCL buffers.");
+            // Without a scale of its own the FP16 transfer uses the default of the kernel
+            if (m_transferMode == TRANSFER_F16 && m_fpHalfOutputScale <= 0.0f) {
+                m_fpHalfOutputScale = getDefaultHalfOutputScale();
             }
 
-            const char* pKernelSource = m_kernelSource.c_str();
-            m_program = clCreateProgramWithSource(m_context, 1, &pKernelSource, NULL, &err);
-            if (err != CL_SUCCESS) {
-                throw OpenCLException(err, "Failed to create an OpenCL program.");
+            if (m_historyDepth > 0) {
+                m_historyBuffer = clCreateBuffer(m_context, CL_MEM_READ_WRITE, m_historyDepth * getHistoryFrameBytes(), nullptr, &err);
+                if (err != CL_SUCCESS || !m_historyBuffer) {
+                    throw OpenCLException(err, "Failed to create the OpenCL spectrogram history buffer.");
+                }
+
+                // The history is read on a queue of its own, so a reader does not need a lane
+                m_historyQueue = clCreateCommandQueue(m_context, m_device, 0, &err);
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to create the command queue of the spectrogram history.");
+                }
             }
 
-            err = clBuildProgram(m_program, 1, &m_device, NULL, NULL, NULL);
-            if (err != CL_SUCCESS) {
-                size_t logSize;
-                clGetProgramBuildInfo(m_program, m_device, CL_PROGRAM_BUILD_LOG, 0, NULL, &logSize);
-                if (logSize > 0) {
-                    std::vector<char> log(logSize);
-                    clGetProgramBuildInfo(m_program, m_device, CL_PROGRAM_BUILD_LOG, logSize, log.data(), NULL);
-                    throw OpenCLException(err, "Failed to build the OpenCL program. Build log:\n" + std::string(log.data()));
+            return 0;
+        }
+
+        /// <summary>
+        /// Execute the OpenCL DFT kernel on a lane of the calling thread.
+        /// </summary>
+        /// <param name="inputReal">Input real data.</param>
+        /// <param name="onesidePower">Output one-sided power spectrum, or nullptr to skip the readback
+        /// when the spectrum is only kept in the history buffer.</param>
+        /// <returns>0 on success, 1 on failure.</returns>
+        int executeOpenCLKernel(const float* inputReal, float* onesidePower) {
+            LaneScope scope(*this, false);
+            Lane& lane = getLane();
+
+            if (m_transferMode == TRANSFER_F16) executeHalfTransfer(lane, inputReal, onesidePower);
+            else executeFloatTransfer(lane, inputReal, onesidePower);
+
+            if (m_historyBuffer) appendHistory(lane);
+
+            return 0;
+        }
+
+        /// <summary>
+        /// Execute the OpenCL DFT kernel on several frames with one launch on a lane of the calling thread.
+        /// The frames are not added to the history. Only the FP32 transfer mode supports batches.
+        /// </summary>
+        /// <param name="inputReal">Input real data, frameCount frames one after another.</param>
+        /// <param name="onesidePower">Output one-sided power spectra, frameCount spectra one after another.</param>
+        /// <param name="frameCount">Number of frames.</param>
+        /// <returns>0 on success, 1 on failure.</returns>
+        int executeOpenCLBatch(const float* inputReal, float* onesidePower, const int frameCount) {
+            cl_int err;
+
+            if (m_transferMode != TRANSFER_F32) {
+                throw OpenCLException(1, "Batches need the FP32 transfer mode.");
+            }
+            if (frameCount < 1) return 0;
+
+            LaneScope scope(*this, false);
+            Lane& lane = getLane();
+            if (frameCount > lane.batchCapacity) createLaneBatch(lane, frameCount);
+
+            // The write does not block; the blocking read at the end orders it in the in-order queue.
+            {
+                // The span only covers the enqueue; the transfer and the kernel show in the blocking readback
+                CI_TRACE_SCOPE("upload");
+                err = clEnqueueWriteBuffer(lane.commandQueue, lane.batchInputBuffer, CL_FALSE, 0, static_cast<size_t>(frameCount) * m_sampleSize * sizeof(float),
+                    inputReal, 0, nullptr, nextEvent(lane, PROFILE_WRITE));
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to write data to a buffer object in device memory.");
                 }
-                else {
-                    throw OpenCLException(err, "Failed to build the OpenCL program.");
+            }
+
+            size_t globalWorkSize[2] = { (size_t)m_onesideSize, (size_t)frameCount };
+            {
+                // The launch returns at once; the run of the kernel shows in the blocking readback
+                CI_TRACE_SCOPE("kernel");
+                err = clEnqueueNDRangeKernel(lane.commandQueue, lane.kernelBatch, 2, nullptr, globalWorkSize, nullptr, 0, nullptr,
+                    nextEvent(lane, PROFILE_KERNEL));
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to enqueue the batch kernel for execution.");
                 }
             }
 
-            if (m_kernelNo == P1S) m_kernel = clCreateKernel(m_program, "dft_R1SP", &err);
-            if (m_kernelNo == P1SN) m_kernel = clCreateKernel(m_program, "dft_R1SPN", &err);
-            if (err != CL_SUCCESS) {
-                throw OpenCLException(err, "Failed to create the OpenCL kernel.");
+            {
+                CI_TRACE_SCOPE("readback");
+                err = clEnqueueReadBuffer(lane.commandQueue, lane.batchOutputBuffer, CL_TRUE, 0, static_cast<size_t>(frameCount) * m_onesideSize * sizeof(float),
+                    onesidePower, 0, nullptr, nextEvent(lane, PROFILE_READ));
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to read the data from the buffer object.");
+                }
             }
+            collectEvents(lane);
 
             return 0;
         }
 
         /// <summary>
-        /// Execute the OpenCL DFT kernel.
+        /// Upload the band matrix of a filterbank to the device. Must be called after createOpenCLKernel.
         /// </summary>
-        /// <param name="inputReal">Input real data.</param>
-        /// <param name="onesidePower">Output one-sided power spectrum.</param>
+        /// <param name="filterbank">Filterbank designed for the sample size of this transform.</param>
         /// <returns>0 on success, 1 on failure.</returns>
-        int executeOpenCLKernel(const float* inputReal, float* onesidePower) {
+        int setFilterbank(const CiFilterbank& filterbank) {
             cl_int err;
 
-            err = clEnqueueWriteBuffer(m_commandQueue, m_inputRealBuffer, CL_TRUE, 0, m_sampleSize * sizeof(float), inputReal, 0, nullptr, nullptr);
+            if (filterbank.getSampleSize() != m_sampleSize || filterbank.getBandCount() < 1) {
+                throw OpenCLException(1, "The filterbank is not designed for the sample size of the transform.");
+            }
+
+            clearFilterbank();
+            m_bandCount = filterbank.getBandCount();
+
+            m_rowOffsetsBuffer = clCreateBuffer(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, filterbank.getRowOffsets().size() * sizeof(int),
+                const_cast<int*>(filterbank.getRowOffsets().data()), &err);
+            if (err == CL_SUCCESS) m_columnsBuffer = clCreateBuffer(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, filterbank.getColumns().size() * sizeof(int),
+                const_cast<int*>(filterbank.getColumns().data()), &err);
+            if (err == CL_SUCCESS) m_weightsBuffer = clCreateBuffer(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, filterbank.getWeights().size() * sizeof(float),
+                const_cast<float*>(filterbank.getWeights().data()), &err);
             if (err != CL_SUCCESS) {
-                throw OpenCLException(err, "Failed to write data to a buffer object in device memory.");
+                throw OpenCLException(err, "Failed to create OpenCL filterbank buffers.");
+            }
+
+            // The band matrix is shared; each lane creates its band buffer and kernel with its next frame.
+            ++m_filterbankVersion;
+
+            return 0;
+        }
+
+        /// <summary>
+        /// Execute the DFT kernel followed by the filterbank kernel; only the band energies are read back.
+        /// </summary>
+        /// <param name="inputReal">Input real data.</param>
+        /// <param name="bands">Output band energies, getBandCount() values.</param>
+        /// <returns>0 on success, 1 on failure.</returns>
+        int executeOpenCLFilterbank(const float* inputReal, float* bands) {
+            if (!m_weightsBuffer) {
+                throw OpenCLException(1, "No filterbank is set.");
             }
 
-            err = clSetKernelArg(m_kernel, 0, sizeof(cl_mem), &m_inputRealBuffer);
+            LaneScope scope(*this, false);
+            Lane& lane = getLane();
+            if (lane.filterbankVersion != m_filterbankVersion) createLaneFilterbank(lane);
+
+            executeOpenCLKernel(inputReal, nullptr);
+
+            size_t globalWorkSize = (size_t)m_bandCount;
+            cl_int err = clEnqueueNDRangeKernel(lane.commandQueue, lane.kernelFilterbank, 1, nullptr, &globalWorkSize, nullptr, 0, nullptr,
+                nextEvent(lane, PROFILE_FILTERBANK));
             if (err != CL_SUCCESS) {
-                throw OpenCLException(err, "Failed to set the argument value for the input buffer.");
+                throw OpenCLException(err, "Failed to enqueue the filterbank kernel for execution.");
             }
 
-            err = clSetKernelArg(m_kernel, 1, sizeof(cl_mem), &m_onesidePowerBuffer);
+            err = clEnqueueReadBuffer(lane.commandQueue, lane.bandsBuffer, CL_TRUE, 0, m_bandCount * sizeof(float), bands, 0, nullptr,
+                nextEvent(lane, PROFILE_READ));
             if (err != CL_SUCCESS) {
-                throw OpenCLException(err, "Failed to set the argument value for the output buffer.");
+                throw OpenCLException(err, "Failed to read the band energies from the buffer object.");
             }
+            collectEvents(lane);
 
-            size_t globalWorkSize = (size_t)m_onesideSize;
-            err = clEnqueueNDRangeKernel(m_commandQueue, m_kernel, 1, nullptr, &globalWorkSize, nullptr, 0, nullptr, nullptr);
+            return 0;
+        }
+
+        /// <summary>
+        /// Get the number of bands of the filterbank set on the device.
+        /// </summary>
+        /// <returns>Number of bands, 0 without a filterbank.</returns>
+        int getBandCount() const { return m_bandCount; }
+
+        /// <summary>
+        /// Release the filterbank buffers and kernels.
+        /// </summary>
+        void clearFilterbank() {
+            {
+                std::lock_guard<std::mutex> lock(m_lanesMutex);
+                for (auto& pLane : m_lanes) releaseLaneFilterbank(*pLane);
+            }
+            if (m_weightsBuffer) clReleaseMemObject(m_weightsBuffer);
+            if (m_columnsBuffer) clReleaseMemObject(m_columnsBuffer);
+            if (m_rowOffsetsBuffer) clReleaseMemObject(m_rowOffsetsBuffer);
+            m_rowOffsetsBuffer = m_columnsBuffer = m_weightsBuffer = nullptr;
+            m_bandCount = 0;
+        }
+
+        /// <summary>
+        /// Set up the device-side peak picking. Must be called after createOpenCLKernel.
+        /// A peak is a local maximum of the power spectrum with at least the given prominence in dB.
+        /// On each side the base is the lowest power between the peak and the nearest higher bin, or the
+        /// edge of the spectrum; the prominence is the height of the peak above the higher of the two bases.
+        /// </summary>
+        /// <param name="peakCount">Number of peak records per frame (K), 1 ... PEAKS_MAX.</param>
+        /// <param name="minProminence">Minimum prominence (dB).</param>
+        /// <param name="firstBin">First bin where a peak can be found, at least 1.</param>
+        /// <param name="lastBin">Last bin where a peak can be found, 0 for the bin before the Nyquist bin.</param>
+        /// <returns>0 on success, 1 on failure.</returns>
+        int setPeakPicking(const int peakCount, const float minProminence, const int firstBin = 1, const int lastBin = 0) {
+            if (m_onesideSize < 3) {
+                throw OpenCLException(1, "The OpenCL kernel is not created.");
+            }
+            if (peakCount < 1 || peakCount > PEAKS_MAX) {
+                throw OpenCLException(1, "The number of peaks is out of range.");
+            }
+
+            // The interpolation needs both neighbours of a peak bin.
+            m_peakFirstBin = (std::max)(firstBin, 1);
+            m_peakLastBin = (lastBin < 1 || lastBin > m_onesideSize - 2) ? m_onesideSize - 2 : lastBin;
+            if (m_peakFirstBin > m_peakLastBin) {
+                throw OpenCLException(1, "The bin range of the peak picking is empty.");
+            }
+            m_peakCount = peakCount;
+            m_fpMinProminence = minProminence;
+
+            // Each lane creates its peak buffer and kernel with its next frame.
+            ++m_peakVersion;
+
+            return 0;
+        }
+
+        /// <summary>
+        /// Execute the DFT kernel followed by the peak picking kernel; only the peak records are read back.
+        /// </summary>
+        /// <param name="inputReal">Input real data.</param>
+        /// <param name="peaks">Output of getPeakCount() records, the highest peak first.
+        /// The records after the last found peak have the index -1.</param>
+        /// <returns>0 on success, 1 on failure.</returns>
+        int executeOpenCLPeaks(const float* inputReal, Peak* peaks) {
+            if (m_peakCount == 0) {
+                throw OpenCLException(1, "No peak picking is set.");
+            }
+
+            LaneScope scope(*this, false);
+            Lane& lane = getLane();
+            if (lane.peakVersion != m_peakVersion) createLanePeaks(lane);
+
+            executeOpenCLKernel(inputReal, nullptr);
+
+            // One work-group reduces the whole spectrum
+            size_t workSize = (size_t)REDUCE_GROUP_SIZE;
+            cl_int err = clEnqueueNDRangeKernel(lane.commandQueue, lane.kernelPeaks, 1, nullptr, &workSize, &workSize, 0, nullptr,
+                nextEvent(lane, PROFILE_PEAKS));
             if (err != CL_SUCCESS) {
-                throw OpenCLException(err, "Failed to enqueue the kernel for execution.");
+                throw OpenCLException(err, "Failed to enqueue the peak picking kernel for execution.");
             }
 
-            err = clEnqueueReadBuffer(m_commandQueue, m_onesidePowerBuffer, CL_TRUE, 0, m_onesideSize * sizeof(float), onesidePower, 0, nullptr, nullptr);
+            err = clEnqueueReadBuffer(lane.commandQueue, lane.peaksBuffer, CL_TRUE, 0, m_peakCount * sizeof(Peak), peaks, 0, nullptr,
+                nextEvent(lane, PROFILE_READ));
             if (err != CL_SUCCESS) {
-                throw OpenCLException(err, "Failed to read the data from the buffer object.");
+                throw OpenCLException(err, "Failed to read the peaks from the buffer object.");
             }
+            collectEvents(lane);
 
             return 0;
         }
 
         /// <summary>
-        /// Release OpenCL resources.
+        /// Get the number of peak records per frame.
         /// </summary>
-        void releaseOpenCLResources() {
-            if (m_context) clReleaseContext(m_context);
-            if (m_commandQueue) clReleaseCommandQueue(m_commandQueue);
-            if (m_inputRealBuffer) clReleaseMemObject(m_inputRealBuffer);
-            if (m_onesidePowerBuffer) clReleaseMemObject(m_onesidePowerBuffer);
-            if (m_program) clReleaseProgram(m_program);
-            if (m_kernel) clReleaseKernel(m_kernel);
-        }
+        /// <returns>Number of records, 0 without peak picking.</returns>
+        int getPeakCount() const { return m_peakCount; }
 
         /// <summary>
-        /// Get the size of the one-sided power spectrum.
+        /// Release the peak picking buffers and kernels.
         /// </summary>
-        /// <returns>One-sided power spectrum size.</returns>
-        int getOnesideSize() const { return m_onesideSize; }
+        void clearPeakPicking() {
+            {
+                std::lock_guard<std::mutex> lock(m_lanesMutex);
+                for (auto& pLane : m_lanes) releaseLanePeaks(*pLane);
+            }
+            m_peakCount = 0;
+        }
 
         /// <summary>
-        /// Get the kernel number.
+        /// Set up the device-side spectral features. Must be called after createOpenCLKernel.
         /// </summary>
-        /// <returns>Kernel number (P1S or P1SN).</returns>
-        int getKernelNo() const { return m_kernelNo; }
+        /// <param name="frequencyStep">Width of a bin (Hz), 1 to get the frequencies in bins.</param>
+        /// <param name="rolloffFraction">Fraction of the power below the roll-off frequency.</param>
+        /// <param name="frameGroup">Number of streams whose frames are executed in turn by a thread, e.g. 2 when the channels
+        /// of a stereo stream are transformed one after another; the flux of a frame compares it with the frame frameGroup frames before.</param>
+        /// <param name="firstBin">First bin of the features.</param>
+        /// <param name="lastBin">Last bin of the features, 0 for the Nyquist bin.</param>
+        /// <returns>0 on success, 1 on failure.</returns>
+        int setFeatures(const float frequencyStep = 1.0f, const float rolloffFraction = 0.85f, const int frameGroup = 1,
+            const int firstBin = 0, const int lastBin = 0) {
+            if (m_onesideSize == 0) {
+                throw OpenCLException(1, "The OpenCL kernel is not created.");
+            }
+            if (rolloffFraction <= 0.0f || rolloffFraction > 1.0f || frameGroup < 1) {
+                throw OpenCLException(1, "The feature settings are out of range.");
+            }
 
-    private:
-        std::string m_kernelSource;
-        cl_platform_id m_platform;
-        cl_device_id m_device;
-        cl_context m_context;
-        cl_command_queue m_commandQueue;
-        cl_mem m_inputRealBuffer;
-        cl_mem m_onesidePowerBuffer;
-        cl_program m_program;
-        cl_kernel m_kernel;
+            m_featureFirstBin = (std::max)(firstBin, 0);
+            m_featureLastBin = (lastBin < 1 || lastBin > m_onesideSize - 1) ? m_onesideSize - 1 : lastBin;
+            if (m_featureFirstBin > m_featureLastBin) {
+                throw OpenCLException(1, "The bin range of the features is empty.");
+            }
+            m_fpFrequencyStep = frequencyStep;
+            m_fpRolloffFraction = rolloffFraction;
+            m_featureFrameGroup = frameGroup;
+            m_bFeatures = true;
 
-        int m_sampleSize;
-        int m_onesideSize;
-        int m_kernelNo;
+            // Each lane creates its feature buffers and kernel with its next frame.
+            ++m_featureVersion;
+
+            return 0;
+        }
 
         /// <summary>
-        /// Load OpenCL kernel source code from a file.
+        /// Execute the DFT kernel followed by the feature kernel; the features are read back instead of, or together with, the spectrum.
         /// </summary>
-        /// <param name="fileName">Name of the kernel source file.</param>
+        /// <param name="inputReal">Input real data.</param>
+        /// <param name="features">Output features of the frame.</param>
+        /// <param name="onesidePower">Output one-sided power spectrum, or nullptr to read back only the features.</param>
         /// <returns>0 on success, 1 on failure.</returns>
-        int loadKernelFromFile(const std::string& fileName) {
-            std::ifstream file(fileName);
-            if (!file.is_open()) {
-                std::cerr << "Failed to open the kernel file." << std::endl;
-                return 1;
+        int executeOpenCLFeatures(const float* inputReal, Features* features, float* onesidePower = nullptr) {
+            if (!m_bFeatures) {
+                throw OpenCLException(1, "No features are set.");
+            }
+
+            LaneScope scope(*this, false);
+            Lane& lane = getLane();
+            if (lane.featureVersion != m_featureVersion) createLaneFeatures(lane);
+
+            executeOpenCLKernel(inputReal, onesidePower);
+
+            // The previous spectrum of every stream of the lane stays on the device for the flux
+            int previousOffset = static_cast<int>(lane.featureFrames % m_featureFrameGroup) * m_onesideSize;
+            int hasPrevious = (lane.featureFrames >= static_cast<unsigned long long>(m_featureFrameGroup)) ? 1 : 0;
+            cl_int err = clSetKernelArg(lane.kernelFeatures, 9, sizeof(int), &previousOffset);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelFeatures, 10, sizeof(int), &hasPrevious);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to set the argument values for the feature kernel.");
             }
-            m_kernelSource.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+            // One work-group reduces the whole spectrum
+            size_t workSize = (size_t)REDUCE_GROUP_SIZE;
+            err = clEnqueueNDRangeKernel(lane.commandQueue, lane.kernelFeatures, 1, nullptr, &workSize, &workSize, 0, nullptr,
+                nextEvent(lane, PROFILE_FEATURES));
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to enqueue the feature kernel for execution.");
+            }
+            ++lane.featureFrames;
+
+            err = clEnqueueReadBuffer(lane.commandQueue, lane.featuresBuffer, CL_TRUE, 0, sizeof(Features), features, 0, nullptr,
+                nextEvent(lane, PROFILE_READ));
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to read the features from the buffer object.");
+            }
+            collectEvents(lane);
+
             return 0;
         }
 
+        /// <summary>
+        /// Check whether the spectral features are set.
+        /// </summary>
+        /// <returns>True if executeOpenCLFeatures can be used.</returns>
+        bool hasFeatures() const { return m_bFeatures; }
+
+        /// <summary>
+        /// Release the feature buffers and kernels.
+        /// </summary>
+        void clearFeatures() {
+            {
+                std::lock_guard<std::mutex> lock(m_lanesMutex);
+                for (auto& pLane : m_lanes) releaseLaneFeatures(*pLane);
+            }
+            m_bFeatures = false;
+        }
+
+        /// <summary>
+        /// Set the depth of the device-side spectrogram history in frames. Must be called before createOpenCLKernel.
+        /// </summary>
+        /// <param name="historyDepth">Number of frames kept on the device, 0 disables the history.</param>
+        void setHistoryDepth(const int historyDepth) {
+            if (historyDepth < 0) {
+                throw OpenCLException(1, "The history depth must not be negative.");
+            }
+            m_historyDepth = historyDepth;
+        }
+
+        /// <summary>
+        /// Get the depth of the device-side spectrogram history in frames.
+        /// </summary>
+        /// <returns>History depth.</returns>
+        int getHistoryDepth() const { return m_historyDepth; }
+
+        /// <summary>
+        /// Get the number of frames currently held in the history buffer.
+        /// </summary>
+        /// <returns>Number of stored frames (at most the history depth).</returns>
+        int getHistoryFrameCount() {
+            std::lock_guard<std::mutex> lock(m_historyMutex);
+            return m_historyCount;
+        }
+
+        /// <summary>
+        /// Forget all frames of the history buffer.
+        /// </summary>
+        void clearHistory() {
+            std::lock_guard<std::mutex> lock(m_historyMutex);
+            m_historyNext = 0;
+            m_historyCount = 0;
+            m_historyTotal = 0;
+        }
+
+        /// <summary>
+        /// Read the last frames of the spectrogram history, the oldest frame first.
+        /// </summary>
+        /// <param name="frameCount">Number of requested frames.</param>
+        /// <param name="spectrogram">Output of frameCount * getOnesideSize() values.</param>
+        /// <param name="frameGroup">Frames are returned in whole groups of this size counted from the first executed frame,
+        /// e.g. 2 when the channels of a stereo stream are transformed one after another.</param>
+        /// <returns>Number of frames read, less than frameCount if fewer frames are stored.</returns>
+        int readHistory(const int frameCount, float* spectrogram, const int frameGroup = 1) {
+            std::lock_guard<std::mutex> lock(m_historyMutex);
+
+            if (!m_historyBuffer) {
+                throw OpenCLException(1, "The spectrogram history is not enabled.");
+            }
+
+            // Leave out the newest frames of an incomplete group.
+            int nIncomplete = static_cast<int>(m_historyTotal % frameGroup);
+            int nAvailable = m_historyCount - nIncomplete;
+            int nFrames = (frameCount < nAvailable) ? frameCount : nAvailable;
+            nFrames -= nFrames % frameGroup;
+            if (nFrames <= 0) return 0;
+
+            // The frames may have been copied by the queues of other threads.
+            finishLanes();
+
+            size_t frameBytes = getHistoryFrameBytes();
+            int first = ((m_historyNext - nIncomplete - nFrames) % m_historyDepth + m_historyDepth) % m_historyDepth;
+            int firstPart = (first + nFrames <= m_historyDepth) ? nFrames : m_historyDepth - first;
+
+            // In FP16 mode the history holds packed values which are unpacked after the transfer.
+            void* pTarget = spectrogram;
+            if (m_transferMode == TRANSFER_F16) {
+                m_historyHalf.resize(static_cast<size_t>(nFrames) * m_onesideSize);
+                pTarget = m_historyHalf.data();
+            }
+
+            // A wrapped range is fetched with two reads that complete in a single round trip.
+            cl_int err = clEnqueueReadBuffer(m_historyQueue, m_historyBuffer, CL_FALSE, first * frameBytes, firstPart * frameBytes,
+                pTarget, 0, nullptr, nullptr);
+            if (err == CL_SUCCESS && firstPart < nFrames) {
+                err = clEnqueueReadBuffer(m_historyQueue, m_historyBuffer, CL_FALSE, 0, (nFrames - firstPart) * frameBytes,
+                    static_cast<char*>(pTarget) + firstPart * frameBytes, 0, nullptr, nullptr);
+            }
+            if (err == CL_SUCCESS) err = clFinish(m_historyQueue);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to read the spectrogram history.");
+            }
+
+            if (m_transferMode == TRANSFER_F16) {
+                float fpInverseScale = 1.0f / m_fpHalfOutputScale;
+                for (size_t i = 0; i < m_historyHalf.size(); ++i) spectrogram[i] = halfToFloat(m_historyHalf[i]) * fpInverseScale;
+            }
+
+            return nFrames;
+        }
+
+        /// <summary>
+        /// Measure the accuracy loss of the FP16 transfer mode for one frame.
+        /// The frame is transformed twice, once with FP32 and once with FP16 transfers.
+        /// </summary>
+        /// <param name="inputReal">Input real data.</param>
+        /// <returns>Error of the FP16 power spectrum against the FP32 power spectrum.</returns>
+        TransferErrorReport measureTransferError(const float* inputReal) {
+            if (m_transferMode != TRANSFER_F16) {
+                throw OpenCLException(1, "The FP16 transfer mode is not enabled.");
+            }
+
+            LaneScope scope(*this, false);
+            Lane& lane = getLane();
+
+            // The FP32 buffers are only needed for the comparison, so they are created on first use.
+            if (!lane.inputRealBuffer) createFloatBuffers(lane);
+
+            std::vector<float> powerF32(m_onesideSize);
+            std::vector<float> powerF16(m_onesideSize);
+            executeFloatTransfer(lane, inputReal, powerF32.data());
+            executeHalfTransfer(lane, inputReal, powerF16.data());
+
+            TransferErrorReport report{ 0.0f, 0.0f, 0.0f, 0.0f };
+            double sumSquares = 0.0;
+            for (int i = 0; i < m_onesideSize; ++i) {
+                float error = std::fabs(powerF16[i] - powerF32[i]);
+                if (error > report.maxAbsError) report.maxAbsError = error;
+                if (powerF32[i] > report.peakPower) report.peakPower = powerF32[i];
+                sumSquares += static_cast<double>(error) * error;
+            }
+            report.rmsError = static_cast<float>(std::sqrt(sumSquares / m_onesideSize));
+            if (report.peakPower > 0.0f) report.maxErrorToPeak = report.maxAbsError / report.peakPower;
+
+            return report;
+        }
+
+        /// <summary>
+        /// Release OpenCL resources in the reverse order of their creation.
+        /// The shared context and program are only released by this transform,
+        /// they stay alive in CiCLRuntime for the next transform.
+        /// </summary>
+        void releaseOpenCLResources() {
+            clearFilterbank();
+            clearPeakPicking();
+            clearFeatures();
+            {
+                std::lock_guard<std::mutex> lock(m_lanesMutex);
+                for (auto& pLane : m_lanes) releaseLane(*pLane);
+                m_lanes.clear();
+                m_freeLanes.clear();
+                m_boundLanes.clear();
+            }
+            if (m_historyQueue) clReleaseCommandQueue(m_historyQueue);
+            if (m_historyBuffer) clReleaseMemObject(m_historyBuffer);
+            if (m_program) clReleaseProgram(m_program);
+            if (m_context) clReleaseContext(m_context);
+
+            m_historyQueue = nullptr;
+            m_historyBuffer = nullptr;
+            m_program = nullptr;
+            m_context = nullptr;
+            m_historyNext = m_historyCount = 0;
+            m_historyTotal = 0;
+        }
+
+        /// <summary>
+        /// Set the host-device transfer mode. Must be called before createOpenCLKernel.
+        /// </summary>
+        /// <param name="transferMode">TRANSFER_F32 or TRANSFER_F16.</param>
+        void setTransferMode(const int transferMode) {
+            if (transferMode < 0 || transferMode > 1) {
+                throw OpenCLException(1, "No transfer mode with such number.");
+            }
+            m_transferMode = transferMode;
+        }
+
+        /// <summary>
+        /// Get the host-device transfer mode.
+        /// </summary>
+        /// <returns>Transfer mode (TRANSFER_F32 or TRANSFER_F16).</returns>
+        int getTransferMode() const { return m_transferMode; }
+
+        /// <summary>
+        /// Set the factor the power is multiplied by before it is packed as FP16.
+        /// A value of 0 selects a default suitable for the kernel number.
+        /// The transfer kernels of the lanes take the new factor at once; the history, which is packed with the old one,
+        /// is cleared. It cannot change while a thread executes a frame.
+        /// </summary>
+        /// <param name="fpScale">Output scale factor.</param>
+        void setHalfOutputScale(const float fpScale) {
+            if (fpScale < 0.0f) {
+                throw OpenCLException(1, "The FP16 output scale must not be negative.");
+            }
+
+            // Before createOpenCLKernel the default is not known yet; createOpenCLKernel resolves the 0
+            float fpResolved = (fpScale > 0.0f || m_kernelNo < 0) ? fpScale : getDefaultHalfOutputScale();
+
+            std::lock_guard<std::mutex> historyLock(m_historyMutex);
+            std::lock_guard<std::mutex> lanesLock(m_lanesMutex);
+            if (fpResolved == m_fpHalfOutputScale) return;
+            if (!m_boundLanes.empty()) {
+                throw OpenCLException(1, "The FP16 output scale cannot change while a frame is executed.");
+            }
+            m_fpHalfOutputScale = fpResolved;
+
+            for (auto& pLane : m_lanes) {
+                if (!pLane->kernelHalf) continue;
+                cl_int err = clSetKernelArg(pLane->kernelHalf, 2, sizeof(float), &m_fpHalfOutputScale);
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to set the argument value for the output scale.");
+                }
+            }
+
+            // The filterbank, peak and feature kernels decode with the inverse factor; each lane creates them again with its next frame
+            ++m_filterbankVersion;
+            ++m_peakVersion;
+            ++m_featureVersion;
+            m_historyNext = 0;
+            m_historyCount = 0;
+            m_historyTotal = 0;
+        }
+
+        /// <summary>
+        /// Get the factor the power is multiplied by before it is packed as FP16.
+        /// </summary>
+        /// <returns>Output scale factor.</returns>
+        float getHalfOutputScale() const { return m_fpHalfOutputScale; }
+
+        /// <summary>
+        /// Get the default FP16 output scale of the kernel: it keeps the largest expected power value well below
+        /// the FP16 maximum (65504) while lifting small values out of the FP16 subnormal range.
+        /// </summary>
+        /// <returns>Output scale factor, 0 before createOpenCLKernel.</returns>
+        float getDefaultHalfOutputScale() const {
+            if (m_kernelNo < 0) return 0.0f;
+            return (m_kernelNo == P1SN) ? 16384.0f
+                : 16384.0f * 4.0f / (static_cast<float>(m_sampleSize) * static_cast<float>(m_sampleSize));
+        }
+
+        /// <summary>
+        /// Convert a single precision value to IEEE half precision with rounding to nearest even.
+        /// </summary>
+        /// <param name="value">Single precision value.</param>
+        /// <returns>Half precision bit pattern.</returns>
+        static cl_half floatToHalf(const float value) {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+
+            uint32_t sign = (bits >> 16) & 0x8000u;
+            uint32_t absBits = bits & 0x7FFFFFFFu;
+
+            // NaN and infinity
+            if (absBits >= 0x7F800000u) {
+                return static_cast<cl_half>(sign | 0x7C00u | (absBits > 0x7F800000u ? 0x0200u : 0u));
+            }
+            // Overflow to infinity
+            if (absBits >= 0x477FF000u) {
+                return static_cast<cl_half>(sign | 0x7C00u);
+            }
+            // Normal half values
+            if (absBits >= 0x38800000u) {
+                uint32_t mantissa = absBits + 0xC8000FFFu + ((absBits >> 13) & 1u);
+                return static_cast<cl_half>(sign | (mantissa >> 13));
+            }
+            // Subnormal half values and zero
+            if (absBits > 0x33000000u) {
+                uint32_t exponent = absBits >> 23;
+                uint32_t mantissa = (absBits & 0x007FFFFFu) | 0x00800000u;
+                uint32_t shift = 126u - exponent;
+                uint32_t half = mantissa >> shift;
+                uint32_t rest = mantissa & ((1u << shift) - 1u);
+                uint32_t middle = 1u << (shift - 1u);
+                if (rest > middle || (rest == middle && (half & 1u))) ++half;
+                return static_cast<cl_half>(sign | half);
+            }
+            return static_cast<cl_half>(sign);
+        }
+
+        /// <summary>
+        /// Convert an IEEE half precision value to single precision.
+        /// </summary>
+        /// <param name="value">Half precision bit pattern.</param>
+        /// <returns>Single precision value.</returns>
+        static float halfToFloat(const cl_half value) {
+            uint32_t sign = (static_cast<uint32_t>(value) & 0x8000u) << 16;
+            uint32_t exponent = (value >> 10) & 0x1Fu;
+            uint32_t mantissa = value & 0x03FFu;
+            uint32_t bits;
+
+            if (exponent == 0x1Fu) {
+                bits = sign | 0x7F800000u | (mantissa << 13);
+            }
+            else if (exponent != 0) {
+                bits = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+            }
+            else if (mantissa != 0) {
+                // Normalize the subnormal half value
+                exponent = 113u;
+                while ((mantissa & 0x0400u) == 0) {
+                    mantissa <<= 1;
+                    --exponent;
+                }
+                bits = sign | (exponent << 23) | ((mantissa & 0x03FFu) << 13);
+            }
+            else {
+                bits = sign;
+            }
+
+            float result;
+            std::memcpy(&result, &bits, sizeof(result));
+            return result;
+        }
+
+        /// <summary>
+        /// Get the size of the input samples.
+        /// </summary>
+        /// <returns>Sample size.</returns>
+        int getSampleSize() const { return m_sampleSize; }
+
+        /// <summary>
+        /// Get the size of the one-sided power spectrum.
+        /// </summary>
+        /// <returns>One-sided power spectrum size.</returns>
+        int getOnesideSize() const { return m_onesideSize; }
+
+        /// <summary>
+        /// Get the kernel number.
+        /// </summary>
+        /// <returns>Kernel number (P1S or P1SN).</returns>
+        int getKernelNo() const { return m_kernelNo; }
+
+        /// <summary>
+        /// Get the number of lanes of the pool, i.e. the largest number of threads that executed frames at the same time.
+        /// </summary>
+        /// <returns>Number of lanes.</returns>
+        size_t getLaneCount() {
+            std::lock_guard<std::mutex> lock(m_lanesMutex);
+            return m_lanes.size();
+        }
+
+    private:
+
+        // Work-group size of the kernels that reduce a whole spectrum, must match REDUCE_GROUP_SIZE in the kernel source
+        static const int REDUCE_GROUP_SIZE = 64;
+
+        /// <summary>
+        /// Command queue, buffers and kernel objects used by one thread at a time.
+        /// The kernel arguments are bound once, so the kernels of a lane are never shared.
+        /// </summary>
+        struct Lane {
+            cl_command_queue commandQueue = nullptr;
+            cl_mem inputRealBuffer = nullptr;
+            cl_mem onesidePowerBuffer = nullptr;
+            cl_mem inputHalfBuffer = nullptr;
+            cl_mem onesideHalfBuffer = nullptr;
+            cl_mem bandsBuffer = nullptr;
+            cl_kernel kernel = nullptr;
+            cl_kernel kernelHalf = nullptr;
+            cl_kernel kernelFilterbank = nullptr;
+            unsigned int filterbankVersion = 0;
+            cl_mem peaksBuffer = nullptr;
+            cl_kernel kernelPeaks = nullptr;
+            unsigned int peakVersion = 0;
+            cl_mem previousBuffer = nullptr;
+            cl_mem featuresBuffer = nullptr;
+            cl_kernel kernelFeatures = nullptr;
+            unsigned int featureVersion = 0;
+            unsigned long long featureFrames = 0;
+            cl_mem batchInputBuffer = nullptr;
+            cl_mem batchOutputBuffer = nullptr;
+            cl_kernel kernelBatch = nullptr;
+            int batchCapacity = 0;
+            std::vector<cl_half> halfInput;
+            std::vector<cl_half> halfOutput;
+            std::vector<std::pair<int, cl_event>> pendingEvents;  // Profiling events by stage
+        };
+
+        /// <summary>
+        /// Most recent profiling samples of one stage.
+        /// </summary>
+        struct ProfileRing {
+            std::vector<ProfileSample> samples;
+            size_t next = 0;
+        };
+
+        cl_platform_id m_platform;
+        cl_device_id m_device;
+        cl_context m_context;
+        cl_program m_program;
+        cl_command_queue m_historyQueue;
+        cl_mem m_historyBuffer;
+        cl_mem m_rowOffsetsBuffer;
+        cl_mem m_columnsBuffer;
+        cl_mem m_weightsBuffer;
+
+        int m_sampleSize;
+        int m_onesideSize;
+        int m_kernelNo;
+        int m_transferMode;
+        float m_fpHalfOutputScale;
+
+        // Circular spectrogram history on the device
+        int m_historyDepth;
+        int m_historyNext;
+        int m_historyCount;
+        unsigned long long m_historyTotal;
+        std::mutex m_historyMutex;
+        std::vector<cl_half> m_historyHalf;
+
+        int m_bandCount;
+        unsigned int m_filterbankVersion;
+
+        // Peak picking
+        int m_peakCount;
+        float m_fpMinProminence;
+        int m_peakFirstBin;
+        int m_peakLastBin;
+        unsigned int m_peakVersion;
+
+        // Spectral features
+        bool m_bFeatures;
+        float m_fpFrequencyStep;
+        float m_fpRolloffFraction;
+        int m_featureFirstBin;
+        int m_featureLastBin;
+        int m_featureFrameGroup;
+        unsigned int m_featureVersion;
+
+        int m_deviceIndex;
+
+        // Pool of lanes, the free ones and the ones held by executing threads; lock order is m_historyMutex before m_lanesMutex.
+        // A thread holds its lane only while it executes a frame or a LaneScope, so a finished thread leaves no entry behind.
+        std::mutex m_lanesMutex;
+        std::vector<std::unique_ptr<Lane>> m_lanes;
+        std::vector<Lane*> m_freeLanes;
+        std::map<std::thread::id, Lane*> m_boundLanes;
+
+        // Profiling samples of all lanes
+        bool m_bProfiling;
+        size_t m_profileCapacity;
+        std::mutex m_profileMutex;
+        ProfileRing m_profile[PROFILE_STAGES];
+
+        /// <summary>
+        /// Give the calling thread a free lane, creating one when all lanes are held by other threads.
+        /// </summary>
+        /// <returns>True if a lane was taken, false if the thread already holds one.</returns>
+        bool bindLane() {
+            std::lock_guard<std::mutex> lock(m_lanesMutex);
+
+            std::thread::id id = std::this_thread::get_id();
+            if (m_boundLanes.count(id)) return false;
+
+            if (m_freeLanes.empty()) {
+                std::unique_ptr<Lane> pNewLane(new Lane());
+                try {
+                    createLane(*pNewLane);
+                }
+                catch (...) {
+                    releaseLane(*pNewLane);
+                    throw;
+                }
+                m_lanes.push_back(std::move(pNewLane));
+                m_freeLanes.push_back(m_lanes.back().get());
+            }
+
+            // The most recently returned lane first, its buffers are the likeliest to be warm
+            m_boundLanes.emplace(id, m_freeLanes.back());
+            m_freeLanes.pop_back();
+            return true;
+        }
+
+        /// <summary>
+        /// Give the lane of the calling thread back to the pool.
+        /// </summary>
+        /// <param name="bStage">True at the end of a stage: the next holder starts new streams, so the flux has no previous frame.</param>
+        void returnLane(const bool bStage) {
+            std::lock_guard<std::mutex> lock(m_lanesMutex);
+
+            auto it = m_boundLanes.find(std::this_thread::get_id());
+            if (it == m_boundLanes.end()) return;
+            if (bStage) it->second->featureFrames = 0;
+            m_freeLanes.push_back(it->second);
+            m_boundLanes.erase(it);
+        }
+
+        /// <summary>
+        /// Get the lane held by the calling thread; a LaneScope of the thread must be alive.
+        /// </summary>
+        Lane& getLane() {
+            std::lock_guard<std::mutex> lock(m_lanesMutex);
+            return *m_boundLanes.at(std::this_thread::get_id());
+        }
+
+        /// <summary>
+        /// Create the command queue, buffers and kernel objects of a lane and bind the kernel arguments.
+        /// </summary>
+        void createLane(Lane& lane) {
+            cl_int err;
+
+            if (!m_program || m_onesideSize == 0) {
+                throw OpenCLException(1, "The OpenCL kernel is not created.");
+            }
+
+            lane.commandQueue = clCreateCommandQueue(m_context, m_device, m_bProfiling ? CL_QUEUE_PROFILING_ENABLE : 0, &err);
+            if (err != CL_SUCCESS) {
+                lane.commandQueue = nullptr;
+                throw OpenCLException(err, "Failed to create the command queue of a lane.");
+            }
+
+            if (m_transferMode == TRANSFER_F16) {
+                lane.inputHalfBuffer = clCreateBuffer(m_context, CL_MEM_READ_ONLY, m_sampleSize * sizeof(cl_half), nullptr, &err);
+                if (err == CL_SUCCESS) lane.onesideHalfBuffer = clCreateBuffer(m_context, CL_MEM_WRITE_ONLY, m_onesideSize * sizeof(cl_half), nullptr, &err);
+                if (err != CL_SUCCESS || !lane.inputHalfBuffer || !lane.onesideHalfBuffer) {
+                    throw OpenCLException(err, "Failed to create OpenCL FP16 buffers.");
+                }
+
+                lane.halfInput.resize(m_sampleSize);
+                lane.halfOutput.resize(m_onesideSize);
+
+                if (m_kernelNo == P1S) lane.kernelHalf = clCreateKernel(m_program, "dft_R1SP_H", &err);
+                if (m_kernelNo == P1SN) lane.kernelHalf = clCreateKernel(m_program, "dft_R1SPN_H", &err);
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to create the OpenCL FP16 transfer kernel.");
+                }
+
+                err = clSetKernelArg(lane.kernelHalf, 0, sizeof(cl_mem), &lane.inputHalfBuffer);
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to set the argument value for the input buffer.");
+                }
+
+                err = clSetKernelArg(lane.kernelHalf, 1, sizeof(cl_mem), &lane.onesideHalfBuffer);
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to set the argument value for the output buffer.");
+                }
+
+                err = clSetKernelArg(lane.kernelHalf, 2, sizeof(float), &m_fpHalfOutputScale);
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to set the argument value for the output scale.");
+                }
+            }
+            else {
+                createFloatBuffers(lane);
+            }
+        }
+
+        /// <summary>
+        /// Create the FP32 input and output buffers and the FP32 kernel of a lane.
+        /// </summary>
+        void createFloatBuffers(Lane& lane) {
+            cl_int err;
+
+            lane.inputRealBuffer = clCreateBuffer(m_context, CL_MEM_READ_ONLY, m_sampleSize * sizeof(float), nullptr, &err);
+            if (err == CL_SUCCESS) lane.onesidePowerBuffer = clCreateBuffer(m_context, CL_MEM_WRITE_ONLY, m_onesideSize * sizeof(float), nullptr, &err);
+
+            if (err != CL_SUCCESS || !lane.inputRealBuffer || !lane.onesidePowerBuffer) {
+                throw OpenCLException(err, "Failed to create OpenCL buffers.");
+            }
+
+            if (m_kernelNo == P1S) lane.kernel = clCreateKernel(m_program, "dft_R1SP", &err);
+            if (m_kernelNo == P1SN) lane.kernel = clCreateKernel(m_program, "dft_R1SPN", &err);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to create the OpenCL kernel.");
+            }
+
+            err = clSetKernelArg(lane.kernel, 0, sizeof(cl_mem), &lane.inputRealBuffer);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to set the argument value for the input buffer.");
+            }
+
+            err = clSetKernelArg(lane.kernel, 1, sizeof(cl_mem), &lane.onesidePowerBuffer);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to set the argument value for the output buffer.");
+            }
+        }
+
+        /// <summary>
+        /// Create the batch buffers and batch kernel of a lane for at least frameCount frames.
+        /// </summary>
+        void createLaneBatch(Lane& lane, const int frameCount) {
+            cl_int err;
+
+            releaseLaneBatch(lane);
+
+            // Grow in powers of two, so a slowly growing batch does not recreate the buffers every time
+            int capacity = 1;
+            while (capacity < frameCount) capacity *= 2;
+
+            lane.batchInputBuffer = clCreateBuffer(m_context, CL_MEM_READ_ONLY, static_cast<size_t>(capacity) * m_sampleSize * sizeof(float), nullptr, &err);
+            if (err == CL_SUCCESS) lane.batchOutputBuffer = clCreateBuffer(m_context, CL_MEM_WRITE_ONLY, static_cast<size_t>(capacity) * m_onesideSize * sizeof(float), nullptr, &err);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to create OpenCL batch buffers.");
+            }
+
+            lane.kernelBatch = clCreateKernel(m_program, (m_kernelNo == P1SN) ? "dft_R1SPN_B" : "dft_R1SP_B", &err);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to create the OpenCL batch kernel.");
+            }
+
+            err = clSetKernelArg(lane.kernelBatch, 0, sizeof(cl_mem), &lane.batchInputBuffer);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelBatch, 1, sizeof(cl_mem), &lane.batchOutputBuffer);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to set the argument values for the batch kernel.");
+            }
+
+            lane.batchCapacity = capacity;
+        }
+
+        /// <summary>
+        /// Release the batch kernel and buffers of a lane.
+        /// </summary>
+        void releaseLaneBatch(Lane& lane) {
+            if (lane.kernelBatch) clReleaseKernel(lane.kernelBatch);
+            if (lane.batchOutputBuffer) clReleaseMemObject(lane.batchOutputBuffer);
+            if (lane.batchInputBuffer) clReleaseMemObject(lane.batchInputBuffer);
+            lane.kernelBatch = nullptr;
+            lane.batchOutputBuffer = nullptr;
+            lane.batchInputBuffer = nullptr;
+            lane.batchCapacity = 0;
+        }
+
+        /// <summary>
+        /// Create the band output buffer and filterbank kernel of a lane for the current band matrix.
+        /// </summary>
+        void createLaneFilterbank(Lane& lane) {
+            cl_int err;
+
+            releaseLaneFilterbank(lane);
+
+            lane.bandsBuffer = clCreateBuffer(m_context, CL_MEM_WRITE_ONLY, m_bandCount * sizeof(float), nullptr, &err);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to create OpenCL filterbank buffers.");
+            }
+
+            lane.kernelFilterbank = clCreateKernel(m_program, (m_transferMode == TRANSFER_F16) ? "filterbank_CSR_H" : "filterbank_CSR", &err);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to create the OpenCL filterbank kernel.");
+            }
+
+            // The arguments do not change between frames.
+            cl_mem power = (m_transferMode == TRANSFER_F16) ? lane.onesideHalfBuffer : lane.onesidePowerBuffer;
+            err = clSetKernelArg(lane.kernelFilterbank, 0, sizeof(cl_mem), &power);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelFilterbank, 1, sizeof(cl_mem), &m_rowOffsetsBuffer);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelFilterbank, 2, sizeof(cl_mem), &m_columnsBuffer);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelFilterbank, 3, sizeof(cl_mem), &m_weightsBuffer);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelFilterbank, 4, sizeof(cl_mem), &lane.bandsBuffer);
+            if (err == CL_SUCCESS && m_transferMode == TRANSFER_F16) {
+                float fpInverseScale = 1.0f / m_fpHalfOutputScale;
+                err = clSetKernelArg(lane.kernelFilterbank, 5, sizeof(float), &fpInverseScale);
+            }
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to set the argument values for the filterbank kernel.");
+            }
+
+            lane.filterbankVersion = m_filterbankVersion;
+        }
+
+        /// <summary>
+        /// Release the filterbank kernel and band output buffer of a lane.
+        /// </summary>
+        void releaseLaneFilterbank(Lane& lane) {
+            if (lane.kernelFilterbank) clReleaseKernel(lane.kernelFilterbank);
+            if (lane.bandsBuffer) clReleaseMemObject(lane.bandsBuffer);
+            lane.kernelFilterbank = nullptr;
+            lane.bandsBuffer = nullptr;
+            lane.filterbankVersion = 0;
+        }
+
+        /// <summary>
+        /// Create the peak output buffer and peak picking kernel of a lane for the current settings.
+        /// </summary>
+        void createLanePeaks(Lane& lane) {
+            cl_int err;
+
+            releaseLanePeaks(lane);
+
+            lane.peaksBuffer = clCreateBuffer(m_context, CL_MEM_WRITE_ONLY, m_peakCount * sizeof(Peak), nullptr, &err);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to create OpenCL peak picking buffers.");
+            }
+
+            lane.kernelPeaks = clCreateKernel(m_program, (m_transferMode == TRANSFER_F16) ? "peaks_topK_H" : "peaks_topK", &err);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to create the OpenCL peak picking kernel.");
+            }
+
+            // The arguments do not change between frames.
+            cl_mem power = (m_transferMode == TRANSFER_F16) ? lane.onesideHalfBuffer : lane.onesidePowerBuffer;
+            err = clSetKernelArg(lane.kernelPeaks, 0, sizeof(cl_mem), &power);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelPeaks, 1, sizeof(cl_mem), &lane.peaksBuffer);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelPeaks, 2, sizeof(int), &m_onesideSize);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelPeaks, 3, sizeof(int), &m_peakCount);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelPeaks, 4, sizeof(float), &m_fpMinProminence);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelPeaks, 5, sizeof(int), &m_peakFirstBin);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelPeaks, 6, sizeof(int), &m_peakLastBin);
+            if (err == CL_SUCCESS && m_transferMode == TRANSFER_F16) {
+                float fpInverseScale = 1.0f / m_fpHalfOutputScale;
+                err = clSetKernelArg(lane.kernelPeaks, 7, sizeof(float), &fpInverseScale);
+            }
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to set the argument values for the peak picking kernel.");
+            }
+
+            lane.peakVersion = m_peakVersion;
+        }
+
+        /// <summary>
+        /// Release the peak picking kernel and peak output buffer of a lane.
+        /// </summary>
+        void releaseLanePeaks(Lane& lane) {
+            if (lane.kernelPeaks) clReleaseKernel(lane.kernelPeaks);
+            if (lane.peaksBuffer) clReleaseMemObject(lane.peaksBuffer);
+            lane.kernelPeaks = nullptr;
+            lane.peaksBuffer = nullptr;
+            lane.peakVersion = 0;
+        }
+
+        /// <summary>
+        /// Create the feature buffers and feature kernel of a lane for the current settings.
+        /// </summary>
+        void createLaneFeatures(Lane& lane) {
+            cl_int err;
+
+            releaseLaneFeatures(lane);
+
+            lane.previousBuffer = clCreateBuffer(m_context, CL_MEM_READ_WRITE, static_cast<size_t>(m_featureFrameGroup) * m_onesideSize * sizeof(float), nullptr, &err);
+            if (err == CL_SUCCESS) lane.featuresBuffer = clCreateBuffer(m_context, CL_MEM_WRITE_ONLY, sizeof(Features), nullptr, &err);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to create OpenCL feature buffers.");
+            }
+
+            lane.kernelFeatures = clCreateKernel(m_program, (m_transferMode == TRANSFER_F16) ? "features_R_H" : "features_R", &err);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to create the OpenCL feature kernel.");
+            }
+
+            // The arguments except the previous frame slot do not change between frames.
+            bool bHalf = m_transferMode == TRANSFER_F16;
+            cl_mem power = bHalf ? lane.onesideHalfBuffer : lane.onesidePowerBuffer;
+            cl_mem input = bHalf ? lane.inputHalfBuffer : lane.inputRealBuffer;
+            err = clSetKernelArg(lane.kernelFeatures, 0, sizeof(cl_mem), &power);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelFeatures, 1, sizeof(cl_mem), &input);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelFeatures, 2, sizeof(cl_mem), &lane.previousBuffer);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelFeatures, 3, sizeof(cl_mem), &lane.featuresBuffer);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelFeatures, 4, sizeof(int), &m_sampleSize);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelFeatures, 5, sizeof(int), &m_featureFirstBin);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelFeatures, 6, sizeof(int), &m_featureLastBin);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelFeatures, 7, sizeof(float), &m_fpFrequencyStep);
+            if (err == CL_SUCCESS) err = clSetKernelArg(lane.kernelFeatures, 8, sizeof(float), &m_fpRolloffFraction);
+            if (err == CL_SUCCESS && bHalf) {
+                float fpInverseScale = 1.0f / m_fpHalfOutputScale;
+                err = clSetKernelArg(lane.kernelFeatures, 11, sizeof(float), &fpInverseScale);
+            }
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to set the argument values for the feature kernel.");
+            }
+
+            lane.featureVersion = m_featureVersion;
+            lane.featureFrames = 0;
+        }
+
+        /// <summary>
+        /// Release the feature kernel and buffers of a lane.
+        /// </summary>
+        void releaseLaneFeatures(Lane& lane) {
+            if (lane.kernelFeatures) clReleaseKernel(lane.kernelFeatures);
+            if (lane.featuresBuffer) clReleaseMemObject(lane.featuresBuffer);
+            if (lane.previousBuffer) clReleaseMemObject(lane.previousBuffer);
+            lane.kernelFeatures = nullptr;
+            lane.featuresBuffer = nullptr;
+            lane.previousBuffer = nullptr;
+            lane.featureVersion = 0;
+            lane.featureFrames = 0;
+        }
+
+        /// <summary>
+        /// Release the kernels, buffers and command queue of a lane in the reverse order of their creation.
+        /// </summary>
+        void releaseLane(Lane& lane) {
+            for (auto& pending : lane.pendingEvents) {
+                if (pending.second) clReleaseEvent(pending.second);
+            }
+            releaseLaneBatch(lane);
+            releaseLaneFeatures(lane);
+            releaseLanePeaks(lane);
+            releaseLaneFilterbank(lane);
+            if (lane.kernel) clReleaseKernel(lane.kernel);
+            if (lane.kernelHalf) clReleaseKernel(lane.kernelHalf);
+            if (lane.onesidePowerBuffer) clReleaseMemObject(lane.onesidePowerBuffer);
+            if (lane.inputRealBuffer) clReleaseMemObject(lane.inputRealBuffer);
+            if (lane.onesideHalfBuffer) clReleaseMemObject(lane.onesideHalfBuffer);
+            if (lane.inputHalfBuffer) clReleaseMemObject(lane.inputHalfBuffer);
+            if (lane.commandQueue) clReleaseCommandQueue(lane.commandQueue);
+            lane = Lane();
+        }
+
+        /// <summary>
+        /// Wait until the command queues of all lanes have finished.
+        /// </summary>
+        void finishLanes() {
+            std::lock_guard<std::mutex> lock(m_lanesMutex);
+            for (auto& pLane : m_lanes) {
+                if (pLane->commandQueue) clFinish(pLane->commandQueue);
+            }
+        }
+
+        /// <summary>
+        /// Execute the DFT kernel with FP32 input and output transfers.
+        /// </summary>
+        /// <param name="lane">Lane of the calling thread.</param>
+        /// <param name="inputReal">Input real data.</param>
+        /// <param name="onesidePower">Output one-sided power spectrum, or nullptr to skip the readback.</param>
+        /// <returns>0 on success, 1 on failure.</returns>
+        int executeFloatTransfer(Lane& lane, const float* inputReal, float* onesidePower) {
+            cl_int err;
+
+            {
+                CI_TRACE_SCOPE("upload");
+                err = clEnqueueWriteBuffer(lane.commandQueue, lane.inputRealBuffer, CL_TRUE, 0, m_sampleSize * sizeof(float), inputReal, 0, nullptr,
+                    nextEvent(lane, PROFILE_WRITE));
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to write data to a buffer object in device memory.");
+                }
+            }
+            collectEvents(lane);
+
+            size_t globalWorkSize = (size_t)m_onesideSize;
+            {
+                // The launch returns at once; the run of the kernel shows in the blocking readback
+                CI_TRACE_SCOPE("kernel");
+                err = clEnqueueNDRangeKernel(lane.commandQueue, lane.kernel, 1, nullptr, &globalWorkSize, nullptr, 0, nullptr,
+                    nextEvent(lane, PROFILE_KERNEL));
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to enqueue the kernel for execution.");
+                }
+            }
+
+            if (!onesidePower) return 0;
+
+            {
+                CI_TRACE_SCOPE("readback");
+                err = clEnqueueReadBuffer(lane.commandQueue, lane.onesidePowerBuffer, CL_TRUE, 0, m_onesideSize * sizeof(float), onesidePower, 0, nullptr,
+                    nextEvent(lane, PROFILE_READ));
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to read the data from the buffer object.");
+                }
+            }
+            collectEvents(lane);
+
+            return 0;
+        }
+
+        /// <summary>
+        /// Execute the DFT kernel with FP16 input and output transfers.
+        /// The kernel unpacks the samples and computes in FP32.
+        /// </summary>
+        /// <param name="lane">Lane of the calling thread.</param>
+        /// <param name="inputReal">Input real data.</param>
+        /// <param name="onesidePower">Output one-sided power spectrum, or nullptr to skip the readback.</param>
+        /// <returns>0 on success, 1 on failure.</returns>
+        int executeHalfTransfer(Lane& lane, const float* inputReal, float* onesidePower) {
+            cl_int err;
+
+            for (int i = 0; i < m_sampleSize; ++i) lane.halfInput[i] = floatToHalf(inputReal[i]);
+
+            {
+                CI_TRACE_SCOPE("upload");
+                err = clEnqueueWriteBuffer(lane.commandQueue, lane.inputHalfBuffer, CL_TRUE, 0, m_sampleSize * sizeof(cl_half), lane.halfInput.data(), 0, nullptr,
+                    nextEvent(lane, PROFILE_WRITE));
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to write data to a buffer object in device memory.");
+                }
+            }
+            collectEvents(lane);
+
+            size_t globalWorkSize = (size_t)m_onesideSize;
+            {
+                // The launch returns at once; the run of the kernel shows in the blocking readback
+                CI_TRACE_SCOPE("kernel");
+                err = clEnqueueNDRangeKernel(lane.commandQueue, lane.kernelHalf, 1, nullptr, &globalWorkSize, nullptr, 0, nullptr,
+                    nextEvent(lane, PROFILE_KERNEL));
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to enqueue the kernel for execution.");
+                }
+            }
+
+            if (!onesidePower) return 0;
+
+            {
+                CI_TRACE_SCOPE("readback");
+                err = clEnqueueReadBuffer(lane.commandQueue, lane.onesideHalfBuffer, CL_TRUE, 0, m_onesideSize * sizeof(cl_half), lane.halfOutput.data(), 0, nullptr,
+                    nextEvent(lane, PROFILE_READ));
+                if (err != CL_SUCCESS) {
+                    throw OpenCLException(err, "Failed to read the data from the buffer object.");
+                }
+            }
+            collectEvents(lane);
+
+            float fpInverseScale = 1.0f / m_fpHalfOutputScale;
+            for (int i = 0; i < m_onesideSize; ++i) onesidePower[i] = halfToFloat(lane.halfOutput[i]) * fpInverseScale;
+
+            return 0;
+        }
+
+        /// <summary>
+        /// Get the event slot for the next command of a stage, or nullptr when profiling is disabled.
+        /// </summary>
+        cl_event* nextEvent(Lane& lane, const int stage) {
+            if (!m_bProfiling) return nullptr;
+            lane.pendingEvents.emplace_back(stage, nullptr);
+            return &lane.pendingEvents.back().second;
+        }
+
+        /// <summary>
+        /// Record the timestamps of the pending events of a lane.
+        /// Called after a blocking transfer: the queue is in order, so every earlier command has completed.
+        /// </summary>
+        void collectEvents(Lane& lane) {
+            if (lane.pendingEvents.empty()) return;
+
+            std::lock_guard<std::mutex> lock(m_profileMutex);
+            for (auto& pending : lane.pendingEvents) {
+                if (!pending.second) continue;
+
+                ProfileSample sample{ 0, 0, 0, 0 };
+                cl_int err = clGetEventProfilingInfo(pending.second, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &sample.queued, nullptr);
+                if (err == CL_SUCCESS) err = clGetEventProfilingInfo(pending.second, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &sample.submit, nullptr);
+                if (err == CL_SUCCESS) err = clGetEventProfilingInfo(pending.second, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &sample.start, nullptr);
+                if (err == CL_SUCCESS) err = clGetEventProfilingInfo(pending.second, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &sample.end, nullptr);
+                clReleaseEvent(pending.second);
+
+                if (err != CL_SUCCESS) continue;
+
+                ProfileRing& ring = m_profile[pending.first];
+                if (ring.samples.size() < m_profileCapacity) {
+                    ring.samples.push_back(sample);
+                }
+                else {
+                    ring.samples[ring.next] = sample;
+                    ring.next = (ring.next + 1) % m_profileCapacity;
+                }
+            }
+            lane.pendingEvents.clear();
+        }
+
+        /// <summary>
+        /// Compute the statistics of the interval between two timestamps of the samples.
+        /// </summary>
+        static ProfileStats computeStats(const std::vector<ProfileSample>& samples, cl_ulong ProfileSample::* from, cl_ulong ProfileSample::* to) {
+            ProfileStats stats{ samples.size(), 0.0, 0.0, 0.0, 0.0 };
+            if (samples.empty()) return stats;
+
+            std::vector<double> durations;
+            durations.reserve(samples.size());
+            for (const ProfileSample& sample : samples) {
+                // Some drivers leave out the submit time, the interval then counts as zero.
+                double us = (sample.*to >= sample.*from) ? (sample.*to - sample.*from) / 1000.0 : 0.0;
+                durations.push_back(us);
+                stats.mean += us;
+            }
+            std::sort(durations.begin(), durations.end());
+
+            stats.mean /= durations.size();
+            stats.p50 = durations[(durations.size() - 1) / 2];
+            stats.p99 = durations[static_cast<size_t>(std::ceil(0.99 * durations.size())) - 1];
+            stats.max = durations.back();
+            return stats;
+        }
+
+        /// <summary>
+        /// Get the size of one history frame in bytes for the current transfer mode.
+        /// </summary>
+        size_t getHistoryFrameBytes() const {
+            return m_onesideSize * ((m_transferMode == TRANSFER_F16) ? sizeof(cl_half) : sizeof(float));
+        }
+
+        /// <summary>
+        /// Copy the power spectrum of the last executed kernel into the next history slot.
+        /// The copy stays on the device and is ordered after the kernel by the in-order queue of the lane.
+        /// </summary>
+        void appendHistory(Lane& lane) {
+            std::lock_guard<std::mutex> lock(m_historyMutex);
+
+            size_t frameBytes = getHistoryFrameBytes();
+            cl_mem source = (m_transferMode == TRANSFER_F16) ? lane.onesideHalfBuffer : lane.onesidePowerBuffer;
+
+            cl_int err = clEnqueueCopyBuffer(lane.commandQueue, source, m_historyBuffer, 0, m_historyNext * frameBytes, frameBytes, 0, nullptr, nullptr);
+            if (err != CL_SUCCESS) {
+                throw OpenCLException(err, "Failed to copy the power spectrum into the history buffer.");
+            }
+
+            m_historyNext = (m_historyNext + 1) % m_historyDepth;
+            if (m_historyCount < m_historyDepth) ++m_historyCount;
+            ++m_historyTotal;
+        }
+
     };
 
 }
@@ -0,0 +1,337 @@
+// This C++ code defines a compressed variant of the spectrogram file. It
+// has the header and frequency table of CiSpectrogramFile.hpp, followed by
+// independent blocks of frames coded with CiSpectrumCodec. The sink
+// compresses on its own I/O thread, so the transform stage never pays for
+// it, and the disk sees a fraction of the raw record bytes. A compressed
+// recording can be expanded into a regular spectrogram file for the
+// memory-mapped queries of CiSpectrogramReader.
+//
+// Layout (little-endian):
+//   CiSpectrogramHeader           magic "VISPEZ01", nRecordSize is the size of an uncompressed record
+//   float frequencies[nValues]    at nHeaderSize
+//   blocks                        from nDataOffset until the end of the file:
+//                                   CiCompressedBlock, CiSpectrogramRecord[nFrames], payload,
+//                                   padding to a multiple of 8 bytes
+
+#pragma once
+#include "CiSpectrogramFile.hpp"
+#include "CiSpectrumCodec.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Header of a block of compressed frames.
+    /// </summary>
+    struct CiCompressedBlock {
+        char magic[4];              // "VZB1"
+        uint32_t nFrames;           // Number of frames in the block
+        uint64_t nPayloadSize;      // Size of the coded values (bytes)
+    };
+
+    static_assert(sizeof(CiCompressedBlock) == 16, "The compressed block header must be 16 bytes.");
+
+    /// <summary>
+    /// Class for writing a compressed spectrogram file.
+    /// </summary>
+    class CiCompressedSpectrogramWriter {
+    public:
+
+        CiCompressedSpectrogramWriter() : m_sizeBlockFrames(64), m_nRawBytes(0), m_nFileBytes(0), m_nFrameCount(0) {
+            std::memset(&m_header, 0, sizeof(m_header));
+        }
+
+        CiCompressedSpectrogramWriter(const CiCompressedSpectrogramWriter&) = delete;
+        CiCompressedSpectrogramWriter& operator=(const CiCompressedSpectrogramWriter&) = delete;
+
+        /// <summary>
+        /// Destructor for CiCompressedSpectrogramWriter. Writes the last block and closes the file.
+        /// </summary>
+        ~CiCompressedSpectrogramWriter() {
+            try {
+                close();
+            }
+            catch (...) {}
+        }
+
+        /// <summary>
+        /// Set the number of frames per block. Larger blocks compress slightly better, smaller ones lose less on a crash.
+        /// </summary>
+        /// <param name="sizeBlockFrames">Frames per block.</param>
+        void setBlockFrames(const size_t sizeBlockFrames) { m_sizeBlockFrames = sizeBlockFrames > 0 ? sizeBlockFrames : 1; }
+
+        /// <summary>
+        /// Create a compressed spectrogram file and write its header.
+        /// </summary>
+        /// <param name="sFileName">Name of the file.</param>
+        /// <param name="layout">Description of the frames; the values nIndexMin ... nIndexMax of every channel are stored.</param>
+        /// <param name="sWindow">Name of the window function applied before the transform.</param>
+        void open(const std::string& sFileName, const CiSinkLayout& layout, const std::string& sWindow = "rectangular") {
+            close();
+
+            m_header = CiSpectrogramFormat::makeHeader(layout, sWindow, CiSpectrogramFormat::COMPRESSED_MAGIC);
+
+            m_file.open(sFileName, std::ios::binary | std::ios::trunc);
+            if (!m_file.is_open()) {
+                throw std::runtime_error("Can't open a file " + sFileName + ".");
+            }
+            m_sFileName = sFileName;
+
+            std::vector<char> start(static_cast<size_t>(m_header.nDataOffset), 0);
+            std::memcpy(start.data(), &m_header, sizeof(m_header));
+            std::memcpy(start.data() + m_header.nHeaderSize, layout.frequencies.data() + layout.nIndexMin, m_header.nValues * sizeof(float));
+            writeRaw(start.data(), start.size());
+
+            size_t sizeValues = static_cast<size_t>(m_header.nChannels) * m_header.nValues;
+            m_values.resize(sizeValues);
+            m_records.clear();
+            m_payload.clear();
+            m_payload.reserve(m_sizeBlockFrames * sizeValues * sizeof(float) + 64);
+            m_codec.reset(sizeValues);
+            m_writer.attach(&m_payload);
+            m_nRawBytes = m_header.nDataOffset;
+            m_nFrameCount = 0;
+        }
+
+        /// <summary>
+        /// Compress the stored range of all channels of a frame into the current block.
+        /// </summary>
+        /// <param name="frame">Frame with the channel count of the layout.</param>
+        void append(const CiFrame& frame) {
+            if (!m_file.is_open()) {
+                throw std::runtime_error("The compressed spectrogram file is not open.");
+            }
+            if (frame.getChannelCount() != static_cast<int>(m_header.nChannels) || frame.getSize() <= m_header.nIndexMax) {
+                throw std::invalid_argument("The frame does not match the spectrogram layout.");
+            }
+
+            for (uint32_t c = 0; c < m_header.nChannels; ++c) {
+                std::memcpy(m_values.data() + static_cast<size_t>(c) * m_header.nValues, frame.getChannel(static_cast<int>(c)) + m_header.nIndexMin,
+                    m_header.nValues * sizeof(float));
+            }
+            m_codec.encode(m_values.data(), m_writer);
+            m_records.push_back(CiSpectrogramRecord{ static_cast<uint64_t>(frame.getIndex()), frame.getTime() });
+
+            m_nRawBytes += m_header.nRecordSize;
+            ++m_nFrameCount;
+
+            if (m_records.size() >= m_sizeBlockFrames) writeBlock();
+        }
+
+        /// <summary>
+        /// Write the last block and close the file.
+        /// </summary>
+        void close() {
+            if (!m_file.is_open()) return;
+            writeBlock();
+            m_file.close();
+        }
+
+        // Getter for the number of written frames
+        uint64_t getFrameCount() const { return m_nFrameCount; }
+
+        // Getter for the size an uncompressed spectrogram file of the same frames would have (bytes)
+        uint64_t getRawBytes() const { return m_nRawBytes; }
+
+        // Getter for the number of bytes written to the file
+        uint64_t getFileBytes() const { return m_nFileBytes; }
+
+    private:
+        std::ofstream m_file;
+        std::string m_sFileName;
+        CiSpectrogramHeader m_header;
+        size_t m_sizeBlockFrames;
+        CiSpectrumCodec m_codec;
+        CiBitWriter m_writer;
+        std::vector<float> m_values;
+        std::vector<CiSpectrogramRecord> m_records;
+        std::vector<uint8_t> m_payload;
+        uint64_t m_nRawBytes;
+        uint64_t m_nFileBytes;
+        uint64_t m_nFrameCount;
+
+        // Method to write the current block with one sequential write per part and start the next one
+        void writeBlock() {
+            if (m_records.empty()) return;
+
+            m_writer.finish();
+            CiCompressedBlock block;
+            std::memcpy(block.magic, "VZB1", 4);
+            block.nFrames = static_cast<uint32_t>(m_records.size());
+            block.nPayloadSize = m_payload.size();
+
+            static const char padding[8] = {};
+            size_t sizePadding = (8 - m_payload.size() % 8) % 8;
+            writeRaw(&block, sizeof(block));
+            writeRaw(m_records.data(), m_records.size() * sizeof(CiSpectrogramRecord));
+            writeRaw(m_payload.data(), m_payload.size());
+            writeRaw(padding, sizePadding);
+
+            m_records.clear();
+            m_payload.clear();
+            m_codec.reset(m_values.size());
+            m_writer.attach(&m_payload);
+        }
+
+        // Method to write bytes to the file
+        void writeRaw(const void* pData, const size_t sizeBytes) {
+            if (sizeBytes == 0) return;
+            m_file.write(static_cast<const char*>(pData), static_cast<std::streamsize>(sizeBytes));
+            if (!m_file) {
+                throw std::runtime_error("Failed to write the file " + m_sFileName + ".");
+            }
+            m_nFileBytes += sizeBytes;
+        }
+    };
+
+    /// <summary>
+    /// Sink that records all frames into one compressed spectrogram file.
+    /// The frames are compressed on the I/O thread of the sink.
+    /// </summary>
+    class CiCompressedSpectrogramSink : public CiSink {
+    public:
+
+        /// <summary>
+        /// Constructor for CiCompressedSpectrogramSink.
+        /// </summary>
+        /// <param name="sFileName">Name of the compressed spectrogram file.</param>
+        /// <param name="sWindow">Name of the window function applied before the transform.</param>
+        explicit CiCompressedSpectrogramSink(const std::string& sFileName, const std::string& sWindow = "rectangular") : m_sFileName(sFileName), m_sWindow(sWindow) {}
+
+        void open(const CiSinkLayout& layout) override { m_writer.open(m_sFileName, layout, m_sWindow); }
+
+        void write(const CiFrame& frame) override { m_writer.append(frame); }
+
+        void close() override { m_writer.close(); }
+
+        // Getter for the writer, e.g. to read the compression ratio after the recording
+        CiCompressedSpectrogramWriter& getWriter() { return m_writer; }
+
+    private:
+        std::string m_sFileName;
+        std::string m_sWindow;
+        CiCompressedSpectrogramWriter m_writer;
+    };
+
+    /// <summary>
+    /// Class for reading a compressed spectrogram file block by block.
+    /// </summary>
+    class CiCompressedSpectrogramReader {
+    public:
+
+        CiCompressedSpectrogramReader() {
+            std::memset(&m_header, 0, sizeof(m_header));
+        }
+
+        /// <summary>
+        /// Open a compressed spectrogram file and read its header and frequency table.
+        /// </summary>
+        /// <param name="sFileName">Name of the file.</param>
+        void open(const std::string& sFileName) {
+            m_file.close();
+            m_file.clear();
+            m_file.open(sFileName, std::ios::binary);
+            if (!m_file.is_open()) {
+                throw std::runtime_error("Can't open a file " + sFileName + ".");
+            }
+            m_file.read(reinterpret_cast<char*>(&m_header), sizeof(m_header));
+            if (!m_file || std::memcmp(m_header.magic, CiSpectrogramFormat::COMPRESSED_MAGIC, 8) != 0 || m_header.nVersion != CiSpectrogramFormat::VERSION) {
+                throw std::runtime_error("The file " + sFileName + " is not a compressed spectrogram file of a supported version.");
+            }
+
+            m_frequencies.resize(m_header.nValues);
+            m_file.seekg(m_header.nHeaderSize);
+            m_file.read(reinterpret_cast<char*>(m_frequencies.data()), m_header.nValues * sizeof(float));
+            m_file.seekg(static_cast<std::streamoff>(m_header.nDataOffset));
+            if (!m_file) {
+                throw std::runtime_error("The file " + sFileName + " is truncated.");
+            }
+            m_codec.reset(static_cast<size_t>(m_header.nChannels) * m_header.nValues);
+        }
+
+        // Getter for the header of the file
+        const CiSpectrogramHeader& getHeader() const { return m_header; }
+
+        // Getter for the frequency table, one frequency per stored value (Hz)
+        const std::vector<float>& getFrequencies() const { return m_frequencies; }
+
+        /// <summary>
+        /// Read and decompress the next block.
+        /// </summary>
+        /// <param name="records">Receives the frame index and time of every frame.</param>
+        /// <param name="values">Receives the values, values[(frame * nChannels + channel) * nValues + value].</param>
+        /// <returns>False at the end of the file, including an incomplete last block of an interrupted recording.</returns>
+        bool readBlock(std::vector<CiSpectrogramRecord>& records, std::vector<float>& values) {
+            CiCompressedBlock block;
+            if (!m_file.read(reinterpret_cast<char*>(&block), sizeof(block))) return false;
+            if (std::memcmp(block.magic, "VZB1", 4) != 0) {
+                throw std::runtime_error("The compressed spectrogram file has a damaged block.");
+            }
+
+            records.resize(block.nFrames);
+            m_payload.resize(static_cast<size_t>((block.nPayloadSize + 7) / 8 * 8));
+            m_file.read(reinterpret_cast<char*>(records.data()), block.nFrames * sizeof(CiSpectrogramRecord));
+            m_file.read(reinterpret_cast<char*>(m_payload.data()), static_cast<std::streamsize>(m_payload.size()));
+            if (!m_file) return false;
+
+            size_t sizeValues = static_cast<size_t>(m_header.nChannels) * m_header.nValues;
+            values.resize(block.nFrames * sizeValues);
+            m_codec.reset(sizeValues);
+            CiBitReader reader(m_payload.data(), static_cast<size_t>(block.nPayloadSize));
+            for (uint32_t n = 0; n < block.nFrames; ++n) m_codec.decode(reader, values.data() + n * sizeValues);
+            return true;
+        }
+
+        /// <summary>
+        /// Decompress the whole file into a regular spectrogram file that CiSpectrogramReader can map.
+        /// </summary>
+        /// <param name="sFileName">Name of the spectrogram file to create.</param>
+        /// <returns>Number of frames.</returns>
+        uint64_t expand(const std::string& sFileName) {
+            CiSinkLayout layout;
+            layout.nChannels = static_cast<int>(m_header.nChannels);
+            layout.nSampleSize = static_cast<int>(m_header.nSampleSize);
+            layout.dwSamplesPerSec = m_header.nSamplesPerSec;
+            layout.dbTimeStep = m_header.dbTimeStep;
+            layout.nIndexMin = m_header.nIndexMin;
+            layout.nIndexMax = m_header.nIndexMax;
+            layout.bBands = (m_header.nFlags & CiSpectrogramFormat::FLAG_BANDS) != 0;
+            layout.frequencies.assign(static_cast<size_t>(m_header.nIndexMin), 0.0f);
+            layout.frequencies.insert(layout.frequencies.end(), m_frequencies.begin(), m_frequencies.end());
+
+            CiSpectrogramWriter writer;
+            writer.open(sFileName, layout, std::string(m_header.sWindow, strnlen(m_header.sWindow, sizeof(m_header.sWindow))));
+
+            CiFrame frame;
+            frame.resize(layout.nChannels, layout.nIndexMax + 1);
+            std::vector<CiSpectrogramRecord> records;
+            std::vector<float> values;
+            while (readBlock(records, values)) {
+                for (size_t n = 0; n < records.size(); ++n) {
+                    for (int c = 0; c < layout.nChannels; ++c) {
+                        std::memcpy(frame.getChannel(c) + layout.nIndexMin, values.data() + (n * layout.nChannels + c) * m_header.nValues,
+                            m_header.nValues * sizeof(float));
+                    }
+                    frame.setIndex(static_cast<size_t>(records[n].nFrameIndex));
+                    frame.setTime(records[n].dbTime);
+                    writer.append(frame);
+                }
+            }
+            writer.close();
+            return writer.getRecordCount();
+        }
+
+    private:
+        std::ifstream m_file;
+        CiSpectrogramHeader m_header;
+        std::vector<float> m_frequencies;
+        std::vector<uint8_t> m_payload;
+        CiSpectrumCodec m_codec;
+    };
+
+}
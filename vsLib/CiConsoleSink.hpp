@@ -0,0 +1,204 @@
+// This C++ code defines a sink that shows the output values of the latest
+// frame as a table on the Windows console, together with the console
+// helper functions used by the demo programs. The table is redrawn at a
+// capped rate and only where it changed, so the console never slows the
+// analysis down and does not flicker.
+
+#pragma once
+#include "CiSink.hpp"
+#include <Windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vi {
+
+    inline void clearConsole() {
+        // Get the console handle
+        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+        if (hConsole == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Failed to get console handle");
+        }
+
+        // Get the size of the console window
+        CONSOLE_SCREEN_BUFFER_INFO csbi;
+        if (!GetConsoleScreenBufferInfo(hConsole, &csbi)) {
+            throw std::runtime_error("Failed to get console buffer info");
+        }
+        DWORD consoleSize = csbi.dwSize.X * csbi.dwSize.Y;
+
+        // Fill the entire screen with blanks
+        DWORD charsWritten;
+        if (!FillConsoleOutputCharacter(hConsole, (TCHAR)' ', consoleSize, { 0, 0 }, &charsWritten)) {
+            throw std::runtime_error("Failed to fill console output character");
+        }
+
+        // Get the current text attribute
+        if (!GetConsoleScreenBufferInfo(hConsole, &csbi)) {
+            throw std::runtime_error("Failed to get console buffer info");
+        }
+
+        // Set the buffer's attributes accordingly
+        if (!FillConsoleOutputAttribute(hConsole, csbi.wAttributes, consoleSize, { 0, 0 }, &charsWritten)) {
+            throw std::runtime_error("Failed to fill console output attribute");
+        }
+
+        // Put the cursor at (0, 0)
+        if (!SetConsoleCursorPosition(hConsole, { 0, 0 })) {
+            throw std::runtime_error("Failed to set console cursor position");
+        }
+    }
+
+    inline void setCursorPosition(int x, int y) {
+        // Get the console handle
+        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+        if (hConsole == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Failed to get console handle");
+        }
+
+        // Set the cursor position
+        COORD coord;
+        coord.X = x;
+        coord.Y = y;
+        if (!SetConsoleCursorPosition(hConsole, coord)) {
+            throw std::runtime_error("Failed to set console cursor position");
+        }
+    }
+
+    /// <summary>
+    /// Sink that shows a table of the output values of the latest frame at the top of the console.
+    /// Every screen is composed into one buffer and only the lines that differ from the previous
+    /// screen are written. The refresh rate is capped; run the sink with CiAsyncSink::DROP_OLDEST
+    /// so the frames that arrive between two refreshes are skipped and the newest one is shown.
+    /// </summary>
+    class CiConsoleSink : public CiSink {
+    public:
+
+        /// <summary>
+        /// Constructor for CiConsoleSink.
+        /// </summary>
+        /// <param name="fnFramesLeft">Optional function returning the number of captured audio frames not processed yet.</param>
+        /// <param name="fpMaxRefreshRate">Maximum number of screen updates per second, 0 for no limit.</param>
+        explicit CiConsoleSink(std::function<size_t()> fnFramesLeft = nullptr, const float fpMaxRefreshRate = 20.0f)
+            : m_fnFramesLeft(fnFramesLeft), m_fpMaxRefreshRate(fpMaxRefreshRate), m_hConsole(INVALID_HANDLE_VALUE), m_sizeRefreshes(0) {}
+
+        void open(const CiSinkLayout& layout) override {
+            m_layout = layout;
+            m_screenLines.clear();
+            m_sizeRefreshes = 0;
+            m_nextRefresh = std::chrono::steady_clock::now();
+            m_hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+            if (m_hConsole == INVALID_HANDLE_VALUE) {
+                throw std::runtime_error("Failed to get console handle");
+            }
+        }
+
+        void write(const CiFrame& frame) override {
+            composeScreen(frame);
+            drawChangedLines();
+            ++m_sizeRefreshes;
+
+            // Wait for the next refresh slot; the queue keeps only the newest frame meanwhile
+            if (m_fpMaxRefreshRate > 0.0f) {
+                m_nextRefresh += std::chrono::microseconds(static_cast<long long>(1e6 / m_fpMaxRefreshRate));
+                auto now = std::chrono::steady_clock::now();
+                if (m_nextRefresh > now) std::this_thread::sleep_until(m_nextRefresh);
+                else m_nextRefresh = now;
+            }
+        }
+
+        // Getter for the number of drawn screens
+        size_t getRefreshCount() const { return m_sizeRefreshes; }
+
+    private:
+        std::function<size_t()> m_fnFramesLeft;
+        float m_fpMaxRefreshRate;
+        CiSinkLayout m_layout;
+        HANDLE m_hConsole;
+        std::chrono::steady_clock::time_point m_nextRefresh;
+        size_t m_sizeRefreshes;
+
+        // The composed screen: all lines in one buffer, m_lineEnds[i] is the end of line i
+        std::string m_screen;
+        std::vector<size_t> m_lineEnds;
+
+        // The lines currently on the console
+        std::vector<std::string> m_screenLines;
+
+        // The padded text of a changed line, kept so its storage is reused
+        std::string m_sLine;
+
+        // Method to append formatted text to the current line of the composed screen
+        void appendFormat(const char* sFormat, ...) {
+            char sText[256];
+            va_list args;
+            va_start(args, sFormat);
+            int nLength = vsnprintf(sText, sizeof(sText), sFormat, args);
+            va_end(args);
+            if (nLength > 0) m_screen.append(sText, (std::min)(static_cast<size_t>(nLength), sizeof(sText) - 1));
+        }
+
+        // Method to finish the current line of the composed screen
+        void endLine() { m_lineEnds.push_back(m_screen.size()); }
+
+        // Method to compose the table of a frame
+        void composeScreen(const CiFrame& frame) {
+            int nChannels = frame.getChannelCount();
+            int nFramesLeft = m_fnFramesLeft ? static_cast<int>(m_fnFramesLeft()) : 0;
+
+            m_screen.clear();
+            m_lineEnds.clear();
+
+            endLine();
+            appendFormat("  Normalized One-Sided Power Spectrum after  %10.6f seconds (frames left: %6d)", frame.getTime(), nFramesLeft);
+            endLine();
+            appendFormat("----------------------------------------------");
+            endLine();
+            appendFormat(" Frequency | Index  ");
+            for (int c = 0; c < nChannels; ++c) appendFormat("|   Power %c%s", 'A' + c, (c + 1 < nChannels) ? "  " : "");
+            endLine();
+            appendFormat("----------------------------------------------");
+            endLine();
+
+            for (int j = m_layout.nIndexMin; j <= m_layout.nIndexMax; ++j) {
+                appendFormat("%10.2f | %6d", m_layout.frequencies[j], j);
+                for (int c = 0; c < nChannels; ++c) appendFormat(" | %10.6f", frame.getChannel(c)[j]);
+                endLine();
+            }
+        }
+
+        // Method to write the lines that differ from the console, padded to hide the rest of a longer old line
+        void drawChangedLines() {
+            if (m_screenLines.size() < m_lineEnds.size()) m_screenLines.resize(m_lineEnds.size());
+
+            size_t sizeStart = 0;
+            bool bDrawn = false;
+            for (size_t i = 0; i < m_lineEnds.size(); ++i) {
+                size_t sizeEnd = m_lineEnds[i];
+                size_t sizeLength = sizeEnd - sizeStart;
+                std::string& sOld = m_screenLines[i];
+
+                if (sOld.size() != sizeLength || m_screen.compare(sizeStart, sizeLength, sOld) != 0) {
+                    m_sLine.assign(m_screen, sizeStart, sizeLength);
+                    if (m_sLine.size() < sOld.size()) m_sLine.append(sOld.size() - m_sLine.size(), ' ');
+                    setCursorPosition(0, static_cast<int>(i));
+                    DWORD dwWritten = 0;
+                    WriteConsoleA(m_hConsole, m_sLine.data(), static_cast<DWORD>(m_sLine.size()), &dwWritten, NULL);
+                    sOld.assign(m_screen, sizeStart, sizeLength);
+                    bDrawn = true;
+                }
+                sizeStart = sizeEnd;
+            }
+
+            // Leave the cursor below the table
+            if (bDrawn) setCursorPosition(0, static_cast<int>(m_lineEnds.size()));
+        }
+    };
+
+}
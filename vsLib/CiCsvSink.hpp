@@ -0,0 +1,185 @@
+// This C++ code defines a sink that saves the output values of the frames
+// as CSV files in a folder. In the wide layout every frame gets its own
+// file, named by the time of the frame in whole microseconds, padded to
+// 10 digits. In the long layout many frames share one file and every row
+// is tagged with the time and the index of its frame. Numbers are
+// formatted with std::to_chars into a large reusable buffer that is
+// written in big blocks, so the export is not bound by printf parsing.
+
+#pragma once
+#include "CiSink.hpp"
+#include "CiPortable.hpp"
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Sink that writes the frames as CSV files.
+    /// </summary>
+    class CiCsvSink : public CiSink {
+    public:
+
+        static constexpr int LAYOUT_WIDE = 0;   // One file per frame: Frequency,Power A[,Power B...]
+        static constexpr int LAYOUT_LONG = 1;   // Many frames per file: Time,Frame,Frequency,Power A[,Power B...]
+
+        /// <summary>
+        /// Constructor for CiCsvSink.
+        /// </summary>
+        /// <param name="sFolderPath">Existing folder for the files.</param>
+        /// <param name="fpRecordThreshold">Rows where the values of all channels are below this threshold are skipped.</param>
+        /// <param name="nLayout">LAYOUT_WIDE or LAYOUT_LONG.</param>
+        /// <param name="sizeFramesPerFile">Frames per file in the long layout, 0 for one file for the whole session.</param>
+        CiCsvSink(const std::string& sFolderPath, const float fpRecordThreshold = 0.0f, const int nLayout = LAYOUT_WIDE, const size_t sizeFramesPerFile = 0)
+            : m_sFolderPath(sFolderPath), m_fpRecordThreshold(fpRecordThreshold), m_nLayout(nLayout), m_sizeFramesPerFile(sizeFramesPerFile),
+            m_sizeBufferBytes(1 << 20), m_sizeBuffered(0), m_sizeMaxRow(0), m_pFile(nullptr), m_sizeFramesInFile(0) {}
+
+        /// <summary>
+        /// Destructor for CiCsvSink. Closes the current file.
+        /// </summary>
+        ~CiCsvSink() {
+            if (m_pFile) fclose(m_pFile);
+        }
+
+        // Setter for the size of the write buffer (bytes)
+        void setBufferSize(const size_t sizeBufferBytes) { m_sizeBufferBytes = sizeBufferBytes; }
+
+        void open(const CiSinkLayout& layout) override {
+            m_layout = layout;
+            // A row holds the time, the frame index, the frequency and one value per channel
+            m_sizeMaxRow = static_cast<size_t>(MAX_NUMBER_CHARS) * (layout.nChannels + 3);
+            m_buffer.resize(m_sizeBufferBytes > 2 * m_sizeMaxRow ? m_sizeBufferBytes : 2 * m_sizeMaxRow);
+            m_sizeBuffered = 0;
+            m_sizeFramesInFile = 0;
+        }
+
+        void write(const CiFrame& frame) override {
+            int nChannels = frame.getChannelCount();
+            bool bLong = m_nLayout == LAYOUT_LONG;
+
+            if (!m_pFile) {
+                makeFileName(frame.getTime());
+                openFile();
+                appendText(bLong ? "Time,Frame,Frequency" : "Frequency");
+                for (int c = 0; c < nChannels; ++c) {
+                    char sColumn[] = ",Power A";
+                    sColumn[7] = static_cast<char>('A' + c);
+                    appendText(sColumn);
+                }
+                appendText("\n");
+            }
+
+            for (int j = m_layout.nIndexMin; j <= m_layout.nIndexMax; ++j) {
+                // Skip the record if the power of all channels is less than the threshold value.
+                bool bAboveThreshold = false;
+                for (int c = 0; c < nChannels; ++c) bAboveThreshold = bAboveThreshold || frame.getChannel(c)[j] >= m_fpRecordThreshold;
+                if (!bAboveThreshold) continue;
+
+                if (m_sizeBuffered + m_sizeMaxRow > m_buffer.size()) flushBuffer();
+
+                char* p = m_buffer.data() + m_sizeBuffered;
+                char* pEnd = m_buffer.data() + m_buffer.size();
+                if (bLong) {
+                    p = std::to_chars(p, pEnd, frame.getTime(), std::chars_format::fixed, 6).ptr;
+                    *p++ = ',';
+                    p = std::to_chars(p, pEnd, frame.getIndex()).ptr;
+                    *p++ = ',';
+                }
+                p = std::to_chars(p, pEnd, m_layout.frequencies[j], std::chars_format::fixed, 2).ptr;
+                for (int c = 0; c < nChannels; ++c) {
+                    *p++ = ',';
+                    p = std::to_chars(p, pEnd, frame.getChannel(c)[j], std::chars_format::fixed, 6).ptr;
+                }
+                *p++ = '\n';
+                m_sizeBuffered = p - m_buffer.data();
+            }
+
+            // A wide file holds one frame; a long file is finished after m_sizeFramesPerFile frames
+            ++m_sizeFramesInFile;
+            if (!bLong || (m_sizeFramesPerFile > 0 && m_sizeFramesInFile >= m_sizeFramesPerFile)) closeFile();
+        }
+
+        void close() override {
+            closeFile();
+        }
+
+        // Getter for the folder of the files
+        std::string getFolderPath() const { return m_sFolderPath; }
+
+    private:
+        // Characters of a formatted float with 6 decimals, including the separator
+        static constexpr int MAX_NUMBER_CHARS = 56;
+
+        std::string m_sFolderPath;
+        float m_fpRecordThreshold;
+        int m_nLayout;
+        size_t m_sizeFramesPerFile;
+        CiSinkLayout m_layout;
+        std::vector<char> m_buffer;
+        size_t m_sizeBufferBytes;
+        size_t m_sizeBuffered;
+        size_t m_sizeMaxRow;
+        std::string m_sFileName;
+        FILE* m_pFile;
+        size_t m_sizeFramesInFile;
+
+        // Method to name the next file by the time of its first frame in whole microseconds.
+        // The name is built in place, so a wide layout with one file per frame reuses the storage of the name.
+        void makeFileName(const double dbTime) {
+            char sDigits[24];
+            char* pEnd = std::to_chars(sDigits, sDigits + sizeof(sDigits), static_cast<long long>(dbTime * 1e6)).ptr;
+            size_t sizeDigits = static_cast<size_t>(pEnd - sDigits);
+            m_sFileName.assign(m_sFolderPath);
+            m_sFileName += '/';
+            if (sizeDigits < 10) m_sFileName.append(10 - sizeDigits, '0');
+            m_sFileName.append(sDigits, sizeDigits);
+            m_sFileName += ".csv";
+        }
+
+        // Method to open the file m_sFileName; the stream is unbuffered because the sink writes whole blocks
+        void openFile() {
+            errno_t err = fopen_s(&m_pFile, m_sFileName.c_str(), "wb");
+            if (err != 0 || !m_pFile) {
+                m_pFile = nullptr;
+                throw std::runtime_error("Can't open a file " + m_sFileName + ".");
+            }
+            setvbuf(m_pFile, nullptr, _IONBF, 0);
+            m_sizeFramesInFile = 0;
+        }
+
+        // Method to write the buffered text and close the current file
+        void closeFile() {
+            if (!m_pFile) return;
+            flushBuffer();
+            int err = fclose(m_pFile);
+            m_pFile = nullptr;
+            if (err != 0) {
+                throw std::runtime_error("Failed to write the file " + m_sFileName + ".");
+            }
+        }
+
+        // Method to write the buffered text to the current file
+        void flushBuffer() {
+            if (m_sizeBuffered == 0) return;
+            size_t sizeWritten = fwrite(m_buffer.data(), 1, m_sizeBuffered, m_pFile);
+            bool bComplete = sizeWritten == m_sizeBuffered;
+            m_sizeBuffered = 0;
+            if (!bComplete) {
+                throw std::runtime_error("Failed to write the file " + m_sFileName + ".");
+            }
+        }
+
+        // Method to add a text to the buffer
+        void appendText(const char* sText) {
+            size_t sizeText = std::strlen(sText);
+            if (m_sizeBuffered + sizeText > m_buffer.size()) flushBuffer();
+            std::memcpy(m_buffer.data() + m_sizeBuffered, sText, sizeText);
+            m_sizeBuffered += sizeText;
+        }
+    };
+
+}
@@ -0,0 +1,192 @@
+// This C++ code defines a process-wide cache of DFT plans. A plan is a
+// CiCLaDft with its buffers and kernels already created for one sample size,
+// kernel number, transfer mode, history depth, device and profiling mode. Plans are handed
+// out as shared pointers that return the plan to the cache when the last
+// owner lets it go, so a new session or a changed batch size reuses warm
+// resources instead of creating them again.
+
+#pragma once
+#include "CiCLaDft.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace vi {
+
+    /// <summary>
+    /// Handle of a cached DFT plan.
+    /// </summary>
+    typedef std::shared_ptr<CiCLaDft> CiDftPlan;
+
+    /// <summary>
+    /// Class for caching DFT plans keyed by size, kernel type and device.
+    /// </summary>
+    class CiDftPlanCache {
+    public:
+
+        /// <summary>
+        /// Get the plan cache of the process.
+        /// </summary>
+        static CiDftPlanCache& getInstance() {
+            static CiDftPlanCache cache;
+            return cache;
+        }
+
+        CiDftPlanCache(const CiDftPlanCache&) = delete;
+        CiDftPlanCache& operator=(const CiDftPlanCache&) = delete;
+
+        /// <summary>
+        /// Get a plan from the cache or create a new one.
+        /// </summary>
+        /// <param name="sampleSize">Size of the input samples.</param>
+        /// <param name="kernelNo">Kernel number (CiCLaDft::P1S or CiCLaDft::P1SN).</param>
+        /// <param name="transferMode">Transfer mode (CiCLaDft::TRANSFER_F32 or CiCLaDft::TRANSFER_F16).</param>
+        /// <param name="historyDepth">Depth of the device-side spectrogram history in frames.</param>
+        /// <param name="deviceIndex">Index of the GPU device.</param>
+        /// <param name="bProfiling">True to record OpenCL profiling events.</param>
+        /// <returns>Handle that returns the plan to the cache when it is destroyed.</returns>
+        CiDftPlan acquirePlan(const int sampleSize, const int kernelNo, const int transferMode = CiCLaDft::TRANSFER_F32,
+            const int historyDepth = 0, const int deviceIndex = 0, const bool bProfiling = false) {
+
+            PlanKey key{ sampleSize, kernelNo, transferMode, historyDepth, deviceIndex, bProfiling };
+            std::unique_ptr<CiCLaDft> pPlan;
+
+            {
+                std::lock_guard<std::mutex> lock(m_pState->mtx);
+                auto it = m_pState->idlePlans.find(key);
+                if (it != m_pState->idlePlans.end()) {
+                    pPlan = std::move(it->second);
+                    m_pState->idlePlans.erase(it);
+                    ++m_pState->hits;
+                }
+                else {
+                    ++m_pState->misses;
+                }
+            }
+
+            if (!pPlan) {
+                pPlan.reset(new CiCLaDft());
+                pPlan->setDeviceIndex(deviceIndex);
+                pPlan->setTransferMode(transferMode);
+                pPlan->setHistoryDepth(historyDepth);
+                pPlan->setProfiling(bProfiling);
+                pPlan->setOpenCL();
+                pPlan->createOpenCLKernel(sampleSize, kernelNo);
+            }
+
+            std::weak_ptr<State> wpState = m_pState;
+            return CiDftPlan(pPlan.release(), [wpState, key](CiCLaDft* pDft) {
+                std::shared_ptr<State> pState = wpState.lock();
+                if (pState) {
+                    pDft->clearFilterbank();
+                    pDft->clearPeakPicking();
+                    pDft->clearFeatures();
+                    pDft->clearHistory();
+                    pDft->resetProfile();
+
+                    // A caller may have set an FP16 scale of its own; the next caller gets the default of the key
+                    bool bReset = true;
+                    if (pDft->getTransferMode() == CiCLaDft::TRANSFER_F16) {
+                        try {
+                            pDft->setHalfOutputScale(0.0f);
+                        }
+                        catch (const OpenCLException&) {
+                            bReset = false;
+                        }
+                    }
+
+                    std::lock_guard<std::mutex> lock(pState->mtx);
+                    if (bReset && pState->idlePlans.size() < pState->maxIdlePlans) {
+                        pState->idlePlans.emplace(key, std::unique_ptr<CiCLaDft>(pDft));
+                        return;
+                    }
+                }
+                delete pDft;
+            });
+        }
+
+        /// <summary>
+        /// Set the maximum number of idle plans kept in the cache.
+        /// </summary>
+        /// <param name="maxIdlePlans">Maximum number of idle plans.</param>
+        void setMaxIdlePlans(const size_t maxIdlePlans) {
+            std::lock_guard<std::mutex> lock(m_pState->mtx);
+            m_pState->maxIdlePlans = maxIdlePlans;
+        }
+
+        /// <summary>
+        /// Get the number of idle plans in the cache.
+        /// </summary>
+        size_t getIdlePlanCount() {
+            std::lock_guard<std::mutex> lock(m_pState->mtx);
+            return m_pState->idlePlans.size();
+        }
+
+        /// <summary>
+        /// Get the number of acquisitions served from the cache.
+        /// </summary>
+        size_t getHitCount() {
+            std::lock_guard<std::mutex> lock(m_pState->mtx);
+            return m_pState->hits;
+        }
+
+        /// <summary>
+        /// Get the number of acquisitions that created a new plan.
+        /// </summary>
+        size_t getMissCount() {
+            std::lock_guard<std::mutex> lock(m_pState->mtx);
+            return m_pState->misses;
+        }
+
+        /// <summary>
+        /// Release all idle plans. Plans in use are not affected.
+        /// </summary>
+        void releaseIdlePlans() {
+            std::multimap<PlanKey, std::unique_ptr<CiCLaDft>> idlePlans;
+            {
+                std::lock_guard<std::mutex> lock(m_pState->mtx);
+                idlePlans.swap(m_pState->idlePlans);
+            }
+        }
+
+    private:
+
+        /// <summary>
+        /// Key of a plan.
+        /// </summary>
+        struct PlanKey {
+            int sampleSize;
+            int kernelNo;
+            int transferMode;
+            int historyDepth;
+            int deviceIndex;
+            bool bProfiling;
+
+            bool operator<(const PlanKey& other) const {
+                if (sampleSize != other.sampleSize) return sampleSize < other.sampleSize;
+                if (kernelNo != other.kernelNo) return kernelNo < other.kernelNo;
+                if (transferMode != other.transferMode) return transferMode < other.transferMode;
+                if (historyDepth != other.historyDepth) return historyDepth < other.historyDepth;
+                if (deviceIndex != other.deviceIndex) return deviceIndex < other.deviceIndex;
+                return bProfiling < other.bProfiling;
+            }
+        };
+
+        /// <summary>
+        /// Cache state shared with the plan handles, so a handle that outlives the cache deletes its plan.
+        /// </summary>
+        struct State {
+            std::mutex mtx;
+            std::multimap<PlanKey, std::unique_ptr<CiCLaDft>> idlePlans;
+            size_t maxIdlePlans = 16;
+            size_t hits = 0;
+            size_t misses = 0;
+        };
+
+        std::shared_ptr<State> m_pState;
+
+        CiDftPlanCache() : m_pState(std::make_shared<State>()) {}
+
+    };
+
+}
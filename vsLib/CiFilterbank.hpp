@@ -0,0 +1,252 @@
+// This C++ code defines a class for designing filterbanks that combine
+// the bins of a one-sided power spectrum into bands: mel bands for
+// machine learning features, constant-Q bands and fractional-octave
+// bands for acoustics. The band matrix is sparse and stored in the
+// compressed sparse row (CSR) format, so it can be applied on the device.
+
+#pragma once
+#include <vector>
+#include <cmath>
+#include <stdexcept>
+
+namespace vi {
+
+    /// <summary>
+    /// Class for designing sparse band matrices over the bins of a one-sided power spectrum.
+    /// </summary>
+    class CiFilterbank {
+    public:
+
+        /// <summary>
+        /// Triangular bands equally spaced on the mel scale.
+        /// </summary>
+        static const int MEL = 0;
+
+        /// <summary>
+        /// Triangular bands with a constant ratio of centre frequency to bandwidth.
+        /// </summary>
+        static const int CONSTANT_Q = 1;
+
+        /// <summary>
+        /// Rectangular 1/N-octave bands with base-10 centre frequencies referenced to 1 kHz.
+        /// </summary>
+        static const int FRACTIONAL_OCTAVE = 2;
+
+        /// <summary>
+        /// Default constructor, creates a 1/3-octave filterbank from 20 Hz to 20 kHz.
+        /// </summary>
+        CiFilterbank() : m_nType(FRACTIONAL_OCTAVE), m_fpMinF(20.0f), m_fpMaxF(20000.0f), m_nBandParameter(3),
+            m_dwSamplesPerSec(0), m_nSampleSize(0) {}
+
+        /// <summary>
+        /// Constructor for CiFilterbank.
+        /// </summary>
+        /// <param name="nType">Filterbank type (MEL, CONSTANT_Q or FRACTIONAL_OCTAVE).</param>
+        /// <param name="fpMinF">Lowest frequency of interest (Hz).</param>
+        /// <param name="fpMaxF">Highest frequency of interest (Hz).</param>
+        /// <param name="nBandParameter">Number of mel bands, bins per octave for CONSTANT_Q or N of the 1/N octave.</param>
+        CiFilterbank(const int nType, const float fpMinF, const float fpMaxF, const int nBandParameter)
+            : m_nType(nType), m_fpMinF(fpMinF), m_fpMaxF(fpMaxF), m_nBandParameter(nBandParameter),
+            m_dwSamplesPerSec(0), m_nSampleSize(0) {
+            if (nType < MEL || nType > FRACTIONAL_OCTAVE) {
+                throw std::invalid_argument("No filterbank type with such number.");
+            }
+            if (fpMinF <= 0.0f || fpMaxF <= fpMinF) {
+                throw std::invalid_argument("The filterbank frequency range is not valid.");
+            }
+            if (nBandParameter < 1) {
+                throw std::invalid_argument("The filterbank band parameter must be positive.");
+            }
+        }
+
+        /// <summary>
+        /// Compute the band matrix for a sample rate and sample (FFT) size.
+        /// The matrix is only recomputed when one of them changes.
+        /// </summary>
+        /// <param name="dwSamplesPerSec">Sample rate (Hz).</param>
+        /// <param name="nSampleSize">Sample size of the transform.</param>
+        void design(const unsigned long dwSamplesPerSec, const int nSampleSize) {
+            if (dwSamplesPerSec == m_dwSamplesPerSec && nSampleSize == m_nSampleSize && !m_rowOffsets.empty()) return;
+
+            if (dwSamplesPerSec < 1 || nSampleSize < 2) {
+                throw std::invalid_argument("Sample rate or sample size of the filterbank is not valid.");
+            }
+
+            m_dwSamplesPerSec = dwSamplesPerSec;
+            m_nSampleSize = nSampleSize;
+
+            m_rowOffsets.assign(1, 0);
+            m_columns.clear();
+            m_weights.clear();
+            m_centreF.clear();
+
+            double dbNyquist = dwSamplesPerSec / 2.0;
+            double dbMaxF = (m_fpMaxF < dbNyquist) ? m_fpMaxF : dbNyquist;
+
+            if (m_nType == MEL) designMel(dbMaxF);
+            if (m_nType == CONSTANT_Q) designConstantQ(dbMaxF);
+            if (m_nType == FRACTIONAL_OCTAVE) designFractionalOctave(dbMaxF);
+        }
+
+        /// <summary>
+        /// Apply the band matrix to a power spectrum on the host.
+        /// </summary>
+        /// <param name="onesidePower">One-sided power spectrum of the designed sample size.</param>
+        /// <param name="bands">Output band energies, getBandCount() values.</param>
+        void apply(const float* onesidePower, float* bands) const {
+            for (int b = 0; b < getBandCount(); ++b) {
+                float sum = 0.0f;
+                for (int k = m_rowOffsets[b]; k < m_rowOffsets[b + 1]; ++k) sum += m_weights[k] * onesidePower[m_columns[k]];
+                bands[b] = sum;
+            }
+        }
+
+        /// <summary>
+        /// Get the number of bands of the designed matrix.
+        /// </summary>
+        int getBandCount() const { return m_rowOffsets.empty() ? 0 : static_cast<int>(m_rowOffsets.size()) - 1; }
+
+        /// <summary>
+        /// Get the number of non-zero weights of the designed matrix.
+        /// </summary>
+        int getWeightCount() const { return static_cast<int>(m_weights.size()); }
+
+        /// <summary>
+        /// Get the CSR row offsets, getBandCount() + 1 values.
+        /// </summary>
+        const std::vector<int>& getRowOffsets() const { return m_rowOffsets; }
+
+        /// <summary>
+        /// Get the CSR column (bin) indices.
+        /// </summary>
+        const std::vector<int>& getColumns() const { return m_columns; }
+
+        /// <summary>
+        /// Get the CSR weights.
+        /// </summary>
+        const std::vector<float>& getWeights() const { return m_weights; }
+
+        /// <summary>
+        /// Get the centre frequencies of the bands (Hz).
+        /// </summary>
+        const std::vector<float>& getCentreFrequencies() const { return m_centreF; }
+
+        /// <summary>
+        /// Get the filterbank type.
+        /// </summary>
+        int getType() const { return m_nType; }
+
+        /// <summary>
+        /// Get the sample rate the matrix was designed for.
+        /// </summary>
+        unsigned long getSamplesPerSec() const { return m_dwSamplesPerSec; }
+
+        /// <summary>
+        /// Get the sample size the matrix was designed for.
+        /// </summary>
+        int getSampleSize() const { return m_nSampleSize; }
+
+    private:
+        int m_nType;
+        float m_fpMinF;
+        float m_fpMaxF;
+        int m_nBandParameter;
+
+        unsigned long m_dwSamplesPerSec;
+        int m_nSampleSize;
+
+        std::vector<int> m_rowOffsets;
+        std::vector<int> m_columns;
+        std::vector<float> m_weights;
+        std::vector<float> m_centreF;
+
+        static double hzToMel(const double dbF) { return 2595.0 * std::log10(1.0 + dbF / 700.0); }
+        static double melToHz(const double dbMel) { return 700.0 * (std::pow(10.0, dbMel / 2595.0) - 1.0); }
+
+        /// <summary>
+        /// Get the frequency of a bin (Hz).
+        /// </summary>
+        double binFrequency(const int nBin) const { return nBin * static_cast<double>(m_dwSamplesPerSec) / m_nSampleSize; }
+
+        /// <summary>
+        /// Append a triangular band with the given edges and centre.
+        /// A band narrower than the bin spacing falls back to the nearest bin.
+        /// </summary>
+        void addTriangle(const double dbLowF, const double dbCentreF, const double dbHighF) {
+            int nOnesideSize = m_nSampleSize / 2 + 1;
+            for (int j = 0; j < nOnesideSize; ++j) {
+                double f = binFrequency(j);
+                if (f <= dbLowF || f >= dbHighF) continue;
+                double w = (f <= dbCentreF) ? (f - dbLowF) / (dbCentreF - dbLowF) : (dbHighF - f) / (dbHighF - dbCentreF);
+                m_columns.push_back(j);
+                m_weights.push_back(static_cast<float>(w));
+            }
+            closeBand(dbCentreF);
+        }
+
+        /// <summary>
+        /// Append a rectangular band; bins on the band edges are weighted by their overlap with the band.
+        /// </summary>
+        void addRectangle(const double dbLowF, const double dbCentreF, const double dbHighF) {
+            int nOnesideSize = m_nSampleSize / 2 + 1;
+            double df = binFrequency(1);
+            for (int j = 0; j < nOnesideSize; ++j) {
+                double binLow = binFrequency(j) - df / 2.0;
+                double binHigh = binLow + df;
+                double overlap = ((binHigh < dbHighF) ? binHigh : dbHighF) - ((binLow > dbLowF) ? binLow : dbLowF);
+                if (overlap <= 0.0) continue;
+                m_columns.push_back(j);
+                m_weights.push_back(static_cast<float>(overlap / df));
+            }
+            closeBand(dbCentreF);
+        }
+
+        /// <summary>
+        /// Finish the current CSR row.
+        /// </summary>
+        void closeBand(const double dbCentreF) {
+            if (static_cast<int>(m_columns.size()) == m_rowOffsets.back()) {
+                int nOnesideSize = m_nSampleSize / 2 + 1;
+                int nNearest = static_cast<int>(std::lround(dbCentreF / binFrequency(1)));
+                m_columns.push_back((nNearest < nOnesideSize) ? nNearest : nOnesideSize - 1);
+                m_weights.push_back(1.0f);
+            }
+            m_rowOffsets.push_back(static_cast<int>(m_columns.size()));
+            m_centreF.push_back(static_cast<float>(dbCentreF));
+        }
+
+        void designMel(const double dbMaxF) {
+            double melMin = hzToMel(m_fpMinF);
+            double melStep = (hzToMel(dbMaxF) - melMin) / (m_nBandParameter + 1);
+            for (int b = 0; b < m_nBandParameter; ++b) {
+                addTriangle(melToHz(melMin + b * melStep), melToHz(melMin + (b + 1) * melStep), melToHz(melMin + (b + 2) * melStep));
+            }
+        }
+
+        void designConstantQ(const double dbMaxF) {
+            double ratio = std::pow(2.0, 1.0 / m_nBandParameter);
+            for (double f = m_fpMinF; f * ratio <= dbMaxF; f *= ratio) {
+                addTriangle(f / ratio, f, f * ratio);
+            }
+        }
+
+        void designFractionalOctave(const double dbMaxF) {
+            // IEC 61260 base-10 octave ratio; a band is used when its nominal range contains its centre,
+            // e.g. the 1/3-octave bands 20 Hz ... 20 kHz for the default range.
+            // For odd N the centres are G^(x/N) kHz, for even N they are G^((2x+1)/(2N)) kHz,
+            // so 1 kHz is a band edge of the 1/2-, 1/6- and 1/12-octave banks.
+            double G = std::pow(10.0, 0.3);
+            double halfBand = std::pow(G, 1.0 / (2.0 * m_nBandParameter));
+            double dbNyquist = m_dwSamplesPerSec / 2.0;
+            int nOffset = (m_nBandParameter % 2 == 0) ? 1 : 0;
+            int nFirst = static_cast<int>(std::floor(m_nBandParameter * std::log(m_fpMinF / 1000.0) / std::log(G) + 0.5 - nOffset / 2.0));
+            for (int x = nFirst; ; ++x) {
+                double fc = 1000.0 * std::pow(G, static_cast<double>(2 * x + nOffset) / (2.0 * m_nBandParameter));
+                if (fc > dbMaxF * halfBand || fc * halfBand > dbNyquist) break;
+                addRectangle(fc / halfBand, fc, fc * halfBand);
+            }
+        }
+
+    };
+
+}
@@ -0,0 +1,100 @@
+// This C++ code defines a multi-channel frame of float values that is
+// handed from one pipeline stage to the next: the deinterleaved samples of
+// a batch between the deinterleave and transform stages, and the power
+// spectra or band energies of the batch between the transform and sink
+// stages. The values of all channels are kept in one contiguous block
+// that starts on a cache line.
+
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Allocator of storage that starts on a cache line, so vector instructions load the values without splits.
+    /// </summary>
+    template <typename T>
+    struct CiAlignedAllocator {
+        typedef T value_type;
+
+        static constexpr std::size_t ALIGNMENT = 64;
+
+        CiAlignedAllocator() noexcept {}
+        template <typename U> CiAlignedAllocator(const CiAlignedAllocator<U>&) noexcept {}
+
+        T* allocate(const std::size_t sizeCount) { return static_cast<T*>(::operator new(sizeCount * sizeof(T), std::align_val_t(ALIGNMENT))); }
+        void deallocate(T* p, const std::size_t) noexcept { ::operator delete(p, std::align_val_t(ALIGNMENT)); }
+
+        template <typename U> bool operator==(const CiAlignedAllocator<U>&) const noexcept { return true; }
+        template <typename U> bool operator!=(const CiAlignedAllocator<U>&) const noexcept { return false; }
+    };
+
+    /// <summary>
+    /// Multi-channel block of float values with its frame index and time stamp.
+    /// </summary>
+    class CiFrame {
+    public:
+
+        CiFrame() : m_sizeIndex(0), m_dbTime(0.0), m_nChannels(0), m_nSize(0) {}
+
+        /// <summary>
+        /// Set the number of channels and the number of values per channel.
+        /// The storage is kept when the frame is reused with the same or a smaller shape.
+        /// </summary>
+        /// <param name="nChannels">Number of channels.</param>
+        /// <param name="nSize">Number of values per channel.</param>
+        void resize(const int nChannels, const int nSize) {
+            m_nChannels = nChannels;
+            m_nSize = nSize;
+            m_values.resize(static_cast<size_t>(nChannels) * nSize);
+        }
+
+        /// <summary>
+        /// Get the values of a channel.
+        /// </summary>
+        /// <param name="nChannel">Channel index.</param>
+        float* getChannel(const int nChannel) { return m_values.data() + static_cast<size_t>(nChannel) * m_nSize; }
+
+        /// <summary>
+        /// Get the values of a channel.
+        /// </summary>
+        /// <param name="nChannel">Channel index.</param>
+        const float* getChannel(const int nChannel) const { return m_values.data() + static_cast<size_t>(nChannel) * m_nSize; }
+
+        // Getter for the number of channels
+        int getChannelCount() const { return m_nChannels; }
+
+        // Getter for the number of values per channel
+        int getSize() const { return m_nSize; }
+
+        // Setter for the sequence number of the frame, starting from 1
+        void setIndex(const size_t sizeIndex) { m_sizeIndex = sizeIndex; }
+
+        // Getter for the sequence number of the frame
+        size_t getIndex() const { return m_sizeIndex; }
+
+        // Setter for the time of the end of the frame from the start of the capture (s)
+        void setTime(const double dbTime) { m_dbTime = dbTime; }
+
+        // Getter for the time of the end of the frame from the start of the capture (s)
+        double getTime() const { return m_dbTime; }
+
+        // Setter for the audio samples the values of the frame were computed from, or nullptr
+        void setSource(std::shared_ptr<const CiFrame> pSource) { m_pSource = std::move(pSource); }
+
+        // Getter for the audio samples the values of the frame were computed from, or nullptr
+        const std::shared_ptr<const CiFrame>& getSource() const { return m_pSource; }
+
+    private:
+        size_t m_sizeIndex;
+        double m_dbTime;
+        int m_nChannels;
+        int m_nSize;
+        std::vector<float, CiAlignedAllocator<float>> m_values;
+        std::shared_ptr<const CiFrame> m_pSource;
+    };
+
+}
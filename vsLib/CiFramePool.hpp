@@ -0,0 +1,202 @@
+// This C++ code defines a recycling pool of frames for the pipeline. All
+// frames of the pool and the reference counts of their handles are
+// allocated when the pool is created. A frame is handed out as a shared
+// pointer that returns the frame to the pool when its last owner lets it
+// go, so a frame moves from the deinterleave stage to the transform stage
+// and on to the sinks without a copy and without calls to the heap. The
+// free frames are kept on lock-free stacks, so the capture, transform and
+// sink threads never wait for each other or for the allocator. When all
+// frames are in use, a frame is taken from the heap instead and counted,
+// so a pool that is too small shows up in the telemetry but never blocks.
+
+#pragma once
+#include "CiFrame.hpp"
+#include "CiTelemetry.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Handle of a frame; a frame of a pool returns to its pool when the last handle is destroyed.
+    /// </summary>
+    typedef std::shared_ptr<CiFrame> CiFrameHandle;
+
+    /// <summary>
+    /// Class for handing out frames of one shape from preallocated storage.
+    /// </summary>
+    class CiFramePool {
+    public:
+
+        /// <summary>
+        /// Constructor for CiFramePool.
+        /// </summary>
+        /// <param name="sizeCapacity">Number of frames of the pool.</param>
+        /// <param name="nChannels">Number of channels of a frame.</param>
+        /// <param name="nSize">Number of values per channel.</param>
+        CiFramePool(const size_t sizeCapacity, const int nChannels, const int nSize)
+            : m_pState(std::make_shared<State>(sizeCapacity, nChannels, nSize)) {}
+
+        CiFramePool(const CiFramePool&) = delete;
+        CiFramePool& operator=(const CiFramePool&) = delete;
+
+        /// <summary>
+        /// Get a free frame with the shape of the pool, index 0, time 0 and no source.
+        /// Frames that are still in use when the pool is destroyed are freed by their last handle.
+        /// </summary>
+        CiFrameHandle acquire() {
+            State& state = *m_pState;
+            size_t sizeSlot = state.freeFrames.pop();
+            if (sizeSlot == IndexStack::EMPTY) {
+                state.sizeMisses.fetch_add(1, std::memory_order_relaxed);
+                state.misses.add();
+                CiFrameHandle pFrame = std::make_shared<CiFrame>();
+                pFrame->resize(state.nChannels, state.nSize);
+                return pFrame;
+            }
+
+            CiFrame* pFrame = &state.frames[sizeSlot];
+            pFrame->resize(state.nChannels, state.nSize);
+            pFrame->setIndex(0);
+            pFrame->setTime(0.0);
+            return CiFrameHandle(pFrame, Recycler{ m_pState, sizeSlot }, ControlAllocator<CiFrame>(m_pState));
+        }
+
+        // Getter for the number of frames of the pool
+        size_t getCapacity() const { return m_pState->frames.size(); }
+
+        // Getter for the number of frames taken from the heap because the pool was empty
+        uint64_t getMissCount() const { return m_pState->sizeMisses.load(std::memory_order_relaxed); }
+
+    private:
+
+        // Bytes of one reference count block; larger blocks are taken from the heap
+        static constexpr size_t CONTROL_BYTES = 128;
+
+        /// <summary>
+        /// Lock-free stack of slot indices. The head carries a tag that changes with every
+        /// operation, so a pop never succeeds on a head that was popped and pushed again meanwhile.
+        /// </summary>
+        class IndexStack {
+        public:
+            static constexpr size_t EMPTY = static_cast<size_t>(-1);
+
+            explicit IndexStack(const size_t sizeCount) : m_next(new std::atomic<uint32_t>[sizeCount]), m_nHead(0) {
+                for (size_t k = 0; k < sizeCount; ++k) {
+                    m_next[k].store(static_cast<uint32_t>(k), std::memory_order_relaxed);
+                }
+                if (sizeCount > 0) m_nHead.store(sizeCount, std::memory_order_relaxed);
+            }
+
+            // Method to add a slot
+            void push(const size_t sizeSlot) {
+                uint64_t nHead = m_nHead.load(std::memory_order_relaxed);
+                uint64_t nNew;
+                do {
+                    m_next[sizeSlot].store(static_cast<uint32_t>(nHead), std::memory_order_relaxed);
+                    nNew = ((nHead >> 32) + 1) << 32 | (sizeSlot + 1);
+                } while (!m_nHead.compare_exchange_weak(nHead, nNew, std::memory_order_release, std::memory_order_relaxed));
+            }
+
+            // Method to take a slot, EMPTY if there is none
+            size_t pop() {
+                uint64_t nHead = m_nHead.load(std::memory_order_acquire);
+                while (true) {
+                    uint32_t nTop = static_cast<uint32_t>(nHead);
+                    if (nTop == 0) return EMPTY;
+                    uint64_t nNew = ((nHead >> 32) + 1) << 32 | m_next[nTop - 1].load(std::memory_order_relaxed);
+                    if (m_nHead.compare_exchange_weak(nHead, nNew, std::memory_order_acquire, std::memory_order_acquire)) return nTop - 1;
+                }
+            }
+
+        private:
+            // Slot below each slot plus one, 0 for the bottom; the low half of the head is the top slot plus one
+            std::unique_ptr<std::atomic<uint32_t>[]> m_next;
+            std::atomic<uint64_t> m_nHead;
+        };
+
+        /// <summary>
+        /// Storage of the pool, shared with the handles, so a handle that outlives the pool can still return its frame.
+        /// </summary>
+        struct State {
+            struct alignas(std::max_align_t) ControlBlock {
+                unsigned char bytes[CONTROL_BYTES];
+            };
+
+            int nChannels;
+            int nSize;
+            std::vector<CiFrame> frames;
+            std::unique_ptr<ControlBlock[]> controls;
+            IndexStack freeFrames;
+            IndexStack freeControls;
+            std::atomic<uint64_t> sizeMisses;
+            CiCounter& misses;
+
+            State(const size_t sizeCapacity, const int nFrameChannels, const int nFrameSize)
+                : nChannels(nFrameChannels), nSize(nFrameSize), frames(checkCapacity(sizeCapacity)), controls(new ControlBlock[sizeCapacity]),
+                freeFrames(sizeCapacity), freeControls(sizeCapacity), sizeMisses(0),
+                misses(CiTelemetry::getInstance().getCounter("vslib_frame_pool_misses_total", "Frames taken from the heap because a frame pool was empty.")) {
+                for (CiFrame& frame : frames) frame.resize(nChannels, nSize);
+            }
+
+            static size_t checkCapacity(const size_t sizeCapacity) {
+                if (sizeCapacity < 1 || sizeCapacity >= UINT32_MAX) {
+                    throw std::invalid_argument("The capacity of a frame pool must be between 1 and 2^32 - 2 frames.");
+                }
+                return sizeCapacity;
+            }
+        };
+
+        /// <summary>
+        /// Deleter of a handle: drops the source of the frame and puts the frame back on the free stack.
+        /// </summary>
+        struct Recycler {
+            std::shared_ptr<State> pState;
+            size_t sizeSlot;
+
+            void operator()(CiFrame* pFrame) const {
+                pFrame->setSource(nullptr);
+                pState->freeFrames.push(sizeSlot);
+            }
+        };
+
+        /// <summary>
+        /// Allocator of the reference count blocks of the handles from the preallocated blocks of the pool.
+        /// </summary>
+        template <typename T>
+        struct ControlAllocator {
+            typedef T value_type;
+
+            std::shared_ptr<State> pState;
+
+            explicit ControlAllocator(std::shared_ptr<State> pPoolState) noexcept : pState(std::move(pPoolState)) {}
+            template <typename U> ControlAllocator(const ControlAllocator<U>& other) noexcept : pState(other.pState) {}
+
+            T* allocate(const size_t sizeCount) {
+                if (sizeCount * sizeof(T) <= CONTROL_BYTES && alignof(T) <= alignof(typename State::ControlBlock)) {
+                    size_t sizeBlock = pState->freeControls.pop();
+                    if (sizeBlock != IndexStack::EMPTY) return reinterpret_cast<T*>(&pState->controls[sizeBlock]);
+                }
+                return static_cast<T*>(::operator new(sizeCount * sizeof(T)));
+            }
+
+            void deallocate(T* p, const size_t) noexcept {
+                auto pBlock = reinterpret_cast<typename State::ControlBlock*>(p);
+                auto pFirst = pState->controls.get();
+                if (pBlock >= pFirst && pBlock < pFirst + pState->frames.size()) pState->freeControls.push(static_cast<size_t>(pBlock - pFirst));
+                else ::operator delete(p);
+            }
+
+            template <typename U> bool operator==(const ControlAllocator<U>& other) const noexcept { return pState == other.pState; }
+            template <typename U> bool operator!=(const ControlAllocator<U>& other) const noexcept { return pState != other.pState; }
+        };
+
+        std::shared_ptr<State> m_pState;
+    };
+
+}
@@ -0,0 +1,294 @@
+// This C++ code defines long-term level statistics of the power spectrum
+// for noise monitoring. CiLevelStatistics keeps a histogram of the levels
+// of every bin in buckets of equal width in dB, together with the energy
+// sum and the extremes, so the equivalent level Leq, the minimum and
+// maximum and the percentile levels L10/L50/L90 of any time span are
+// available to the bucket width in constant memory. CiStatisticsSink
+// accumulates the frames of a stream and writes a report file at the end
+// of every interval, so minutes or hours of spectra never have to be stored.
+
+#pragma once
+#include "CiSink.hpp"
+#include "CiPortable.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Streaming per-bin level statistics over the added frames.
+    /// </summary>
+    class CiLevelStatistics {
+    public:
+
+        /// <summary>
+        /// Constructor for CiLevelStatistics.
+        /// </summary>
+        /// <param name="fpLevelMin">Lower edge of the lowest bucket (dB); lower levels are counted in the lowest bucket.</param>
+        /// <param name="fpLevelMax">Upper edge of the highest bucket (dB); higher levels are counted in the highest bucket.</param>
+        /// <param name="fpBucketWidth">Width of a bucket (dB), the resolution of the percentile levels.</param>
+        CiLevelStatistics(const float fpLevelMin = -140.0f, const float fpLevelMax = 20.0f, const float fpBucketWidth = 0.5f)
+            : m_fpLevelMin(fpLevelMin), m_fpBucketWidth(fpBucketWidth), m_nBuckets(0), m_sizeBins(0), m_sizeFrames(0) {
+            if (fpBucketWidth <= 0.0f || fpLevelMax <= fpLevelMin) {
+                throw std::invalid_argument("The level range of the statistics is empty.");
+            }
+            m_nBuckets = static_cast<int>(std::ceil((fpLevelMax - fpLevelMin) / fpBucketWidth));
+        }
+
+        /// <summary>
+        /// Allocate the statistics of a number of bins and forget all frames.
+        /// </summary>
+        /// <param name="sizeBins">Number of values per frame.</param>
+        void open(const size_t sizeBins) {
+            m_sizeBins = sizeBins;
+            m_counts.assign(sizeBins * m_nBuckets, 0);
+            m_energy.assign(sizeBins, 0.0);
+            m_minimum.assign(sizeBins, 0.0f);
+            m_maximum.assign(sizeBins, 0.0f);
+            m_levels.resize(sizeBins);
+            m_sizeFrames = 0;
+        }
+
+        // Method to forget all frames, keeping the allocated memory
+        void reset() {
+            std::fill(m_counts.begin(), m_counts.end(), 0u);
+            std::fill(m_energy.begin(), m_energy.end(), 0.0);
+            m_sizeFrames = 0;
+        }
+
+        /// <summary>
+        /// Add the power values of a frame.
+        /// </summary>
+        /// <param name="pPower">getBinCount() power values.</param>
+        void add(const float* pPower) {
+            // The levels are computed in one branch-free pass that the compiler can vectorise,
+            // the histogram update is a second pass.
+            float fpScale = 1.0f / m_fpBucketWidth;
+            for (size_t j = 0; j < m_sizeBins; ++j) {
+                m_levels[j] = (10.0f * std::log10((std::max)(pPower[j], 1e-30f)) - m_fpLevelMin) * fpScale;
+            }
+
+            float fpLastBucket = static_cast<float>(m_nBuckets - 1);
+            uint32_t* pCounts = m_counts.data();
+            for (size_t j = 0; j < m_sizeBins; ++j, pCounts += m_nBuckets) {
+                int nBucket = static_cast<int>((std::min)((std::max)(m_levels[j], 0.0f), fpLastBucket));
+                ++pCounts[nBucket];
+                m_energy[j] += pPower[j];
+            }
+
+            if (m_sizeFrames == 0) {
+                std::copy(pPower, pPower + m_sizeBins, m_minimum.begin());
+                std::copy(pPower, pPower + m_sizeBins, m_maximum.begin());
+            }
+            else {
+                for (size_t j = 0; j < m_sizeBins; ++j) {
+                    m_minimum[j] = (std::min)(m_minimum[j], pPower[j]);
+                    m_maximum[j] = (std::max)(m_maximum[j], pPower[j]);
+                }
+            }
+            ++m_sizeFrames;
+        }
+
+        // Getter for the number of bins
+        size_t getBinCount() const { return m_sizeBins; }
+
+        // Getter for the number of added frames
+        size_t getFrameCount() const { return m_sizeFrames; }
+
+        // Getter for the number of buckets per bin
+        int getBucketCount() const { return m_nBuckets; }
+
+        // Getter for the equivalent continuous level of a bin: the level of the mean power (dB)
+        float getLeq(const size_t sizeBin) const {
+            if (m_sizeFrames == 0) return toLevel(0.0f);
+            return toLevel(static_cast<float>(m_energy[sizeBin] / m_sizeFrames));
+        }
+
+        // Getter for the lowest level of a bin (dB)
+        float getMinLevel(const size_t sizeBin) const { return toLevel(m_sizeFrames ? m_minimum[sizeBin] : 0.0f); }
+
+        // Getter for the highest level of a bin (dB)
+        float getMaxLevel(const size_t sizeBin) const { return toLevel(m_sizeFrames ? m_maximum[sizeBin] : 0.0f); }
+
+        /// <summary>
+        /// Get the level of a bin that was exceeded in a given percentage of the frames, e.g. 10 for L10.
+        /// The result is the upper edge of the bucket that holds the percentile, limited to the highest level.
+        /// </summary>
+        /// <param name="sizeBin">Index of the bin.</param>
+        /// <param name="fpExceeded">Percentage of the frames above the returned level (0 ... 100).</param>
+        /// <returns>Percentile level (dB).</returns>
+        float getPercentileLevel(const size_t sizeBin, const float fpExceeded) const {
+            if (m_sizeFrames == 0) return toLevel(0.0f);
+
+            // Rank of the percentile counted from the lowest level
+            double dbRank = std::ceil((1.0 - fpExceeded / 100.0) * m_sizeFrames);
+            uint64_t nRank = static_cast<uint64_t>((std::max)(dbRank, 1.0));
+
+            const uint32_t* pCounts = m_counts.data() + sizeBin * m_nBuckets;
+            uint64_t nCumulative = 0;
+            int nBucket = 0;
+            for (; nBucket < m_nBuckets - 1; ++nBucket) {
+                nCumulative += pCounts[nBucket];
+                if (nCumulative >= nRank) break;
+            }
+
+            return (std::min)(m_fpLevelMin + (nBucket + 1) * m_fpBucketWidth, getMaxLevel(sizeBin));
+        }
+
+    private:
+        float m_fpLevelMin;
+        float m_fpBucketWidth;
+        int m_nBuckets;
+        size_t m_sizeBins;
+        size_t m_sizeFrames;
+        std::vector<uint32_t> m_counts;     // Bucket counts, m_nBuckets per bin
+        std::vector<double> m_energy;       // Sum of the power per bin
+        std::vector<float> m_minimum;
+        std::vector<float> m_maximum;
+        std::vector<float> m_levels;        // Bucket positions of the current frame
+
+        static float toLevel(const float fpPower) { return 10.0f * std::log10((std::max)(fpPower, 1e-30f)); }
+    };
+
+    /// <summary>
+    /// Sink that accumulates the level statistics of every channel and writes a CSV report at the end of every interval.
+    /// Run it with CiAsyncSink::BLOCK so every frame is counted.
+    /// </summary>
+    class CiStatisticsSink : public CiSink {
+    public:
+
+        /// <summary>
+        /// Description of a written report.
+        /// </summary>
+        struct Report {
+            double dbTimeBegin;         // Time of the first frame of the interval (s)
+            double dbTimeEnd;           // Time of the last frame of the interval (s)
+            size_t sizeFrames;          // Number of frames of the interval
+            std::string sFileName;      // CSV file of the report
+        };
+
+        /// <summary>
+        /// Constructor for CiStatisticsSink.
+        /// </summary>
+        /// <param name="sFolderPath">Existing folder for the report files.</param>
+        /// <param name="dbInterval">Length of a report interval (s).</param>
+        /// <param name="fpLevelMin">Lower edge of the lowest level bucket (dB).</param>
+        /// <param name="fpLevelMax">Upper edge of the highest level bucket (dB).</param>
+        /// <param name="fpBucketWidth">Width of a level bucket (dB).</param>
+        CiStatisticsSink(const std::string& sFolderPath, const double dbInterval = 60.0, const float fpLevelMin = -140.0f,
+            const float fpLevelMax = 20.0f, const float fpBucketWidth = 0.5f)
+            : m_sFolderPath(sFolderPath), m_dbInterval(dbInterval), m_fpLevelMin(fpLevelMin), m_fpLevelMax(fpLevelMax),
+            m_fpBucketWidth(fpBucketWidth), m_fpLevelOffset(0.0f), m_dbIntervalEnd(0.0), m_sizeReports(0), m_lastReport{ 0.0, 0.0, 0, "" } {
+            if (dbInterval <= 0.0) {
+                throw std::invalid_argument("The report interval must be positive.");
+            }
+        }
+
+        // Setter for the offset added to all reported levels, e.g. the calibration to dB SPL
+        void setLevelOffset(const float fpLevelOffset) { m_fpLevelOffset = fpLevelOffset; }
+
+        void open(const CiSinkLayout& layout) override {
+            m_layout = layout;
+            m_statistics.assign(layout.nChannels, CiLevelStatistics(m_fpLevelMin, m_fpLevelMax, m_fpBucketWidth));
+            for (CiLevelStatistics& statistics : m_statistics) statistics.open(static_cast<size_t>(layout.nIndexMax - layout.nIndexMin + 1));
+            m_current = Report{ 0.0, 0.0, 0, "" };
+            m_sizeReports = 0;
+        }
+
+        void write(const CiFrame& frame) override {
+            if (m_current.sizeFrames > 0 && frame.getTime() >= m_dbIntervalEnd) writeReport();
+
+            if (m_current.sizeFrames == 0) {
+                m_current.dbTimeBegin = frame.getTime();
+                m_dbIntervalEnd = frame.getTime() + m_dbInterval - 0.5 * m_layout.dbTimeStep;
+            }
+            for (int c = 0; c < frame.getChannelCount(); ++c) m_statistics[c].add(frame.getChannel(c) + m_layout.nIndexMin);
+            m_current.dbTimeEnd = frame.getTime();
+            ++m_current.sizeFrames;
+        }
+
+        void close() override {
+            // The last interval is reported even if it is incomplete
+            if (m_current.sizeFrames > 0) writeReport();
+        }
+
+        // Getter for the statistics of a channel in the current interval
+        const CiLevelStatistics& getStatistics(const int nChannel) const { return m_statistics.at(nChannel); }
+
+        // Getter for the number of written reports
+        size_t getReportCount() const { return m_sizeReports; }
+
+        // Getter for the last written report
+        const Report& getLastReport() const { return m_lastReport; }
+
+    private:
+        std::string m_sFolderPath;
+        double m_dbInterval;
+        float m_fpLevelMin;
+        float m_fpLevelMax;
+        float m_fpBucketWidth;
+        float m_fpLevelOffset;
+        CiSinkLayout m_layout;
+        std::vector<CiLevelStatistics> m_statistics;
+        Report m_current;
+        double m_dbIntervalEnd;
+        size_t m_sizeReports;
+        Report m_lastReport;
+
+        // Method to write the report of the current interval and start the next one
+        void writeReport() {
+            char sDigits[24];
+            char* pEnd = std::to_chars(sDigits, sDigits + sizeof(sDigits), static_cast<long long>(m_current.dbTimeBegin * 1e6)).ptr;
+            std::string sTime(sDigits, pEnd);
+            if (sTime.size() < 10) sTime.insert(0, 10 - sTime.size(), '0');
+            m_current.sFileName = m_sFolderPath + "/stats_" + sTime + ".csv";
+
+            std::string sText = "Frequency";
+            for (size_t c = 0; c < m_statistics.size(); ++c) {
+                const char* columns[] = { ",Leq ", ",Lmin ", ",Lmax ", ",L10 ", ",L50 ", ",L90 " };
+                for (const char* sColumn : columns) {
+                    sText += sColumn;
+                    sText += static_cast<char>('A' + c);
+                }
+            }
+            sText += '\n';
+
+            char sNumber[64];
+            for (size_t j = 0; j < m_statistics[0].getBinCount(); ++j) {
+                sText.append(sNumber, std::to_chars(sNumber, sNumber + sizeof(sNumber), m_layout.frequencies[m_layout.nIndexMin + j],
+                    std::chars_format::fixed, 2).ptr);
+                for (const CiLevelStatistics& statistics : m_statistics) {
+                    float levels[] = { statistics.getLeq(j), statistics.getMinLevel(j), statistics.getMaxLevel(j),
+                        statistics.getPercentileLevel(j, 10.0f), statistics.getPercentileLevel(j, 50.0f), statistics.getPercentileLevel(j, 90.0f) };
+                    for (float fpLevel : levels) {
+                        sText += ',';
+                        sText.append(sNumber, std::to_chars(sNumber, sNumber + sizeof(sNumber), fpLevel + m_fpLevelOffset, std::chars_format::fixed, 2).ptr);
+                    }
+                }
+                sText += '\n';
+            }
+
+            FILE* pFile = nullptr;
+            errno_t err = fopen_s(&pFile, m_current.sFileName.c_str(), "wb");
+            if (err != 0 || !pFile) {
+                throw std::runtime_error("Can't open a file " + m_current.sFileName + ".");
+            }
+            bool bComplete = fwrite(sText.data(), 1, sText.size(), pFile) == sText.size();
+            if (fclose(pFile) != 0 || !bComplete) {
+                throw std::runtime_error("Failed to write the file " + m_current.sFileName + ".");
+            }
+
+            m_lastReport = m_current;
+            ++m_sizeReports;
+            for (CiLevelStatistics& statistics : m_statistics) statistics.reset();
+            m_current = Report{ 0.0, 0.0, 0, "" };
+        }
+    };
+
+}
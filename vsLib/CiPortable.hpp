@@ -0,0 +1,20 @@
+// This C++ code provides the few C runtime functions of the Microsoft
+// compiler that the file writers use, for builds with other compilers,
+// so the parts of the library that do not capture audio also build and
+// run on Linux.
+
+#pragma once
+#include <cerrno>
+#include <cstdio>
+
+#if !defined(_MSC_VER)
+
+typedef int errno_t;
+
+// Open a file like fopen, reporting the error like the secure variant of the Microsoft runtime
+inline errno_t fopen_s(FILE** ppFile, const char* sFileName, const char* sMode) {
+    *ppFile = std::fopen(sFileName, sMode);
+    return *ppFile ? 0 : errno;
+}
+
+#endif
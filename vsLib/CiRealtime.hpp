@@ -0,0 +1,264 @@
+// This C++ code defines the real-time settings of the pipeline threads. A
+// thread of the capture, deinterleave, transform or sink stage can run at
+// real-time priority (SCHED_FIFO on Linux, an MMCSS task on Windows), be
+// pinned to a set of cores, and keep the pages of the process in memory,
+// so a loaded machine does not preempt the capture or page out its
+// buffers. Only Linux and other POSIX systems lock the pages (mlockall);
+// Windows has no process-wide lock, so there the setting only raises the
+// minimum working set, which makes paging out less likely but pins no
+// buffer. The settings need rights the process may not have: each one is
+// tried on its own, and a report tells what was applied and why the rest
+// was not, instead of failing the capture. The settings are reverted when
+// the thread leaves its stage; the memory lock holds for the process.
+
+#pragma once
+#ifdef _WIN32
+#include <Windows.h>
+#include <avrt.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <cerrno>
+#include <cstring>
+#endif
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Real-time settings of one pipeline thread.
+    /// </summary>
+    struct CiThreadConfig {
+
+        static constexpr int PRIORITY_DEFAULT = 0;      // Keep the priority the thread was started with
+        static constexpr int PRIORITY_REALTIME = 1;     // SCHED_FIFO on Linux, an MMCSS task on Windows
+
+        int nPriority;                  // PRIORITY_*
+        int nFifoPriority;              // SCHED_FIFO priority on Linux, 1 to 99
+        std::string sMmcssTask;         // MMCSS task on Windows, e.g. "Pro Audio" or "Audio"
+        std::vector<int> cores;         // Cores the thread may run on, empty for all cores
+        bool bLockMemory;               // Lock the pages of the process in memory; on Windows only raise the minimum working set
+        size_t sizeWorkingSetBytes;     // Bytes added to the minimum working set on Windows, which has no process-wide lock
+
+        CiThreadConfig() : nPriority(PRIORITY_DEFAULT), nFifoPriority(70), sMmcssTask("Pro Audio"), bLockMemory(false),
+            sizeWorkingSetBytes(static_cast<size_t>(256) << 20) {}
+
+        // Method to check whether the settings change anything
+        bool isDefault() const { return nPriority == PRIORITY_DEFAULT && cores.empty() && !bLockMemory; }
+    };
+
+    /// <summary>
+    /// What a pipeline thread actually got of its real-time settings.
+    /// </summary>
+    struct CiThreadReport {
+        std::string sThread;                // Name of the thread
+        std::string sPriority;              // Applied priority, e.g. "SCHED_FIFO 70", "MMCSS Pro Audio" or "default"
+        std::string sAffinity;              // Applied cores, e.g. "2,3", or "all"
+        std::string sMemory;                // "locked", "working set +256 MB" or "not locked"
+        std::vector<std::string> errors;    // Settings that were asked for but not applied, with the reason
+
+        CiThreadReport() : sPriority("default"), sAffinity("all"), sMemory("not locked") {}
+
+        // Method to check whether all settings were applied
+        bool isComplete() const { return errors.empty(); }
+
+        // Method to describe the report in one line
+        std::string toString() const {
+            std::string sText = sThread + ": priority " + sPriority + ", cores " + sAffinity + ", memory " + sMemory;
+            for (const std::string& sError : errors) sText += "; " + sError;
+            return sText;
+        }
+    };
+
+    /// <summary>
+    /// Applies real-time settings to the calling thread for the lifetime of the object.
+    /// </summary>
+    class CiRealtimeThread {
+    public:
+
+        /// <summary>
+        /// Constructor for CiRealtimeThread. Applies the settings to the calling thread.
+        /// </summary>
+        /// <param name="sThread">Name of the thread in the report.</param>
+        /// <param name="config">Settings to apply.</param>
+        CiRealtimeThread(const std::string& sThread, const CiThreadConfig& config)
+            : m_bPriority(false), m_bAffinity(false) {
+            if (config.nPriority != CiThreadConfig::PRIORITY_DEFAULT && config.nPriority != CiThreadConfig::PRIORITY_REALTIME) {
+                throw std::invalid_argument("Unknown thread priority.");
+            }
+            if (config.nFifoPriority < 1 || config.nFifoPriority > 99) {
+                throw std::invalid_argument("The SCHED_FIFO priority must be between 1 and 99.");
+            }
+            for (int nCore : config.cores) {
+                if (nCore < 0) throw std::invalid_argument("A core index must not be negative.");
+            }
+
+            m_report.sThread = sThread;
+            if (config.bLockMemory) lockMemory(config, m_report);
+            if (!config.cores.empty()) setAffinity(config.cores);
+            if (config.nPriority == CiThreadConfig::PRIORITY_REALTIME) setPriority(config);
+        }
+
+        /// <summary>
+        /// Destructor for CiRealtimeThread. Gives the thread back its priority and cores.
+        /// </summary>
+        ~CiRealtimeThread() {
+#ifdef _WIN32
+            if (m_bPriority) AvRevertMmThreadCharacteristics(m_hTask);
+            if (m_bAffinity) SetThreadAffinityMask(GetCurrentThread(), m_dwPreviousMask);
+#else
+            if (m_bPriority) pthread_setschedparam(pthread_self(), m_nPreviousPolicy, &m_previousParam);
+#if defined(__linux__)
+            if (m_bAffinity) pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &m_previousSet);
+#endif
+#endif
+        }
+
+        CiRealtimeThread(const CiRealtimeThread&) = delete;
+        CiRealtimeThread& operator=(const CiRealtimeThread&) = delete;
+
+        // Getter for what was applied
+        const CiThreadReport& getReport() const { return m_report; }
+
+    private:
+        CiThreadReport m_report;
+        bool m_bPriority;
+        bool m_bAffinity;
+#ifdef _WIN32
+        HANDLE m_hTask;
+        DWORD_PTR m_dwPreviousMask;
+#else
+        int m_nPreviousPolicy;
+        sched_param m_previousParam;
+#if defined(__linux__)
+        cpu_set_t m_previousSet;
+#endif
+#endif
+
+        // Method to list the cores of the report
+        static std::string formatCores(const std::vector<int>& cores) {
+            std::string sCores;
+            for (size_t k = 0; k < cores.size(); ++k) sCores += (k ? "," : "") + std::to_string(cores[k]);
+            return sCores;
+        }
+
+#ifdef _WIN32
+        // Method to describe the last Windows error
+        static std::string getLastErrorText() {
+            return "error " + std::to_string(GetLastError());
+        }
+#endif
+
+        // Method to pin the calling thread to the cores
+        void setAffinity(const std::vector<int>& cores) {
+#ifdef _WIN32
+            DWORD_PTR dwMask = 0;
+            for (int nCore : cores) {
+                if (nCore >= static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+                    m_report.errors.push_back("core " + std::to_string(nCore) + " is outside the first processor group");
+                    return;
+                }
+                dwMask |= static_cast<DWORD_PTR>(1) << nCore;
+            }
+            m_dwPreviousMask = SetThreadAffinityMask(GetCurrentThread(), dwMask);
+            if (m_dwPreviousMask == 0) {
+                m_report.errors.push_back("cores " + formatCores(cores) + ": " + getLastErrorText());
+                return;
+            }
+#elif defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int nCore : cores) {
+                if (nCore >= CPU_SETSIZE) {
+                    m_report.errors.push_back("core " + std::to_string(nCore) + " is beyond CPU_SETSIZE");
+                    return;
+                }
+                CPU_SET(nCore, &set);
+            }
+            int err = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &m_previousSet);
+            if (err == 0) err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+            if (err != 0) {
+                m_report.errors.push_back("cores " + formatCores(cores) + ": " + std::strerror(err));
+                return;
+            }
+#else
+            m_report.errors.push_back("core pinning is not supported on this platform");
+            return;
+#endif
+            m_bAffinity = true;
+            m_report.sAffinity = formatCores(cores);
+        }
+
+        // Method to raise the calling thread to real-time priority
+        void setPriority(const CiThreadConfig& config) {
+#ifdef _WIN32
+            DWORD dwTaskIndex = 0;
+            m_hTask = AvSetMmThreadCharacteristicsA(config.sMmcssTask.c_str(), &dwTaskIndex);
+            if (!m_hTask) {
+                m_report.errors.push_back("MMCSS " + config.sMmcssTask + ": " + getLastErrorText());
+                return;
+            }
+            m_bPriority = true;
+            m_report.sPriority = "MMCSS " + config.sMmcssTask;
+            if (AvSetMmThreadPriority(m_hTask, AVRT_PRIORITY_HIGH)) m_report.sPriority += " high";
+#else
+            int err = pthread_getschedparam(pthread_self(), &m_nPreviousPolicy, &m_previousParam);
+            sched_param param{};
+            param.sched_priority = config.nFifoPriority;
+            if (err == 0) err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            if (err != 0) {
+                std::string sError = "SCHED_FIFO " + std::to_string(config.nFifoPriority) + ": " + std::strerror(err);
+                if (err == EPERM) sError += " (needs CAP_SYS_NICE or an rtprio limit)";
+                m_report.errors.push_back(sError);
+                return;
+            }
+            m_bPriority = true;
+            m_report.sPriority = "SCHED_FIFO " + std::to_string(config.nFifoPriority);
+#endif
+        }
+
+        // Method to lock the pages of the process, or on Windows to raise its minimum working set, once;
+        // later threads get the result of the first try
+        static void lockMemory(const CiThreadConfig& config, CiThreadReport& report) {
+            static std::mutex mtx;
+            static bool bTried = false;
+            static std::string sMemory = "not locked";
+            static std::string sError;
+
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!bTried) {
+                bTried = true;
+#ifdef _WIN32
+                SIZE_T sizeMinimum = 0, sizeMaximum = 0;
+                HANDLE hProcess = GetCurrentProcess();
+                if (GetProcessWorkingSetSize(hProcess, &sizeMinimum, &sizeMaximum) &&
+                    SetProcessWorkingSetSize(hProcess, sizeMinimum + config.sizeWorkingSetBytes, (std::max)(sizeMaximum, sizeMinimum + config.sizeWorkingSetBytes))) {
+                    sMemory = "working set +" + std::to_string(config.sizeWorkingSetBytes >> 20) + " MB";
+                }
+                else {
+                    sError = "working set: " + getLastErrorText();
+                }
+#else
+                (void)config;
+                if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+                    sMemory = "locked";
+                }
+                else {
+                    int err = errno;
+                    sError = std::string("mlockall: ") + std::strerror(err);
+                    if (err == EPERM || err == ENOMEM) sError += " (needs CAP_IPC_LOCK or a larger memlock limit)";
+                }
+#endif
+            }
+            report.sMemory = sMemory;
+            if (!sError.empty()) report.errors.push_back(sError);
+        }
+    };
+
+}
@@ -0,0 +1,102 @@
+// This C++ code defines a generator of synthetic test signals: tones,
+// linear chirps, Gaussian white noise and impulses, added up in one frame
+// of samples. The phases are computed in double precision with the exact
+// value of 2 pi, so the signals can serve as the input of a reference
+// transform as well as of the fast transform paths under test.
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Class for generating a frame of synthetic test samples.
+    /// </summary>
+    class CiSignal {
+    public:
+
+        /// <summary>
+        /// Constructor for CiSignal. The frame starts silent.
+        /// </summary>
+        /// <param name="nSize">Number of samples.</param>
+        /// <param name="dbSamplesPerSec">Sample rate (Hz).</param>
+        CiSignal(const int nSize, const double dbSamplesPerSec) : m_dbSamplesPerSec(dbSamplesPerSec), m_values(nSize > 0 ? nSize : 0, 0.0) {
+            if (nSize < 1 || dbSamplesPerSec <= 0.0) {
+                throw std::invalid_argument("The signal needs at least one sample and a positive sample rate.");
+            }
+        }
+
+        // Method to make the frame silent again
+        void clear() { std::fill(m_values.begin(), m_values.end(), 0.0); }
+
+        /// <summary>
+        /// Add a sine tone.
+        /// </summary>
+        /// <param name="dbFrequency">Frequency (Hz).</param>
+        /// <param name="dbAmplitude">Peak amplitude.</param>
+        /// <param name="dbPhase">Phase at the first sample (rad).</param>
+        void addTone(const double dbFrequency, const double dbAmplitude = 1.0, const double dbPhase = 0.0) {
+            for (size_t i = 0; i < m_values.size(); ++i) {
+                m_values[i] += dbAmplitude * std::sin(TWO_PI * dbFrequency * i / m_dbSamplesPerSec + dbPhase);
+            }
+        }
+
+        /// <summary>
+        /// Add a sine tone whose frequency rises or falls linearly over the frame.
+        /// </summary>
+        /// <param name="dbFrequencyBegin">Frequency at the first sample (Hz).</param>
+        /// <param name="dbFrequencyEnd">Frequency at the end of the frame (Hz).</param>
+        /// <param name="dbAmplitude">Peak amplitude.</param>
+        void addChirp(const double dbFrequencyBegin, const double dbFrequencyEnd, const double dbAmplitude = 1.0) {
+            double dbDuration = m_values.size() / m_dbSamplesPerSec;
+            double dbRate = (dbFrequencyEnd - dbFrequencyBegin) / dbDuration;
+            for (size_t i = 0; i < m_values.size(); ++i) {
+                double dbTime = i / m_dbSamplesPerSec;
+                m_values[i] += dbAmplitude * std::sin(TWO_PI * (dbFrequencyBegin * dbTime + 0.5 * dbRate * dbTime * dbTime));
+            }
+        }
+
+        /// <summary>
+        /// Add Gaussian white noise; the same seed gives the same noise.
+        /// </summary>
+        /// <param name="dbRms">RMS value of the noise.</param>
+        /// <param name="nSeed">Seed of the random generator.</param>
+        void addNoise(const double dbRms, const unsigned int nSeed = 1) {
+            std::mt19937 generator(nSeed);
+            std::normal_distribution<double> distribution(0.0, dbRms);
+            for (double& dbValue : m_values) dbValue += distribution(generator);
+        }
+
+        /// <summary>
+        /// Add a single-sample impulse.
+        /// </summary>
+        /// <param name="nPosition">Index of the sample.</param>
+        /// <param name="dbAmplitude">Value of the impulse.</param>
+        void addImpulse(const int nPosition, const double dbAmplitude = 1.0) {
+            if (nPosition < 0 || nPosition >= static_cast<int>(m_values.size())) {
+                throw std::out_of_range("The impulse is outside the frame.");
+            }
+            m_values[nPosition] += dbAmplitude;
+        }
+
+        // Method to get the samples as float values, as the transforms take them
+        std::vector<float> getSamples() const { return std::vector<float>(m_values.begin(), m_values.end()); }
+
+        // Getter for the number of samples
+        int getSize() const { return static_cast<int>(m_values.size()); }
+
+        // Getter for the sample rate (Hz)
+        double getSamplesPerSec() const { return m_dbSamplesPerSec; }
+
+    private:
+        static constexpr double TWO_PI = 6.283185307179586476925;
+
+        double m_dbSamplesPerSec;
+        std::vector<double> m_values;
+    };
+
+}
@@ -0,0 +1,227 @@
+// This C++ code defines the output sinks of the spectral pipeline. A sink
+// receives every computed frame (power spectra or band energies of all
+// channels) and writes it somewhere: files, the console, a network socket.
+// CiAsyncSink runs a sink on its own I/O thread behind a bounded queue, so
+// a slow disk or console never stalls the transform, and several sinks can
+// consume the same frames at once without copying them.
+
+#pragma once
+#include "CiBoundedQueue.hpp"
+#include "CiFrame.hpp"
+#include "CiRealtime.hpp"
+#include "CiTelemetry.hpp"
+#include "CiTrace.hpp"
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Description of the frames a sink receives.
+    /// </summary>
+    struct CiSinkLayout {
+        int nChannels;                      // Number of channels of a frame
+        int nSampleSize;                    // Sample (FFT) size of the transform
+        unsigned long dwSamplesPerSec;      // Sample rate (Hz)
+        double dbTimeStep;                  // Time between two frames (s)
+        int nIndexMin;                      // First output index to write
+        int nIndexMax;                      // Last output index to write
+        bool bBands;                        // True for filterbank band energies, false for power spectrum bins
+        std::vector<float> frequencies;     // Frequency of every output index (bin or band centre frequency, Hz)
+    };
+
+    /// <summary>
+    /// Interface of an output sink. All calls are made from the I/O thread of the sink.
+    /// </summary>
+    class CiSink {
+    public:
+        virtual ~CiSink() {}
+
+        /// <summary>
+        /// Prepare the output before the first frame.
+        /// </summary>
+        /// <param name="layout">Description of the frames.</param>
+        virtual void open(const CiSinkLayout& layout) = 0;
+
+        /// <summary>
+        /// Write one frame.
+        /// </summary>
+        /// <param name="frame">Output values of all channels.</param>
+        virtual void write(const CiFrame& frame) = 0;
+
+        /// <summary>
+        /// Finish the output after the last frame.
+        /// </summary>
+        virtual void close() {}
+
+        /// <summary>
+        /// Check whether the sink needs the audio samples of the frames (CiFrame::getSource).
+        /// </summary>
+        virtual bool needsSource() const { return false; }
+    };
+
+    /// <summary>
+    /// Runs a sink on its own I/O thread fed through a bounded queue.
+    /// </summary>
+    class CiAsyncSink {
+    public:
+
+        static constexpr int DROP_NEWEST = 0;   // A full queue drops the new frame
+        static constexpr int BLOCK = 1;         // A full queue makes the producer wait
+        static constexpr int DROP_OLDEST = 2;   // A full queue drops its oldest frame, so the sink always gets the latest one
+
+        /// <summary>
+        /// Constructor for CiAsyncSink.
+        /// </summary>
+        /// <param name="pSink">Sink to run.</param>
+        /// <param name="sizeCapacity">Number of frames the queue holds.</param>
+        /// <param name="nOverflow">What happens to a frame that arrives at a full queue: DROP_NEWEST, BLOCK or DROP_OLDEST.</param>
+        CiAsyncSink(std::shared_ptr<CiSink> pSink, const size_t sizeCapacity = 64, const int nOverflow = DROP_NEWEST)
+            : m_pSink(pSink), m_queue(sizeCapacity), m_nOverflow(nOverflow), m_sizeWritten(0), m_sizeDropped(0),
+            m_droppedMetric(CiTelemetry::getInstance().getCounter("vslib_sink_dropped_frames_total", "Frames dropped at the queue of a sink.")),
+            m_writeMetric(CiTelemetry::getInstance().getHistogram("vslib_sink_write_seconds", "Time of a sink to write one frame.",
+                CiHistogram::makeExponentialBounds(1e-6, 4.0, 12))) {}
+
+        CiAsyncSink(const CiAsyncSink&) = delete;
+        CiAsyncSink& operator=(const CiAsyncSink&) = delete;
+
+        /// <summary>
+        /// Destructor for CiAsyncSink. Writes the queued frames and stops the I/O thread.
+        /// </summary>
+        ~CiAsyncSink() {
+            stop();
+        }
+
+        /// <summary>
+        /// Start the I/O thread, which opens the sink and writes the queued frames.
+        /// </summary>
+        /// <param name="layout">Description of the frames.</param>
+        void start(const CiSinkLayout& layout) {
+            stop();
+
+            m_queue.reset();
+            m_sizeWritten = 0;
+            m_sizeDropped = 0;
+            {
+                std::lock_guard<std::mutex> lock(m_errorMutex);
+                m_pError = nullptr;
+            }
+
+            m_thread = std::thread(&CiAsyncSink::run, this, layout);
+        }
+
+        // Getter for the number of frames the queue holds
+        size_t getCapacity() { return m_queue.getCapacity(); }
+
+        // Setter for the real-time settings of the I/O thread, used from the next start
+        void setThreadConfig(const CiThreadConfig& config) { m_threadConfig = config; }
+
+        // Getter for what the I/O thread got of its real-time settings
+        CiThreadReport getThreadReport() {
+            std::lock_guard<std::mutex> lock(m_errorMutex);
+            return m_threadReport;
+        }
+
+        /// <summary>
+        /// Hand a frame over to the I/O thread.
+        /// </summary>
+        /// <param name="pFrame">Frame shared with the other sinks.</param>
+        /// <returns>False if the frame was dropped because the queue is full or the sink has failed.</returns>
+        bool push(const std::shared_ptr<const CiFrame>& pFrame) {
+            if (m_nOverflow == DROP_OLDEST) {
+                bool bDiscarded = false;
+                bool bQueued = m_queue.pushOverwrite(pFrame, bDiscarded);
+                if (!bQueued || bDiscarded) {
+                    ++m_sizeDropped;
+                    m_droppedMetric.add();
+                }
+                return bQueued;
+            }
+
+            bool bQueued = (m_nOverflow == BLOCK) ? m_queue.push(pFrame) : m_queue.tryPush(pFrame);
+            if (!bQueued) {
+                ++m_sizeDropped;
+                m_droppedMetric.add();
+            }
+            return bQueued;
+        }
+
+        /// <summary>
+        /// Write the queued frames, close the sink and stop the I/O thread.
+        /// </summary>
+        void stop() {
+            m_queue.close();
+            if (m_thread.joinable()) m_thread.join();
+        }
+
+        /// <summary>
+        /// Get the error that stopped the sink, or nullptr.
+        /// </summary>
+        std::exception_ptr getError() {
+            std::lock_guard<std::mutex> lock(m_errorMutex);
+            return m_pError;
+        }
+
+        // Getter for the sink
+        std::shared_ptr<CiSink> getSink() const { return m_pSink; }
+
+        // Getter for the number of written frames
+        size_t getWrittenFrames() const { return m_sizeWritten; }
+
+        // Getter for the number of frames dropped because the queue was full
+        size_t getDroppedFrames() const { return m_sizeDropped; }
+
+    private:
+        std::shared_ptr<CiSink> m_pSink;
+        CiBoundedQueue<std::shared_ptr<const CiFrame>> m_queue;
+        int m_nOverflow;
+        std::thread m_thread;
+        std::atomic<size_t> m_sizeWritten;
+        std::atomic<size_t> m_sizeDropped;
+        std::mutex m_errorMutex;
+        std::exception_ptr m_pError;
+        CiCounter& m_droppedMetric;
+        CiHistogram& m_writeMetric;
+        CiThreadConfig m_threadConfig;
+        CiThreadReport m_threadReport;
+
+        // I/O thread: opens the sink, writes the frames until the queue is closed and empty, then closes the sink
+        void run(CiSinkLayout layout) {
+            CI_TRACE_THREAD_NAME("sink");
+            try {
+                CiRealtimeThread realtime("sink", m_threadConfig);
+                {
+                    std::lock_guard<std::mutex> lock(m_errorMutex);
+                    m_threadReport = realtime.getReport();
+                }
+                m_pSink->open(layout);
+
+                std::shared_ptr<const CiFrame> pFrame;
+                while (m_queue.pop(pFrame)) {
+                    CI_TRACE_SCOPE_INDEX("sink_write", pFrame->getIndex());
+                    auto tpBegin = std::chrono::steady_clock::now();
+                    m_pSink->write(*pFrame);
+                    m_writeMetric.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - tpBegin).count());
+                    pFrame.reset();
+                    ++m_sizeWritten;
+                }
+
+                m_pSink->close();
+            }
+            catch (...) {
+                {
+                    std::lock_guard<std::mutex> lock(m_errorMutex);
+                    m_pError = std::current_exception();
+                }
+                // Later frames are dropped instead of blocking the producer
+                m_queue.close();
+            }
+        }
+    };
+
+}
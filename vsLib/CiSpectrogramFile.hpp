@@ -0,0 +1,548 @@
+// This C++ code defines a single-file binary container for recorded
+// spectrograms and a writer for it. The file starts with a header that
+// describes the stream (sample rate, FFT size, window, stored bin range),
+// followed by the frequency of every stored value and fixed-size records
+// of float values. Records are appended through a large buffer, so a
+// session becomes a few big sequential writes instead of one file per
+// frame. While recording, the writer also builds decimated overviews
+// (min/max/mean pyramids) of the records, so a reader can show hours of
+// data without touching every record. When the file is closed, the time
+// index, the pyramid levels and a footer are appended; a file without a
+// footer (e.g. after a crash) is still readable because the records have
+// a fixed size.
+//
+// Layout (little-endian):
+//   CiSpectrogramHeader           nHeaderSize bytes
+//   float frequencies[nValues]    at nHeaderSize
+//   records                       at nDataOffset, nRecordSize bytes each:
+//                                   CiSpectrogramRecord, then float values[nChannels][nValues]
+//   sections                      SECTION_TIME_INDEX: CiSpectrogramIndexEntry[]
+//                                 SECTION_PYRAMID: entries of getPyramidEntrySize bytes:
+//                                   CiSpectrogramPyramidEntry, then float min[nChannels][nValues],
+//                                   max[nChannels][nValues], mean[nChannels][nValues]
+//   CiSpectrogramSection[]        section table
+//   CiSpectrogramFooter           last 32 bytes of the file
+
+#pragma once
+#include "CiSink.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Header at the start of a spectrogram file.
+    /// </summary>
+    struct CiSpectrogramHeader {
+        char magic[8];              // "VISPEC01"
+        uint32_t nVersion;          // Format version
+        uint32_t nHeaderSize;       // Size of this header (bytes)
+        uint64_t nDataOffset;       // File offset of the first record
+        uint32_t nRecordSize;       // Size of a record (bytes)
+        uint32_t nChannels;         // Number of channels per record
+        uint32_t nSamplesPerSec;    // Sample rate (Hz)
+        uint32_t nSampleSize;       // Sample (FFT) size
+        int32_t nIndexMin;          // First stored bin or band index
+        int32_t nIndexMax;          // Last stored bin or band index
+        uint32_t nValues;           // Values per channel, nIndexMax - nIndexMin + 1
+        uint32_t nFlags;            // FLAG_BANDS
+        double dbTimeStep;          // Time between two frames (s)
+        int64_t nStartTimeUs;       // Wall-clock time of the start of the recording (microseconds since 1970)
+        char sWindow[16];           // Window function applied before the transform
+        uint8_t reserved[168];
+    };
+
+    /// <summary>
+    /// Fixed part at the start of every record.
+    /// </summary>
+    struct CiSpectrogramRecord {
+        uint64_t nFrameIndex;       // Sequence number of the frame, starting from 1
+        double dbTime;              // Time of the end of the frame from the start of the capture (s)
+    };
+
+    /// <summary>
+    /// Entry of the section table.
+    /// </summary>
+    struct CiSpectrogramSection {
+        uint32_t nType;             // SECTION_TIME_INDEX, ...
+        uint32_t nParam;            // Type-specific parameter
+        uint64_t nOffset;           // File offset of the section
+        uint64_t nSize;             // Size of the section (bytes)
+        uint64_t nCount;            // Number of entries in the section
+    };
+
+    /// <summary>
+    /// Entry of the time index: the time of every n-th record.
+    /// </summary>
+    struct CiSpectrogramIndexEntry {
+        double dbTime;              // Time of the record
+        uint64_t nRecord;           // Record number, starting from 0
+    };
+
+    /// <summary>
+    /// Fixed part at the start of every pyramid entry, which summarizes consecutive records.
+    /// </summary>
+    struct CiSpectrogramPyramidEntry {
+        uint64_t nFirstRecord;      // First summarized record
+        uint32_t nCount;            // Number of summarized records
+        uint32_t reserved;
+        double dbTimeBegin;         // Time of the first summarized record
+        double dbTimeEnd;           // Time of the last summarized record
+    };
+
+    /// <summary>
+    /// Footer at the end of a closed spectrogram file.
+    /// </summary>
+    struct CiSpectrogramFooter {
+        uint64_t nSectionTableOffset;   // File offset of the section table
+        uint64_t nRecordCount;          // Number of records
+        uint32_t nSectionCount;         // Number of section table entries
+        uint32_t reserved;
+        char magic[8];                  // "VISPEND1"
+    };
+
+    static_assert(sizeof(CiSpectrogramHeader) == 256, "The spectrogram header must be 256 bytes.");
+    static_assert(sizeof(CiSpectrogramRecord) == 16, "The spectrogram record header must be 16 bytes.");
+    static_assert(sizeof(CiSpectrogramSection) == 32, "The spectrogram section entry must be 32 bytes.");
+    static_assert(sizeof(CiSpectrogramPyramidEntry) == 32, "The spectrogram pyramid entry must be 32 bytes.");
+    static_assert(sizeof(CiSpectrogramFooter) == 32, "The spectrogram footer must be 32 bytes.");
+
+    /// <summary>
+    /// Constants of the spectrogram file format.
+    /// </summary>
+    struct CiSpectrogramFormat {
+        static constexpr const char* HEADER_MAGIC = "VISPEC01";
+        static constexpr const char* FOOTER_MAGIC = "VISPEND1";
+        static constexpr const char* COMPRESSED_MAGIC = "VISPEZ01";
+        static const uint32_t VERSION = 1;
+        static const uint32_t FLAG_BANDS = 1;
+        static const uint32_t SECTION_TIME_INDEX = 1;
+        static const uint32_t SECTION_PYRAMID = 2;     // nParam is the number of records per entry
+        static const uint32_t DATA_ALIGNMENT = 64;
+
+        /// <summary>
+        /// Get the size of a pyramid entry of a file.
+        /// </summary>
+        static uint64_t getPyramidEntrySize(const CiSpectrogramHeader& header) {
+            return sizeof(CiSpectrogramPyramidEntry) + 3ull * header.nChannels * header.nValues * sizeof(float);
+        }
+
+        /// <summary>
+        /// Create the header of a file that stores the values nIndexMin ... nIndexMax of every channel of the frames.
+        /// </summary>
+        /// <param name="layout">Description of the frames.</param>
+        /// <param name="sWindow">Name of the window function applied before the transform.</param>
+        /// <param name="sMagic">HEADER_MAGIC or COMPRESSED_MAGIC.</param>
+        static CiSpectrogramHeader makeHeader(const CiSinkLayout& layout, const std::string& sWindow, const char* sMagic = HEADER_MAGIC) {
+            if (layout.nIndexMin < 0 || layout.nIndexMax < layout.nIndexMin || layout.nIndexMax >= static_cast<int>(layout.frequencies.size())) {
+                throw std::invalid_argument("The stored index range of the spectrogram is not valid.");
+            }
+
+            CiSpectrogramHeader header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, sMagic, 8);
+            header.nVersion = VERSION;
+            header.nHeaderSize = sizeof(CiSpectrogramHeader);
+            header.nChannels = static_cast<uint32_t>(layout.nChannels);
+            header.nSamplesPerSec = static_cast<uint32_t>(layout.dwSamplesPerSec);
+            header.nSampleSize = static_cast<uint32_t>(layout.nSampleSize);
+            header.nIndexMin = layout.nIndexMin;
+            header.nIndexMax = layout.nIndexMax;
+            header.nValues = static_cast<uint32_t>(layout.nIndexMax - layout.nIndexMin + 1);
+            header.nFlags = layout.bBands ? FLAG_BANDS : 0;
+            header.dbTimeStep = layout.dbTimeStep;
+            header.nStartTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            std::memcpy(header.sWindow, sWindow.c_str(), (std::min)(sWindow.size(), sizeof(header.sWindow) - 1));
+
+            uint64_t nFrequenciesEnd = header.nHeaderSize + static_cast<uint64_t>(header.nValues) * sizeof(float);
+            header.nDataOffset = (nFrequenciesEnd + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+            header.nRecordSize = static_cast<uint32_t>(sizeof(CiSpectrogramRecord) + static_cast<size_t>(header.nChannels) * header.nValues * sizeof(float));
+            return header;
+        }
+    };
+
+    /// <summary>
+    /// Class for writing a spectrogram file with large sequential appends.
+    /// </summary>
+    class CiSpectrogramWriter {
+    public:
+
+        CiSpectrogramWriter() : m_sizeBufferBytes(4 << 20), m_sizeBuffered(0), m_nRecordCount(0), m_nIndexInterval(64), m_nFileOffset(0),
+            m_nPyramidLevels(4), m_nPyramidFactor(8) {
+            std::memset(&m_header, 0, sizeof(m_header));
+        }
+
+        CiSpectrogramWriter(const CiSpectrogramWriter&) = delete;
+        CiSpectrogramWriter& operator=(const CiSpectrogramWriter&) = delete;
+
+        /// <summary>
+        /// Destructor for CiSpectrogramWriter. Closes the file if it is open.
+        /// </summary>
+        ~CiSpectrogramWriter() {
+            try {
+                close();
+            }
+            catch (...) {}
+        }
+
+        /// <summary>
+        /// Set the size of the write buffer. Must be called before open.
+        /// </summary>
+        /// <param name="sizeBufferBytes">Write buffer size (bytes).</param>
+        void setBufferSize(const size_t sizeBufferBytes) { m_sizeBufferBytes = sizeBufferBytes; }
+
+        /// <summary>
+        /// Set the number of records between two time index entries. Must be called before open.
+        /// </summary>
+        /// <param name="nIndexInterval">Records per index entry.</param>
+        void setIndexInterval(const uint32_t nIndexInterval) { m_nIndexInterval = nIndexInterval > 0 ? nIndexInterval : 1; }
+
+        /// <summary>
+        /// Set the shape of the overview pyramid. Level k summarizes nFactor^k records per entry. Must be called before open.
+        /// </summary>
+        /// <param name="nLevels">Number of levels, 0 for no pyramid.</param>
+        /// <param name="nFactor">Number of entries of a level summarized by one entry of the next level.</param>
+        void setPyramid(const int nLevels, const uint32_t nFactor) {
+            m_nPyramidLevels = nLevels > 0 ? nLevels : 0;
+            m_nPyramidFactor = nFactor > 1 ? nFactor : 2;
+        }
+
+        /// <summary>
+        /// Create a spectrogram file and write its header.
+        /// </summary>
+        /// <param name="sFileName">Name of the file.</param>
+        /// <param name="layout">Description of the frames; the values nIndexMin ... nIndexMax of every channel are stored.</param>
+        /// <param name="sWindow">Name of the window function applied before the transform.</param>
+        void open(const std::string& sFileName, const CiSinkLayout& layout, const std::string& sWindow = "rectangular") {
+            close();
+
+            m_header = CiSpectrogramFormat::makeHeader(layout, sWindow);
+
+            m_file.open(sFileName, std::ios::binary | std::ios::trunc);
+            if (!m_file.is_open()) {
+                throw std::runtime_error("Can't open a file " + sFileName + ".");
+            }
+            m_sFileName = sFileName;
+
+            // Header, frequency table and padding up to the first record
+            m_buffer.assign(static_cast<size_t>(m_header.nDataOffset), 0);
+            std::memcpy(m_buffer.data(), &m_header, sizeof(m_header));
+            std::memcpy(m_buffer.data() + m_header.nHeaderSize, layout.frequencies.data() + layout.nIndexMin, m_header.nValues * sizeof(float));
+            m_sizeBuffered = m_buffer.size();
+
+            size_t sizeCapacity = (m_sizeBufferBytes > m_buffer.size() + m_header.nRecordSize) ? m_sizeBufferBytes : m_buffer.size() + m_header.nRecordSize;
+            m_buffer.resize(sizeCapacity);
+
+            m_nRecordCount = 0;
+            m_nFileOffset = 0;
+            m_index.clear();
+
+            // Pyramid levels are spooled into temporary files next to the recording and appended on close
+            m_levels.clear();
+            size_t sizeValues = static_cast<size_t>(m_header.nChannels) * m_header.nValues;
+            size_t sizeEntry = static_cast<size_t>(CiSpectrogramFormat::getPyramidEntrySize(m_header));
+            uint64_t nRecordsPerEntry = 1;
+            for (int k = 0; k < m_nPyramidLevels; ++k) {
+                nRecordsPerEntry *= m_nPyramidFactor;
+                std::unique_ptr<PyramidLevel> pLevel(new PyramidLevel());
+                pLevel->nRecordsPerEntry = nRecordsPerEntry;
+                pLevel->sFileName = sFileName + ".L" + std::to_string(k + 1) + ".tmp";
+                pLevel->file.open(pLevel->sFileName, std::ios::binary | std::ios::trunc);
+                if (!pLevel->file.is_open()) {
+                    throw std::runtime_error("Can't open a file " + pLevel->sFileName + ".");
+                }
+                pLevel->buffer.resize((std::max)(sizeEntry, m_sizeBufferBytes / 4));
+                pLevel->minValues.resize(sizeValues);
+                pLevel->maxValues.resize(sizeValues);
+                pLevel->sumValues.resize(sizeValues);
+                m_levels.push_back(std::move(pLevel));
+            }
+            m_meanValues.resize(sizeValues);
+        }
+
+        /// <summary>
+        /// Append the stored range of all channels of a frame.
+        /// </summary>
+        /// <param name="frame">Frame with the channel count of the layout.</param>
+        void append(const CiFrame& frame) {
+            if (!m_file.is_open()) {
+                throw std::runtime_error("The spectrogram file is not open.");
+            }
+            if (frame.getChannelCount() != static_cast<int>(m_header.nChannels) || frame.getSize() <= m_header.nIndexMax) {
+                throw std::invalid_argument("The frame does not match the spectrogram layout.");
+            }
+
+            if (m_sizeBuffered + m_header.nRecordSize > m_buffer.size()) flush();
+
+            char* pRecord = m_buffer.data() + m_sizeBuffered;
+            CiSpectrogramRecord record{ static_cast<uint64_t>(frame.getIndex()), frame.getTime() };
+            std::memcpy(pRecord, &record, sizeof(record));
+
+            char* pValues = pRecord + sizeof(record);
+            size_t sizeChannelBytes = m_header.nValues * sizeof(float);
+            for (uint32_t c = 0; c < m_header.nChannels; ++c) {
+                std::memcpy(pValues + c * sizeChannelBytes, frame.getChannel(static_cast<int>(c)) + m_header.nIndexMin, sizeChannelBytes);
+            }
+
+            if (m_nRecordCount % m_nIndexInterval == 0) m_index.push_back(CiSpectrogramIndexEntry{ frame.getTime(), m_nRecordCount });
+
+            if (!m_levels.empty()) {
+                const float* pRecordValues = reinterpret_cast<const float*>(pValues);
+                addToPyramid(0, pRecordValues, pRecordValues, pRecordValues, 1, m_nRecordCount, frame.getTime(), frame.getTime());
+            }
+
+            m_sizeBuffered += m_header.nRecordSize;
+            ++m_nRecordCount;
+        }
+
+        /// <summary>
+        /// Write the buffered records to the file.
+        /// </summary>
+        void flush() {
+            if (!m_file.is_open() || m_sizeBuffered == 0) return;
+
+            m_file.write(m_buffer.data(), static_cast<std::streamsize>(m_sizeBuffered));
+            if (!m_file) {
+                throw std::runtime_error("Failed to write the file " + m_sFileName + ".");
+            }
+            m_nFileOffset += m_sizeBuffered;
+            m_sizeBuffered = 0;
+        }
+
+        /// <summary>
+        /// Write the remaining records, the time index and the footer, and close the file.
+        /// </summary>
+        void close() {
+            if (!m_file.is_open()) return;
+
+            flush();
+
+            std::vector<CiSpectrogramSection> sections;
+            writeSection(sections, CiSpectrogramFormat::SECTION_TIME_INDEX, m_nIndexInterval, m_index.data(), m_index.size());
+
+            // The incomplete entries at the end summarize fewer records
+            for (size_t k = 0; k < m_levels.size(); ++k) {
+                if (m_levels[k]->nChildren > 0) emitPyramidEntry(k);
+            }
+            for (auto& pLevel : m_levels) {
+                flushPyramidLevel(*pLevel);
+                pLevel->file.close();
+                if (pLevel->nEntries > 0) {
+                    CiSpectrogramSection section{ CiSpectrogramFormat::SECTION_PYRAMID, static_cast<uint32_t>(pLevel->nRecordsPerEntry), m_nFileOffset,
+                        pLevel->nEntries * CiSpectrogramFormat::getPyramidEntrySize(m_header), pLevel->nEntries };
+                    copyFile(pLevel->sFileName, section.nSize);
+                    sections.push_back(section);
+                }
+                std::remove(pLevel->sFileName.c_str());
+            }
+            m_levels.clear();
+
+            writeSections(sections);
+
+            m_file.close();
+        }
+
+        // Getter for the number of appended records
+        uint64_t getRecordCount() const { return m_nRecordCount; }
+
+        // Getter for the header of the open file
+        const CiSpectrogramHeader& getHeader() const { return m_header; }
+
+        // Getter for the name of the file
+        std::string getFileName() const { return m_sFileName; }
+
+    protected:
+
+        // One level of the overview pyramid with the entry being accumulated
+        struct PyramidLevel {
+            uint64_t nRecordsPerEntry = 0;
+            std::string sFileName;
+            std::ofstream file;
+            std::vector<char> buffer;
+            size_t sizeBuffered = 0;
+            uint64_t nEntries = 0;
+            uint32_t nChildren = 0;
+            CiSpectrogramPyramidEntry entry{};
+            std::vector<float> minValues;
+            std::vector<float> maxValues;
+            std::vector<double> sumValues;
+        };
+
+        /// <summary>
+        /// Add a record (level 0) or a completed entry of the level below to a pyramid level.
+        /// </summary>
+        void addToPyramid(const size_t nLevel, const float* pMin, const float* pMax, const float* pMean, const uint32_t nCount,
+            const uint64_t nFirstRecord, const double dbTimeBegin, const double dbTimeEnd) {
+            PyramidLevel& level = *m_levels[nLevel];
+            size_t sizeValues = level.minValues.size();
+
+            if (level.nChildren == 0) {
+                level.entry.nFirstRecord = nFirstRecord;
+                level.entry.nCount = 0;
+                level.entry.dbTimeBegin = dbTimeBegin;
+                std::memcpy(level.minValues.data(), pMin, sizeValues * sizeof(float));
+                std::memcpy(level.maxValues.data(), pMax, sizeValues * sizeof(float));
+                for (size_t i = 0; i < sizeValues; ++i) level.sumValues[i] = static_cast<double>(pMean[i]) * nCount;
+            }
+            else {
+                for (size_t i = 0; i < sizeValues; ++i) {
+                    if (pMin[i] < level.minValues[i]) level.minValues[i] = pMin[i];
+                    if (pMax[i] > level.maxValues[i]) level.maxValues[i] = pMax[i];
+                    level.sumValues[i] += static_cast<double>(pMean[i]) * nCount;
+                }
+            }
+            level.entry.nCount += nCount;
+            level.entry.dbTimeEnd = dbTimeEnd;
+
+            if (++level.nChildren == m_nPyramidFactor) emitPyramidEntry(nLevel);
+        }
+
+        /// <summary>
+        /// Write the accumulated entry of a pyramid level and pass it on to the next level.
+        /// </summary>
+        void emitPyramidEntry(const size_t nLevel) {
+            PyramidLevel& level = *m_levels[nLevel];
+            size_t sizeValues = level.minValues.size();
+            size_t sizeEntry = static_cast<size_t>(CiSpectrogramFormat::getPyramidEntrySize(m_header));
+
+            for (size_t i = 0; i < sizeValues; ++i) m_meanValues[i] = static_cast<float>(level.sumValues[i] / level.entry.nCount);
+
+            if (level.sizeBuffered + sizeEntry > level.buffer.size()) flushPyramidLevel(level);
+            char* pEntry = level.buffer.data() + level.sizeBuffered;
+            std::memcpy(pEntry, &level.entry, sizeof(level.entry));
+            pEntry += sizeof(level.entry);
+            std::memcpy(pEntry, level.minValues.data(), sizeValues * sizeof(float));
+            std::memcpy(pEntry + sizeValues * sizeof(float), level.maxValues.data(), sizeValues * sizeof(float));
+            std::memcpy(pEntry + 2 * sizeValues * sizeof(float), m_meanValues.data(), sizeValues * sizeof(float));
+            level.sizeBuffered += sizeEntry;
+            ++level.nEntries;
+            level.nChildren = 0;
+
+            if (nLevel + 1 < m_levels.size()) {
+                addToPyramid(nLevel + 1, level.minValues.data(), level.maxValues.data(), m_meanValues.data(), level.entry.nCount,
+                    level.entry.nFirstRecord, level.entry.dbTimeBegin, level.entry.dbTimeEnd);
+            }
+        }
+
+        /// <summary>
+        /// Write the buffered entries of a pyramid level to its temporary file.
+        /// </summary>
+        void flushPyramidLevel(PyramidLevel& level) {
+            if (level.sizeBuffered == 0) return;
+            level.file.write(level.buffer.data(), static_cast<std::streamsize>(level.sizeBuffered));
+            if (!level.file) {
+                throw std::runtime_error("Failed to write the file " + level.sFileName + ".");
+            }
+            level.sizeBuffered = 0;
+        }
+
+        /// <summary>
+        /// Append the contents of a file in large blocks.
+        /// </summary>
+        void copyFile(const std::string& sSourceName, uint64_t nSize) {
+            std::ifstream source(sSourceName, std::ios::binary);
+            if (!source.is_open()) {
+                throw std::runtime_error("Can't open a file " + sSourceName + ".");
+            }
+            while (nSize > 0) {
+                size_t sizeBlock = static_cast<size_t>((std::min)(nSize, static_cast<uint64_t>(m_buffer.size())));
+                source.read(m_buffer.data(), static_cast<std::streamsize>(sizeBlock));
+                if (!source) {
+                    throw std::runtime_error("Failed to read the file " + sSourceName + ".");
+                }
+                writeRaw(m_buffer.data(), sizeBlock);
+                nSize -= sizeBlock;
+            }
+        }
+
+        /// <summary>
+        /// Append a section to the file and to the section table.
+        /// </summary>
+        template <typename E>
+        void writeSection(std::vector<CiSpectrogramSection>& sections, const uint32_t nType, const uint32_t nParam, const E* pEntries, const size_t sizeCount) {
+            CiSpectrogramSection section{ nType, nParam, m_nFileOffset, sizeCount * sizeof(E), sizeCount };
+            writeRaw(pEntries, section.nSize);
+            sections.push_back(section);
+        }
+
+        /// <summary>
+        /// Append the section table and the footer.
+        /// </summary>
+        void writeSections(const std::vector<CiSpectrogramSection>& sections) {
+            CiSpectrogramFooter footer;
+            std::memset(&footer, 0, sizeof(footer));
+            footer.nSectionTableOffset = m_nFileOffset;
+            footer.nRecordCount = m_nRecordCount;
+            footer.nSectionCount = static_cast<uint32_t>(sections.size());
+            std::memcpy(footer.magic, CiSpectrogramFormat::FOOTER_MAGIC, 8);
+
+            writeRaw(sections.data(), sections.size() * sizeof(CiSpectrogramSection));
+            writeRaw(&footer, sizeof(footer));
+        }
+
+        /// <summary>
+        /// Write bytes directly to the file.
+        /// </summary>
+        void writeRaw(const void* pData, const uint64_t nSize) {
+            if (nSize == 0) return;
+            m_file.write(static_cast<const char*>(pData), static_cast<std::streamsize>(nSize));
+            if (!m_file) {
+                throw std::runtime_error("Failed to write the file " + m_sFileName + ".");
+            }
+            m_nFileOffset += nSize;
+        }
+
+        std::ofstream m_file;
+        std::string m_sFileName;
+        CiSpectrogramHeader m_header;
+        std::vector<char> m_buffer;
+        size_t m_sizeBufferBytes;
+        size_t m_sizeBuffered;
+        uint64_t m_nRecordCount;
+        uint32_t m_nIndexInterval;
+        uint64_t m_nFileOffset;
+        std::vector<CiSpectrogramIndexEntry> m_index;
+        int m_nPyramidLevels;
+        uint32_t m_nPyramidFactor;
+        std::vector<std::unique_ptr<PyramidLevel>> m_levels;
+        std::vector<float> m_meanValues;
+    };
+
+    /// <summary>
+    /// Sink that records all frames into one spectrogram file.
+    /// </summary>
+    class CiSpectrogramSink : public CiSink {
+    public:
+
+        /// <summary>
+        /// Constructor for CiSpectrogramSink.
+        /// </summary>
+        /// <param name="sFileName">Name of the spectrogram file.</param>
+        /// <param name="sWindow">Name of the window function applied before the transform.</param>
+        explicit CiSpectrogramSink(const std::string& sFileName, const std::string& sWindow = "rectangular") : m_sFileName(sFileName), m_sWindow(sWindow) {}
+
+        void open(const CiSinkLayout& layout) override { m_writer.open(m_sFileName, layout, m_sWindow); }
+
+        void write(const CiFrame& frame) override { m_writer.append(frame); }
+
+        void close() override { m_writer.close(); }
+
+        // Getter for the writer, e.g. to set the buffer size before the recording starts
+        CiSpectrogramWriter& getWriter() { return m_writer; }
+
+    private:
+        std::string m_sFileName;
+        std::string m_sWindow;
+        CiSpectrogramWriter m_writer;
+    };
+
+}
@@ -0,0 +1,434 @@
+// This C++ code defines a reader for spectrogram files written by
+// CiSpectrogramWriter. The file is memory-mapped, and queries for a time
+// range and a frequency range return views that point straight into the
+// mapping, so nothing is copied or parsed. Long time ranges can be read
+// from the min/max/mean pyramids that were built while recording.
+
+#pragma once
+#include "CiSpectrogramFile.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vi {
+
+    /// <summary>
+    /// Zero-copy view of a time range and a frequency range of a spectrogram file.
+    /// A row is a record, or a pyramid entry that summarizes getDecimation() records.
+    /// For records the minimum, maximum and mean are the record values.
+    /// </summary>
+    class CiSpectrogramView {
+    public:
+
+        CiSpectrogramView() : m_pRows(nullptr), m_pFrequencies(nullptr), m_sizeRows(0), m_sizeRowStride(0), m_sizeMinOffset(0), m_sizeMaxOffset(0),
+            m_sizeMeanOffset(0), m_sizeChannelStride(0), m_nChannels(0), m_nFirstValue(0), m_nValues(0), m_nIndexMin(0), m_nDecimation(1), m_bPyramid(false) {}
+
+        // Getter for the number of rows
+        size_t getRows() const { return m_sizeRows; }
+
+        // Getter for the number of channels
+        int getChannelCount() const { return m_nChannels; }
+
+        // Getter for the number of values per channel
+        int getSize() const { return m_nValues; }
+
+        // Getter for the bin or band index of the first value
+        int getIndexMin() const { return m_nIndexMin + m_nFirstValue; }
+
+        // Getter for the number of records summarized by a full row, 1 for records
+        uint32_t getDecimation() const { return m_nDecimation; }
+
+        // Getter for the frequency of a value (Hz)
+        float getFrequency(const int nValue) const { return m_pFrequencies[m_nFirstValue + nValue]; }
+
+        /// <summary>
+        /// Get the number of the first record of a row.
+        /// </summary>
+        uint64_t getFirstRecord(const size_t sizeRow) const {
+            return m_bPyramid ? getPyramidEntry(sizeRow).nFirstRecord : m_nFirstRecord + sizeRow;
+        }
+
+        /// <summary>
+        /// Get the number of records of a row.
+        /// </summary>
+        uint32_t getRecordCount(const size_t sizeRow) const {
+            return m_bPyramid ? getPyramidEntry(sizeRow).nCount : 1;
+        }
+
+        /// <summary>
+        /// Get the time of the first record of a row (s).
+        /// </summary>
+        double getTimeBegin(const size_t sizeRow) const {
+            return m_bPyramid ? getPyramidEntry(sizeRow).dbTimeBegin : getRecord(sizeRow).dbTime;
+        }
+
+        /// <summary>
+        /// Get the time of the last record of a row (s).
+        /// </summary>
+        double getTimeEnd(const size_t sizeRow) const {
+            return m_bPyramid ? getPyramidEntry(sizeRow).dbTimeEnd : getRecord(sizeRow).dbTime;
+        }
+
+        /// <summary>
+        /// Get the minimum values of a channel in a row.
+        /// </summary>
+        const float* getMin(const size_t sizeRow, const int nChannel) const { return getValues(sizeRow, nChannel, m_sizeMinOffset); }
+
+        /// <summary>
+        /// Get the maximum values of a channel in a row.
+        /// </summary>
+        const float* getMax(const size_t sizeRow, const int nChannel) const { return getValues(sizeRow, nChannel, m_sizeMaxOffset); }
+
+        /// <summary>
+        /// Get the mean values of a channel in a row.
+        /// </summary>
+        const float* getMean(const size_t sizeRow, const int nChannel) const { return getValues(sizeRow, nChannel, m_sizeMeanOffset); }
+
+    private:
+        friend class CiSpectrogramReader;
+
+        const char* m_pRows;
+        const float* m_pFrequencies;
+        size_t m_sizeRows;
+        size_t m_sizeRowStride;
+        size_t m_sizeMinOffset;
+        size_t m_sizeMaxOffset;
+        size_t m_sizeMeanOffset;
+        size_t m_sizeChannelStride;
+        int m_nChannels;
+        int m_nFirstValue;
+        int m_nValues;
+        int m_nIndexMin;
+        uint32_t m_nDecimation;
+        bool m_bPyramid;
+        uint64_t m_nFirstRecord = 0;
+
+        const float* getValues(const size_t sizeRow, const int nChannel, const size_t sizeOffset) const {
+            return reinterpret_cast<const float*>(m_pRows + sizeRow * m_sizeRowStride + sizeOffset + nChannel * m_sizeChannelStride) + m_nFirstValue;
+        }
+
+        const CiSpectrogramRecord& getRecord(const size_t sizeRow) const {
+            return *reinterpret_cast<const CiSpectrogramRecord*>(m_pRows + sizeRow * m_sizeRowStride);
+        }
+
+        const CiSpectrogramPyramidEntry& getPyramidEntry(const size_t sizeRow) const {
+            return *reinterpret_cast<const CiSpectrogramPyramidEntry*>(m_pRows + sizeRow * m_sizeRowStride);
+        }
+    };
+
+    /// <summary>
+    /// Class for reading a spectrogram file through a memory mapping.
+    /// </summary>
+    class CiSpectrogramReader {
+    public:
+
+        CiSpectrogramReader() : m_pData(nullptr), m_sizeFile(0), m_nRecordCount(0), m_bClosed(false), m_pIndex(nullptr), m_sizeIndex(0)
+#ifdef _WIN32
+            , m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL)
+#else
+            , m_nFile(-1)
+#endif
+        {
+            std::memset(&m_header, 0, sizeof(m_header));
+        }
+
+        CiSpectrogramReader(const CiSpectrogramReader&) = delete;
+        CiSpectrogramReader& operator=(const CiSpectrogramReader&) = delete;
+
+        /// <summary>
+        /// Destructor for CiSpectrogramReader. Unmaps the file.
+        /// </summary>
+        ~CiSpectrogramReader() {
+            close();
+        }
+
+        /// <summary>
+        /// Map a spectrogram file and read its header, sections and footer.
+        /// </summary>
+        /// <param name="sFileName">Name of the file.</param>
+        void open(const std::string& sFileName) {
+            close();
+            map(sFileName);
+
+            if (m_sizeFile < sizeof(CiSpectrogramHeader)) {
+                close();
+                throw std::runtime_error("The file " + sFileName + " is not a spectrogram file.");
+            }
+            std::memcpy(&m_header, m_pData, sizeof(m_header));
+            if (std::memcmp(m_header.magic, CiSpectrogramFormat::HEADER_MAGIC, 8) != 0 || m_header.nVersion != CiSpectrogramFormat::VERSION
+                || m_header.nDataOffset > m_sizeFile || m_header.nRecordSize == 0) {
+                close();
+                throw std::runtime_error("The file " + sFileName + " is not a spectrogram file of a supported version.");
+            }
+
+            // A closed file has a footer; otherwise the recording was interrupted and only the complete records count
+            m_bClosed = false;
+            uint64_t nDataEnd = m_sizeFile;
+            if (m_sizeFile >= m_header.nDataOffset + sizeof(CiSpectrogramFooter)) {
+                CiSpectrogramFooter footer;
+                std::memcpy(&footer, m_pData + m_sizeFile - sizeof(footer), sizeof(footer));
+                uint64_t nTableEnd = footer.nSectionTableOffset + static_cast<uint64_t>(footer.nSectionCount) * sizeof(CiSpectrogramSection);
+                if (std::memcmp(footer.magic, CiSpectrogramFormat::FOOTER_MAGIC, 8) == 0 && nTableEnd <= m_sizeFile - sizeof(footer)
+                    && m_header.nDataOffset + footer.nRecordCount * m_header.nRecordSize <= footer.nSectionTableOffset) {
+                    m_bClosed = true;
+                    m_nRecordCount = footer.nRecordCount;
+                    const CiSpectrogramSection* pSections = reinterpret_cast<const CiSpectrogramSection*>(m_pData + footer.nSectionTableOffset);
+                    m_sections.assign(pSections, pSections + footer.nSectionCount);
+                }
+            }
+            if (!m_bClosed) m_nRecordCount = (nDataEnd - m_header.nDataOffset) / m_header.nRecordSize;
+
+            for (const CiSpectrogramSection& section : m_sections) {
+                if (section.nOffset + section.nSize > m_sizeFile) {
+                    close();
+                    throw std::runtime_error("The file " + sFileName + " has a damaged section table.");
+                }
+                if (section.nType == CiSpectrogramFormat::SECTION_TIME_INDEX) {
+                    m_pIndex = reinterpret_cast<const CiSpectrogramIndexEntry*>(m_pData + section.nOffset);
+                    m_sizeIndex = static_cast<size_t>(section.nCount);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Unmap the file.
+        /// </summary>
+        void close() {
+#ifdef _WIN32
+            if (m_pData) UnmapViewOfFile(m_pData);
+            if (m_hMapping) CloseHandle(m_hMapping);
+            if (m_hFile != INVALID_HANDLE_VALUE) CloseHandle(m_hFile);
+            m_hMapping = NULL;
+            m_hFile = INVALID_HANDLE_VALUE;
+#else
+            if (m_pData) munmap(const_cast<char*>(m_pData), static_cast<size_t>(m_sizeFile));
+            if (m_nFile >= 0) ::close(m_nFile);
+            m_nFile = -1;
+#endif
+            m_pData = nullptr;
+            m_sizeFile = 0;
+            m_nRecordCount = 0;
+            m_bClosed = false;
+            m_sections.clear();
+            m_pIndex = nullptr;
+            m_sizeIndex = 0;
+        }
+
+        // Getter for the header of the file
+        const CiSpectrogramHeader& getHeader() const { return m_header; }
+
+        // Getter for the number of records
+        uint64_t getRecordCount() const { return m_nRecordCount; }
+
+        // Getter for the state of the file: false if the recording was interrupted before the footer was written
+        bool isComplete() const { return m_bClosed; }
+
+        // Getter for the frequency table, one frequency per stored value (Hz)
+        const float* getFrequencies() const { return reinterpret_cast<const float*>(m_pData + m_header.nHeaderSize); }
+
+        /// <summary>
+        /// Get the numbers of records summarized by an entry of the pyramid levels, from the finest to the coarsest.
+        /// </summary>
+        std::vector<uint32_t> getPyramidLevels() const {
+            std::vector<uint32_t> levels;
+            for (const CiSpectrogramSection& section : m_sections) {
+                if (section.nType == CiSpectrogramFormat::SECTION_PYRAMID) levels.push_back(section.nParam);
+            }
+            std::sort(levels.begin(), levels.end());
+            return levels;
+        }
+
+        /// <summary>
+        /// Get the records with a time in [dbTimeBegin, dbTimeEnd] and the values with a frequency in [fpFrequencyMin, fpFrequencyMax].
+        /// </summary>
+        /// <param name="dbTimeBegin">Start of the time range (s).</param>
+        /// <param name="dbTimeEnd">End of the time range (s).</param>
+        /// <param name="fpFrequencyMin">Lowest frequency (Hz).</param>
+        /// <param name="fpFrequencyMax">Highest frequency (Hz).</param>
+        /// <returns>View into the mapped file, valid until the reader is closed.</returns>
+        CiSpectrogramView query(const double dbTimeBegin, const double dbTimeEnd, const float fpFrequencyMin, const float fpFrequencyMax) const {
+            CiSpectrogramView view = makeView(fpFrequencyMin, fpFrequencyMax);
+
+            uint64_t nFirst = findRecord(dbTimeBegin);
+            uint64_t nLast = (std::max)(nFirst, findRecord(std::nextafter(dbTimeEnd, dbTimeEnd + 1.0)));
+            view.m_pRows = m_pData + m_header.nDataOffset + nFirst * m_header.nRecordSize;
+            view.m_sizeRows = static_cast<size_t>(nLast - nFirst);
+            view.m_nFirstRecord = nFirst;
+            view.m_sizeRowStride = m_header.nRecordSize;
+            view.m_sizeMinOffset = view.m_sizeMaxOffset = view.m_sizeMeanOffset = sizeof(CiSpectrogramRecord);
+            return view;
+        }
+
+        /// <summary>
+        /// Get a decimated overview of a time range and a frequency range with at most sizeMaxRows rows.
+        /// The finest level that fits is used: the records themselves if there are few enough, otherwise a pyramid level.
+        /// </summary>
+        /// <param name="dbTimeBegin">Start of the time range (s).</param>
+        /// <param name="dbTimeEnd">End of the time range (s).</param>
+        /// <param name="fpFrequencyMin">Lowest frequency (Hz).</param>
+        /// <param name="fpFrequencyMax">Highest frequency (Hz).</param>
+        /// <param name="sizeMaxRows">Maximum number of rows, e.g. the width of a plot in pixels.</param>
+        /// <returns>View into the mapped file, valid until the reader is closed.</returns>
+        CiSpectrogramView queryOverview(const double dbTimeBegin, const double dbTimeEnd, const float fpFrequencyMin, const float fpFrequencyMax,
+            const size_t sizeMaxRows) const {
+            CiSpectrogramView view = query(dbTimeBegin, dbTimeEnd, fpFrequencyMin, fpFrequencyMax);
+            if (view.m_sizeRows <= sizeMaxRows) return view;
+
+            // Pyramid levels from the finest to the coarsest; the coarsest is used if none fits
+            std::vector<const CiSpectrogramSection*> levels;
+            for (const CiSpectrogramSection& section : m_sections) {
+                if (section.nType == CiSpectrogramFormat::SECTION_PYRAMID && section.nCount > 0) levels.push_back(&section);
+            }
+            if (levels.empty()) return view;
+            std::sort(levels.begin(), levels.end(), [](const CiSpectrogramSection* a, const CiSpectrogramSection* b) { return a->nParam < b->nParam; });
+
+            uint64_t nEntrySize = CiSpectrogramFormat::getPyramidEntrySize(m_header);
+            uint64_t nValuesBytes = static_cast<uint64_t>(m_header.nChannels) * m_header.nValues * sizeof(float);
+            for (size_t k = 0; k < levels.size(); ++k) {
+                const CiSpectrogramSection& section = *levels[k];
+                const char* pEntries = m_pData + section.nOffset;
+                auto entryAt = [&](uint64_t n) { return reinterpret_cast<const CiSpectrogramPyramidEntry*>(pEntries + n * nEntrySize); };
+
+                // Entries that overlap the time range
+                uint64_t nFirst = lowerBound(section.nCount, [&](uint64_t n) { return entryAt(n)->dbTimeEnd < dbTimeBegin; });
+                uint64_t nLast = lowerBound(section.nCount, [&](uint64_t n) { return entryAt(n)->dbTimeBegin <= dbTimeEnd; });
+                if (nLast < nFirst) nLast = nFirst;
+
+                if (nLast - nFirst <= sizeMaxRows || k + 1 == levels.size()) {
+                    view.m_bPyramid = true;
+                    view.m_nDecimation = section.nParam;
+                    view.m_pRows = pEntries + nFirst * nEntrySize;
+                    view.m_sizeRows = static_cast<size_t>(nLast - nFirst);
+                    view.m_sizeRowStride = static_cast<size_t>(nEntrySize);
+                    view.m_sizeMinOffset = sizeof(CiSpectrogramPyramidEntry);
+                    view.m_sizeMaxOffset = static_cast<size_t>(sizeof(CiSpectrogramPyramidEntry) + nValuesBytes);
+                    view.m_sizeMeanOffset = static_cast<size_t>(sizeof(CiSpectrogramPyramidEntry) + 2 * nValuesBytes);
+                    break;
+                }
+            }
+            return view;
+        }
+
+        /// <summary>
+        /// Find the first record with a time not earlier than dbTime.
+        /// </summary>
+        /// <returns>Record number, or the record count if all records are earlier.</returns>
+        uint64_t findRecord(const double dbTime) const {
+            // The time index narrows the search down to one interval of records
+            uint64_t nLow = 0;
+            uint64_t nHigh = m_nRecordCount;
+            if (m_pIndex && m_sizeIndex > 0) {
+                size_t sizeEntry = static_cast<size_t>(lowerBound(m_sizeIndex, [&](uint64_t n) { return m_pIndex[n].dbTime < dbTime; }));
+                if (sizeEntry > 0) nLow = m_pIndex[sizeEntry - 1].nRecord;
+                if (sizeEntry < m_sizeIndex) nHigh = m_pIndex[sizeEntry].nRecord;
+            }
+            return nLow + lowerBound(nHigh - nLow, [&](uint64_t n) { return getRecordTime(nLow + n) < dbTime; });
+        }
+
+        /// <summary>
+        /// Get the time of a record (s).
+        /// </summary>
+        double getRecordTime(const uint64_t nRecord) const {
+            return reinterpret_cast<const CiSpectrogramRecord*>(m_pData + m_header.nDataOffset + nRecord * m_header.nRecordSize)->dbTime;
+        }
+
+    private:
+        CiSpectrogramHeader m_header;
+        const char* m_pData;
+        uint64_t m_sizeFile;
+        uint64_t m_nRecordCount;
+        bool m_bClosed;
+        std::vector<CiSpectrogramSection> m_sections;
+        const CiSpectrogramIndexEntry* m_pIndex;
+        size_t m_sizeIndex;
+#ifdef _WIN32
+        HANDLE m_hFile;
+        HANDLE m_hMapping;
+#else
+        int m_nFile;
+#endif
+
+        // Method to map the whole file read-only
+        void map(const std::string& sFileName) {
+#ifdef _WIN32
+            m_hFile = CreateFileA(sFileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (m_hFile == INVALID_HANDLE_VALUE) {
+                throw std::runtime_error("Can't open a file " + sFileName + ".");
+            }
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(m_hFile, &size) || size.QuadPart == 0) {
+                close();
+                throw std::runtime_error("The file " + sFileName + " is empty.");
+            }
+            m_sizeFile = static_cast<uint64_t>(size.QuadPart);
+            m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (m_hMapping) m_pData = static_cast<const char*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+#else
+            m_nFile = ::open(sFileName.c_str(), O_RDONLY);
+            if (m_nFile < 0) {
+                throw std::runtime_error("Can't open a file " + sFileName + ".");
+            }
+            struct stat st;
+            if (fstat(m_nFile, &st) != 0 || st.st_size == 0) {
+                close();
+                throw std::runtime_error("The file " + sFileName + " is empty.");
+            }
+            m_sizeFile = static_cast<uint64_t>(st.st_size);
+            void* pData = mmap(nullptr, static_cast<size_t>(m_sizeFile), PROT_READ, MAP_SHARED, m_nFile, 0);
+            if (pData != MAP_FAILED) m_pData = static_cast<const char*>(pData);
+#endif
+            if (!m_pData) {
+                close();
+                throw std::runtime_error("Can't map a file " + sFileName + ".");
+            }
+        }
+
+        // Method to create a view of the values with a frequency in [fpFrequencyMin, fpFrequencyMax]
+        CiSpectrogramView makeView(const float fpFrequencyMin, const float fpFrequencyMax) const {
+            CiSpectrogramView view;
+            const float* pFrequencies = getFrequencies();
+            const float* pEnd = pFrequencies + m_header.nValues;
+            int nFirst = static_cast<int>(std::lower_bound(pFrequencies, pEnd, fpFrequencyMin) - pFrequencies);
+            int nLast = static_cast<int>(std::upper_bound(pFrequencies, pEnd, fpFrequencyMax) - pFrequencies);
+
+            view.m_pFrequencies = pFrequencies;
+            view.m_nChannels = static_cast<int>(m_header.nChannels);
+            view.m_nFirstValue = nFirst;
+            view.m_nValues = nLast > nFirst ? nLast - nFirst : 0;
+            view.m_nIndexMin = m_header.nIndexMin;
+            view.m_sizeChannelStride = static_cast<size_t>(m_header.nValues) * sizeof(float);
+            return view;
+        }
+
+        // Method to find the first of nCount positions for which bLess is false; bLess must be true for a prefix of the positions
+        template <typename F>
+        static uint64_t lowerBound(uint64_t nCount, F bLess) {
+            uint64_t nFirst = 0;
+            while (nCount > 0) {
+                uint64_t nStep = nCount / 2;
+                if (bLess(nFirst + nStep)) {
+                    nFirst += nStep + 1;
+                    nCount -= nStep + 1;
+                }
+                else {
+                    nCount = nStep;
+                }
+            }
+            return nFirst;
+        }
+    };
+
+}
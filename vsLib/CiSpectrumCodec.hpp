@@ -0,0 +1,195 @@
+// This C++ code defines a lossless codec for sequences of spectra in the
+// style of the Gorilla time-series compression. Every value is XORed with
+// the value of the same bin in the previous frame. Equal values cost one
+// bit, and for other values only the meaningful bits between the leading
+// and trailing zeros of the XOR are stored, reusing the bit window of the
+// previous value of the bin when it fits. Neighbouring frames of a
+// spectrum share sign, exponent and the high mantissa bits, so most of
+// every value disappears. Blocks of frames are coded independently, so a
+// reader can start at any block.
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Appends bit fields to a byte vector, most significant bit first.
+    /// </summary>
+    class CiBitWriter {
+    public:
+
+        CiBitWriter() : m_pBytes(nullptr), m_nAccumulator(0), m_nBits(0) {}
+
+        // Method to start writing at the end of a byte vector
+        void attach(std::vector<uint8_t>* pBytes) {
+            m_pBytes = pBytes;
+            m_nAccumulator = 0;
+            m_nBits = 0;
+        }
+
+        /// <summary>
+        /// Write the nBits lowest bits of nValue (nBits = 0 ... 32).
+        /// </summary>
+        void write(const uint32_t nValue, const int nBits) {
+            if (nBits == 0) return;
+            m_nAccumulator = (m_nAccumulator << nBits) | (nBits == 32 ? nValue : (nValue & ((1u << nBits) - 1)));
+            m_nBits += nBits;
+            while (m_nBits >= 8) {
+                m_nBits -= 8;
+                m_pBytes->push_back(static_cast<uint8_t>(m_nAccumulator >> m_nBits));
+            }
+        }
+
+        // Method to write the remaining bits, padded with zeros to a whole byte
+        void finish() {
+            if (m_nBits > 0) m_pBytes->push_back(static_cast<uint8_t>(m_nAccumulator << (8 - m_nBits)));
+            m_nAccumulator = 0;
+            m_nBits = 0;
+        }
+
+    private:
+        std::vector<uint8_t>* m_pBytes;
+        uint64_t m_nAccumulator;
+        int m_nBits;
+    };
+
+    /// <summary>
+    /// Reads bit fields written by CiBitWriter.
+    /// </summary>
+    class CiBitReader {
+    public:
+
+        CiBitReader(const uint8_t* pBytes, const size_t sizeBytes) : m_pBytes(pBytes), m_pEnd(pBytes + sizeBytes), m_nAccumulator(0), m_nBits(0) {}
+
+        /// <summary>
+        /// Read nBits bits (nBits = 0 ... 32).
+        /// </summary>
+        uint32_t read(const int nBits) {
+            if (nBits == 0) return 0;
+            while (m_nBits < nBits) {
+                if (m_pBytes == m_pEnd) {
+                    throw std::runtime_error("The compressed spectrum data is truncated.");
+                }
+                m_nAccumulator = (m_nAccumulator << 8) | *m_pBytes++;
+                m_nBits += 8;
+            }
+            m_nBits -= nBits;
+            return static_cast<uint32_t>((m_nAccumulator >> m_nBits) & (nBits == 32 ? 0xFFFFFFFFu : ((1u << nBits) - 1)));
+        }
+
+    private:
+        const uint8_t* m_pBytes;
+        const uint8_t* m_pEnd;
+        uint64_t m_nAccumulator;
+        int m_nBits;
+    };
+
+    /// <summary>
+    /// Lossless XOR codec for a block of frames of nValues floats.
+    /// </summary>
+    class CiSpectrumCodec {
+    public:
+
+        CiSpectrumCodec() : m_nValues(0) {}
+
+        /// <summary>
+        /// Start a new block. The first frame of a block is coded against zeros.
+        /// </summary>
+        /// <param name="nValues">Number of values per frame.</param>
+        void reset(const size_t nValues) {
+            m_nValues = nValues;
+            m_previous.assign(nValues, 0);
+            m_leading.assign(nValues, 0xFF);
+            m_trailing.assign(nValues, 0);
+        }
+
+        /// <summary>
+        /// Append a frame to the block being encoded.
+        /// </summary>
+        /// <param name="pValues">Values of the frame.</param>
+        /// <param name="writer">Bit writer attached to the block payload.</param>
+        void encode(const float* pValues, CiBitWriter& writer) {
+            for (size_t i = 0; i < m_nValues; ++i) {
+                uint32_t nBitsValue;
+                std::memcpy(&nBitsValue, pValues + i, sizeof(nBitsValue));
+                uint32_t nXor = nBitsValue ^ m_previous[i];
+                m_previous[i] = nBitsValue;
+
+                if (nXor == 0) {
+                    writer.write(0, 1);
+                    continue;
+                }
+
+                int nLeading = countLeadingZeros(nXor);
+                int nTrailing = countTrailingZeros(nXor);
+
+                if (m_leading[i] != 0xFF && nLeading >= m_leading[i] && nTrailing >= m_trailing[i]) {
+                    // The meaningful bits fit into the window of the previous value
+                    int nLength = 32 - m_leading[i] - m_trailing[i];
+                    writer.write(2, 2);
+                    writer.write(nXor >> m_trailing[i], nLength);
+                }
+                else {
+                    int nLength = 32 - nLeading - nTrailing;
+                    writer.write(3, 2);
+                    writer.write(static_cast<uint32_t>(nLeading), 5);
+                    writer.write(static_cast<uint32_t>(nLength - 1), 5);
+                    writer.write(nXor >> nTrailing, nLength);
+                    m_leading[i] = static_cast<uint8_t>(nLeading);
+                    m_trailing[i] = static_cast<uint8_t>(nTrailing);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Decode the next frame of a block.
+        /// </summary>
+        /// <param name="reader">Bit reader positioned at the frame.</param>
+        /// <param name="pValues">Receives the values of the frame.</param>
+        void decode(CiBitReader& reader, float* pValues) {
+            for (size_t i = 0; i < m_nValues; ++i) {
+                if (reader.read(1) != 0) {
+                    if (reader.read(1) != 0) {
+                        m_leading[i] = static_cast<uint8_t>(reader.read(5));
+                        int nLength = static_cast<int>(reader.read(5)) + 1;
+                        m_trailing[i] = static_cast<uint8_t>(32 - m_leading[i] - nLength);
+                    }
+                    int nLength = 32 - m_leading[i] - m_trailing[i];
+                    m_previous[i] ^= reader.read(nLength) << m_trailing[i];
+                }
+                std::memcpy(pValues + i, &m_previous[i], sizeof(float));
+            }
+        }
+
+    private:
+        size_t m_nValues;
+        std::vector<uint32_t> m_previous;
+        std::vector<uint8_t> m_leading;
+        std::vector<uint8_t> m_trailing;
+
+        static int countLeadingZeros(uint32_t nValue) {
+            int n = 0;
+            if ((nValue & 0xFFFF0000u) == 0) { n += 16; nValue <<= 16; }
+            if ((nValue & 0xFF000000u) == 0) { n += 8; nValue <<= 8; }
+            if ((nValue & 0xF0000000u) == 0) { n += 4; nValue <<= 4; }
+            if ((nValue & 0xC0000000u) == 0) { n += 2; nValue <<= 2; }
+            if ((nValue & 0x80000000u) == 0) { n += 1; }
+            return n;
+        }
+
+        static int countTrailingZeros(uint32_t nValue) {
+            int n = 0;
+            if ((nValue & 0x0000FFFFu) == 0) { n += 16; nValue >>= 16; }
+            if ((nValue & 0x000000FFu) == 0) { n += 8; nValue >>= 8; }
+            if ((nValue & 0x0000000Fu) == 0) { n += 4; nValue >>= 4; }
+            if ((nValue & 0x00000003u) == 0) { n += 2; nValue >>= 2; }
+            if ((nValue & 0x00000001u) == 0) { n += 1; }
+            return n;
+        }
+    };
+
+}
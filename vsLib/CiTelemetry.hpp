@@ -0,0 +1,369 @@
+// This C++ code defines the runtime telemetry of the library: counters,
+// gauges and histograms that the capture and processing stages update on
+// their hot paths without locks, and a registry of the process that
+// writes a snapshot of all metrics as Prometheus text or as JSON. A metric
+// is registered once by name, which takes a lock, and then updated
+// through its reference with relaxed atomic operations only. The exporter
+// rewrites a snapshot file at a fixed interval, e.g. for the textfile
+// collector of the Prometheus node exporter, so a growing backlog or
+// dropped frames are visible before data is lost.
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Monotonic count of events.
+    /// </summary>
+    class CiCounter {
+    public:
+        CiCounter() : m_nValue(0) {}
+
+        // Method to count events
+        void add(const uint64_t nCount = 1) { m_nValue.fetch_add(nCount, std::memory_order_relaxed); }
+
+        // Getter for the count
+        uint64_t get() const { return m_nValue.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> m_nValue;
+    };
+
+    /// <summary>
+    /// Current value of a quantity, e.g. the occupancy of a buffer, with its highest value.
+    /// </summary>
+    class CiGauge {
+    public:
+        CiGauge() : m_nValue(0), m_nMax(0) {}
+
+        // Method to set the value
+        void set(const int64_t nValue) {
+            m_nValue.store(nValue, std::memory_order_relaxed);
+            int64_t nMax = m_nMax.load(std::memory_order_relaxed);
+            while (nValue > nMax && !m_nMax.compare_exchange_weak(nMax, nValue, std::memory_order_relaxed)) {}
+        }
+
+        // Getter for the value
+        int64_t get() const { return m_nValue.load(std::memory_order_relaxed); }
+
+        // Getter for the highest value since the start
+        int64_t getMax() const { return m_nMax.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<int64_t> m_nValue;
+        std::atomic<int64_t> m_nMax;
+    };
+
+    /// <summary>
+    /// Distribution of observed values in buckets with fixed upper bounds.
+    /// </summary>
+    class CiHistogram {
+    public:
+
+        /// <summary>
+        /// Constructor for CiHistogram.
+        /// </summary>
+        /// <param name="bounds">Upper bounds of the buckets in rising order; larger values go to an overflow bucket.</param>
+        explicit CiHistogram(const std::vector<double>& bounds)
+            : m_bounds(bounds), m_counts(new std::atomic<uint64_t>[bounds.size() + 1]), m_nCount(0), m_dbSum(0.0) {
+            if (!std::is_sorted(m_bounds.begin(), m_bounds.end())) {
+                throw std::invalid_argument("The bucket bounds of a histogram must rise.");
+            }
+            for (size_t k = 0; k <= m_bounds.size(); ++k) m_counts[k].store(0, std::memory_order_relaxed);
+        }
+
+        // Method to add a value
+        void observe(const double dbValue) {
+            size_t sizeBucket = std::lower_bound(m_bounds.begin(), m_bounds.end(), dbValue) - m_bounds.begin();
+            m_counts[sizeBucket].fetch_add(1, std::memory_order_relaxed);
+            m_nCount.fetch_add(1, std::memory_order_relaxed);
+            double dbSum = m_dbSum.load(std::memory_order_relaxed);
+            while (!m_dbSum.compare_exchange_weak(dbSum, dbSum + dbValue, std::memory_order_relaxed)) {}
+        }
+
+        // Getter for the upper bounds of the buckets
+        const std::vector<double>& getBounds() const { return m_bounds; }
+
+        // Getter for the number of values of a bucket, getBounds().size() for the overflow bucket
+        uint64_t getBucketCount(const size_t sizeBucket) const { return m_counts[sizeBucket].load(std::memory_order_relaxed); }
+
+        // Getter for the number of values
+        uint64_t getCount() const { return m_nCount.load(std::memory_order_relaxed); }
+
+        // Getter for the sum of the values
+        double getSum() const { return m_dbSum.load(std::memory_order_relaxed); }
+
+        /// <summary>
+        /// Get the bounds base, base * factor, base * factor^2 ... of nCount buckets.
+        /// </summary>
+        static std::vector<double> makeExponentialBounds(const double dbBase, const double dbFactor, const int nCount) {
+            std::vector<double> bounds;
+            double dbBound = dbBase;
+            for (int k = 0; k < nCount; ++k, dbBound *= dbFactor) bounds.push_back(dbBound);
+            return bounds;
+        }
+
+    private:
+        std::vector<double> m_bounds;
+        std::unique_ptr<std::atomic<uint64_t>[]> m_counts;
+        std::atomic<uint64_t> m_nCount;
+        std::atomic<double> m_dbSum;
+    };
+
+    /// <summary>
+    /// Process-wide registry of the metrics.
+    /// </summary>
+    class CiTelemetry {
+    public:
+
+        static constexpr int FORMAT_PROMETHEUS = 0;     // Prometheus text exposition format
+        static constexpr int FORMAT_JSON = 1;
+
+        /// <summary>
+        /// Get the registry of the process.
+        /// </summary>
+        static CiTelemetry& getInstance() {
+            static CiTelemetry telemetry;
+            return telemetry;
+        }
+
+        CiTelemetry(const CiTelemetry&) = delete;
+        CiTelemetry& operator=(const CiTelemetry&) = delete;
+
+        /// <summary>
+        /// Get a counter, registering it on first use. The reference stays valid for the lifetime of the process.
+        /// </summary>
+        /// <param name="sName">Metric name, e.g. vslib_capture_packets_total.</param>
+        /// <param name="sHelp">Description written to the snapshot.</param>
+        CiCounter& getCounter(const std::string& sName, const std::string& sHelp) {
+            return *getMetric(sName, sHelp, TYPE_COUNTER, [] { Metric metric; metric.pCounter.reset(new CiCounter()); return metric; }).pCounter;
+        }
+
+        /// <summary>
+        /// Get a gauge, registering it on first use. The reference stays valid for the lifetime of the process.
+        /// </summary>
+        /// <param name="sName">Metric name.</param>
+        /// <param name="sHelp">Description written to the snapshot.</param>
+        CiGauge& getGauge(const std::string& sName, const std::string& sHelp) {
+            return *getMetric(sName, sHelp, TYPE_GAUGE, [] { Metric metric; metric.pGauge.reset(new CiGauge()); return metric; }).pGauge;
+        }
+
+        /// <summary>
+        /// Get a histogram, registering it on first use. The reference stays valid for the lifetime of the process.
+        /// </summary>
+        /// <param name="sName">Metric name.</param>
+        /// <param name="sHelp">Description written to the snapshot.</param>
+        /// <param name="bounds">Upper bounds of the buckets, used when the histogram is registered.</param>
+        CiHistogram& getHistogram(const std::string& sName, const std::string& sHelp, const std::vector<double>& bounds) {
+            return *getMetric(sName, sHelp, TYPE_HISTOGRAM, [&bounds] { Metric metric; metric.pHistogram.reset(new CiHistogram(bounds)); return metric; }).pHistogram;
+        }
+
+        /// <summary>
+        /// Write the current values of all metrics.
+        /// </summary>
+        /// <param name="os">Stream to write to.</param>
+        /// <param name="nFormat">FORMAT_PROMETHEUS or FORMAT_JSON.</param>
+        void writeSnapshot(std::ostream& os, const int nFormat = FORMAT_PROMETHEUS) {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            if (nFormat == FORMAT_JSON) writeJson(os);
+            else writePrometheus(os);
+        }
+
+        // Getter for the time since the registry was created (s)
+        double getUptime() const { return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_tpStart).count(); }
+
+    private:
+        static constexpr int TYPE_COUNTER = 0;
+        static constexpr int TYPE_GAUGE = 1;
+        static constexpr int TYPE_HISTOGRAM = 2;
+
+        struct Metric {
+            int nType;
+            std::string sHelp;
+            std::unique_ptr<CiCounter> pCounter;
+            std::unique_ptr<CiGauge> pGauge;
+            std::unique_ptr<CiHistogram> pHistogram;
+        };
+
+        std::mutex m_mtx;
+        std::map<std::string, Metric> m_metrics;
+        std::chrono::steady_clock::time_point m_tpStart;
+
+        CiTelemetry() : m_tpStart(std::chrono::steady_clock::now()) {}
+
+        // Method to find a metric or register a new one
+        template <typename F>
+        Metric& getMetric(const std::string& sName, const std::string& sHelp, const int nType, F create) {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            auto it = m_metrics.find(sName);
+            if (it == m_metrics.end()) {
+                Metric metric = create();
+                metric.nType = nType;
+                metric.sHelp = sHelp;
+                it = m_metrics.emplace(sName, std::move(metric)).first;
+            }
+            else if (it->second.nType != nType) {
+                throw std::invalid_argument("The metric " + sName + " is registered with another type.");
+            }
+            return it->second;
+        }
+
+        // Method to write the metrics in the Prometheus text format
+        void writePrometheus(std::ostream& os) const {
+            os << "# HELP vslib_uptime_seconds Time since the telemetry started.\n# TYPE vslib_uptime_seconds gauge\n"
+                << "vslib_uptime_seconds " << getUptime() << "\n";
+            for (const auto& entry : m_metrics) {
+                const std::string& sName = entry.first;
+                const Metric& metric = entry.second;
+                if (metric.nType == TYPE_COUNTER) {
+                    os << "# HELP " << sName << " " << metric.sHelp << "\n# TYPE " << sName << " counter\n" << sName << " " << metric.pCounter->get() << "\n";
+                }
+                else if (metric.nType == TYPE_GAUGE) {
+                    os << "# HELP " << sName << " " << metric.sHelp << "\n# TYPE " << sName << " gauge\n" << sName << " " << metric.pGauge->get() << "\n";
+                    os << "# HELP " << sName << "_max Highest value of " << sName << ".\n# TYPE " << sName << "_max gauge\n"
+                        << sName << "_max " << metric.pGauge->getMax() << "\n";
+                }
+                else {
+                    const CiHistogram& histogram = *metric.pHistogram;
+                    os << "# HELP " << sName << " " << metric.sHelp << "\n# TYPE " << sName << " histogram\n";
+                    uint64_t nCumulative = 0;
+                    for (size_t k = 0; k < histogram.getBounds().size(); ++k) {
+                        nCumulative += histogram.getBucketCount(k);
+                        os << sName << "_bucket{le=\"" << histogram.getBounds()[k] << "\"} " << nCumulative << "\n";
+                    }
+                    nCumulative += histogram.getBucketCount(histogram.getBounds().size());
+                    os << sName << "_bucket{le=\"+Inf\"} " << nCumulative << "\n"
+                        << sName << "_sum " << histogram.getSum() << "\n" << sName << "_count " << nCumulative << "\n";
+                }
+            }
+        }
+
+        // Method to write the metrics as one JSON object
+        void writeJson(std::ostream& os) const {
+            os << "{\n  \"uptime_seconds\": " << getUptime();
+            for (const auto& entry : m_metrics) {
+                const std::string& sName = entry.first;
+                const Metric& metric = entry.second;
+                os << ",\n  \"" << sName << "\": ";
+                if (metric.nType == TYPE_COUNTER) {
+                    os << metric.pCounter->get();
+                }
+                else if (metric.nType == TYPE_GAUGE) {
+                    os << "{ \"value\": " << metric.pGauge->get() << ", \"max\": " << metric.pGauge->getMax() << " }";
+                }
+                else {
+                    const CiHistogram& histogram = *metric.pHistogram;
+                    os << "{ \"count\": " << histogram.getCount() << ", \"sum\": " << histogram.getSum() << ", \"buckets\": [";
+                    for (size_t k = 0; k <= histogram.getBounds().size(); ++k) {
+                        os << (k ? ", " : "") << "{ \"le\": ";
+                        if (k < histogram.getBounds().size()) os << histogram.getBounds()[k];
+                        else os << "\"+Inf\"";
+                        os << ", \"count\": " << histogram.getBucketCount(k) << " }";
+                    }
+                    os << "] }";
+                }
+            }
+            os << "\n}\n";
+        }
+    };
+
+    /// <summary>
+    /// Writes a snapshot of the telemetry to a file at a fixed interval on its own thread.
+    /// </summary>
+    class CiTelemetryExporter {
+    public:
+
+        /// <summary>
+        /// Constructor for CiTelemetryExporter.
+        /// </summary>
+        /// <param name="sFileName">Name of the snapshot file; it is replaced as a whole, so readers never see a partial snapshot.</param>
+        /// <param name="nFormat">CiTelemetry::FORMAT_PROMETHEUS or CiTelemetry::FORMAT_JSON.</param>
+        /// <param name="dbInterval">Time between two snapshots (s).</param>
+        CiTelemetryExporter(const std::string& sFileName, const int nFormat = CiTelemetry::FORMAT_PROMETHEUS, const double dbInterval = 10.0)
+            : m_sFileName(sFileName), m_nFormat(nFormat),
+            m_interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(dbInterval))), m_bStop(false) {}
+
+        CiTelemetryExporter(const CiTelemetryExporter&) = delete;
+        CiTelemetryExporter& operator=(const CiTelemetryExporter&) = delete;
+
+        /// <summary>
+        /// Destructor for CiTelemetryExporter. Writes the last snapshot and stops the thread.
+        /// </summary>
+        ~CiTelemetryExporter() {
+            stop();
+        }
+
+        // Method to start writing snapshots
+        void start() {
+            stop();
+            m_bStop = false;
+            m_thread = std::thread(&CiTelemetryExporter::run, this);
+        }
+
+        // Method to write the last snapshot and stop the thread
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_bStop = true;
+            }
+            m_cv.notify_one();
+            if (m_thread.joinable()) m_thread.join();
+        }
+
+        /// <summary>
+        /// Write a snapshot now; the file is written under a temporary name and renamed.
+        /// </summary>
+        void writeSnapshot() {
+            std::string sTempName = m_sFileName + ".tmp";
+            {
+                std::ofstream file(sTempName, std::ios::trunc);
+                if (!file.is_open()) {
+                    throw std::runtime_error("Can't open a file " + sTempName + ".");
+                }
+                CiTelemetry::getInstance().writeSnapshot(file, m_nFormat);
+            }
+            std::filesystem::rename(sTempName, m_sFileName);
+        }
+
+    private:
+        std::string m_sFileName;
+        int m_nFormat;
+        std::chrono::steady_clock::duration m_interval;
+        std::mutex m_mtx;
+        std::condition_variable m_cv;
+        bool m_bStop;
+        std::thread m_thread;
+
+        // Method of the export thread; a failed write is retried at the next interval
+        void run() {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            while (true) {
+                bool bStop = m_cv.wait_for(lock, m_interval, [this] { return m_bStop; });
+                lock.unlock();
+                try {
+                    writeSnapshot();
+                }
+                catch (...) {
+                }
+                lock.lock();
+                if (bStop) break;
+            }
+        }
+    };
+
+}
@@ -0,0 +1,275 @@
+// This C++ code defines the timeline tracing of the processing stages. A
+// scoped trace point records when a stage of a frame begins and how long
+// it takes, e.g. a capture packet, the extraction of a block, the upload,
+// kernel and readback of a transform or the write of a sink. Every thread
+// records into a buffer of its own with one writer and no locks, and the
+// buffers of all threads are written as Chrome trace-event JSON, which
+// chrome://tracing and the Perfetto UI show as one timeline per thread.
+// The trace points are compiled only when VSLIB_TRACE is defined; without
+// it the CI_TRACE_* macros expand to nothing and cost nothing.
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// One completed scope of a trace.
+    /// </summary>
+    struct CiTraceEvent {
+        const char* pName;          // Name of the trace point, a string literal
+        int64_t nBegin;             // Begin of the scope since the start of the trace (ns)
+        int64_t nDuration;          // Duration of the scope (ns)
+        int64_t nIndex;             // Index of the frame, or -1
+    };
+
+    /// <summary>
+    /// Events of one thread. Only the owning thread writes; the count is published
+    /// after the event, so a reader sees complete events without a lock.
+    /// When the buffer is full, later events are counted as dropped.
+    /// </summary>
+    class CiTraceBuffer {
+    public:
+
+        CiTraceBuffer(const size_t sizeCapacity, const int nThreadId)
+            : m_events(sizeCapacity), m_sizeCount(0), m_sizeDropped(0), m_nThreadId(nThreadId) {}
+
+        // Method to add an event, called by the owning thread only
+        void record(const CiTraceEvent& event) {
+            size_t sizeCount = m_sizeCount.load(std::memory_order_relaxed);
+            if (sizeCount >= m_events.size()) {
+                m_sizeDropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            m_events[sizeCount] = event;
+            m_sizeCount.store(sizeCount + 1, std::memory_order_release);
+        }
+
+        // Getter for the number of complete events
+        size_t getCount() const { return m_sizeCount.load(std::memory_order_acquire); }
+
+        // Getter for an event below getCount()
+        const CiTraceEvent& getEvent(const size_t sizeEvent) const { return m_events[sizeEvent]; }
+
+        // Getter for the number of events that did not fit
+        size_t getDropped() const { return m_sizeDropped.load(std::memory_order_relaxed); }
+
+        // Getter for the thread id written to the trace
+        int getThreadId() const { return m_nThreadId; }
+
+        // Getter and setter for the thread name written to the trace
+        const std::string& getThreadName() const { return m_sThreadName; }
+        void setThreadName(const std::string& sName) { m_sThreadName = sName; }
+
+    private:
+        std::vector<CiTraceEvent> m_events;
+        std::atomic<size_t> m_sizeCount;
+        std::atomic<size_t> m_sizeDropped;
+        int m_nThreadId;
+        std::string m_sThreadName;
+    };
+
+    /// <summary>
+    /// Process-wide trace: the buffers of all threads that recorded an event.
+    /// </summary>
+    class CiTrace {
+    public:
+
+        /// <summary>
+        /// Get the trace of the process.
+        /// </summary>
+        static CiTrace& getInstance() {
+            static CiTrace trace;
+            return trace;
+        }
+
+        CiTrace(const CiTrace&) = delete;
+        CiTrace& operator=(const CiTrace&) = delete;
+
+        // Getter and setter for the recording; it is on from the start
+        bool isEnabled() const { return m_bEnabled.load(std::memory_order_relaxed); }
+        void setEnabled(const bool bEnabled) { m_bEnabled.store(bEnabled, std::memory_order_relaxed); }
+
+        /// <summary>
+        /// Set the number of events of a thread; used for the threads that record their first event later.
+        /// </summary>
+        void setBufferEvents(const size_t sizeEvents) {
+            if (sizeEvents < 1) {
+                throw std::invalid_argument("A trace buffer needs room for at least one event.");
+            }
+            m_sizeBufferEvents.store(sizeEvents, std::memory_order_relaxed);
+        }
+
+        // Method to get the time since the start of the trace (ns)
+        int64_t now() const {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_tpStart).count();
+        }
+
+        // Method to add a completed scope to the buffer of the calling thread
+        void record(const char* pName, const int64_t nBegin, const int64_t nEnd, const int64_t nIndex = -1) {
+            getThreadBuffer().record(CiTraceEvent{ pName, nBegin, nEnd - nBegin, nIndex });
+        }
+
+        // Method to name the calling thread in the trace
+        void setThreadName(const std::string& sName) {
+            CiTraceBuffer& buffer = getThreadBuffer();
+            std::lock_guard<std::mutex> lock(m_mtx);
+            buffer.setThreadName(sName);
+        }
+
+        // Getter for the number of recorded events of all threads
+        size_t getEventCount() {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            size_t sizeCount = 0;
+            for (const auto& pBuffer : m_buffers) sizeCount += pBuffer->getCount();
+            return sizeCount;
+        }
+
+        // Getter for the number of events of all threads that did not fit into their buffers
+        size_t getDroppedCount() {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            size_t sizeDropped = 0;
+            for (const auto& pBuffer : m_buffers) sizeDropped += pBuffer->getDropped();
+            return sizeDropped;
+        }
+
+        /// <summary>
+        /// Write the events recorded so far as Chrome trace-event JSON. The threads may keep recording.
+        /// </summary>
+        /// <param name="os">Stream to write to.</param>
+        void writeChromeJson(std::ostream& os) {
+            std::lock_guard<std::mutex> lock(m_mtx);
+
+            os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"vsLib\"}}";
+
+            char szNumber[32];
+            for (const auto& pBuffer : m_buffers) {
+                int nThreadId = pBuffer->getThreadId();
+                if (!pBuffer->getThreadName().empty()) {
+                    os << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << nThreadId
+                        << ",\"args\":{\"name\":\"" << escape(pBuffer->getThreadName()) << "\"}}";
+                }
+
+                size_t sizeCount = pBuffer->getCount();
+                for (size_t k = 0; k < sizeCount; ++k) {
+                    const CiTraceEvent& event = pBuffer->getEvent(k);
+                    // Chrome expects microseconds; the fraction keeps the nanoseconds
+                    os << ",\n{\"name\":\"" << event.pName << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << nThreadId;
+                    std::snprintf(szNumber, sizeof(szNumber), "%.3f", event.nBegin / 1000.0);
+                    os << ",\"ts\":" << szNumber;
+                    std::snprintf(szNumber, sizeof(szNumber), "%.3f", event.nDuration / 1000.0);
+                    os << ",\"dur\":" << szNumber;
+                    if (event.nIndex >= 0) os << ",\"args\":{\"frame\":" << event.nIndex << "}";
+                    os << "}";
+                }
+
+                if (pBuffer->getDropped() > 0) {
+                    os << ",\n{\"name\":\"dropped_events\",\"ph\":\"C\",\"pid\":1,\"tid\":" << nThreadId
+                        << ",\"ts\":0,\"args\":{\"dropped\":" << pBuffer->getDropped() << "}}";
+                }
+            }
+            os << "\n]}\n";
+        }
+
+        /// <summary>
+        /// Write the events recorded so far to a file as Chrome trace-event JSON.
+        /// </summary>
+        /// <param name="sFileName">Name of the file, e.g. trace.json.</param>
+        void writeChromeJson(const std::string& sFileName) {
+            std::ofstream file(sFileName, std::ios::trunc);
+            if (!file.is_open()) {
+                throw std::runtime_error("Can't open a file " + sFileName + ".");
+            }
+            writeChromeJson(file);
+        }
+
+    private:
+        std::mutex m_mtx;
+        std::vector<std::unique_ptr<CiTraceBuffer>> m_buffers;
+        std::atomic<bool> m_bEnabled;
+        std::atomic<size_t> m_sizeBufferEvents;
+        std::chrono::steady_clock::time_point m_tpStart;
+
+        CiTrace() : m_bEnabled(true), m_sizeBufferEvents(1 << 16), m_tpStart(std::chrono::steady_clock::now()) {}
+
+        // Method to get the buffer of the calling thread, registering it on first use.
+        // The trace owns the buffers, so the events of a thread outlive the thread.
+        CiTraceBuffer& getThreadBuffer() {
+            thread_local CiTraceBuffer* pBuffer = nullptr;
+            if (!pBuffer) {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_buffers.emplace_back(new CiTraceBuffer(m_sizeBufferEvents.load(std::memory_order_relaxed), static_cast<int>(m_buffers.size()) + 1));
+                pBuffer = m_buffers.back().get();
+            }
+            return *pBuffer;
+        }
+
+        // Method to escape a thread name for a JSON string
+        static std::string escape(const std::string& sText) {
+            std::string sEscaped;
+            for (char ch : sText) {
+                if (ch == '"' || ch == '\\') sEscaped += '\\';
+                if (static_cast<unsigned char>(ch) >= 0x20) sEscaped += ch;
+            }
+            return sEscaped;
+        }
+    };
+
+    /// <summary>
+    /// Records the time from its construction to its destruction as one event of the calling thread.
+    /// </summary>
+    class CiTraceScope {
+    public:
+
+        /// <summary>
+        /// Constructor for CiTraceScope.
+        /// </summary>
+        /// <param name="pName">Name of the trace point; must be a string literal, only the pointer is kept.</param>
+        /// <param name="nIndex">Index of the frame, or -1.</param>
+        explicit CiTraceScope(const char* pName, const int64_t nIndex = -1)
+            : m_pName(CiTrace::getInstance().isEnabled() ? pName : nullptr), m_nIndex(nIndex), m_nBegin(m_pName ? CiTrace::getInstance().now() : 0) {}
+
+        ~CiTraceScope() {
+            if (m_pName) {
+                CiTrace& trace = CiTrace::getInstance();
+                trace.record(m_pName, m_nBegin, trace.now(), m_nIndex);
+            }
+        }
+
+        CiTraceScope(const CiTraceScope&) = delete;
+        CiTraceScope& operator=(const CiTraceScope&) = delete;
+
+    private:
+        const char* m_pName;
+        int64_t m_nIndex;
+        int64_t m_nBegin;
+    };
+
+}
+
+#define CI_TRACE_CONCAT_(a, b) a##b
+#define CI_TRACE_CONCAT(a, b) CI_TRACE_CONCAT_(a, b)
+
+#ifdef VSLIB_TRACE
+// Trace the rest of the enclosing scope
+#define CI_TRACE_SCOPE(name) vi::CiTraceScope CI_TRACE_CONCAT(ciTraceScope, __LINE__)(name)
+// Trace the rest of the enclosing scope of a frame
+#define CI_TRACE_SCOPE_INDEX(name, index) vi::CiTraceScope CI_TRACE_CONCAT(ciTraceScope, __LINE__)(name, static_cast<int64_t>(index))
+// Name the calling thread in the trace
+#define CI_TRACE_THREAD_NAME(name) vi::CiTrace::getInstance().setThreadName(name)
+#else
+#define CI_TRACE_SCOPE(name) ((void)0)
+#define CI_TRACE_SCOPE_INDEX(name, index) ((void)0)
+#define CI_TRACE_THREAD_NAME(name) ((void)0)
+#endif
@@ -0,0 +1,293 @@
+// This C++ code defines a trigger engine for event recording. CiTrigger
+// evaluates band-energy, peak and spectral-flux conditions on every frame.
+// CiTriggerSink keeps a pre-trigger ring of the latest spectra and audio
+// blocks and forwards only the event windows to an output sink: the
+// frames from N frames before a trigger to M frames after the last one.
+// The audio of every event can be saved as a WAV file. A monitoring
+// station then stores its events instead of the whole stream.
+
+#pragma once
+#include "CiSink.hpp"
+#include "CiWavWriter.hpp"
+#include <algorithm>
+#include <charconv>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Evaluates trigger conditions on the frames of a stream. A frame triggers if any condition is met in any channel.
+    /// </summary>
+    class CiTrigger {
+    public:
+
+        static constexpr int BAND_ENERGY = 0;      // Sum of the values in the frequency range
+        static constexpr int PEAK = 1;             // Largest value in the frequency range
+        static constexpr int SPECTRAL_FLUX = 2;    // Sum of the increases against the previous frame in the frequency range
+
+        /// <summary>
+        /// Add a condition.
+        /// </summary>
+        /// <param name="nType">BAND_ENERGY, PEAK or SPECTRAL_FLUX.</param>
+        /// <param name="fpFrequencyMin">Lowest frequency of the range (Hz).</param>
+        /// <param name="fpFrequencyMax">Highest frequency of the range (Hz).</param>
+        /// <param name="fpThreshold">The condition is met when the measure reaches this value.</param>
+        void addCondition(const int nType, const float fpFrequencyMin, const float fpFrequencyMax, const float fpThreshold) {
+            if (nType < BAND_ENERGY || nType > SPECTRAL_FLUX) {
+                throw std::invalid_argument("Unknown trigger condition type.");
+            }
+            m_conditions.push_back(Condition{ nType, fpFrequencyMin, fpFrequencyMax, fpThreshold, 0, -1 });
+        }
+
+        // Method to remove all conditions
+        void clearConditions() { m_conditions.clear(); }
+
+        // Getter for the number of conditions
+        size_t getConditionCount() const { return m_conditions.size(); }
+
+        /// <summary>
+        /// Map the frequency ranges of the conditions to the output indices of a stream and forget the previous frame.
+        /// </summary>
+        /// <param name="layout">Description of the frames.</param>
+        void open(const CiSinkLayout& layout) {
+            for (Condition& condition : m_conditions) {
+                condition.nIndexFirst = layout.nIndexMax + 1;
+                condition.nIndexLast = layout.nIndexMin - 1;
+                for (int j = layout.nIndexMin; j <= layout.nIndexMax; ++j) {
+                    if (layout.frequencies[j] < condition.fpFrequencyMin || layout.frequencies[j] > condition.fpFrequencyMax) continue;
+                    condition.nIndexFirst = (std::min)(condition.nIndexFirst, j);
+                    condition.nIndexLast = (std::max)(condition.nIndexLast, j);
+                }
+            }
+            m_previous.clear();
+        }
+
+        /// <summary>
+        /// Evaluate the conditions on a frame.
+        /// </summary>
+        /// <param name="frame">Output values of all channels.</param>
+        /// <returns>True if the frame triggers.</returns>
+        bool evaluate(const CiFrame& frame) {
+            bool bFired = false;
+            bool bHavePrevious = !m_previous.empty();
+
+            for (const Condition& condition : m_conditions) {
+                for (int c = 0; c < frame.getChannelCount() && !bFired; ++c) {
+                    const float* pValues = frame.getChannel(c);
+                    const float* pPrevious = bHavePrevious ? m_previous.data() + static_cast<size_t>(c) * frame.getSize() : nullptr;
+                    float fpMeasure = 0.0f;
+
+                    for (int j = condition.nIndexFirst; j <= condition.nIndexLast; ++j) {
+                        if (condition.nType == BAND_ENERGY) fpMeasure += pValues[j];
+                        else if (condition.nType == PEAK) fpMeasure = (std::max)(fpMeasure, pValues[j]);
+                        else if (pPrevious && pValues[j] > pPrevious[j]) fpMeasure += pValues[j] - pPrevious[j];
+                    }
+
+                    // The flux of the first frame is undefined
+                    if (condition.nType == SPECTRAL_FLUX && !bHavePrevious) continue;
+                    bFired = fpMeasure >= condition.fpThreshold;
+                }
+                if (bFired) break;
+            }
+
+            // The flux compares every frame with the one before it
+            m_previous.assign(frame.getChannel(0), frame.getChannel(0) + static_cast<size_t>(frame.getChannelCount()) * frame.getSize());
+            return bFired;
+        }
+
+    private:
+        struct Condition {
+            int nType;
+            float fpFrequencyMin;
+            float fpFrequencyMax;
+            float fpThreshold;
+            int nIndexFirst;
+            int nIndexLast;
+        };
+
+        std::vector<Condition> m_conditions;
+        std::vector<float> m_previous;
+    };
+
+    /// <summary>
+    /// Sink that forwards only the frames around triggers to an output sink and saves the audio of every event.
+    /// Run it with CiAsyncSink::BLOCK so no frame of an event is lost.
+    /// </summary>
+    class CiTriggerSink : public CiSink {
+    public:
+
+        /// <summary>
+        /// Description of a recorded event.
+        /// </summary>
+        struct Event {
+            size_t sizeTriggerFrame;        // Index of the frame that started the event
+            size_t sizeFirstFrame;          // Index of the first recorded frame
+            size_t sizeLastFrame;           // Index of the last recorded frame
+            double dbTimeBegin;             // Time of the first recorded frame (s)
+            double dbTimeEnd;               // Time of the last recorded frame (s)
+            std::string sAudioFile;         // WAV file of the event, or empty
+        };
+
+        /// <summary>
+        /// Constructor for CiTriggerSink.
+        /// </summary>
+        /// <param name="pOutput">Sink for the frames of the events.</param>
+        /// <param name="sizePreFrames">Frames kept before a trigger (N).</param>
+        /// <param name="sizePostFrames">Frames recorded after the last trigger of an event (M).</param>
+        /// <param name="sAudioFolder">Existing folder for the WAV files of the events, or empty for no audio.</param>
+        CiTriggerSink(std::shared_ptr<CiSink> pOutput, const size_t sizePreFrames, const size_t sizePostFrames, const std::string& sAudioFolder = "")
+            : m_pOutput(pOutput), m_sizePreFrames(sizePreFrames), m_sizePostFrames(sizePostFrames), m_sAudioFolder(sAudioFolder),
+            m_sizeRingStart(0), m_sizeRingCount(0), m_bInEvent(false), m_sizePostLeft(0), m_sizeFrames(0), m_sizeRecordedFrames(0) {}
+
+        // Getter for the trigger, to add conditions before the recording starts
+        CiTrigger& getTrigger() { return m_trigger; }
+
+        bool needsSource() const override { return !m_sAudioFolder.empty(); }
+
+        void open(const CiSinkLayout& layout) override {
+            m_layout = layout;
+            m_trigger.open(layout);
+            m_pOutput->open(layout);
+
+            m_ring.assign(m_sizePreFrames, CiFrame());
+            m_audioRing.assign(m_sizePreFrames, CiFrame());
+            m_sizeRingStart = 0;
+            m_sizeRingCount = 0;
+            m_bInEvent = false;
+            m_sizePostLeft = 0;
+            m_sizeFrames = 0;
+            m_sizeRecordedFrames = 0;
+            m_events.clear();
+        }
+
+        void write(const CiFrame& frame) override {
+            ++m_sizeFrames;
+            bool bFired = m_trigger.evaluate(frame);
+
+            if (!m_bInEvent && bFired) startEvent(frame);
+
+            if (m_bInEvent) {
+                record(frame, frame.getSource().get());
+                // Every trigger extends the event to M frames after it
+                if (bFired) m_sizePostLeft = m_sizePostFrames;
+                else --m_sizePostLeft;
+                if (m_sizePostLeft == 0) endEvent();
+                return;
+            }
+
+            keep(frame);
+        }
+
+        void close() override {
+            if (m_bInEvent) endEvent();
+            m_pOutput->close();
+        }
+
+        // Getter for the recorded events
+        const std::vector<Event>& getEvents() const { return m_events; }
+
+        // Getter for the number of evaluated frames
+        size_t getFrameCount() const { return m_sizeFrames; }
+
+        // Getter for the number of frames forwarded to the output sink
+        size_t getRecordedFrameCount() const { return m_sizeRecordedFrames; }
+
+    private:
+        std::shared_ptr<CiSink> m_pOutput;
+        size_t m_sizePreFrames;
+        size_t m_sizePostFrames;
+        std::string m_sAudioFolder;
+        CiSinkLayout m_layout;
+        CiTrigger m_trigger;
+
+        // Pre-trigger ring of copies of the latest spectra and audio blocks; the storage of the frames is reused
+        std::vector<CiFrame> m_ring;
+        std::vector<CiFrame> m_audioRing;
+        size_t m_sizeRingStart;
+        size_t m_sizeRingCount;
+
+        bool m_bInEvent;
+        size_t m_sizePostLeft;
+        CiWavWriter m_wavWriter;
+        std::vector<Event> m_events;
+        size_t m_sizeFrames;
+        size_t m_sizeRecordedFrames;
+
+        // Method to copy a frame and its audio into the pre-trigger ring, replacing the oldest one when the ring is full
+        void keep(const CiFrame& frame) {
+            if (m_sizePreFrames == 0) return;
+
+            size_t sizeSlot = (m_sizeRingStart + m_sizeRingCount) % m_sizePreFrames;
+            if (m_sizeRingCount == m_sizePreFrames) {
+                sizeSlot = m_sizeRingStart;
+                m_sizeRingStart = (m_sizeRingStart + 1) % m_sizePreFrames;
+            }
+            else {
+                ++m_sizeRingCount;
+            }
+
+            copyFrame(frame, m_ring[sizeSlot]);
+            if (frame.getSource()) copyFrame(*frame.getSource(), m_audioRing[sizeSlot]);
+            else m_audioRing[sizeSlot].resize(0, 0);
+        }
+
+        // Method to copy the values, index and time of a frame into a frame with reusable storage
+        static void copyFrame(const CiFrame& source, CiFrame& target) {
+            target.resize(source.getChannelCount(), source.getSize());
+            if (source.getChannelCount() > 0 && source.getSize() > 0) {
+                std::copy(source.getChannel(0), source.getChannel(0) + static_cast<size_t>(source.getChannelCount()) * source.getSize(), target.getChannel(0));
+            }
+            target.setIndex(source.getIndex());
+            target.setTime(source.getTime());
+        }
+
+        // Method to start an event with the frames of the pre-trigger ring
+        void startEvent(const CiFrame& trigger) {
+            m_bInEvent = true;
+            Event event{ trigger.getIndex(), trigger.getIndex(), trigger.getIndex(), trigger.getTime(), trigger.getTime(), "" };
+            if (m_sizeRingCount > 0) {
+                event.sizeFirstFrame = m_ring[m_sizeRingStart].getIndex();
+                event.dbTimeBegin = m_ring[m_sizeRingStart].getTime();
+            }
+
+            if (!m_sAudioFolder.empty()) {
+                char sDigits[24];
+                char* pEnd = std::to_chars(sDigits, sDigits + sizeof(sDigits), static_cast<long long>(event.dbTimeBegin * 1e6)).ptr;
+                std::string sTime(sDigits, pEnd);
+                if (sTime.size() < 10) sTime.insert(0, 10 - sTime.size(), '0');
+                event.sAudioFile = m_sAudioFolder + "/event_" + sTime + ".wav";
+                m_wavWriter.open(event.sAudioFile, m_layout.nChannels, m_layout.dwSamplesPerSec);
+            }
+            m_events.push_back(event);
+
+            for (size_t k = 0; k < m_sizeRingCount; ++k) {
+                size_t sizeSlot = (m_sizeRingStart + k) % m_sizePreFrames;
+                record(m_ring[sizeSlot], m_audioRing[sizeSlot].getChannelCount() > 0 ? &m_audioRing[sizeSlot] : nullptr);
+            }
+            m_sizeRingStart = 0;
+            m_sizeRingCount = 0;
+        }
+
+        // Method to forward a frame of the current event
+        void record(const CiFrame& frame, const CiFrame* pAudio) {
+            m_pOutput->write(frame);
+            ++m_sizeRecordedFrames;
+            if (pAudio && !m_sAudioFolder.empty()) m_wavWriter.write(*pAudio);
+
+            Event& event = m_events.back();
+            event.sizeLastFrame = frame.getIndex();
+            event.dbTimeEnd = frame.getTime();
+        }
+
+        // Method to finish the current event
+        void endEvent() {
+            m_bInEvent = false;
+            m_sizePostLeft = 0;
+            m_wavWriter.close();
+        }
+    };
+
+}
@@ -0,0 +1,184 @@
+// This C++ code defines a reader for WAV files. The samples of 16-bit,
+// 24-bit and 32-bit integer PCM files and of 32-bit float files are read
+// block by block and deinterleaved into the channels of a frame as float
+// values in the range -1 ... 1, so recordings of any length can be
+// processed without loading them into memory.
+
+#pragma once
+#include "CiFrame.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Class for reading audio frames from a WAV file.
+    /// </summary>
+    class CiWavReader {
+    public:
+
+        CiWavReader() : m_nChannels(0), m_dwSamplesPerSec(0), m_nBitsPerSample(0), m_bFloat(false), m_nDataFrames(0), m_nReadFrames(0) {}
+
+        /// <summary>
+        /// Open a WAV file and read its format.
+        /// </summary>
+        /// <param name="sFileName">Name of the file.</param>
+        void open(const std::string& sFileName) {
+            m_file.close();
+            m_file.clear();
+            m_file.open(sFileName, std::ios::binary);
+            if (!m_file.is_open()) {
+                throw std::runtime_error("Can't open a file " + sFileName + ".");
+            }
+            m_sFileName = sFileName;
+
+            char riff[12];
+            if (!m_file.read(riff, sizeof(riff)) || std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0) {
+                throw std::runtime_error("The file " + sFileName + " is not a WAV file.");
+            }
+
+            // Walk the chunks up to the data chunk; the format chunk comes before it
+            bool bFormat = false;
+            while (true) {
+                char sId[4];
+                uint32_t nChunkBytes = 0;
+                if (!m_file.read(sId, 4) || !m_file.read(reinterpret_cast<char*>(&nChunkBytes), 4)) {
+                    throw std::runtime_error("The file " + sFileName + " has no data chunk.");
+                }
+
+                if (std::memcmp(sId, "fmt ", 4) == 0) {
+                    readFormat(nChunkBytes);
+                    bFormat = true;
+                }
+                else if (std::memcmp(sId, "data", 4) == 0) {
+                    if (!bFormat) {
+                        throw std::runtime_error("The file " + sFileName + " has no format chunk before the data.");
+                    }
+                    m_nDataFrames = nChunkBytes / (static_cast<uint32_t>(m_nChannels) * (m_nBitsPerSample / 8));
+                    m_nReadFrames = 0;
+                    return;
+                }
+                else {
+                    // Chunks are padded to an even size
+                    m_file.seekg(nChunkBytes + (nChunkBytes & 1u), std::ios::cur);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Read the next samples of all channels.
+        /// </summary>
+        /// <param name="frame">Receives the samples, one channel after another.</param>
+        /// <param name="sizeFrames">Number of samples per channel to read.</param>
+        /// <returns>Number of samples per channel read, less than sizeFrames at the end of the file.</returns>
+        size_t read(CiFrame& frame, const size_t sizeFrames) {
+            size_t sizeRead = static_cast<size_t>((std::min)(static_cast<uint64_t>(sizeFrames), m_nDataFrames - m_nReadFrames));
+            frame.resize(m_nChannels, static_cast<int>(sizeRead));
+            if (sizeRead == 0) return 0;
+
+            int nBytesPerSample = m_nBitsPerSample / 8;
+            m_raw.resize(sizeRead * m_nChannels * nBytesPerSample);
+            if (!m_file.read(reinterpret_cast<char*>(m_raw.data()), m_raw.size())) {
+                throw std::runtime_error("Failed to read the file " + m_sFileName + ".");
+            }
+            m_nReadFrames += sizeRead;
+
+            const uint8_t* p = m_raw.data();
+            for (size_t i = 0; i < sizeRead; ++i) {
+                for (int c = 0; c < m_nChannels; ++c, p += nBytesPerSample) frame.getChannel(c)[i] = toFloat(p);
+            }
+            return sizeRead;
+        }
+
+        /// <summary>
+        /// Skip samples of all channels.
+        /// </summary>
+        /// <param name="sizeFrames">Number of samples per channel to skip.</param>
+        /// <returns>Number of samples per channel skipped.</returns>
+        size_t skip(const size_t sizeFrames) {
+            size_t sizeSkipped = static_cast<size_t>((std::min)(static_cast<uint64_t>(sizeFrames), m_nDataFrames - m_nReadFrames));
+            m_file.seekg(static_cast<std::streamoff>(sizeSkipped * m_nChannels * (m_nBitsPerSample / 8)), std::ios::cur);
+            m_nReadFrames += sizeSkipped;
+            return sizeSkipped;
+        }
+
+        // Method to close the file
+        void close() { m_file.close(); }
+
+        // Getter for the number of channels
+        int getChannelCount() const { return m_nChannels; }
+
+        // Getter for the sample rate (Hz)
+        unsigned long getSamplesPerSec() const { return m_dwSamplesPerSec; }
+
+        // Getter for the number of samples per channel in the file
+        uint64_t getFrameCount() const { return m_nDataFrames; }
+
+        // Getter for the duration of the file (s)
+        double getDuration() const { return m_dwSamplesPerSec ? static_cast<double>(m_nDataFrames) / m_dwSamplesPerSec : 0.0; }
+
+    private:
+        std::ifstream m_file;
+        std::string m_sFileName;
+        int m_nChannels;
+        unsigned long m_dwSamplesPerSec;
+        int m_nBitsPerSample;
+        bool m_bFloat;
+        uint64_t m_nDataFrames;
+        uint64_t m_nReadFrames;
+        std::vector<uint8_t> m_raw;
+
+        // Method to read and check the format chunk
+        void readFormat(const uint32_t nChunkBytes) {
+            std::vector<char> chunk(nChunkBytes + (nChunkBytes & 1u));
+            if (nChunkBytes < 16 || !m_file.read(chunk.data(), chunk.size())) {
+                throw std::runtime_error("The file " + m_sFileName + " has a broken format chunk.");
+            }
+
+            uint16_t nFormat, nChannels, nBitsPerSample;
+            uint32_t nSamplesPerSec;
+            std::memcpy(&nFormat, chunk.data(), 2);
+            std::memcpy(&nChannels, chunk.data() + 2, 2);
+            std::memcpy(&nSamplesPerSec, chunk.data() + 4, 4);
+            std::memcpy(&nBitsPerSample, chunk.data() + 14, 2);
+
+            // WAVE_FORMAT_EXTENSIBLE keeps the format tag in the first bytes of the sub-format GUID
+            if (nFormat == 0xFFFE && nChunkBytes >= 40) std::memcpy(&nFormat, chunk.data() + 24, 2);
+
+            m_bFloat = nFormat == 3;
+            bool bSupported = (nFormat == 1 && (nBitsPerSample == 16 || nBitsPerSample == 24 || nBitsPerSample == 32))
+                || (nFormat == 3 && nBitsPerSample == 32);
+            if (!bSupported || nChannels == 0) {
+                throw std::runtime_error("The sample format of the file " + m_sFileName + " is not supported.");
+            }
+
+            m_nChannels = nChannels;
+            m_dwSamplesPerSec = nSamplesPerSec;
+            m_nBitsPerSample = nBitsPerSample;
+        }
+
+        // Method to convert one little-endian sample to a float value
+        float toFloat(const uint8_t* p) const {
+            if (m_bFloat) {
+                float fpValue;
+                std::memcpy(&fpValue, p, 4);
+                return fpValue;
+            }
+            if (m_nBitsPerSample == 16) {
+                return static_cast<int16_t>(p[0] | (p[1] << 8)) / 32768.0f;
+            }
+            if (m_nBitsPerSample == 24) {
+                int32_t nValue = static_cast<int32_t>((static_cast<uint32_t>(p[0]) << 8) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 24));
+                return (nValue >> 8) / 8388608.0f;
+            }
+            int32_t nValue;
+            std::memcpy(&nValue, p, 4);
+            return nValue / 2147483648.0f;
+        }
+    };
+
+}
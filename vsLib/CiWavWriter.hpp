@@ -0,0 +1,140 @@
+// This C++ code defines a writer for WAV files with 32-bit float samples.
+// The deinterleaved channels of audio frames are interleaved into a
+// buffer and appended to the file; the sizes in the RIFF header are
+// filled in when the file is closed.
+
+#pragma once
+#include "CiFrame.hpp"
+#include "CiPortable.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vi {
+
+    /// <summary>
+    /// Class for writing audio frames to a 32-bit float WAV file.
+    /// </summary>
+    class CiWavWriter {
+    public:
+
+        CiWavWriter() : m_pFile(nullptr), m_nChannels(0), m_dwSamplesPerSec(0), m_nDataBytes(0) {}
+
+        CiWavWriter(const CiWavWriter&) = delete;
+        CiWavWriter& operator=(const CiWavWriter&) = delete;
+
+        /// <summary>
+        /// Destructor for CiWavWriter. Closes the file if it is open.
+        /// </summary>
+        ~CiWavWriter() {
+            try {
+                close();
+            }
+            catch (...) {}
+        }
+
+        /// <summary>
+        /// Create a WAV file and write a header with empty sizes.
+        /// </summary>
+        /// <param name="sFileName">Name of the file.</param>
+        /// <param name="nChannels">Number of channels.</param>
+        /// <param name="dwSamplesPerSec">Sample rate (Hz).</param>
+        void open(const std::string& sFileName, const int nChannels, const unsigned long dwSamplesPerSec) {
+            close();
+
+            errno_t err = fopen_s(&m_pFile, sFileName.c_str(), "wb");
+            if (err != 0 || !m_pFile) {
+                m_pFile = nullptr;
+                throw std::runtime_error("Can't open a file " + sFileName + ".");
+            }
+            m_sFileName = sFileName;
+            m_nChannels = nChannels;
+            m_dwSamplesPerSec = dwSamplesPerSec;
+            m_nDataBytes = 0;
+            writeHeader();
+        }
+
+        /// <summary>
+        /// Append the samples of all channels of an audio frame.
+        /// </summary>
+        /// <param name="frame">Deinterleaved audio samples with the channel count of the file.</param>
+        void write(const CiFrame& frame) {
+            if (!m_pFile) {
+                throw std::runtime_error("The WAV file is not open.");
+            }
+            if (frame.getChannelCount() != m_nChannels) {
+                throw std::invalid_argument("The audio frame does not match the channel count of the WAV file.");
+            }
+
+            size_t sizeSamples = static_cast<size_t>(frame.getSize());
+            m_interleaved.resize(sizeSamples * m_nChannels);
+            for (int c = 0; c < m_nChannels; ++c) {
+                const float* pChannel = frame.getChannel(c);
+                for (size_t i = 0; i < sizeSamples; ++i) m_interleaved[i * m_nChannels + c] = pChannel[i];
+            }
+
+            size_t sizeBytes = m_interleaved.size() * sizeof(float);
+            if (fwrite(m_interleaved.data(), 1, sizeBytes, m_pFile) != sizeBytes) {
+                throw std::runtime_error("Failed to write the file " + m_sFileName + ".");
+            }
+            m_nDataBytes += sizeBytes;
+        }
+
+        /// <summary>
+        /// Fill in the sizes of the header and close the file.
+        /// </summary>
+        void close() {
+            if (!m_pFile) return;
+            fseek(m_pFile, 0, SEEK_SET);
+            writeHeader();
+            int err = fclose(m_pFile);
+            m_pFile = nullptr;
+            if (err != 0) {
+                throw std::runtime_error("Failed to write the file " + m_sFileName + ".");
+            }
+        }
+
+        // Getter for the name of the file
+        std::string getFileName() const { return m_sFileName; }
+
+    private:
+        FILE* m_pFile;
+        std::string m_sFileName;
+        int m_nChannels;
+        unsigned long m_dwSamplesPerSec;
+        uint64_t m_nDataBytes;
+        std::vector<float> m_interleaved;
+
+        // Method to write the RIFF header of a WAVE_FORMAT_IEEE_FLOAT file
+        void writeHeader() {
+            uint32_t nDataBytes = static_cast<uint32_t>(m_nDataBytes);
+            uint32_t nRiffBytes = 36 + nDataBytes;
+            uint16_t nFormat = 3;
+            uint16_t nChannels = static_cast<uint16_t>(m_nChannels);
+            uint32_t nSamplesPerSec = static_cast<uint32_t>(m_dwSamplesPerSec);
+            uint16_t nBlockAlign = static_cast<uint16_t>(m_nChannels * sizeof(float));
+            uint32_t nBytesPerSec = nSamplesPerSec * nBlockAlign;
+            uint16_t nBitsPerSample = 32;
+            uint32_t nFormatBytes = 16;
+
+            bool bOk = fwrite("RIFF", 1, 4, m_pFile) == 4;
+            bOk = bOk && fwrite(&nRiffBytes, 4, 1, m_pFile) == 1;
+            bOk = bOk && fwrite("WAVEfmt ", 1, 8, m_pFile) == 8;
+            bOk = bOk && fwrite(&nFormatBytes, 4, 1, m_pFile) == 1;
+            bOk = bOk && fwrite(&nFormat, 2, 1, m_pFile) == 1;
+            bOk = bOk && fwrite(&nChannels, 2, 1, m_pFile) == 1;
+            bOk = bOk && fwrite(&nSamplesPerSec, 4, 1, m_pFile) == 1;
+            bOk = bOk && fwrite(&nBytesPerSec, 4, 1, m_pFile) == 1;
+            bOk = bOk && fwrite(&nBlockAlign, 2, 1, m_pFile) == 1;
+            bOk = bOk && fwrite(&nBitsPerSample, 2, 1, m_pFile) == 1;
+            bOk = bOk && fwrite("data", 1, 4, m_pFile) == 4;
+            bOk = bOk && fwrite(&nDataBytes, 4, 1, m_pFile) == 1;
+            if (!bOk) {
+                throw std::runtime_error("Failed to write the file " + m_sFileName + ".");
+            }
+        }
+    };
+
+}